@@ -13,6 +13,37 @@
 #include <string.h>
 #include <stdio.h>
 
+#if defined(_WIN32)
+	#include <windows.h>
+	#include <process.h>
+#else
+	#include <pthread.h>
+	#include <unistd.h>
+#endif
+
+/*	the kernels rely on every multiply and add being rounded on its own,
+	so don't let the compiler fuse them into FMAs (e.g. with -march=native)	*/
+#if defined(__clang__)
+	#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+	#pragma GCC optimize ("fp-contract=off")
+#elif defined(_MSC_VER)
+	#pragma fp_contract (off)
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	#define DXT_X86	1
+	#include <immintrin.h>
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+		#define DXT_TARGET(isa)
+	#else
+		#define DXT_TARGET(isa)	__attribute__((target(isa)))
+	#endif
+#else
+	#define DXT_X86	0
+#endif
+
 /*	set this =1 if you want to use the covarince matrix method...
 	which is better than my method of using standard deviations
 	overall, except on the infintesimal chance that the power
@@ -38,6 +69,46 @@ void compress_DDS_alpha_block(
 				const unsigned char *const uncompressed,
 				unsigned char compressed[8] );
 
+/********* Encoder Settings and Kernels *********/
+/*
+	The two loops over the 16 pixels of a colour block that take most of
+	the time: projecting the pixels onto the colour line to find its end
+	points, and mapping them to the 4 palette entries.  The SIMD versions
+	do the same single precision operations in the same order as the
+	scalar ones (and never contract them into FMAs), so every kernel
+	encodes every block identically.
+*/
+typedef void (*DXT_dot_range_kernel)(
+				const float axis[3],
+				int channels,
+				const unsigned char *const uncompressed,
+				float *dot_min, float *dot_max );
+typedef void (*DXT_index_kernel)(
+				const float line[3], float offset,
+				int channels,
+				const unsigned char *const uncompressed,
+				int values[16] );
+
+static void dot_range_scalar( const float axis[3], int channels, const unsigned char *const uncompressed, float *dot_min, float *dot_max );
+static void color_indices_scalar( const float line[3], float offset, int channels, const unsigned char *const uncompressed, int values[16] );
+static int DXT_cpu_mode( void );
+#if DXT_X86
+static void DXT_TARGET("sse4.1") dot_range_sse4( const float axis[3], int channels, const unsigned char *const uncompressed, float *dot_min, float *dot_max );
+static void DXT_TARGET("sse4.1") color_indices_sse4( const float line[3], float offset, int channels, const unsigned char *const uncompressed, int values[16] );
+static void DXT_TARGET("avx2") dot_range_avx2( const float axis[3], int channels, const unsigned char *const uncompressed, float *dot_min, float *dot_max );
+static void DXT_TARGET("avx2") color_indices_avx2( const float line[3], float offset, int channels, const unsigned char *const uncompressed, int values[16] );
+#endif
+
+static DXT_dot_range_kernel DXT_dot_range = dot_range_scalar;
+static DXT_index_kernel DXT_color_indices = color_indices_scalar;
+static int DXT_mode = -1;
+static int DXT_thread_count = 0;
+
+/*	no more threads than this, and none for images with fewer blocks
+	per thread than this	*/
+#define DXT_MAX_THREADS	64
+#define DXT_MIN_BLOCKS_PER_THREAD	1024
+
 /********* Actual Exposed Functions *********/
 int
 	save_image_as_DDS
@@ -98,84 +169,243 @@ int
 	return 1;
 }
 
-unsigned char* convert_image_to_DXT1(
+/*
+	Encodes the row of 4x4 blocks starting at pixel row j into
+	'compressed', as DXT1 blocks or as DXT5 blocks (alpha block first).
+*/
+static void
+	compress_DDS_block_row
+	(
 		const unsigned char *const uncompressed,
 		int width, int height, int channels,
-		int *out_size )
+		int j, int dxt5,
+		unsigned char *compressed
+	)
 {
-	unsigned char *compressed;
-	int i, j, x, y;
-	unsigned char ublock[16*3];
+	int i, x, y;
+	/*	room for 16 RGBA pixels even when encoding RGB: the SIMD kernels
+		read the 48 bytes of RGB blocks 16 at a time	*/
+	unsigned char ublock[16*4];
 	unsigned char cblock[8];
 	int index = 0, chan_step = 1;
-	int block_count = 0;
-	/*	error check	*/
-	*out_size = 0;
-	if( (width < 1) || (height < 1) ||
-		(NULL == uncompressed) ||
-		(channels < 1) || (channels > 4) )
-	{
-		return NULL;
-	}
+	/*	DXT1 blocks are gathered as RGB, DXT5 blocks as RGBA	*/
+	int block_channels = 3 + dxt5;
+	/*	# channels = 1 or 3 have no alpha, 2 & 4 do have alpha	*/
+	int has_alpha = 1 - (channels & 1);
 	/*	for channels == 1 or 2, I do not step forward for R,G,B values	*/
 	if( channels < 3 )
 	{
 		chan_step = 0;
 	}
-	/*	get the RAM for the compressed image
-		(8 bytes per 4x4 pixel block)	*/
-	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 8;
-	compressed = (unsigned char*)malloc( *out_size );
-	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
+	for( i = 0; i < width; i += 4 )
 	{
-		for( i = 0; i < width; i += 4 )
+		/*	copy this block into a new one	*/
+		int idx = 0;
+		int mx = 4, my = 4;
+		if( j+4 >= height )
 		{
-			/*	copy this block into a new one	*/
-			int idx = 0;
-			int mx = 4, my = 4;
-			if( j+4 >= height )
-			{
-				my = height - j;
-			}
-			if( i+4 >= width )
-			{
-				mx = width - i;
-			}
-			for( y = 0; y < my; ++y )
+			my = height - j;
+		}
+		if( i+4 >= width )
+		{
+			mx = width - i;
+		}
+		for( y = 0; y < my; ++y )
+		{
+			for( x = 0; x < mx; ++x )
 			{
-				for( x = 0; x < mx; ++x )
-				{
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step+chan_step];
-				}
-				for( x = mx; x < 4; ++x )
+				ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels];
+				ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step];
+				ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step+chan_step];
+				if( dxt5 )
 				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
+					ublock[idx++] =
+						has_alpha * uncompressed[(j+y)*width*channels+(i+x)*channels+channels-1]
+						+ (1-has_alpha)*255;
 				}
 			}
-			for( y = my; y < 4; ++y )
+			for( x = mx; x < 4; ++x )
 			{
-				for( x = 0; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-				}
+				memcpy( ublock + idx, ublock, block_channels );
+				idx += block_channels;
 			}
-			/*	compress the block	*/
-			++block_count;
-			compress_DDS_color_block( 3, ublock, cblock );
-			/*	copy the data from the block into the main block	*/
-			for( x = 0; x < 8; ++x )
+		}
+		for( y = my; y < 4; ++y )
+		{
+			for( x = 0; x < 4; ++x )
 			{
-				compressed[index++] = cblock[x];
+				memcpy( ublock + idx, ublock, block_channels );
+				idx += block_channels;
 			}
 		}
+		if( dxt5 )
+		{
+			/*	now compress the alpha block	*/
+			compress_DDS_alpha_block( ublock, cblock );
+			/*	copy the data from the compressed alpha block into the main buffer	*/
+			memcpy( compressed + index, cblock, 8 );
+			index += 8;
+		}
+		/*	then compress the color block	*/
+		compress_DDS_color_block( block_channels, ublock, cblock );
+		/*	copy the data from the compressed color block into the main buffer	*/
+		memcpy( compressed + index, cblock, 8 );
+		index += 8;
+	}
+}
+
+typedef struct
+{
+	const unsigned char *uncompressed;
+	int width, height, channels;
+	int dxt5;
+	unsigned char *compressed;
+	/*	this job encodes block rows first_row, first_row + row_step, ...	*/
+	int first_row, row_step;
+}
+DXT_rows_job;
+
+static void DXT_compress_rows( DXT_rows_job *job )
+{
+	int row_bytes = ((job->width+3) >> 2) * (job->dxt5 ? 16 : 8);
+	int row;
+	for( row = job->first_row; row*4 < job->height; row += job->row_step )
+	{
+		compress_DDS_block_row( job->uncompressed, job->width, job->height, job->channels,
+				row*4, job->dxt5, job->compressed + row*row_bytes );
 	}
+}
+
+#if defined(_WIN32)
+static unsigned __stdcall DXT_worker( void *job )
+{
+	DXT_compress_rows( (DXT_rows_job*)job );
+	return 0;
+}
+#else
+static void* DXT_worker( void *job )
+{
+	DXT_compress_rows( (DXT_rows_job*)job );
+	return NULL;
+}
+#endif
+
+static int DXT_hardware_threads( void )
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+	return (int)info.dwNumberOfProcessors;
+#else
+	long count = sysconf( _SC_NPROCESSORS_ONLN );
+	return count > 0 ? (int)count : 1;
+#endif
+}
+
+/*
+	Encodes a whole image, spreading the block rows over worker threads
+	(interleaved, so every thread gets a similar share of the image).
+	The calling thread takes the first share itself.
+*/
+static void
+	compress_DDS_image
+	(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int dxt5,
+		unsigned char *compressed
+	)
+{
+	DXT_rows_job jobs[DXT_MAX_THREADS];
+#if defined(_WIN32)
+	HANDLE threads[DXT_MAX_THREADS];
+#else
+	pthread_t threads[DXT_MAX_THREADS];
+#endif
+	int started[DXT_MAX_THREADS];
+	int rows = (height+3) >> 2;
+	int blocks = rows * ((width+3) >> 2);
+	int thread_count = DXT_thread_count > 0 ? DXT_thread_count : DXT_hardware_threads();
+	int t;
+	if( DXT_mode < 0 )
+	{
+		DXT_set_mode( DXT_MODE_AUTO );
+	}
+	if( DXT_mode == DXT_MODE_REFERENCE )
+	{
+		thread_count = 1;
+	}
+	if( thread_count > blocks / DXT_MIN_BLOCKS_PER_THREAD )
+	{
+		thread_count = blocks / DXT_MIN_BLOCKS_PER_THREAD;
+	}
+	if( thread_count > DXT_MAX_THREADS )
+	{
+		thread_count = DXT_MAX_THREADS;
+	}
+	if( thread_count < 1 )
+	{
+		thread_count = 1;
+	}
+	for( t = 0; t < thread_count; ++t )
+	{
+		jobs[t].uncompressed = uncompressed;
+		jobs[t].width = width;
+		jobs[t].height = height;
+		jobs[t].channels = channels;
+		jobs[t].dxt5 = dxt5;
+		jobs[t].compressed = compressed;
+		jobs[t].first_row = t;
+		jobs[t].row_step = thread_count;
+		started[t] = 0;
+	}
+	for( t = 1; t < thread_count; ++t )
+	{
+#if defined(_WIN32)
+		threads[t] = (HANDLE)_beginthreadex( NULL, 0, DXT_worker, &jobs[t], 0, NULL );
+		started[t] = threads[t] != 0;
+#else
+		started[t] = pthread_create( &threads[t], NULL, DXT_worker, &jobs[t] ) == 0;
+#endif
+	}
+	DXT_compress_rows( &jobs[0] );
+	for( t = 1; t < thread_count; ++t )
+	{
+		if( !started[t] )
+		{
+			/*	couldn't get a thread, so do its share here	*/
+			DXT_compress_rows( &jobs[t] );
+			continue;
+		}
+#if defined(_WIN32)
+		WaitForSingleObject( threads[t], INFINITE );
+		CloseHandle( threads[t] );
+#else
+		pthread_join( threads[t], NULL );
+#endif
+	}
+}
+
+unsigned char* convert_image_to_DXT1(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int *out_size )
+{
+	unsigned char *compressed;
+	/*	error check	*/
+	*out_size = 0;
+	if( (width < 1) || (height < 1) ||
+		(NULL == uncompressed) ||
+		(channels < 1) || (channels > 4) )
+	{
+		return NULL;
+	}
+	/*	get the RAM for the compressed image
+		(8 bytes per 4x4 pixel block)	*/
+	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 8;
+	compressed = (unsigned char*)malloc( *out_size );
+	/*	go through each block	*/
+	compress_DDS_image( uncompressed, width, height, channels, 0, compressed );
 	return compressed;
 }
 
@@ -185,11 +415,6 @@ unsigned char* convert_image_to_DXT5(
 		int *out_size )
 {
 	unsigned char *compressed;
-	int i, j, x, y;
-	unsigned char ublock[16*4];
-	unsigned char cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0, has_alpha;
 	/*	error check	*/
 	*out_size = 0;
 	if( (width < 1) || (height < 1) ||
@@ -198,80 +423,46 @@ unsigned char* convert_image_to_DXT5(
 	{
 		return NULL;
 	}
-	/*	for channels == 1 or 2, I do not step forward for R,G,B vales	*/
-	if( channels < 3 )
-	{
-		chan_step = 0;
-	}
-	/*	# channels = 1 or 3 have no alpha, 2 & 4 do have alpha	*/
-	has_alpha = 1 - (channels & 1);
 	/*	get the RAM for the compressed image
 		(16 bytes per 4x4 pixel block)	*/
 	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 16;
 	compressed = (unsigned char*)malloc( *out_size );
 	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
+	compress_DDS_image( uncompressed, width, height, channels, 1, compressed );
+	return compressed;
+}
+
+int DXT_set_mode( int mode )
+{
+	int supported = DXT_cpu_mode();
+	if( (mode == DXT_MODE_AUTO) || (mode > supported) )
 	{
-		for( i = 0; i < width; i += 4 )
-		{
-			/*	local variables, and my block counter	*/
-			int idx = 0;
-			int mx = 4, my = 4;
-			if( j+4 >= height )
-			{
-				my = height - j;
-			}
-			if( i+4 >= width )
-			{
-				mx = width - i;
-			}
-			for( y = 0; y < my; ++y )
-			{
-				for( x = 0; x < mx; ++x )
-				{
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step+chan_step];
-					ublock[idx++] =
-						has_alpha * uncompressed[(j+y)*width*channels+(i+x)*channels+channels-1]
-						+ (1-has_alpha)*255;
-				}
-				for( x = mx; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-					ublock[idx++] = ublock[3];
-				}
-			}
-			for( y = my; y < 4; ++y )
-			{
-				for( x = 0; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-					ublock[idx++] = ublock[3];
-				}
-			}
-			/*	now compress the alpha block	*/
-			compress_DDS_alpha_block( ublock, cblock );
-			/*	copy the data from the compressed alpha block into the main buffer	*/
-			for( x = 0; x < 8; ++x )
-			{
-				compressed[index++] = cblock[x];
-			}
-			/*	then compress the color block	*/
-			++block_count;
-			compress_DDS_color_block( 4, ublock, cblock );
-			/*	copy the data from the compressed color block into the main buffer	*/
-			for( x = 0; x < 8; ++x )
-			{
-				compressed[index++] = cblock[x];
-			}
-		}
+		mode = supported;
 	}
-	return compressed;
+	if( (mode < DXT_MODE_AUTO) || (mode > DXT_MODE_AVX2) )
+	{
+		mode = DXT_MODE_REFERENCE;
+	}
+	DXT_dot_range = dot_range_scalar;
+	DXT_color_indices = color_indices_scalar;
+#if DXT_X86
+	if( mode == DXT_MODE_SSE4 )
+	{
+		DXT_dot_range = dot_range_sse4;
+		DXT_color_indices = color_indices_sse4;
+	} else if( mode == DXT_MODE_AVX2 )
+	{
+		DXT_dot_range = dot_range_avx2;
+		DXT_color_indices = color_indices_avx2;
+	}
+#endif
+	DXT_mode = mode;
+	return mode;
+}
+
+void DXT_set_thread_count( int count )
+{
+	DXT_thread_count = count;
 }
 
 /********* Helper Functions *********/
@@ -431,29 +622,7 @@ void LSE_master_colors_max_min(
 	vec_len2 = 1.0f / ( 0.00001f +
 			sum_x2[0]*sum_x2[0] + sum_x2[1]*sum_x2[1] + sum_x2[2]*sum_x2[2] );
 	/*	finding the max and min vector values	*/
-	dot_max =
-			(
-				sum_x2[0] * uncompressed[0] +
-				sum_x2[1] * uncompressed[1] +
-				sum_x2[2] * uncompressed[2]
-			);
-	dot_min = dot_max;
-	for( i = 1; i < 16; ++i )
-	{
-		dot =
-			(
-				sum_x2[0] * uncompressed[i*channels+0] +
-				sum_x2[1] * uncompressed[i*channels+1] +
-				sum_x2[2] * uncompressed[i*channels+2]
-			);
-		if( dot < dot_min )
-		{
-			dot_min = dot;
-		} else if( dot > dot_max )
-		{
-			dot_max = dot;
-		}
-	}
+	DXT_dot_range( sum_x2, channels, uncompressed, &dot_min, &dot_max );
 	/*	and the offset (from the average location)	*/
 	dot = sum_x2[0]*sum_x[0] + sum_x2[1]*sum_x[1] + sum_x2[2]*sum_x[2];
 	dot_min -= dot;
@@ -510,6 +679,7 @@ void
 	int next_bit;
 	int enc_c0, enc_c1;
 	int c0[4], c1[4];
+	int values[16];
 	float color_line[] = { 0.0f, 0.0f, 0.0f, 0.0f };
 	float vec_len2 = 0.0f, dot_offset = 0.0f;
 	/*	stupid order	*/
@@ -546,29 +716,14 @@ void
 	color_line[2] *= vec_len2;
 	/*	compute the offset (constant) portion of the dot product	*/
 	dot_offset = color_line[0]*c0[0] + color_line[1]*c0[1] + color_line[2]*c0[2];
+	/*	place every color on the line	*/
+	DXT_color_indices( color_line, dot_offset, channels, uncompressed, values );
 	/*	store the rest of the bits	*/
 	next_bit = 8*4;
 	for( i = 0; i < 16; ++i )
 	{
-		/*	find the dot product of this color, to place it on the line
-			(should be [-1,1])	*/
-		int next_value = 0;
-		float dot_product =
-			color_line[0] * uncompressed[i*channels+0] +
-			color_line[1] * uncompressed[i*channels+1] +
-			color_line[2] * uncompressed[i*channels+2] -
-			dot_offset;
-		/*	map to [0,3]	*/
-		next_value = (int)( dot_product * 3.0f + 0.5f );
-		if( next_value > 3 )
-		{
-			next_value = 3;
-		} else if( next_value < 0 )
-		{
-			next_value = 0;
-		}
 		/*	OK, store this value	*/
-		compressed[next_bit >> 3] |= swizzle4[ next_value ] << (next_bit & 7);
+		compressed[next_bit >> 3] |= swizzle4[ values[i] ] << (next_bit & 7);
 		next_bit += 2;
 	}
 	/*	done compressing to DXT1	*/
@@ -630,3 +785,262 @@ void
 	}
 	/*	done compressing to DXT1	*/
 }
+
+/********* Kernels *********/
+static void dot_range_scalar(
+		const float axis[3],
+		int channels,
+		const unsigned char *const uncompressed,
+		float *dot_min, float *dot_max )
+{
+	int i;
+	float dot;
+	*dot_max =
+			(
+				axis[0] * uncompressed[0] +
+				axis[1] * uncompressed[1] +
+				axis[2] * uncompressed[2]
+			);
+	*dot_min = *dot_max;
+	for( i = 1; i < 16; ++i )
+	{
+		dot =
+			(
+				axis[0] * uncompressed[i*channels+0] +
+				axis[1] * uncompressed[i*channels+1] +
+				axis[2] * uncompressed[i*channels+2]
+			);
+		if( dot < *dot_min )
+		{
+			*dot_min = dot;
+		} else if( dot > *dot_max )
+		{
+			*dot_max = dot;
+		}
+	}
+}
+
+static void color_indices_scalar(
+		const float line[3], float offset,
+		int channels,
+		const unsigned char *const uncompressed,
+		int values[16] )
+{
+	int i;
+	for( i = 0; i < 16; ++i )
+	{
+		/*	find the dot product of this color, to place it on the line
+			(should be [-1,1])	*/
+		int next_value = 0;
+		float dot_product =
+			line[0] * uncompressed[i*channels+0] +
+			line[1] * uncompressed[i*channels+1] +
+			line[2] * uncompressed[i*channels+2] -
+			offset;
+		/*	map to [0,3]	*/
+		next_value = (int)( dot_product * 3.0f + 0.5f );
+		if( next_value > 3 )
+		{
+			next_value = 3;
+		} else if( next_value < 0 )
+		{
+			next_value = 0;
+		}
+		values[i] = next_value;
+	}
+}
+
+#if DXT_X86
+/*
+	pshufb masks widening the R, G or B bytes of 4 pixels to 32 bits.
+	Pixel group g (pixels 4g to 4g+3) is loaded from byte 16g of RGBA
+	blocks.  RGB groups start at byte 12g, except the last one, which is
+	loaded from byte 32 so the 16 byte load stays inside the 48 bytes of
+	the block; its pixels then start 4 bytes into the load.
+*/
+#define DXT_LANES(a, b, c, d)	a,-1,-1,-1, b,-1,-1,-1, c,-1,-1,-1, d,-1,-1,-1
+static const signed char DXT_masks[3][3][16] =
+{
+	/*	RGBA	*/
+	{ { DXT_LANES( 0, 4, 8, 12 ) }, { DXT_LANES( 1, 5, 9, 13 ) }, { DXT_LANES( 2, 6, 10, 14 ) } },
+	/*	RGB, groups 0 to 2	*/
+	{ { DXT_LANES( 0, 3, 6, 9 ) }, { DXT_LANES( 1, 4, 7, 10 ) }, { DXT_LANES( 2, 5, 8, 11 ) } },
+	/*	RGB, group 3	*/
+	{ { DXT_LANES( 4, 7, 10, 13 ) }, { DXT_LANES( 5, 8, 11, 14 ) }, { DXT_LANES( 6, 9, 12, 15 ) } }
+};
+#undef DXT_LANES
+
+static int DXT_group_offset( int channels, int group )
+{
+	return (channels == 4) ? group*16 : ((group < 3) ? group*12 : 32);
+}
+
+static const signed char (*DXT_group_masks( int channels, int group ))[16]
+{
+	return DXT_masks[(channels == 4) ? 0 : ((group < 3) ? 1 : 2)];
+}
+
+/*	R, G and B of pixel group 'group' as floats	*/
+static void DXT_TARGET("sse4.1") DXT_load_group_sse4(
+		const unsigned char *const uncompressed, int channels, int group,
+		__m128 *r, __m128 *g, __m128 *b )
+{
+	__m128i pixels = _mm_loadu_si128( (const __m128i*)(uncompressed + DXT_group_offset( channels, group )) );
+	const signed char (*masks)[16] = DXT_group_masks( channels, group );
+	*r = _mm_cvtepi32_ps( _mm_shuffle_epi8( pixels, _mm_loadu_si128( (const __m128i*)masks[0] ) ) );
+	*g = _mm_cvtepi32_ps( _mm_shuffle_epi8( pixels, _mm_loadu_si128( (const __m128i*)masks[1] ) ) );
+	*b = _mm_cvtepi32_ps( _mm_shuffle_epi8( pixels, _mm_loadu_si128( (const __m128i*)masks[2] ) ) );
+}
+
+static void DXT_TARGET("sse4.1") dot_range_sse4(
+		const float axis[3],
+		int channels,
+		const unsigned char *const uncompressed,
+		float *dot_min, float *dot_max )
+{
+	__m128 ax = _mm_set1_ps( axis[0] ), ay = _mm_set1_ps( axis[1] ), az = _mm_set1_ps( axis[2] );
+	__m128 lo = _mm_set1_ps( 3.402823466e+38f ), hi = _mm_set1_ps( -3.402823466e+38f );
+	__m128 r, g, b, dot;
+	int group;
+	for( group = 0; group < 4; ++group )
+	{
+		DXT_load_group_sse4( uncompressed, channels, group, &r, &g, &b );
+		dot = _mm_add_ps( _mm_add_ps( _mm_mul_ps( ax, r ), _mm_mul_ps( ay, g ) ), _mm_mul_ps( az, b ) );
+		lo = _mm_min_ps( lo, dot );
+		hi = _mm_max_ps( hi, dot );
+	}
+	lo = _mm_min_ps( lo, _mm_movehl_ps( lo, lo ) );
+	lo = _mm_min_ss( lo, _mm_shuffle_ps( lo, lo, 1 ) );
+	hi = _mm_max_ps( hi, _mm_movehl_ps( hi, hi ) );
+	hi = _mm_max_ss( hi, _mm_shuffle_ps( hi, hi, 1 ) );
+	*dot_min = _mm_cvtss_f32( lo );
+	*dot_max = _mm_cvtss_f32( hi );
+}
+
+static void DXT_TARGET("sse4.1") color_indices_sse4(
+		const float line[3], float offset,
+		int channels,
+		const unsigned char *const uncompressed,
+		int values[16] )
+{
+	__m128 lx = _mm_set1_ps( line[0] ), ly = _mm_set1_ps( line[1] ), lz = _mm_set1_ps( line[2] );
+	__m128 off = _mm_set1_ps( offset ), three = _mm_set1_ps( 3.0f ), half = _mm_set1_ps( 0.5f );
+	__m128i zero = _mm_setzero_si128(), top = _mm_set1_epi32( 3 );
+	__m128 r, g, b, dot;
+	__m128i value;
+	int group;
+	for( group = 0; group < 4; ++group )
+	{
+		DXT_load_group_sse4( uncompressed, channels, group, &r, &g, &b );
+		dot = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( lx, r ), _mm_mul_ps( ly, g ) ), _mm_mul_ps( lz, b ) ), off );
+		/*	truncating conversion, like the (int) cast	*/
+		value = _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( dot, three ), half ) );
+		value = _mm_max_epi32( _mm_min_epi32( value, top ), zero );
+		_mm_storeu_si128( (__m128i*)(values + group*4), value );
+	}
+}
+
+/*	R, G and B of pixel groups 'group' and 'group' + 1 as floats	*/
+static void DXT_TARGET("avx2") DXT_load_groups_avx2(
+		const unsigned char *const uncompressed, int channels, int group,
+		__m256 *r, __m256 *g, __m256 *b )
+{
+	__m256i pixels = _mm256_inserti128_si256( _mm256_castsi128_si256(
+			_mm_loadu_si128( (const __m128i*)(uncompressed + DXT_group_offset( channels, group )) ) ),
+			_mm_loadu_si128( (const __m128i*)(uncompressed + DXT_group_offset( channels, group + 1 )) ), 1 );
+	const signed char (*low)[16] = DXT_group_masks( channels, group );
+	const signed char (*high)[16] = DXT_group_masks( channels, group + 1 );
+	__m256i mask_r = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (const __m128i*)low[0] ) ), _mm_loadu_si128( (const __m128i*)high[0] ), 1 );
+	__m256i mask_g = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (const __m128i*)low[1] ) ), _mm_loadu_si128( (const __m128i*)high[1] ), 1 );
+	__m256i mask_b = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (const __m128i*)low[2] ) ), _mm_loadu_si128( (const __m128i*)high[2] ), 1 );
+	*r = _mm256_cvtepi32_ps( _mm256_shuffle_epi8( pixels, mask_r ) );
+	*g = _mm256_cvtepi32_ps( _mm256_shuffle_epi8( pixels, mask_g ) );
+	*b = _mm256_cvtepi32_ps( _mm256_shuffle_epi8( pixels, mask_b ) );
+}
+
+static void DXT_TARGET("avx2") dot_range_avx2(
+		const float axis[3],
+		int channels,
+		const unsigned char *const uncompressed,
+		float *dot_min, float *dot_max )
+{
+	__m256 ax = _mm256_set1_ps( axis[0] ), ay = _mm256_set1_ps( axis[1] ), az = _mm256_set1_ps( axis[2] );
+	__m256 r, g, b, first, second, min8, max8;
+	__m128 lo, hi;
+	DXT_load_groups_avx2( uncompressed, channels, 0, &r, &g, &b );
+	first = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( ax, r ), _mm256_mul_ps( ay, g ) ), _mm256_mul_ps( az, b ) );
+	DXT_load_groups_avx2( uncompressed, channels, 2, &r, &g, &b );
+	second = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( ax, r ), _mm256_mul_ps( ay, g ) ), _mm256_mul_ps( az, b ) );
+	min8 = _mm256_min_ps( first, second );
+	max8 = _mm256_max_ps( first, second );
+	lo = _mm_min_ps( _mm256_castps256_ps128( min8 ), _mm256_extractf128_ps( min8, 1 ) );
+	lo = _mm_min_ps( lo, _mm_movehl_ps( lo, lo ) );
+	lo = _mm_min_ss( lo, _mm_shuffle_ps( lo, lo, 1 ) );
+	*dot_min = _mm_cvtss_f32( lo );
+	hi = _mm_max_ps( _mm256_castps256_ps128( max8 ), _mm256_extractf128_ps( max8, 1 ) );
+	hi = _mm_max_ps( hi, _mm_movehl_ps( hi, hi ) );
+	hi = _mm_max_ss( hi, _mm_shuffle_ps( hi, hi, 1 ) );
+	*dot_max = _mm_cvtss_f32( hi );
+}
+
+static void DXT_TARGET("avx2") color_indices_avx2(
+		const float line[3], float offset,
+		int channels,
+		const unsigned char *const uncompressed,
+		int values[16] )
+{
+	__m256 lx = _mm256_set1_ps( line[0] ), ly = _mm256_set1_ps( line[1] ), lz = _mm256_set1_ps( line[2] );
+	__m256 off = _mm256_set1_ps( offset ), three = _mm256_set1_ps( 3.0f ), half = _mm256_set1_ps( 0.5f );
+	__m256i zero = _mm256_setzero_si256(), top = _mm256_set1_epi32( 3 );
+	__m256 r, g, b, dot;
+	__m256i value;
+	int group;
+	for( group = 0; group < 4; group += 2 )
+	{
+		DXT_load_groups_avx2( uncompressed, channels, group, &r, &g, &b );
+		dot = _mm256_sub_ps( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( lx, r ), _mm256_mul_ps( ly, g ) ), _mm256_mul_ps( lz, b ) ), off );
+		/*	truncating conversion, like the (int) cast	*/
+		value = _mm256_cvttps_epi32( _mm256_add_ps( _mm256_mul_ps( dot, three ), half ) );
+		value = _mm256_max_epi32( _mm256_min_epi32( value, top ), zero );
+		_mm256_storeu_si256( (__m256i*)(values + group*4), value );
+	}
+}
+#endif
+
+/*	the widest kernels the CPU (and OS) can run	*/
+static int DXT_cpu_mode( void )
+{
+#if DXT_X86 && defined(_MSC_VER)
+	int info[4];
+	int max_leaf;
+	__cpuid( info, 0 );
+	max_leaf = info[0];
+	__cpuid( info, 1 );
+	if( max_leaf >= 7 && (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+		((_xgetbv( 0 ) & 6) == 6) )
+	{
+		/*	AVX enabled by the OS, now check for AVX2	*/
+		int leaf7[4];
+		__cpuidex( leaf7, 7, 0 );
+		if( leaf7[1] & (1 << 5) )
+		{
+			return DXT_MODE_AVX2;
+		}
+	}
+	if( info[2] & (1 << 19) )
+	{
+		return DXT_MODE_SSE4;
+	}
+#elif DXT_X86
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports( "avx2" ) )
+	{
+		return DXT_MODE_AVX2;
+	}
+	if( __builtin_cpu_supports( "sse4.1" ) )
+	{
+		return DXT_MODE_SSE4;
+	}
+#endif
+	return DXT_MODE_SCALAR;
+}
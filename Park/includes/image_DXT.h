@@ -10,6 +10,10 @@
 #ifndef HEADER_IMAGE_DXT
 #define HEADER_IMAGE_DXT
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
 	Converts an image from an array of unsigned chars (RGB or RGBA) to
 	DXT1 or DXT5, then saves the converted image to disk.
@@ -45,6 +49,37 @@ convert_image_to_DXT5
     int *out_size
 );
 
+/**
+	Encoder modes, shared by every conversion.  All of them produce
+	bit-identical output; they only differ in speed.
+**/
+#define DXT_MODE_AUTO		0	/* widest SIMD kernels the CPU runs, on all threads */
+#define DXT_MODE_REFERENCE	1	/* the original scalar code, on the calling thread only */
+#define DXT_MODE_SCALAR		2	/* scalar kernels, on all threads */
+#define DXT_MODE_SSE4		3	/* SSE4.1 kernels, on all threads */
+#define DXT_MODE_AVX2		4	/* AVX2 kernels, on all threads */
+
+/**
+	Selects the encoder mode.  A SIMD mode the CPU can't run falls back
+	to the next narrower one.
+	\return the mode actually used
+**/
+int
+DXT_set_mode
+(
+    int mode
+);
+
+/**
+	Sets how many threads share the block rows of large images
+	(0, the default, uses one per hardware thread).
+**/
+void
+DXT_set_thread_count
+(
+    int count
+);
+
 /**	A bunch of DirectDraw Surface structures and flags **/
 typedef struct
 {
@@ -120,4 +155,8 @@ DDS_header ;
 #define DDSCAPS2_CUBEMAP_NEGATIVEZ	0x00008000
 #define DDSCAPS2_VOLUME	0x00200000
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* HEADER_IMAGE_DXT	*/
@@ -8,8 +8,329 @@
 
 #include "image_helper.h"
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
+#if defined(_WIN32)
+	#include <windows.h>
+	#include <process.h>
+#else
+	#include <pthread.h>
+	#include <unistd.h>
+#endif
+
+/*	the up scaling kernels rely on every multiply and add being rounded on
+	its own, so don't let the compiler fuse them into FMAs	*/
+#if defined(__clang__)
+	#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+	#pragma GCC optimize ("fp-contract=off")
+#elif defined(_MSC_VER)
+	#pragma fp_contract (off)
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	#define IH_X86	1
+	#include <immintrin.h>
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+		#define IH_TARGET(isa)
+	#else
+		#define IH_TARGET(isa)	__attribute__((target(isa)))
+	#endif
+#else
+	#define IH_X86	0
+#endif
+
+/********* Settings and Row Kernels *********/
+/*
+	Every function below works on one row of its output at a time, so
+	the rows of a large image can be shared between threads.  A kernel
+	gets the arguments of its function, the row to produce and a scratch
+	buffer private to its thread (NULL if it couldn't be allocated, in
+	which case the SIMD kernels fall back to the scalar ones).  The SIMD
+	kernels do the same operations as the scalar ones (the same single
+	precision multiplies and adds in the same order when up scaling,
+	exact integer arithmetic everywhere else), so every mode produces
+	the same bytes.
+*/
+typedef void (*IH_row_kernel)( const void *args, int row, void *scratch );
+
+typedef struct
+{
+	const unsigned char *orig;
+	int width, height, channels;
+	unsigned char *resampled;
+	int resampled_width, resampled_height;
+	float dx, dy;
+	/*	per output byte of a row: the offset of its top left source byte
+		in a row, and the weights of the left and right source columns	*/
+	int *offset;
+	float *weight0, *weight1;
+}
+IH_up_scale_args;
+
+typedef struct
+{
+	const unsigned char *orig;
+	int width, height, channels;
+	unsigned char *resampled;
+	int block_size_x, block_size_y;
+	int mip_width, mip_height;
+}
+IH_mipmap_args;
+
+typedef struct
+{
+	unsigned char *orig;
+	int width, channels;
+	/*	NTSC: the scaling table, and whether ((i*1767 + 31731) >> 11)
+		reproduces it (which is how the SIMD kernels compute it)	*/
+	unsigned char scale_LUT[256];
+	int exact;
+}
+IH_pixels_args;
+
+static void up_scale_row_scalar( const void *args, int row, void *scratch );
+static void mipmap_row_scalar( const void *args, int row, void *scratch );
+/*	scales bytes 'first' to 'count' of a row, which may start inside a
+	(3 channel) pixel	*/
+static void NTSC_tail( const IH_pixels_args *args, unsigned char *pixels, int first, int count )
+{
+	int channels = args->channels;
+	int i;
+	for( i = first; i < count; ++i )
+	{
+		if( (channels & 1) || (i % channels != channels - 1) )
+		{
+			pixels[i] = args->scale_LUT[pixels[i]];
+		}
+	}
+}
+
+static void NTSC_row_scalar( const void *args, int row, void *scratch );
+static void to_YCoCg_row_scalar( const void *args, int row, void *scratch );
+static void from_YCoCg_row_scalar( const void *args, int row, void *scratch );
+static int IH_cpu_mode( void );
+#if IH_X86
+static void IH_TARGET("sse2") up_scale_row_sse2( const void *args, int row, void *scratch );
+static void IH_TARGET("sse2") mipmap_row_sse2( const void *args, int row, void *scratch );
+static void IH_TARGET("sse2") NTSC_row_sse2( const void *args, int row, void *scratch );
+static void IH_TARGET("sse2") to_YCoCg_row_sse2( const void *args, int row, void *scratch );
+static void IH_TARGET("sse2") from_YCoCg_row_sse2( const void *args, int row, void *scratch );
+static void IH_TARGET("avx2") up_scale_row_avx2( const void *args, int row, void *scratch );
+static void IH_TARGET("avx2") mipmap_row_avx2( const void *args, int row, void *scratch );
+static void IH_TARGET("avx2") NTSC_row_avx2( const void *args, int row, void *scratch );
+static void IH_TARGET("avx2") to_YCoCg_row_avx2( const void *args, int row, void *scratch );
+static void IH_TARGET("avx2") from_YCoCg_row_avx2( const void *args, int row, void *scratch );
+#endif
+
+static IH_row_kernel IH_up_scale_row = up_scale_row_scalar;
+static IH_row_kernel IH_mipmap_row = mipmap_row_scalar;
+static IH_row_kernel IH_NTSC_row = NTSC_row_scalar;
+static IH_row_kernel IH_to_YCoCg_row = to_YCoCg_row_scalar;
+static IH_row_kernel IH_from_YCoCg_row = from_YCoCg_row_scalar;
+static int IH_mode = -1;
+static int IH_thread_count = 0;
+
+/*	no more threads than this, and none for images with fewer output
+	bytes per thread than this	*/
+#define IH_MAX_THREADS	64
+#define IH_MIN_BYTES_PER_THREAD	(256*1024)
+
+typedef struct
+{
+	IH_row_kernel kernel;
+	const void *args;
+	int rows;
+	size_t scratch_size;
+	/*	this job does rows first_row, first_row + row_step, ...	*/
+	int first_row, row_step;
+}
+IH_rows_job;
+
+static void IH_do_rows( IH_rows_job *job )
+{
+	void *scratch = NULL;
+	int row;
+	if( job->scratch_size > 0 )
+	{
+		scratch = malloc( job->scratch_size );
+	}
+	for( row = job->first_row; row < job->rows; row += job->row_step )
+	{
+		job->kernel( job->args, row, scratch );
+	}
+	free( scratch );
+}
+
+#if defined(_WIN32)
+static unsigned __stdcall IH_worker( void *job )
+{
+	IH_do_rows( (IH_rows_job*)job );
+	return 0;
+}
+#else
+static void* IH_worker( void *job )
+{
+	IH_do_rows( (IH_rows_job*)job );
+	return NULL;
+}
+#endif
+
+static int IH_hardware_threads( void )
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+	return (int)info.dwNumberOfProcessors;
+#else
+	long count = sysconf( _SC_NPROCESSORS_ONLN );
+	return count > 0 ? (int)count : 1;
+#endif
+}
+
+/*
+	Runs a row kernel over 'rows' rows of 'row_bytes' output bytes each,
+	spreading them over worker threads (interleaved, so every thread
+	gets a similar share of the image).  The calling thread takes the
+	first share itself.
+*/
+static void
+	IH_run_rows
+	(
+		IH_row_kernel kernel, const void *args,
+		int rows, int row_bytes,
+		size_t scratch_size
+	)
+{
+	IH_rows_job jobs[IH_MAX_THREADS];
+#if defined(_WIN32)
+	HANDLE threads[IH_MAX_THREADS];
+#else
+	pthread_t threads[IH_MAX_THREADS];
+#endif
+	int started[IH_MAX_THREADS];
+	double bytes = (double)rows * row_bytes;
+	int thread_count = IH_thread_count > 0 ? IH_thread_count : IH_hardware_threads();
+	int t;
+	if( IH_mode == IMAGE_HELPER_MODE_REFERENCE )
+	{
+		thread_count = 1;
+	}
+	if( thread_count > bytes / IH_MIN_BYTES_PER_THREAD )
+	{
+		thread_count = (int)(bytes / IH_MIN_BYTES_PER_THREAD);
+	}
+	if( thread_count > IH_MAX_THREADS )
+	{
+		thread_count = IH_MAX_THREADS;
+	}
+	if( thread_count > rows )
+	{
+		thread_count = rows;
+	}
+	if( thread_count < 1 )
+	{
+		thread_count = 1;
+	}
+	for( t = 0; t < thread_count; ++t )
+	{
+		jobs[t].kernel = kernel;
+		jobs[t].args = args;
+		jobs[t].rows = rows;
+		jobs[t].scratch_size = scratch_size;
+		jobs[t].first_row = t;
+		jobs[t].row_step = thread_count;
+		started[t] = 0;
+	}
+	for( t = 1; t < thread_count; ++t )
+	{
+#if defined(_WIN32)
+		threads[t] = (HANDLE)_beginthreadex( NULL, 0, IH_worker, &jobs[t], 0, NULL );
+		started[t] = threads[t] != 0;
+#else
+		started[t] = pthread_create( &threads[t], NULL, IH_worker, &jobs[t] ) == 0;
+#endif
+	}
+	IH_do_rows( &jobs[0] );
+	for( t = 1; t < thread_count; ++t )
+	{
+		if( !started[t] )
+		{
+			/*	couldn't get a thread, so do its share here	*/
+			IH_do_rows( &jobs[t] );
+			continue;
+		}
+#if defined(_WIN32)
+		WaitForSingleObject( threads[t], INFINITE );
+		CloseHandle( threads[t] );
+#else
+		pthread_join( threads[t], NULL );
+#endif
+	}
+}
+
+static void IH_init( void )
+{
+	if( IH_mode < 0 )
+	{
+		image_helper_set_mode( IMAGE_HELPER_MODE_AUTO );
+	}
+}
+
+int
+	image_helper_set_mode
+	(
+		int mode
+	)
+{
+	int supported = IH_cpu_mode();
+	if( (mode == IMAGE_HELPER_MODE_AUTO) || (mode > supported) )
+	{
+		mode = supported;
+	}
+	if( (mode < IMAGE_HELPER_MODE_AUTO) || (mode > IMAGE_HELPER_MODE_AVX2) )
+	{
+		mode = IMAGE_HELPER_MODE_REFERENCE;
+	}
+	IH_up_scale_row = up_scale_row_scalar;
+	IH_mipmap_row = mipmap_row_scalar;
+	IH_NTSC_row = NTSC_row_scalar;
+	IH_to_YCoCg_row = to_YCoCg_row_scalar;
+	IH_from_YCoCg_row = from_YCoCg_row_scalar;
+#if IH_X86
+	if( mode == IMAGE_HELPER_MODE_SSE2 )
+	{
+		IH_up_scale_row = up_scale_row_sse2;
+		IH_mipmap_row = mipmap_row_sse2;
+		IH_NTSC_row = NTSC_row_sse2;
+		IH_to_YCoCg_row = to_YCoCg_row_sse2;
+		IH_from_YCoCg_row = from_YCoCg_row_sse2;
+	} else if( mode == IMAGE_HELPER_MODE_AVX2 )
+	{
+		IH_up_scale_row = up_scale_row_avx2;
+		IH_mipmap_row = mipmap_row_avx2;
+		IH_NTSC_row = NTSC_row_avx2;
+		IH_to_YCoCg_row = to_YCoCg_row_avx2;
+		IH_from_YCoCg_row = from_YCoCg_row_avx2;
+	}
+#endif
+	IH_mode = mode;
+	return mode;
+}
+
+void
+	image_helper_set_thread_count
+	(
+		int count
+	)
+{
+	IH_thread_count = count;
+}
+
+/********* Actual Exposed Functions *********/
+
 /*	Upscaling the image uses simple bilinear interpolation	*/
 int
 	up_scale_image
@@ -20,8 +341,10 @@ int
 		int resampled_width, int resampled_height
 	)
 {
-	float dx, dy;
-	int x, y, c;
+	IH_up_scale_args args;
+	IH_row_kernel kernel = up_scale_row_scalar;
+	size_t scratch_size = 0;
+	int x, c;
 
     /* error(s) check	*/
     if ( 	(width < 1) || (height < 1) ||
@@ -32,51 +355,54 @@ int
         /*	signify badness	*/
         return 0;
     }
+	IH_init();
+	args.orig = orig;
+	args.width = width;
+	args.height = height;
+	args.channels = channels;
+	args.resampled = resampled;
+	args.resampled_width = resampled_width;
+	args.resampled_height = resampled_height;
     /*
 		for each given pixel in the new map, find the exact location
 		from the original map which would contribute to this guy
 	*/
-    dx = (width - 1.0f) / (resampled_width - 1.0f);
-    dy = (height - 1.0f) / (resampled_height - 1.0f);
-    for ( y = 0; y < resampled_height; ++y )
-    {
-    	/* find the base y index and fractional offset from that	*/
-    	float sampley = y * dy;
-    	int inty = (int)sampley;
-    	/*	if( inty < 0 ) { inty = 0; } else	*/
-		if( inty > height - 2 ) { inty = height - 2; }
-		sampley -= inty;
-        for ( x = 0; x < resampled_width; ++x )
-        {
-			float samplex = x * dx;
-			int intx = (int)samplex;
-			int base_index;
-			/* find the base x index and fractional offset from that	*/
-			/*	if( intx < 0 ) { intx = 0; } else	*/
-			if( intx > width - 2 ) { intx = width - 2; }
-			samplex -= intx;
-			/*	base index into the original image	*/
-			base_index = (inty * width + intx) * channels;
-            for ( c = 0; c < channels; ++c )
-            {
-            	/*	do the sampling	*/
-				float value = 0.5f;
-				value += orig[base_index]
-							*(1.0f-samplex)*(1.0f-sampley);
-				value += orig[base_index+channels]
-							*(samplex)*(1.0f-sampley);
-				value += orig[base_index+width*channels]
-							*(1.0f-samplex)*(sampley);
-				value += orig[base_index+width*channels+channels]
-							*(samplex)*(sampley);
-				/*	move to the next channel	*/
-				++base_index;
-            	/*	save the new value	*/
-            	resampled[y*resampled_width*channels+x*channels+c] =
-						(unsigned char)(value);
-            }
-        }
-    }
+	args.dx = (width - 1.0f) / (resampled_width - 1.0f);
+	args.dy = (height - 1.0f) / (resampled_height - 1.0f);
+	args.offset = NULL;
+	args.weight0 = NULL;
+	/*	the SIMD kernels share the horizontal sampling of every row
+		(images narrower or shorter than 2 pixels stay scalar)	*/
+	if( (IH_up_scale_row != up_scale_row_scalar) && (width > 1) && (height > 1) )
+	{
+		size_t elements = (size_t)resampled_width * channels;
+		args.offset = (int*)malloc( elements * sizeof(int) );
+		args.weight0 = (float*)malloc( 2 * elements * sizeof(float) );
+		if( (NULL != args.offset) && (NULL != args.weight0) )
+		{
+			args.weight1 = args.weight0 + elements;
+			for( x = 0; x < resampled_width; ++x )
+			{
+				/*	exactly as the scalar code finds them	*/
+				float samplex = x * args.dx;
+				int intx = (int)samplex;
+				if( intx > width - 2 ) { intx = width - 2; }
+				samplex -= intx;
+				for( c = 0; c < channels; ++c )
+				{
+					args.offset[x*channels+c] = intx*channels + c;
+					args.weight0[x*channels+c] = 1.0f-samplex;
+					args.weight1[x*channels+c] = samplex;
+				}
+			}
+			kernel = IH_up_scale_row;
+			/*	the two source rows, as floats	*/
+			scratch_size = 2 * (size_t)width * channels * sizeof(float);
+		}
+	}
+	IH_run_rows( kernel, &args, resampled_height, resampled_width*channels, scratch_size );
+	free( args.offset );
+	free( args.weight0 );
     /*	done	*/
     return 1;
 }
@@ -90,8 +416,9 @@ int
 		int block_size_x, int block_size_y
 	)
 {
-	int mip_width, mip_height;
-	int i, j, c;
+	IH_mipmap_args args;
+	IH_row_kernel kernel = mipmap_row_scalar;
+	size_t scratch_size = 0;
 
 	/*	error check	*/
 	if( (width < 1) || (height < 1) ||
@@ -102,52 +429,36 @@ int
 		/*	nothing to do	*/
 		return 0;
 	}
-	mip_width = width / block_size_x;
-	mip_height = height / block_size_y;
-	if( mip_width < 1 )
+	IH_init();
+	args.orig = orig;
+	args.width = width;
+	args.height = height;
+	args.channels = channels;
+	args.resampled = resampled;
+	args.block_size_x = block_size_x;
+	args.block_size_y = block_size_y;
+	args.mip_width = width / block_size_x;
+	args.mip_height = height / block_size_y;
+	if( args.mip_width < 1 )
 	{
-		mip_width = 1;
+		args.mip_width = 1;
 	}
-	if( mip_height < 1 )
+	if( args.mip_height < 1 )
 	{
-		mip_height = 1;
+		args.mip_height = 1;
 	}
-	for( j = 0; j < mip_height; ++j )
+	/*	the SIMD kernels do the usual 2x2 box filter, where every block
+		lies inside the image	*/
+	if( (block_size_x == 2) && (block_size_y == 2) && (width > 1) && (height > 1) )
 	{
-		for( i = 0; i < mip_width; ++i )
+		kernel = IH_mipmap_row;
+		if( kernel != mipmap_row_scalar )
 		{
-			for( c = 0; c < channels; ++c )
-			{
-				const int index = (j*block_size_y)*width*channels + (i*block_size_x)*channels + c;
-				int sum_value;
-				int u,v;
-				int u_block = block_size_x;
-				int v_block = block_size_y;
-				int block_area;
-				/*	do a bit of checking so we don't over-run the boundaries
-					(necessary for non-square textures!)	*/
-				if( block_size_x * (i+1) > width )
-				{
-					u_block = width - i*block_size_y;
-				}
-				if( block_size_y * (j+1) > height )
-				{
-					v_block = height - j*block_size_y;
-				}
-				block_area = u_block*v_block;
-				/*	for this pixel, see what the average
-					of all the values in the block are.
-					note: start the sum at the rounding value, not at 0	*/
-				sum_value = block_area >> 1;
-				for( v = 0; v < v_block; ++v )
-				for( u = 0; u < u_block; ++u )
-				{
-					sum_value += orig[index + v*width*channels + u*channels];
-				}
-				resampled[j*mip_width*channels + i*channels + c] = sum_value / block_area;
-			}
+			/*	the vertical sums of a row	*/
+			scratch_size = 2 * (size_t)args.mip_width * channels * sizeof(unsigned short);
 		}
 	}
+	IH_run_rows( kernel, &args, args.mip_height, args.mip_width*channels, scratch_size );
 	return 1;
 }
 
@@ -160,9 +471,8 @@ int
 {
 	const float scale_lo = 16.0f - 0.499f;
 	const float scale_hi = 235.0f + 0.499f;
-	int i, j;
-	int nc = channels;
-	unsigned char scale_LUT[256];
+	IH_pixels_args args;
+	int i;
 	/*	error check	*/
 	if( (width < 1) || (height < 1) ||
 		(channels < 1) || (orig == NULL) )
@@ -170,21 +480,21 @@ int
 		/*	nothing to do	*/
 		return 0;
 	}
+	IH_init();
+	args.orig = orig;
+	args.width = width;
+	args.channels = channels;
+	args.exact = 1;
 	/*	set up the scaling Look Up Table	*/
 	for( i = 0; i < 256; ++i )
 	{
-		scale_LUT[i] = (unsigned char)((scale_hi - scale_lo) * i / 255.0f + scale_lo);
-	}
-	/*	for channels = 2 or 4, ignore the alpha component	*/
-	nc -= 1 - (channels & 1);
-	/*	OK, go through the image and scale any non-alpha components	*/
-	for( i = 0; i < width*height*channels; i += channels )
-	{
-		for( j = 0; j < nc; ++j )
+		args.scale_LUT[i] = (unsigned char)((scale_hi - scale_lo) * i / 255.0f + scale_lo);
+		if( ((i*1767 + 31731) >> 11) != args.scale_LUT[i] )
 		{
-			orig[i+j] = scale_LUT[orig[i+j]];
+			args.exact = 0;
 		}
 	}
+	IH_run_rows( IH_NTSC_row, &args, height, width*channels, 0 );
 	return 1;
 }
 
@@ -204,7 +514,7 @@ int
 		int width, int height, int channels
 	)
 {
-	int i;
+	IH_pixels_args args;
 	/*	error check	*/
 	if( (width < 1) || (height < 1) ||
 		(channels < 3) || (channels > 4) ||
@@ -213,41 +523,12 @@ int
 		/*	nothing to do	*/
 		return -1;
 	}
+	IH_init();
+	args.orig = orig;
+	args.width = width;
+	args.channels = channels;
 	/*	do the conversion	*/
-	if( channels == 3 )
-	{
-		for( i = 0; i < width*height*3; i += 3 )
-		{
-			int r = orig[i+0];
-			int g = (orig[i+1] + 1) >> 1;
-			int b = orig[i+2];
-			int tmp = (2 + r + b) >> 2;
-			/*	Co	*/
-			orig[i+0] = clamp_byte( 128 + ((r - b + 1) >> 1) );
-			/*	Y	*/
-			orig[i+1] = clamp_byte( g + tmp );
-			/*	Cg	*/
-			orig[i+2] = clamp_byte( 128 + g - tmp );
-		}
-	} else
-	{
-		for( i = 0; i < width*height*4; i += 4 )
-		{
-			int r = orig[i+0];
-			int g = (orig[i+1] + 1) >> 1;
-			int b = orig[i+2];
-			unsigned char a = orig[i+3];
-			int tmp = (2 + r + b) >> 2;
-			/*	Co	*/
-			orig[i+0] = clamp_byte( 128 + ((r - b + 1) >> 1) );
-			/*	Cg	*/
-			orig[i+1] = clamp_byte( 128 + g - tmp );
-			/*	Alpha	*/
-			orig[i+2] = a;
-			/*	Y	*/
-			orig[i+3] = clamp_byte( g + tmp );
-		}
-	}
+	IH_run_rows( IH_to_YCoCg_row, &args, height, width*channels, 0 );
 	/*	done	*/
 	return 0;
 }
@@ -263,7 +544,7 @@ int
 		int width, int height, int channels
 	)
 {
-	int i;
+	IH_pixels_args args;
 	/*	error check	*/
 	if( (width < 1) || (height < 1) ||
 		(channels < 3) || (channels > 4) ||
@@ -272,39 +553,12 @@ int
 		/*	nothing to do	*/
 		return -1;
 	}
+	IH_init();
+	args.orig = orig;
+	args.width = width;
+	args.channels = channels;
 	/*	do the conversion	*/
-	if( channels == 3 )
-	{
-		for( i = 0; i < width*height*3; i += 3 )
-		{
-			int co = orig[i+0] - 128;
-			int y  = orig[i+1];
-			int cg = orig[i+2] - 128;
-			/*	R	*/
-			orig[i+0] = clamp_byte( y + co - cg );
-			/*	G	*/
-			orig[i+1] = clamp_byte( y + cg );
-			/*	B	*/
-			orig[i+2] = clamp_byte( y - co - cg );
-		}
-	} else
-	{
-		for( i = 0; i < width*height*4; i += 4 )
-		{
-			int co = orig[i+0] - 128;
-			int cg = orig[i+1] - 128;
-			unsigned char a  = orig[i+2];
-			int y  = orig[i+3];
-			/*	R	*/
-			orig[i+0] = clamp_byte( y + co - cg );
-			/*	G	*/
-			orig[i+1] = clamp_byte( y + cg );
-			/*	B	*/
-			orig[i+2] = clamp_byte( y - co - cg );
-			/*	A	*/
-			orig[i+3] = a;
-		}
-	}
+	IH_run_rows( IH_from_YCoCg_row, &args, height, width*channels, 0 );
 	/*	done	*/
 	return 0;
 }
@@ -433,3 +687,965 @@ RGBE_to_RGBdivA2
 	}
 	return 1;
 }
+
+/********* Scalar Row Kernels *********/
+static void up_scale_row_scalar( const void *arguments, int y, void *scratch )
+{
+	const IH_up_scale_args *args = (const IH_up_scale_args*)arguments;
+	const unsigned char *orig = args->orig;
+	int width = args->width, channels = args->channels;
+	int resampled_width = args->resampled_width;
+	unsigned char *resampled = args->resampled;
+	int x, c;
+	/* find the base y index and fractional offset from that	*/
+	float sampley = y * args->dy;
+	int inty = (int)sampley;
+	/*	if( inty < 0 ) { inty = 0; } else	*/
+	if( inty > args->height - 2 ) { inty = args->height - 2; }
+	sampley -= inty;
+	for ( x = 0; x < resampled_width; ++x )
+	{
+		float samplex = x * args->dx;
+		int intx = (int)samplex;
+		int base_index;
+		/* find the base x index and fractional offset from that	*/
+		/*	if( intx < 0 ) { intx = 0; } else	*/
+		if( intx > width - 2 ) { intx = width - 2; }
+		samplex -= intx;
+		/*	base index into the original image	*/
+		base_index = (inty * width + intx) * channels;
+		for ( c = 0; c < channels; ++c )
+		{
+			/*	do the sampling	*/
+			float value = 0.5f;
+			value += orig[base_index]
+						*(1.0f-samplex)*(1.0f-sampley);
+			value += orig[base_index+channels]
+						*(samplex)*(1.0f-sampley);
+			value += orig[base_index+width*channels]
+						*(1.0f-samplex)*(sampley);
+			value += orig[base_index+width*channels+channels]
+						*(samplex)*(sampley);
+			/*	move to the next channel	*/
+			++base_index;
+			/*	save the new value	*/
+			resampled[y*resampled_width*channels+x*channels+c] =
+					(unsigned char)(value);
+		}
+	}
+	(void)scratch;
+}
+
+static void mipmap_row_scalar( const void *arguments, int j, void *scratch )
+{
+	const IH_mipmap_args *args = (const IH_mipmap_args*)arguments;
+	const unsigned char *orig = args->orig;
+	int width = args->width, height = args->height, channels = args->channels;
+	int block_size_x = args->block_size_x, block_size_y = args->block_size_y;
+	int mip_width = args->mip_width;
+	int i, c;
+	for( i = 0; i < mip_width; ++i )
+	{
+		for( c = 0; c < channels; ++c )
+		{
+			const int index = (j*block_size_y)*width*channels + (i*block_size_x)*channels + c;
+			int sum_value;
+			int u,v;
+			int u_block = block_size_x;
+			int v_block = block_size_y;
+			int block_area;
+			/*	do a bit of checking so we don't over-run the boundaries
+				(necessary for non-square textures!)	*/
+			if( block_size_x * (i+1) > width )
+			{
+				u_block = width - i*block_size_y;
+			}
+			if( block_size_y * (j+1) > height )
+			{
+				v_block = height - j*block_size_y;
+			}
+			block_area = u_block*v_block;
+			/*	for this pixel, see what the average
+				of all the values in the block are.
+				note: start the sum at the rounding value, not at 0	*/
+			sum_value = block_area >> 1;
+			for( v = 0; v < v_block; ++v )
+			for( u = 0; u < u_block; ++u )
+			{
+				sum_value += orig[index + v*width*channels + u*channels];
+			}
+			args->resampled[j*mip_width*channels + i*channels + c] = sum_value / block_area;
+		}
+	}
+	(void)scratch;
+}
+
+/*	scales 'count' bytes of whole pixels	*/
+static void NTSC_pixels( const IH_pixels_args *args, unsigned char *pixels, int count )
+{
+	int i, j;
+	int channels = args->channels;
+	int nc = channels;
+	/*	for channels = 2 or 4, ignore the alpha component	*/
+	nc -= 1 - (channels & 1);
+	/*	OK, go through the image and scale any non-alpha components	*/
+	for( i = 0; i < count; i += channels )
+	{
+		for( j = 0; j < nc; ++j )
+		{
+			pixels[i+j] = args->scale_LUT[pixels[i+j]];
+		}
+	}
+}
+
+static void NTSC_row_scalar( const void *arguments, int row, void *scratch )
+{
+	const IH_pixels_args *args = (const IH_pixels_args*)arguments;
+	int row_bytes = args->width * args->channels;
+	NTSC_pixels( args, args->orig + (size_t)row * row_bytes, row_bytes );
+	(void)scratch;
+}
+
+static void to_YCoCg_pixels( unsigned char *orig, int count, int channels )
+{
+	int i;
+	if( channels == 3 )
+	{
+		for( i = 0; i < count*3; i += 3 )
+		{
+			int r = orig[i+0];
+			int g = (orig[i+1] + 1) >> 1;
+			int b = orig[i+2];
+			int tmp = (2 + r + b) >> 2;
+			/*	Co	*/
+			orig[i+0] = clamp_byte( 128 + ((r - b + 1) >> 1) );
+			/*	Y	*/
+			orig[i+1] = clamp_byte( g + tmp );
+			/*	Cg	*/
+			orig[i+2] = clamp_byte( 128 + g - tmp );
+		}
+	} else
+	{
+		for( i = 0; i < count*4; i += 4 )
+		{
+			int r = orig[i+0];
+			int g = (orig[i+1] + 1) >> 1;
+			int b = orig[i+2];
+			unsigned char a = orig[i+3];
+			int tmp = (2 + r + b) >> 2;
+			/*	Co	*/
+			orig[i+0] = clamp_byte( 128 + ((r - b + 1) >> 1) );
+			/*	Cg	*/
+			orig[i+1] = clamp_byte( 128 + g - tmp );
+			/*	Alpha	*/
+			orig[i+2] = a;
+			/*	Y	*/
+			orig[i+3] = clamp_byte( g + tmp );
+		}
+	}
+}
+
+static void to_YCoCg_row_scalar( const void *arguments, int row, void *scratch )
+{
+	const IH_pixels_args *args = (const IH_pixels_args*)arguments;
+	to_YCoCg_pixels( args->orig + (size_t)row * args->width * args->channels, args->width, args->channels );
+	(void)scratch;
+}
+
+static void from_YCoCg_pixels( unsigned char *orig, int count, int channels )
+{
+	int i;
+	if( channels == 3 )
+	{
+		for( i = 0; i < count*3; i += 3 )
+		{
+			int co = orig[i+0] - 128;
+			int y  = orig[i+1];
+			int cg = orig[i+2] - 128;
+			/*	R	*/
+			orig[i+0] = clamp_byte( y + co - cg );
+			/*	G	*/
+			orig[i+1] = clamp_byte( y + cg );
+			/*	B	*/
+			orig[i+2] = clamp_byte( y - co - cg );
+		}
+	} else
+	{
+		for( i = 0; i < count*4; i += 4 )
+		{
+			int co = orig[i+0] - 128;
+			int cg = orig[i+1] - 128;
+			unsigned char a  = orig[i+2];
+			int y  = orig[i+3];
+			/*	R	*/
+			orig[i+0] = clamp_byte( y + co - cg );
+			/*	G	*/
+			orig[i+1] = clamp_byte( y + cg );
+			/*	B	*/
+			orig[i+2] = clamp_byte( y - co - cg );
+			/*	A	*/
+			orig[i+3] = a;
+		}
+	}
+}
+
+static void from_YCoCg_row_scalar( const void *arguments, int row, void *scratch )
+{
+	const IH_pixels_args *args = (const IH_pixels_args*)arguments;
+	from_YCoCg_pixels( args->orig + (size_t)row * args->width * args->channels, args->width, args->channels );
+	(void)scratch;
+}
+
+#if IH_X86
+/********* SSE2 Row Kernels *********/
+static void IH_TARGET("sse2") IH_bytes_to_floats_sse2( const unsigned char *bytes, float *floats, int count )
+{
+	const __m128i zero = _mm_setzero_si128();
+	int i;
+	for( i = 0; i + 16 <= count; i += 16 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i*)(bytes + i) );
+		__m128i lo = _mm_unpacklo_epi8( v, zero ), hi = _mm_unpackhi_epi8( v, zero );
+		_mm_storeu_ps( floats + i + 0, _mm_cvtepi32_ps( _mm_unpacklo_epi16( lo, zero ) ) );
+		_mm_storeu_ps( floats + i + 4, _mm_cvtepi32_ps( _mm_unpackhi_epi16( lo, zero ) ) );
+		_mm_storeu_ps( floats + i + 8, _mm_cvtepi32_ps( _mm_unpacklo_epi16( hi, zero ) ) );
+		_mm_storeu_ps( floats + i + 12, _mm_cvtepi32_ps( _mm_unpackhi_epi16( hi, zero ) ) );
+	}
+	for( ; i < count; ++i )
+	{
+		floats[i] = bytes[i];
+	}
+}
+
+/*
+	Bilinear sampling of one output row.  The two source rows are
+	converted to floats once, then 4 output bytes at a time are
+	sampled with the same products as the scalar code, using the
+	horizontal offsets and weights from up_scale_image().
+*/
+static void IH_TARGET("sse2") up_scale_row_sse2( const void *arguments, int y, void *scratch )
+{
+	const IH_up_scale_args *args = (const IH_up_scale_args*)arguments;
+	int channels = args->channels;
+	int row_elements = args->width * channels;
+	int elements = args->resampled_width * channels;
+	const int *offset = args->offset;
+	const float *weight0 = args->weight0, *weight1 = args->weight1;
+	float *row0 = (float*)scratch, *row1 = row0 + row_elements;
+	const float *next0 = row0 + channels, *next1 = row1 + channels;
+	unsigned char *out = args->resampled + (size_t)y * elements;
+	float sampley = y * args->dy;
+	int inty = (int)sampley;
+	float wy0, wy1;
+	__m128 half, vy0, vy1;
+	int k;
+	if( NULL == scratch )
+	{
+		up_scale_row_scalar( arguments, y, NULL );
+		return;
+	}
+	if( inty > args->height - 2 ) { inty = args->height - 2; }
+	sampley -= inty;
+	wy0 = 1.0f-sampley;
+	wy1 = sampley;
+	IH_bytes_to_floats_sse2( args->orig + (size_t)inty * row_elements, row0, row_elements );
+	IH_bytes_to_floats_sse2( args->orig + (size_t)(inty+1) * row_elements, row1, row_elements );
+	half = _mm_set1_ps( 0.5f );
+	vy0 = _mm_set1_ps( wy0 );
+	vy1 = _mm_set1_ps( wy1 );
+	for( k = 0; k + 4 <= elements; k += 4 )
+	{
+		const int *o = offset + k;
+		__m128 w0 = _mm_loadu_ps( weight0 + k ), w1 = _mm_loadu_ps( weight1 + k );
+		__m128 value = half;
+		__m128i packed;
+		value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( _mm_setr_ps( row0[o[0]], row0[o[1]], row0[o[2]], row0[o[3]] ), w0 ), vy0 ) );
+		value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( _mm_setr_ps( next0[o[0]], next0[o[1]], next0[o[2]], next0[o[3]] ), w1 ), vy0 ) );
+		value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( _mm_setr_ps( row1[o[0]], row1[o[1]], row1[o[2]], row1[o[3]] ), w0 ), vy1 ) );
+		value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( _mm_setr_ps( next1[o[0]], next1[o[1]], next1[o[2]], next1[o[3]] ), w1 ), vy1 ) );
+		/*	truncate, like the cast of the scalar code	*/
+		packed = _mm_cvttps_epi32( value );
+		packed = _mm_packs_epi32( packed, packed );
+		packed = _mm_packus_epi16( packed, packed );
+		{
+			int bytes = _mm_cvtsi128_si32( packed );
+			memcpy( out + k, &bytes, 4 );
+		}
+	}
+	for( ; k < elements; ++k )
+	{
+		float value = 0.5f;
+		value += row0[offset[k]]*weight0[k]*wy0;
+		value += next0[offset[k]]*weight1[k]*wy0;
+		value += row1[offset[k]]*weight0[k]*wy1;
+		value += next1[offset[k]]*weight1[k]*wy1;
+		out[k] = (unsigned char)(value);
+	}
+}
+
+/*
+	Adds the horizontally neighbouring pixels of the vertical sums in
+	'a' and 'b' (8 sums each, i.e. whole pixel pairs for 1, 2 or 4
+	channels), returning the 8 sums of 2x2 blocks in order
+*/
+static __m128i IH_TARGET("sse2") IH_pair_sums_sse2( __m128i a, __m128i b, int channels )
+{
+	if( channels == 4 )
+	{
+		a = _mm_add_epi16( a, _mm_srli_si128( a, 8 ) );
+		b = _mm_add_epi16( b, _mm_srli_si128( b, 8 ) );
+		return _mm_unpacklo_epi64( a, b );
+	}
+	if( channels == 2 )
+	{
+		/*	the sums end up in the even 32 bit lanes	*/
+		a = _mm_add_epi16( a, _mm_srli_si128( a, 4 ) );
+		b = _mm_add_epi16( b, _mm_srli_si128( b, 4 ) );
+		a = _mm_shuffle_epi32( a, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+		b = _mm_shuffle_epi32( b, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+		return _mm_unpacklo_epi64( a, b );
+	}
+	/*	1 channel: the sums end up in the even 16 bit lanes	*/
+	a = _mm_and_si128( _mm_add_epi16( a, _mm_srli_epi32( a, 16 ) ), _mm_set1_epi32( 0xFFFF ) );
+	b = _mm_and_si128( _mm_add_epi16( b, _mm_srli_epi32( b, 16 ) ), _mm_set1_epi32( 0xFFFF ) );
+	return _mm_packs_epi32( a, b );
+}
+
+/*
+	2x2 box filter of one output row: the two source rows are summed
+	into 16 bit values, then neighbouring pixels of those are summed
+	and rounded.  3 channel pixels don't split evenly into vectors, so
+	their second step is scalar.
+*/
+static void IH_TARGET("sse2") mipmap_row_sse2( const void *arguments, int j, void *scratch )
+{
+	const IH_mipmap_args *args = (const IH_mipmap_args*)arguments;
+	int channels = args->channels;
+	const unsigned char *top = args->orig + (size_t)(2*j) * args->width * channels;
+	const unsigned char *bottom = top + args->width * channels;
+	unsigned char *out = args->resampled + (size_t)j * args->mip_width * channels;
+	unsigned short *sums = (unsigned short*)scratch;
+	int count = 2 * args->mip_width * channels;
+	const __m128i zero = _mm_setzero_si128();
+	int k, c;
+	if( NULL == scratch )
+	{
+		mipmap_row_scalar( arguments, j, NULL );
+		return;
+	}
+	for( k = 0; k + 16 <= count; k += 16 )
+	{
+		__m128i a = _mm_loadu_si128( (const __m128i*)(top + k) );
+		__m128i b = _mm_loadu_si128( (const __m128i*)(bottom + k) );
+		_mm_storeu_si128( (__m128i*)(sums + k), _mm_add_epi16( _mm_unpacklo_epi8( a, zero ), _mm_unpacklo_epi8( b, zero ) ) );
+		_mm_storeu_si128( (__m128i*)(sums + k + 8), _mm_add_epi16( _mm_unpackhi_epi8( a, zero ), _mm_unpackhi_epi8( b, zero ) ) );
+	}
+	for( ; k < count; ++k )
+	{
+		sums[k] = (unsigned short)(top[k] + bottom[k]);
+	}
+	k = 0;
+	if( channels != 3 )
+	{
+		const __m128i rounding = _mm_set1_epi16( 2 );
+		for( ; k + 16 <= count; k += 16 )
+		{
+			__m128i block = IH_pair_sums_sse2(
+					_mm_loadu_si128( (const __m128i*)(sums + k) ),
+					_mm_loadu_si128( (const __m128i*)(sums + k + 8) ), channels );
+			block = _mm_srli_epi16( _mm_add_epi16( block, rounding ), 2 );
+			_mm_storel_epi64( (__m128i*)(out + (k >> 1)), _mm_packus_epi16( block, block ) );
+		}
+	}
+	for( ; k < count; k += 2*channels )
+	{
+		for( c = 0; c < channels; ++c )
+		{
+			out[(k >> 1) + c] = (unsigned char)((sums[k+c] + sums[k+channels+c] + 2) >> 2);
+		}
+	}
+}
+
+/*	the scaling table of scale_image_RGB_to_NTSC_safe() as (i*1767 + 31731) >> 11,
+	for 8 bytes widened to 16 bits	*/
+static __m128i IH_TARGET("sse2") IH_NTSC_scale_sse2( __m128i v )
+{
+	const __m128i one = _mm_set1_epi16( 1 );
+	const __m128i factors = _mm_set1_epi32( 1767 | (31731 << 16) );
+	__m128i lo = _mm_madd_epi16( _mm_unpacklo_epi16( v, one ), factors );
+	__m128i hi = _mm_madd_epi16( _mm_unpackhi_epi16( v, one ), factors );
+	return _mm_packs_epi32( _mm_srli_epi32( lo, 11 ), _mm_srli_epi32( hi, 11 ) );
+}
+
+/*	which bytes of a row get scaled: all but alpha, 16 at a time	*/
+static int IH_NTSC_mask( int channels )
+{
+	if( channels == 2 )
+	{
+		return 0x00FF00FF;
+	}
+	if( channels == 4 )
+	{
+		return 0x00FFFFFF;
+	}
+	return -1;
+}
+
+static void IH_TARGET("sse2") NTSC_row_sse2( const void *arguments, int row, void *scratch )
+{
+	const IH_pixels_args *args = (const IH_pixels_args*)arguments;
+	int row_bytes = args->width * args->channels;
+	unsigned char *pixels = args->orig + (size_t)row * row_bytes;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i scaled = _mm_set1_epi32( IH_NTSC_mask( args->channels ) );
+	int i;
+	if( !args->exact )
+	{
+		NTSC_row_scalar( arguments, row, scratch );
+		return;
+	}
+	for( i = 0; i + 16 <= row_bytes; i += 16 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i*)(pixels + i) );
+		__m128i result = _mm_packus_epi16(
+				IH_NTSC_scale_sse2( _mm_unpacklo_epi8( v, zero ) ),
+				IH_NTSC_scale_sse2( _mm_unpackhi_epi8( v, zero ) ) );
+		result = _mm_or_si128( _mm_and_si128( scaled, result ), _mm_andnot_si128( scaled, v ) );
+		_mm_storeu_si128( (__m128i*)(pixels + i), result );
+	}
+	NTSC_tail( args, pixels, i, row_bytes );
+	(void)scratch;
+}
+
+/*
+	The YCoCg conversions work on 4 pixels at a time, each in a 32 bit
+	lane with its channels in the low bytes.  3 channel pixels are
+	loaded 4 bytes at a time (the 4th byte is ignored), so a row keeps
+	a few pixels for the scalar code to make sure nothing is read past
+	its end.
+*/
+static __m128i IH_TARGET("sse2") IH_load_RGB_sse2( const unsigned char *pixels )
+{
+	int p[4];
+	memcpy( &p[0], pixels + 0, 4 );
+	memcpy( &p[1], pixels + 3, 4 );
+	memcpy( &p[2], pixels + 6, 4 );
+	memcpy( &p[3], pixels + 9, 4 );
+	return _mm_setr_epi32( p[0], p[1], p[2], p[3] );
+}
+
+static void IH_TARGET("sse2") IH_store_RGB_sse2( unsigned char *pixels, __m128i v )
+{
+	int i;
+	for( i = 0; i < 4; ++i )
+	{
+		int p = _mm_cvtsi128_si32( v );
+		memcpy( pixels + 3*i, &p, 3 );
+		v = _mm_srli_si128( v, 4 );
+	}
+}
+
+static __m128i IH_TARGET("sse2") IH_to_YCoCg_sse2( __m128i v, int channels )
+{
+	const __m128i byte = _mm_set1_epi32( 0xFF );
+	const __m128i one = _mm_set1_epi32( 1 );
+	const __m128i two = _mm_set1_epi32( 2 );
+	const __m128i middle = _mm_set1_epi32( 128 );
+	const __m128i top = _mm_set1_epi32( 255 );
+	__m128i r = _mm_and_si128( v, byte );
+	__m128i g = _mm_and_si128( _mm_srli_epi32( v, 8 ), byte );
+	__m128i b = _mm_and_si128( _mm_srli_epi32( v, 16 ), byte );
+	__m128i tmp, co, y, cg;
+	g = _mm_srli_epi32( _mm_add_epi32( g, one ), 1 );
+	tmp = _mm_srli_epi32( _mm_add_epi32( two, _mm_add_epi32( r, b ) ), 2 );
+	co = _mm_add_epi32( middle, _mm_srai_epi32( _mm_add_epi32( _mm_sub_epi32( r, b ), one ), 1 ) );
+	y = _mm_add_epi32( g, tmp );
+	cg = _mm_sub_epi32( _mm_add_epi32( middle, g ), tmp );
+	/*	all three are in [0,256], so only the top needs clamping, and
+		with the upper halves of the lanes 0 a 16 bit min does that	*/
+	co = _mm_min_epi16( co, top );
+	y = _mm_min_epi16( y, top );
+	cg = _mm_min_epi16( cg, top );
+	if( channels == 3 )
+	{
+		/*	CoYCg	*/
+		return _mm_or_si128( co, _mm_or_si128( _mm_slli_epi32( y, 8 ), _mm_slli_epi32( cg, 16 ) ) );
+	}
+	/*	CoCgAY	*/
+	return _mm_or_si128( _mm_or_si128( co, _mm_slli_epi32( cg, 8 ) ),
+			_mm_or_si128( _mm_slli_epi32( _mm_srli_epi32( v, 24 ), 16 ), _mm_slli_epi32( y, 24 ) ) );
+}
+
+static __m128i IH_TARGET("sse2") IH_from_YCoCg_sse2( __m128i v, int channels )
+{
+	const __m128i byte = _mm_set1_epi32( 0xFF );
+	const __m128i middle = _mm_set1_epi32( 128 );
+	const __m128i top = _mm_set1_epi32( 255 );
+	const __m128i zero = _mm_setzero_si128();
+	__m128i co = _mm_sub_epi32( _mm_and_si128( v, byte ), middle );
+	__m128i y, cg, r, g, b, rgb;
+	if( channels == 3 )
+	{
+		y = _mm_and_si128( _mm_srli_epi32( v, 8 ), byte );
+		cg = _mm_sub_epi32( _mm_and_si128( _mm_srli_epi32( v, 16 ), byte ), middle );
+	} else
+	{
+		cg = _mm_sub_epi32( _mm_and_si128( _mm_srli_epi32( v, 8 ), byte ), middle );
+		y = _mm_srli_epi32( v, 24 );
+	}
+	r = _mm_sub_epi32( _mm_add_epi32( y, co ), cg );
+	g = _mm_add_epi32( y, cg );
+	b = _mm_sub_epi32( _mm_sub_epi32( y, co ), cg );
+	/*	all three are in [-255,510], where the 16 bit halves of a lane
+		have the sign of the lane, so 16 bit max and min clamp them	*/
+	r = _mm_min_epi16( _mm_max_epi16( r, zero ), top );
+	g = _mm_min_epi16( _mm_max_epi16( g, zero ), top );
+	b = _mm_min_epi16( _mm_max_epi16( b, zero ), top );
+	rgb = _mm_or_si128( r, _mm_or_si128( _mm_slli_epi32( g, 8 ), _mm_slli_epi32( b, 16 ) ) );
+	if( channels == 3 )
+	{
+		return rgb;
+	}
+	/*	alpha moves from the 3rd byte to the 4th	*/
+	return _mm_or_si128( rgb, _mm_slli_epi32( _mm_srli_epi32( _mm_slli_epi32( v, 8 ), 24 ), 24 ) );
+}
+
+static void IH_TARGET("sse2") to_YCoCg_row_sse2( const void *arguments, int row, void *scratch )
+{
+	const IH_pixels_args *args = (const IH_pixels_args*)arguments;
+	int width = args->width, channels = args->channels;
+	unsigned char *pixels = args->orig + (size_t)row * width * channels;
+	int p = 0;
+	if( channels == 4 )
+	{
+		for( ; p + 4 <= width; p += 4 )
+		{
+			__m128i *at = (__m128i*)(pixels + 4*p);
+			_mm_storeu_si128( at, IH_to_YCoCg_sse2( _mm_loadu_si128( at ), 4 ) );
+		}
+	} else
+	{
+		for( ; p + 5 <= width; p += 4 )
+		{
+			IH_store_RGB_sse2( pixels + 3*p, IH_to_YCoCg_sse2( IH_load_RGB_sse2( pixels + 3*p ), 3 ) );
+		}
+	}
+	to_YCoCg_pixels( pixels + p*channels, width - p, channels );
+	(void)scratch;
+}
+
+static void IH_TARGET("sse2") from_YCoCg_row_sse2( const void *arguments, int row, void *scratch )
+{
+	const IH_pixels_args *args = (const IH_pixels_args*)arguments;
+	int width = args->width, channels = args->channels;
+	unsigned char *pixels = args->orig + (size_t)row * width * channels;
+	int p = 0;
+	if( channels == 4 )
+	{
+		for( ; p + 4 <= width; p += 4 )
+		{
+			__m128i *at = (__m128i*)(pixels + 4*p);
+			_mm_storeu_si128( at, IH_from_YCoCg_sse2( _mm_loadu_si128( at ), 4 ) );
+		}
+	} else
+	{
+		for( ; p + 5 <= width; p += 4 )
+		{
+			IH_store_RGB_sse2( pixels + 3*p, IH_from_YCoCg_sse2( IH_load_RGB_sse2( pixels + 3*p ), 3 ) );
+		}
+	}
+	from_YCoCg_pixels( pixels + p*channels, width - p, channels );
+	(void)scratch;
+}
+
+/********* AVX2 Row Kernels *********/
+/*
+	The same as the SSE2 kernels, twice as wide.  Gathers replace the
+	scalar loads of the up scaling, and 3 channel pixels are shuffled
+	in and out of their 32 bit lanes.
+*/
+static void IH_TARGET("avx2") IH_bytes_to_floats_avx2( const unsigned char *bytes, float *floats, int count )
+{
+	int i;
+	for( i = 0; i + 8 <= count; i += 8 )
+	{
+		__m256i v = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)(bytes + i) ) );
+		_mm256_storeu_ps( floats + i, _mm256_cvtepi32_ps( v ) );
+	}
+	for( ; i < count; ++i )
+	{
+		floats[i] = bytes[i];
+	}
+}
+
+/*	8 32 bit lanes to 8 saturated bytes	*/
+static __m128i IH_TARGET("avx2") IH_pack_bytes_avx2( __m256i v )
+{
+	__m128i words = _mm_packs_epi32( _mm256_castsi256_si128( v ), _mm256_extracti128_si256( v, 1 ) );
+	return _mm_packus_epi16( words, words );
+}
+
+static void IH_TARGET("avx2") up_scale_row_avx2( const void *arguments, int y, void *scratch )
+{
+	const IH_up_scale_args *args = (const IH_up_scale_args*)arguments;
+	int channels = args->channels;
+	int row_elements = args->width * channels;
+	int elements = args->resampled_width * channels;
+	const int *offset = args->offset;
+	const float *weight0 = args->weight0, *weight1 = args->weight1;
+	float *row0 = (float*)scratch, *row1 = row0 + row_elements;
+	const float *next0 = row0 + channels, *next1 = row1 + channels;
+	unsigned char *out = args->resampled + (size_t)y * elements;
+	float sampley = y * args->dy;
+	int inty = (int)sampley;
+	float wy0, wy1;
+	__m256 half, vy0, vy1;
+	int k;
+	if( NULL == scratch )
+	{
+		up_scale_row_scalar( arguments, y, NULL );
+		return;
+	}
+	if( inty > args->height - 2 ) { inty = args->height - 2; }
+	sampley -= inty;
+	wy0 = 1.0f-sampley;
+	wy1 = sampley;
+	IH_bytes_to_floats_avx2( args->orig + (size_t)inty * row_elements, row0, row_elements );
+	IH_bytes_to_floats_avx2( args->orig + (size_t)(inty+1) * row_elements, row1, row_elements );
+	half = _mm256_set1_ps( 0.5f );
+	vy0 = _mm256_set1_ps( wy0 );
+	vy1 = _mm256_set1_ps( wy1 );
+	for( k = 0; k + 8 <= elements; k += 8 )
+	{
+		__m256i o = _mm256_loadu_si256( (const __m256i*)(offset + k) );
+		__m256 w0 = _mm256_loadu_ps( weight0 + k ), w1 = _mm256_loadu_ps( weight1 + k );
+		__m256 value = half;
+		value = _mm256_add_ps( value, _mm256_mul_ps( _mm256_mul_ps( _mm256_i32gather_ps( row0, o, 4 ), w0 ), vy0 ) );
+		value = _mm256_add_ps( value, _mm256_mul_ps( _mm256_mul_ps( _mm256_i32gather_ps( next0, o, 4 ), w1 ), vy0 ) );
+		value = _mm256_add_ps( value, _mm256_mul_ps( _mm256_mul_ps( _mm256_i32gather_ps( row1, o, 4 ), w0 ), vy1 ) );
+		value = _mm256_add_ps( value, _mm256_mul_ps( _mm256_mul_ps( _mm256_i32gather_ps( next1, o, 4 ), w1 ), vy1 ) );
+		_mm_storel_epi64( (__m128i*)(out + k), IH_pack_bytes_avx2( _mm256_cvttps_epi32( value ) ) );
+	}
+	for( ; k < elements; ++k )
+	{
+		float value = 0.5f;
+		value += row0[offset[k]]*weight0[k]*wy0;
+		value += next0[offset[k]]*weight1[k]*wy0;
+		value += row1[offset[k]]*weight0[k]*wy1;
+		value += next1[offset[k]]*weight1[k]*wy1;
+		out[k] = (unsigned char)(value);
+	}
+}
+
+/*	as IH_pair_sums_sse2(), for 16 sums in each of 'a' and 'b'	*/
+static __m256i IH_TARGET("avx2") IH_pair_sums_avx2( __m256i a, __m256i b, int channels )
+{
+	__m256i sums;
+	if( channels == 4 )
+	{
+		a = _mm256_add_epi16( a, _mm256_srli_si256( a, 8 ) );
+		b = _mm256_add_epi16( b, _mm256_srli_si256( b, 8 ) );
+		sums = _mm256_unpacklo_epi64( a, b );
+	} else if( channels == 2 )
+	{
+		a = _mm256_add_epi16( a, _mm256_srli_si256( a, 4 ) );
+		b = _mm256_add_epi16( b, _mm256_srli_si256( b, 4 ) );
+		a = _mm256_shuffle_epi32( a, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+		b = _mm256_shuffle_epi32( b, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+		sums = _mm256_unpacklo_epi64( a, b );
+	} else
+	{
+		a = _mm256_and_si256( _mm256_add_epi16( a, _mm256_srli_epi32( a, 16 ) ), _mm256_set1_epi32( 0xFFFF ) );
+		b = _mm256_and_si256( _mm256_add_epi16( b, _mm256_srli_epi32( b, 16 ) ), _mm256_set1_epi32( 0xFFFF ) );
+		sums = _mm256_packs_epi32( a, b );
+	}
+	/*	the steps above work within 128 bit lanes, which leaves the
+		quarters in the order a0 b0 a1 b1	*/
+	return _mm256_permute4x64_epi64( sums, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+}
+
+static void IH_TARGET("avx2") mipmap_row_avx2( const void *arguments, int j, void *scratch )
+{
+	const IH_mipmap_args *args = (const IH_mipmap_args*)arguments;
+	int channels = args->channels;
+	const unsigned char *top = args->orig + (size_t)(2*j) * args->width * channels;
+	const unsigned char *bottom = top + args->width * channels;
+	unsigned char *out = args->resampled + (size_t)j * args->mip_width * channels;
+	unsigned short *sums = (unsigned short*)scratch;
+	int count = 2 * args->mip_width * channels;
+	int k, c;
+	if( NULL == scratch )
+	{
+		mipmap_row_scalar( arguments, j, NULL );
+		return;
+	}
+	for( k = 0; k + 16 <= count; k += 16 )
+	{
+		__m256i a = _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i*)(top + k) ) );
+		__m256i b = _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i*)(bottom + k) ) );
+		_mm256_storeu_si256( (__m256i*)(sums + k), _mm256_add_epi16( a, b ) );
+	}
+	for( ; k < count; ++k )
+	{
+		sums[k] = (unsigned short)(top[k] + bottom[k]);
+	}
+	k = 0;
+	if( channels == 3 )
+	{
+		/*	adding the sums 3 further on gives every pixel pair's sum in
+			the bytes at 0,1,2 of each 6; 24 sums make 12 output bytes	*/
+		static const signed char first[16] = { 0, 1, 2, 6, 7, 8, 12, 13, 14, -1, -1, -1, -1, -1, -1, -1 };
+		static const signed char second[16] = { -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 3, 4, -1, -1, -1, -1 };
+		const __m128i rounding = _mm_set1_epi16( 2 );
+		const __m128i first_mask = _mm_loadu_si128( (const __m128i*)first );
+		const __m128i second_mask = _mm_loadu_si128( (const __m128i*)second );
+		for( ; k + 32 <= count; k += 24 )
+		{
+			__m128i s[3], bytes;
+			int i, tail;
+			for( i = 0; i < 3; ++i )
+			{
+				s[i] = _mm_add_epi16( _mm_loadu_si128( (const __m128i*)(sums + k + 8*i) ),
+						_mm_loadu_si128( (const __m128i*)(sums + k + 8*i + 3) ) );
+				s[i] = _mm_srli_epi16( _mm_add_epi16( s[i], rounding ), 2 );
+			}
+			bytes = _mm_or_si128(
+					_mm_shuffle_epi8( _mm_packus_epi16( s[0], s[1] ), first_mask ),
+					_mm_shuffle_epi8( _mm_packus_epi16( s[2], s[2] ), second_mask ) );
+			_mm_storel_epi64( (__m128i*)(out + (k >> 1)), bytes );
+			tail = _mm_cvtsi128_si32( _mm_srli_si128( bytes, 8 ) );
+			memcpy( out + (k >> 1) + 8, &tail, 4 );
+		}
+	} else
+	{
+		const __m256i rounding = _mm256_set1_epi16( 2 );
+		for( ; k + 32 <= count; k += 32 )
+		{
+			__m256i block = IH_pair_sums_avx2(
+					_mm256_loadu_si256( (const __m256i*)(sums + k) ),
+					_mm256_loadu_si256( (const __m256i*)(sums + k + 16) ), channels );
+			block = _mm256_srli_epi16( _mm256_add_epi16( block, rounding ), 2 );
+			_mm_storeu_si128( (__m128i*)(out + (k >> 1)),
+					_mm_packus_epi16( _mm256_castsi256_si128( block ), _mm256_extracti128_si256( block, 1 ) ) );
+		}
+	}
+	for( ; k < count; k += 2*channels )
+	{
+		for( c = 0; c < channels; ++c )
+		{
+			out[(k >> 1) + c] = (unsigned char)((sums[k+c] + sums[k+channels+c] + 2) >> 2);
+		}
+	}
+}
+
+static __m256i IH_TARGET("avx2") IH_NTSC_scale_avx2( __m256i v )
+{
+	const __m256i one = _mm256_set1_epi16( 1 );
+	const __m256i factors = _mm256_set1_epi32( 1767 | (31731 << 16) );
+	__m256i lo = _mm256_madd_epi16( _mm256_unpacklo_epi16( v, one ), factors );
+	__m256i hi = _mm256_madd_epi16( _mm256_unpackhi_epi16( v, one ), factors );
+	return _mm256_packs_epi32( _mm256_srli_epi32( lo, 11 ), _mm256_srli_epi32( hi, 11 ) );
+}
+
+static void IH_TARGET("avx2") NTSC_row_avx2( const void *arguments, int row, void *scratch )
+{
+	const IH_pixels_args *args = (const IH_pixels_args*)arguments;
+	int row_bytes = args->width * args->channels;
+	unsigned char *pixels = args->orig + (size_t)row * row_bytes;
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i scaled = _mm256_set1_epi32( IH_NTSC_mask( args->channels ) );
+	int i;
+	if( !args->exact )
+	{
+		NTSC_row_scalar( arguments, row, scratch );
+		return;
+	}
+	for( i = 0; i + 32 <= row_bytes; i += 32 )
+	{
+		/*	unpacking and packing within 128 bit lanes keeps the order	*/
+		__m256i v = _mm256_loadu_si256( (const __m256i*)(pixels + i) );
+		__m256i result = _mm256_packus_epi16(
+				IH_NTSC_scale_avx2( _mm256_unpacklo_epi8( v, zero ) ),
+				IH_NTSC_scale_avx2( _mm256_unpackhi_epi8( v, zero ) ) );
+		result = _mm256_or_si256( _mm256_and_si256( scaled, result ), _mm256_andnot_si256( scaled, v ) );
+		_mm256_storeu_si256( (__m256i*)(pixels + i), result );
+	}
+	NTSC_tail( args, pixels, i, row_bytes );
+	(void)scratch;
+}
+
+/*	8 3 channel pixels in (reads 4 bytes past them) and out	*/
+static const signed char IH_RGB_masks[2][16] =
+{
+	{ 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 },
+	{ 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1 }
+};
+
+static __m256i IH_TARGET("avx2") IH_load_RGB_avx2( const unsigned char *pixels )
+{
+	const __m128i spread = _mm_loadu_si128( (const __m128i*)IH_RGB_masks[0] );
+	__m128i lo = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*)pixels ), spread );
+	__m128i hi = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*)(pixels + 12) ), spread );
+	return _mm256_inserti128_si256( _mm256_castsi128_si256( lo ), hi, 1 );
+}
+
+static void IH_TARGET("avx2") IH_store_RGB_avx2( unsigned char *pixels, __m256i v )
+{
+	const __m256i gather = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)IH_RGB_masks[1] ) );
+	__m128i lo, hi;
+	int tail;
+	v = _mm256_shuffle_epi8( v, gather );
+	lo = _mm256_castsi256_si128( v );
+	hi = _mm256_extracti128_si256( v, 1 );
+	_mm_storel_epi64( (__m128i*)pixels, lo );
+	tail = _mm_cvtsi128_si32( _mm_srli_si128( lo, 8 ) );
+	memcpy( pixels + 8, &tail, 4 );
+	_mm_storel_epi64( (__m128i*)(pixels + 12), hi );
+	tail = _mm_cvtsi128_si32( _mm_srli_si128( hi, 8 ) );
+	memcpy( pixels + 20, &tail, 4 );
+}
+
+static __m256i IH_TARGET("avx2") IH_to_YCoCg_avx2( __m256i v, int channels )
+{
+	const __m256i byte = _mm256_set1_epi32( 0xFF );
+	const __m256i one = _mm256_set1_epi32( 1 );
+	const __m256i two = _mm256_set1_epi32( 2 );
+	const __m256i middle = _mm256_set1_epi32( 128 );
+	const __m256i top = _mm256_set1_epi32( 255 );
+	__m256i r = _mm256_and_si256( v, byte );
+	__m256i g = _mm256_and_si256( _mm256_srli_epi32( v, 8 ), byte );
+	__m256i b = _mm256_and_si256( _mm256_srli_epi32( v, 16 ), byte );
+	__m256i tmp, co, y, cg;
+	g = _mm256_srli_epi32( _mm256_add_epi32( g, one ), 1 );
+	tmp = _mm256_srli_epi32( _mm256_add_epi32( two, _mm256_add_epi32( r, b ) ), 2 );
+	co = _mm256_add_epi32( middle, _mm256_srai_epi32( _mm256_add_epi32( _mm256_sub_epi32( r, b ), one ), 1 ) );
+	y = _mm256_add_epi32( g, tmp );
+	cg = _mm256_sub_epi32( _mm256_add_epi32( middle, g ), tmp );
+	co = _mm256_min_epi32( co, top );
+	y = _mm256_min_epi32( y, top );
+	cg = _mm256_min_epi32( cg, top );
+	if( channels == 3 )
+	{
+		return _mm256_or_si256( co, _mm256_or_si256( _mm256_slli_epi32( y, 8 ), _mm256_slli_epi32( cg, 16 ) ) );
+	}
+	return _mm256_or_si256( _mm256_or_si256( co, _mm256_slli_epi32( cg, 8 ) ),
+			_mm256_or_si256( _mm256_slli_epi32( _mm256_srli_epi32( v, 24 ), 16 ), _mm256_slli_epi32( y, 24 ) ) );
+}
+
+static __m256i IH_TARGET("avx2") IH_from_YCoCg_avx2( __m256i v, int channels )
+{
+	const __m256i byte = _mm256_set1_epi32( 0xFF );
+	const __m256i middle = _mm256_set1_epi32( 128 );
+	const __m256i top = _mm256_set1_epi32( 255 );
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i co = _mm256_sub_epi32( _mm256_and_si256( v, byte ), middle );
+	__m256i y, cg, r, g, b, rgb;
+	if( channels == 3 )
+	{
+		y = _mm256_and_si256( _mm256_srli_epi32( v, 8 ), byte );
+		cg = _mm256_sub_epi32( _mm256_and_si256( _mm256_srli_epi32( v, 16 ), byte ), middle );
+	} else
+	{
+		cg = _mm256_sub_epi32( _mm256_and_si256( _mm256_srli_epi32( v, 8 ), byte ), middle );
+		y = _mm256_srli_epi32( v, 24 );
+	}
+	r = _mm256_sub_epi32( _mm256_add_epi32( y, co ), cg );
+	g = _mm256_add_epi32( y, cg );
+	b = _mm256_sub_epi32( _mm256_sub_epi32( y, co ), cg );
+	r = _mm256_min_epi32( _mm256_max_epi32( r, zero ), top );
+	g = _mm256_min_epi32( _mm256_max_epi32( g, zero ), top );
+	b = _mm256_min_epi32( _mm256_max_epi32( b, zero ), top );
+	rgb = _mm256_or_si256( r, _mm256_or_si256( _mm256_slli_epi32( g, 8 ), _mm256_slli_epi32( b, 16 ) ) );
+	if( channels == 3 )
+	{
+		return rgb;
+	}
+	return _mm256_or_si256( rgb, _mm256_slli_epi32( _mm256_srli_epi32( _mm256_slli_epi32( v, 8 ), 24 ), 24 ) );
+}
+
+static void IH_TARGET("avx2") to_YCoCg_row_avx2( const void *arguments, int row, void *scratch )
+{
+	const IH_pixels_args *args = (const IH_pixels_args*)arguments;
+	int width = args->width, channels = args->channels;
+	unsigned char *pixels = args->orig + (size_t)row * width * channels;
+	int p = 0;
+	if( channels == 4 )
+	{
+		for( ; p + 8 <= width; p += 8 )
+		{
+			__m256i *at = (__m256i*)(pixels + 4*p);
+			_mm256_storeu_si256( at, IH_to_YCoCg_avx2( _mm256_loadu_si256( at ), 4 ) );
+		}
+	} else
+	{
+		for( ; p + 10 <= width; p += 8 )
+		{
+			IH_store_RGB_avx2( pixels + 3*p, IH_to_YCoCg_avx2( IH_load_RGB_avx2( pixels + 3*p ), 3 ) );
+		}
+	}
+	to_YCoCg_pixels( pixels + p*channels, width - p, channels );
+	(void)scratch;
+}
+
+static void IH_TARGET("avx2") from_YCoCg_row_avx2( const void *arguments, int row, void *scratch )
+{
+	const IH_pixels_args *args = (const IH_pixels_args*)arguments;
+	int width = args->width, channels = args->channels;
+	unsigned char *pixels = args->orig + (size_t)row * width * channels;
+	int p = 0;
+	if( channels == 4 )
+	{
+		for( ; p + 8 <= width; p += 8 )
+		{
+			__m256i *at = (__m256i*)(pixels + 4*p);
+			_mm256_storeu_si256( at, IH_from_YCoCg_avx2( _mm256_loadu_si256( at ), 4 ) );
+		}
+	} else
+	{
+		for( ; p + 10 <= width; p += 8 )
+		{
+			IH_store_RGB_avx2( pixels + 3*p, IH_from_YCoCg_avx2( IH_load_RGB_avx2( pixels + 3*p ), 3 ) );
+		}
+	}
+	from_YCoCg_pixels( pixels + p*channels, width - p, channels );
+	(void)scratch;
+}
+#endif
+
+/*	the widest kernels the CPU (and OS) can run	*/
+static int IH_cpu_mode( void )
+{
+#if IH_X86 && defined(_MSC_VER)
+	int info[4];
+	int max_leaf;
+	__cpuid( info, 0 );
+	max_leaf = info[0];
+	__cpuid( info, 1 );
+	if( max_leaf >= 7 && (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+		((_xgetbv( 0 ) & 6) == 6) )
+	{
+		/*	AVX enabled by the OS, now check for AVX2	*/
+		int leaf7[4];
+		__cpuidex( leaf7, 7, 0 );
+		if( leaf7[1] & (1 << 5) )
+		{
+			return IMAGE_HELPER_MODE_AVX2;
+		}
+	}
+	if( info[3] & (1 << 26) )
+	{
+		return IMAGE_HELPER_MODE_SSE2;
+	}
+#elif IH_X86
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports( "avx2" ) )
+	{
+		return IMAGE_HELPER_MODE_AVX2;
+	}
+	if( __builtin_cpu_supports( "sse2" ) )
+	{
+		return IMAGE_HELPER_MODE_SSE2;
+	}
+#endif
+	return IMAGE_HELPER_MODE_SCALAR;
+}
@@ -108,6 +108,39 @@ int
 		int rescale_to_max
 	);
 
+/**
+	Modes of the resampling and colour space functions above
+	(up_scale_image, mipmap_image, scale_image_RGB_to_NTSC_safe and
+	the YCoCg conversions).  All of them produce bit-identical output;
+	they only differ in speed.
+**/
+#define IMAGE_HELPER_MODE_AUTO		0	/* widest SIMD kernels the CPU runs, on all threads */
+#define IMAGE_HELPER_MODE_REFERENCE	1	/* the original scalar code, on the calling thread only */
+#define IMAGE_HELPER_MODE_SCALAR	2	/* scalar kernels, on all threads */
+#define IMAGE_HELPER_MODE_SSE2		3	/* SSE2 kernels, on all threads */
+#define IMAGE_HELPER_MODE_AVX2		4	/* AVX2 kernels, on all threads */
+
+/**
+	Selects the mode.  A SIMD mode the CPU can't run falls back
+	to the next narrower one.
+	\return the mode actually used
+**/
+int
+	image_helper_set_mode
+	(
+		int mode
+	);
+
+/**
+	Sets how many threads share the rows of large images
+	(0, the default, uses one per hardware thread).
+**/
+void
+	image_helper_set_thread_count
+	(
+		int count
+	);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,144 @@
+#ifndef ANIMATED_BATCH_H
+#define ANIMATED_BATCH_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/shader_m.h>
+
+#include <cstddef>
+#include <vector>
+
+// Motion paths understood by the animated vertex shader. The motion is always applied in world space,
+// in front of the instance's base transform: model = motion(time) * base.
+enum Animation_Path {
+    ANIM_BOB    = 0, // translate by amplitude * sin(frequency * time + phase)
+    ANIM_ORBIT  = 1, // translate around a circle in the XZ plane, radii taken from amplitude.x and amplitude.z
+    ANIM_SWAY   = 2  // rotate about the amplitude axis by length(amplitude) * sin(...) degrees
+};
+
+// Per-instance data streamed to the animated vertex shader. The layout matches the instance attributes
+// configured in AnimatedBatch::setupInstanceAttributes().
+struct AnimatedInstance {
+    // static part of the transformation
+    glm::mat4 Base;
+    // xyz: amplitude, w: frequency
+    glm::vec4 Motion;
+    // x: phase, y: path
+    glm::vec2 Params;
+
+    AnimatedInstance(const glm::mat4 &base, Animation_Path path, const glm::vec3 &amplitude, float frequency, float phase = 0.0f)
+        : Base(base), Motion(amplitude, frequency), Params(phase, (float)path)
+    {
+    }
+};
+
+// A set of animated boxes that all share the same diffuse/specular pair. The instances are uploaded
+// once and all motion is evaluated on the GPU from the 'time' uniform, so drawing a batch costs a texture
+// bind and one instanced draw call no matter how many props it holds.
+class AnimatedBatch
+{
+public:
+    unsigned int diffuse;
+    unsigned int specular;
+    std::vector<AnimatedInstance> instances;
+
+    AnimatedBatch(unsigned int diff, unsigned int spec) : diffuse(diff), specular(spec), VAO(0), instanceVBO(0), uploadedCount(0), dirty(true)
+    {
+    }
+
+    void add(const AnimatedInstance &instance)
+    {
+        instances.push_back(instance);
+        dirty = true;
+    }
+
+    void clear()
+    {
+        instances.clear();
+        dirty = true;
+    }
+
+    // creates the batch's VAO on top of an existing box VBO (position, normal, texture coords; 8 floats per vertex)
+    void setup(unsigned int boxVBO)
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &instanceVBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+
+        setupInstanceAttributes();
+        glBindVertexArray(0);
+    }
+
+    // draws every instance of the batch with a single call. The shader must be the animated shader and
+    // already be in use with its 'time' uniform set.
+    void Draw()
+    {
+        if(instances.empty())
+            return;
+
+        if(dirty)
+            upload();
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, diffuse);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, specular);
+
+        glBindVertexArray(VAO);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 36, uploadedCount);
+        glBindVertexArray(0);
+    }
+
+    void destroy()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &instanceVBO);
+    }
+
+private:
+    unsigned int VAO, instanceVBO;
+    GLsizei uploadedCount;
+    bool dirty;
+
+    // the instance buffer only changes when props are added or removed, never per frame
+    void upload()
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(AnimatedInstance), &instances[0], GL_STATIC_DRAW);
+        uploadedCount = (GLsizei)instances.size();
+        dirty = false;
+    }
+
+    void setupInstanceAttributes()
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+
+        // base transformation: a mat4 occupies four consecutive vec4 attribute slots
+        for(unsigned int i = 0; i < 4; i++)
+        {
+            glEnableVertexAttribArray(3 + i);
+            glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(AnimatedInstance), (void*)(offsetof(AnimatedInstance, Base) + i * sizeof(glm::vec4)));
+            glVertexAttribDivisor(3 + i, 1);
+        }
+        // amplitude + frequency
+        glEnableVertexAttribArray(7);
+        glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(AnimatedInstance), (void*)offsetof(AnimatedInstance, Motion));
+        glVertexAttribDivisor(7, 1);
+        // phase + path
+        glEnableVertexAttribArray(8);
+        glVertexAttribPointer(8, 2, GL_FLOAT, GL_FALSE, sizeof(AnimatedInstance), (void*)offsetof(AnimatedInstance, Params));
+        glVertexAttribDivisor(8, 1);
+    }
+};
+#endif
@@ -0,0 +1,325 @@
+#ifndef CLUSTERED_LIGHTS_H
+#define CLUSTERED_LIGHTS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader_m.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A point light with a hard range: it adds nothing beyond 'radius', which is what lets it be binned.
+struct PointLight {
+    glm::vec3 position;
+    float radius;
+    glm::vec3 colour;
+
+    PointLight(const glm::vec3 &position, float radius, const glm::vec3 &colour)
+        : position(position), radius(radius), colour(colour)
+    {
+    }
+};
+
+// Clustered forward shading: the view frustum is cut into GRID_X x GRID_Y screen tiles and GRID_Z
+// exponentially spaced depth slices, and every frame the lights are binned (on the CPU, across threads)
+// into the clusters their spheres touch. The lists are uploaded as buffer textures, so the fragment shader
+// only loops over the few lights of its own cluster, however many lights the scene holds.
+//
+// Usage: fill 'lights', then per frame build(view, projection), upload() and bind(shader) for every
+// shader that samples the clusters (see clusteredLights() in 5.4.light_casters.fs).
+class ClusteredLights
+{
+public:
+    static const int GRID_X = 16;
+    static const int GRID_Y = 9;
+    static const int GRID_Z = 24;
+    static const int CLUSTERS = GRID_X * GRID_Y * GRID_Z;
+    // below this many lights build() doesn't start any threads
+    static const unsigned int MIN_LIGHTS_PER_THREAD = 32;
+
+    std::vector<PointLight> lights;
+    // depth range the slices span; nearer and farther fragments use the first and last slice
+    float zNear;
+    float zFar;
+    // threads build() bins with (0 uses one per hardware thread)
+    unsigned int threadCount;
+
+    ClusteredLights(float nearDepth = 0.1f, float farDepth = 100.0f)
+        : zNear(nearDepth), zFar(farDepth), threadCount(0), lightBuffer(0), rangeBuffer(0), indexBuffer(0),
+          lightTexture(0), rangeTexture(0), indexTexture(0), maxTexels(0)
+    {
+        ranges.resize(2 * CLUSTERS, 0);
+    }
+
+    // creates the buffer textures
+    void setup()
+    {
+        GLint limit = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &limit);
+        maxTexels = (unsigned int)limit;
+
+        createBufferTexture(lightBuffer, lightTexture, GL_RGBA32F);
+        createBufferTexture(rangeBuffer, rangeTexture, GL_RG32UI);
+        createBufferTexture(indexBuffer, indexTexture, GL_R32UI);
+    }
+
+    // bins 'lights' into the clusters of the given camera. Needs no GL context.
+    void build(const glm::mat4 &view, const glm::mat4 &projection)
+    {
+        this->projection = projection;
+        viewSpheres.resize(lights.size());
+        for(unsigned int i = 0; i < lights.size(); i++)
+        {
+            glm::vec4 centre = view * glm::vec4(lights[i].position, 1.0f);
+            viewSpheres[i] = glm::vec4(glm::vec3(centre), lights[i].radius);
+        }
+
+        unsigned int threads = threadCount > 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+        threads = std::min(threads, std::max(1u, (unsigned int)lights.size() / MIN_LIGHTS_PER_THREAD));
+        threads = std::min(threads, (unsigned int)GRID_Z);
+        sliceIndices.resize(threads);
+
+        // each thread owns a contiguous run of slices, so it also owns a contiguous run of clusters
+        if(threads == 1)
+        {
+            binSlices(0, GRID_Z, sliceIndices[0]);
+        }
+        else
+        {
+            std::vector<std::thread> workers;
+            for(unsigned int t = 0; t < threads; t++)
+            {
+                workers.push_back(std::thread(&ClusteredLights::binSlices, this, GRID_Z * t / threads,
+                                              GRID_Z * (t + 1) / threads, std::ref(sliceIndices[t])));
+            }
+            for(unsigned int t = 0; t < workers.size(); t++)
+                workers[t].join();
+        }
+
+        // stitch the per thread lists together; their offsets start at 0 for every thread
+        indices.clear();
+        for(unsigned int t = 0; t < threads; t++)
+        {
+            unsigned int base = (unsigned int)indices.size();
+            for(unsigned int cluster = GRID_X * GRID_Y * (GRID_Z * t / threads); cluster < GRID_X * GRID_Y * (GRID_Z * (t + 1) / threads); cluster++)
+                ranges[2 * cluster] += base;
+            indices.insert(indices.end(), sliceIndices[t].begin(), sliceIndices[t].end());
+        }
+    }
+
+    // copies the lights and the lists of the last build() to the GPU
+    void upload()
+    {
+        std::vector<glm::vec4> lightData(std::max<size_t>(1, 2 * lights.size()));
+        for(unsigned int i = 0; i < lights.size(); i++)
+        {
+            lightData[2 * i] = glm::vec4(lights[i].position, lights[i].radius);
+            lightData[2 * i + 1] = glm::vec4(lights[i].colour, 0.0f);
+        }
+
+        // a cluster must never point past what the index texture can address
+        if(maxTexels > 0 && indices.size() > maxTexels)
+        {
+            std::cout << "CLUSTERED_LIGHTS::TOO_MANY_LIGHT_INDICES " << indices.size() << " > " << maxTexels << std::endl;
+            indices.resize(maxTexels);
+            for(int cluster = 0; cluster < CLUSTERS; cluster++)
+            {
+                unsigned int first = std::min(ranges[2 * cluster], maxTexels);
+                ranges[2 * cluster + 1] = std::min(ranges[2 * cluster + 1], maxTexels - first);
+            }
+        }
+        if(indices.empty())
+            indices.push_back(0);
+
+        fillBuffer(lightBuffer, lightData.size() * sizeof(glm::vec4), &lightData[0]);
+        fillBuffer(rangeBuffer, ranges.size() * sizeof(unsigned int), &ranges[0]);
+        fillBuffer(indexBuffer, indices.size() * sizeof(unsigned int), &indices[0]);
+    }
+
+    // binds the three buffer textures to 'firstUnit' onwards and sets the cluster uniforms of 'shader'
+    // (which must be in use). 'width' and 'height' are the framebuffer size. Leaves GL_TEXTURE0 active.
+    void bind(const Shader &shader, int width, int height, int firstUnit = 2) const
+    {
+        const unsigned int textures[] = {lightTexture, rangeTexture, indexTexture};
+        const char *samplers[] = {"clusterLightData", "clusterRanges", "clusterLightIndices"};
+        for(int i = 0; i < 3; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            shader.setInt(samplers[i], firstUnit + i);
+        }
+        glActiveTexture(GL_TEXTURE0);
+
+        glUniform3i(glGetUniformLocation(shader.ID, "clusterGrid"), GRID_X, GRID_Y, GRID_Z);
+        shader.setVec2("clusterTileSize", (float)width / GRID_X, (float)height / GRID_Y);
+        shader.setVec2("clusterDepth", zNear, GRID_Z / std::log(zFar / zNear));
+    }
+
+    void destroy()
+    {
+        glDeleteTextures(1, &lightTexture);
+        glDeleteTextures(1, &rangeTexture);
+        glDeleteTextures(1, &indexTexture);
+        glDeleteBuffers(1, &lightBuffer);
+        glDeleteBuffers(1, &rangeBuffer);
+        glDeleteBuffers(1, &indexBuffer);
+        lightTexture = rangeTexture = indexTexture = 0;
+        lightBuffer = rangeBuffer = indexBuffer = 0;
+    }
+
+    // first index and light count of a cluster after build()
+    unsigned int clusterFirst(int x, int y, int z) const
+    {
+        return ranges[2 * clusterIndex(x, y, z)];
+    }
+
+    unsigned int clusterCount(int x, int y, int z) const
+    {
+        return ranges[2 * clusterIndex(x, y, z) + 1];
+    }
+
+    const std::vector<unsigned int> &lightIndices() const
+    {
+        return indices;
+    }
+
+    static int clusterIndex(int x, int y, int z)
+    {
+        return x + GRID_X * (y + GRID_Y * z);
+    }
+
+    // view depth at which 'slice' starts; the same exponential spacing the fragment shader inverts
+    float sliceDepth(int slice) const
+    {
+        return zNear * std::pow(zFar / zNear, (float)slice / GRID_Z);
+    }
+
+private:
+    unsigned int lightBuffer, rangeBuffer, indexBuffer;
+    unsigned int lightTexture, rangeTexture, indexTexture;
+    unsigned int maxTexels;
+
+    glm::mat4 projection;
+    // view space centre and radius of every light
+    std::vector<glm::vec4> viewSpheres;
+    // per cluster: first index into 'indices' and light count
+    std::vector<unsigned int> ranges;
+    std::vector<unsigned int> indices;
+    // the lists each thread of build() produced
+    std::vector<std::vector<unsigned int> > sliceIndices;
+
+    // a light's screen space tile rectangle within one slice
+    struct TileRect {
+        unsigned int light;
+        int x0, y0, x1, y1;
+    };
+
+    // fills the ranges of the clusters in slices [first, last) with offsets into 'out'
+    void binSlices(int first, int last, std::vector<unsigned int> &out)
+    {
+        out.clear();
+        std::vector<TileRect> touched;
+        for(int z = first; z < last; z++)
+        {
+            // slabs at either end reach to the camera and to infinity, like the shader's clamped slices
+            float sliceNear = z == 0 ? -INFINITY : sliceDepth(z);
+            float sliceFar = z == GRID_Z - 1 ? INFINITY : sliceDepth(z + 1);
+
+            touched.clear();
+            for(unsigned int i = 0; i < viewSpheres.size(); i++)
+            {
+                const glm::vec4 &sphere = viewSpheres[i];
+                float depth = -sphere.z;
+                if(depth + sphere.w < sliceNear || depth - sphere.w > sliceFar)
+                    continue;
+
+                TileRect rect;
+                rect.light = i;
+                if(tileRect(sphere, std::max(depth - sphere.w, sliceNear), std::min(depth + sphere.w, sliceFar), rect))
+                    touched.push_back(rect);
+            }
+
+            // lights are appended in index order, so every cluster's list is sorted
+            for(int y = 0; y < GRID_Y; y++)
+            {
+                for(int x = 0; x < GRID_X; x++)
+                {
+                    int cluster = clusterIndex(x, y, z);
+                    ranges[2 * cluster] = (unsigned int)out.size();
+                    for(unsigned int r = 0; r < touched.size(); r++)
+                    {
+                        const TileRect &rect = touched[r];
+                        if(x >= rect.x0 && x <= rect.x1 && y >= rect.y0 && y <= rect.y1)
+                            out.push_back(rect.light);
+                    }
+                    ranges[2 * cluster + 1] = (unsigned int)out.size() - ranges[2 * cluster];
+                }
+            }
+        }
+    }
+
+    // conservative tile rectangle of the box around 'sphere' cut to view depths [nearDepth, farDepth];
+    // false when the box is off screen
+    bool tileRect(const glm::vec4 &sphere, float nearDepth, float farDepth, TileRect &rect) const
+    {
+        glm::vec2 lower(INFINITY), upper(-INFINITY);
+        for(int corner = 0; corner < 8; corner++)
+        {
+            glm::vec4 point(sphere.x + ((corner & 1) ? sphere.w : -sphere.w),
+                            sphere.y + ((corner & 2) ? sphere.w : -sphere.w),
+                            -((corner & 4) ? farDepth : nearDepth), 1.0f);
+            glm::vec4 clip = projection * point;
+            // a corner at or behind the eye of a perspective camera: the light may cover the whole screen
+            if(clip.w <= 1e-5f)
+            {
+                rect.x0 = rect.y0 = 0;
+                rect.x1 = GRID_X - 1;
+                rect.y1 = GRID_Y - 1;
+                return true;
+            }
+            glm::vec2 ndc = glm::vec2(clip) / clip.w;
+            lower = glm::min(lower, ndc);
+            upper = glm::max(upper, ndc);
+        }
+        if(upper.x < -1.0f || upper.y < -1.0f || lower.x > 1.0f || lower.y > 1.0f)
+            return false;
+
+        rect.x0 = tile(lower.x, GRID_X);
+        rect.y0 = tile(lower.y, GRID_Y);
+        rect.x1 = tile(upper.x, GRID_X);
+        rect.y1 = tile(upper.y, GRID_Y);
+        return true;
+    }
+
+    static int tile(float ndc, int tiles)
+    {
+        return std::min(std::max((int)std::floor((ndc * 0.5f + 0.5f) * tiles), 0), tiles - 1);
+    }
+
+    static void createBufferTexture(unsigned int &buffer, unsigned int &texture, GLenum format)
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // respecifies the whole store so the driver can hand out fresh memory while the GPU still reads the old
+    static void fillBuffer(unsigned int buffer, size_t bytes, const void *data)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, bytes, data, GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
+#endif
@@ -0,0 +1,234 @@
+#ifndef DEFERRED_SHADING_H
+#define DEFERRED_SHADING_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/clustered_lights.h>
+
+#include <iostream>
+#include <vector>
+
+// Render targets of the deferred path: albedo, specular colour, octahedron packed normal and depth.
+// Positions are rebuilt from the depth, so nothing else is stored per pixel.
+class GBuffer
+{
+public:
+    unsigned int FBO;
+    unsigned int albedo;
+    unsigned int specular;
+    unsigned int normal;
+    unsigned int depth;
+    int width;
+    int height;
+
+    GBuffer() : FBO(0), albedo(0), specular(0), normal(0), depth(0), width(0), height(0)
+    {
+    }
+
+    void setup(int w, int h)
+    {
+        glGenFramebuffers(1, &FBO);
+        glGenTextures(1, &albedo);
+        glGenTextures(1, &specular);
+        glGenTextures(1, &normal);
+        glGenTextures(1, &depth);
+        resize(w, h);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedo, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, specular, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, normal, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        unsigned int attachments[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+        glDrawBuffers(3, attachments);
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "GBUFFER::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // reallocates the targets for a new framebuffer size
+    void resize(int w, int h)
+    {
+        if(w == width && h == height)
+            return;
+        width = w;
+        height = h;
+
+        allocate(albedo, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        allocate(specular, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        allocate(normal, GL_RG16, GL_RG, GL_UNSIGNED_SHORT);
+        // matches the default framebuffer, so blitDepth() can copy it over
+        allocate(depth, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+    }
+
+    // binds the G-buffer for the geometry pass and clears it
+    void begin()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, width, height);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    // back to the default framebuffer, whose depth becomes the scene depth of the G-buffer
+    void blitDepth()
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // albedo, specular, normal and depth on units 'firstUnit' onwards, set as the g* samplers of 'shader'
+    void bindTextures(const Shader &shader, int firstUnit = 0) const
+    {
+        const unsigned int textures[] = {albedo, specular, normal, depth};
+        const char *samplers[] = {"gAlbedo", "gSpecular", "gNormal", "gDepth"};
+        for(int i = 0; i < 4; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            shader.setInt(samplers[i], firstUnit + i);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        shader.setVec2("screenSize", (float)width, (float)height);
+    }
+
+    void destroy()
+    {
+        glDeleteFramebuffers(1, &FBO);
+        unsigned int textures[] = {albedo, specular, normal, depth};
+        glDeleteTextures(4, textures);
+        FBO = albedo = specular = normal = depth = 0;
+        width = height = 0;
+    }
+
+private:
+    void allocate(unsigned int texture, GLint internalFormat, GLenum format, GLenum type)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+};
+
+// Point lights drawn as cubes around their spheres, all in one instanced draw. Only the back faces that lie
+// behind the scene are rasterized, so each light shades just the pixels its volume can reach, and the camera
+// may stand inside a volume.
+class LightVolumes
+{
+public:
+    LightVolumes() : VAO(0), VBO(0), EBO(0), instanceVBO(0), count(0)
+    {
+    }
+
+    void setup()
+    {
+        // a cube around the unit sphere, wound counter clockwise seen from outside (unlike the park's box,
+        // whose faces wind both ways)
+        float corners[8 * 3];
+        for(int i = 0; i < 8; i++)
+        {
+            corners[3 * i] = (i & 1) ? 1.0f : -1.0f;
+            corners[3 * i + 1] = (i & 2) ? 1.0f : -1.0f;
+            corners[3 * i + 2] = (i & 4) ? 1.0f : -1.0f;
+        }
+        unsigned int faces[36] = {
+            0, 6, 2, 0, 4, 6,   // -x
+            1, 3, 7, 1, 7, 5,   // +x
+            0, 1, 5, 0, 5, 4,   // -y
+            2, 7, 3, 2, 6, 7,   // +y
+            0, 3, 1, 0, 2, 3,   // -z
+            4, 5, 7, 4, 7, 6    // +z
+        };
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glGenBuffers(1, &instanceVBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(faces), faces, GL_STATIC_DRAW);
+
+        // per light: position + radius, colour
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribDivisor(1, 1);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), (void*)sizeof(glm::vec4));
+        glEnableVertexAttribArray(2);
+        glVertexAttribDivisor(2, 1);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void upload(const std::vector<PointLight> &lights)
+    {
+        std::vector<glm::vec4> data(2 * lights.size());
+        for(unsigned int i = 0; i < lights.size(); i++)
+        {
+            data[2 * i] = glm::vec4(lights[i].position, lights[i].radius);
+            data[2 * i + 1] = glm::vec4(lights[i].colour, 0.0f);
+        }
+        count = (unsigned int)lights.size();
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(glm::vec4), data.empty() ? NULL : &data[0], GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // adds the lights to the bound framebuffer, whose depth must be the scene's. Restores the default
+    // depth, blend and cull state afterwards.
+    void draw()
+    {
+        if(count == 0)
+            return;
+
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_GEQUAL);
+        glDepthMask(GL_FALSE);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0, count);
+        glBindVertexArray(0);
+
+        glDisable(GL_BLEND);
+        glCullFace(GL_BACK);
+        glDisable(GL_CULL_FACE);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+    }
+
+    void destroy()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteBuffers(1, &instanceVBO);
+        VAO = VBO = EBO = instanceVBO = 0;
+    }
+
+private:
+    unsigned int VAO;
+    unsigned int VBO;
+    unsigned int EBO;
+    unsigned int instanceVBO;
+    unsigned int count;
+};
+#endif
@@ -0,0 +1,265 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/vertex_format.h>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <vector>
+
+// First fit free list over a range of 'units' (vertices or indices). Freed ranges are merged with their
+// free neighbours, so a pool that meshes come and go from doesn't fragment into unusable slivers.
+class RangeAllocator
+{
+public:
+    RangeAllocator() : total(0), allocated(0)
+    {
+    }
+
+    // finds 'size' free units; false if no free range is large enough (grow() and try again)
+    bool allocate(size_t size, size_t &offset)
+    {
+        for(std::map<size_t, size_t>::iterator range = freeRanges.begin(); range != freeRanges.end(); ++range)
+        {
+            if(range->second < size)
+                continue;
+
+            offset = range->first;
+            size_t left = range->second - size;
+            freeRanges.erase(range);
+            if(left > 0)
+                freeRanges[offset + size] = left;
+            allocated += size;
+            return true;
+        }
+        return false;
+    }
+
+    void free(size_t offset, size_t size)
+    {
+        if(size == 0)
+            return;
+        allocated -= size;
+
+        std::map<size_t, size_t>::iterator next = freeRanges.lower_bound(offset);
+        if(next != freeRanges.end() && offset + size == next->first)
+        {
+            size += next->second;
+            next = freeRanges.erase(next);
+        }
+        if(next != freeRanges.begin())
+        {
+            std::map<size_t, size_t>::iterator previous = next;
+            --previous;
+            if(previous->first + previous->second == offset)
+            {
+                previous->second += size;
+                return;
+            }
+        }
+        freeRanges[offset] = size;
+    }
+
+    // adds [capacity(), newCapacity) to the free space
+    void grow(size_t newCapacity)
+    {
+        if(newCapacity <= total)
+            return;
+        size_t added = newCapacity - total;
+        size_t offset = total;
+        total = newCapacity;
+        // free() counts the range as having been allocated
+        allocated += added;
+        free(offset, added);
+    }
+
+    size_t capacity() const
+    {
+        return total;
+    }
+
+    size_t used() const
+    {
+        return allocated;
+    }
+
+private:
+    // offset -> size of every free range
+    std::map<size_t, size_t> freeRanges;
+    size_t total;
+    size_t allocated;
+};
+
+// One vertex buffer and one index buffer shared by every mesh with the same vertex format, and the single
+// VAO that draws all of them. Meshes keep their indices relative to their first vertex and are drawn with
+// glDrawElementsBaseVertex.
+struct GeometryPool {
+    VertexFormat format;
+    unsigned int VAO;
+    unsigned int VBO;
+    unsigned int EBO;
+    RangeAllocator vertices;
+    RangeAllocator indices;
+    // the buffer the per instance attributes of the VAO currently read from (see Mesh::DrawInstanced())
+    unsigned int instanceBuffer;
+};
+
+// Where a mesh lives inside its pool
+struct GeometryAllocation {
+    GeometryPool *pool;
+    unsigned int vertexOffset;
+    unsigned int vertexCount;
+    unsigned int indexOffset;
+    unsigned int indexCount;
+
+    GeometryAllocation() : pool(NULL), vertexOffset(0), vertexCount(0), indexOffset(0), indexCount(0)
+    {
+    }
+};
+
+// Process wide owner of all mesh geometry: one GeometryPool per vertex format, each growing (by copying
+// into a buffer twice the size) when it runs out of space. Must only be used on the GL thread.
+class GeometryArena
+{
+public:
+    // size new pools start at
+    static const unsigned int INITIAL_VERTICES = 1 << 16;
+    static const unsigned int INITIAL_INDICES = 1 << 18;
+
+    static GeometryArena &instance()
+    {
+        static GeometryArena arena;
+        return arena;
+    }
+
+    // copies encoded vertices ('vertexCount' of 'format.stride' bytes) and their indices into the pool of
+    // 'format'. Leaves no VAO bound.
+    GeometryAllocation allocate(const VertexFormat &format, const void *vertexData, unsigned int vertexCount,
+                                const unsigned int *indexData, unsigned int indexCount)
+    {
+        GeometryAllocation allocation;
+        allocation.pool = &pool(format);
+        allocation.vertexCount = vertexCount;
+        allocation.indexCount = indexCount;
+        GeometryPool &target = *allocation.pool;
+
+        size_t offset = 0;
+        if(vertexCount > 0)
+        {
+            if(!target.vertices.allocate(vertexCount, offset))
+            {
+                growBuffer(target.VBO, target.vertices, vertexCount, format.stride);
+                target.vertices.allocate(vertexCount, offset);
+                bindVertexArray(target);
+            }
+            allocation.vertexOffset = (unsigned int)offset;
+            // GL_COPY_WRITE_BUFFER binds without touching any VAO's state
+            glBindBuffer(GL_COPY_WRITE_BUFFER, target.VBO);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, offset * format.stride, (size_t)vertexCount * format.stride, vertexData);
+        }
+        if(indexCount > 0)
+        {
+            if(!target.indices.allocate(indexCount, offset))
+            {
+                growBuffer(target.EBO, target.indices, indexCount, sizeof(unsigned int));
+                target.indices.allocate(indexCount, offset);
+                bindVertexArray(target);
+            }
+            allocation.indexOffset = (unsigned int)offset;
+            glBindBuffer(GL_COPY_WRITE_BUFFER, target.EBO);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, offset * sizeof(unsigned int), (size_t)indexCount * sizeof(unsigned int), indexData);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return allocation;
+    }
+
+    // returns the space of an allocation to its pool; the buffers themselves never shrink
+    void free(GeometryAllocation &allocation)
+    {
+        if(!allocation.pool)
+            return;
+        allocation.pool->vertices.free(allocation.vertexOffset, allocation.vertexCount);
+        allocation.pool->indices.free(allocation.indexOffset, allocation.indexCount);
+        allocation = GeometryAllocation();
+    }
+
+    // pool sizes, for tuning INITIAL_VERTICES and INITIAL_INDICES
+    void report(std::ostream &out) const
+    {
+        for(unsigned int i = 0; i < pools.size(); i++)
+        {
+            const GeometryPool &p = *pools[i];
+            out << "GEOMETRY:: format " << p.format.attributes << " (" << p.format.stride << " byte vertices): "
+                << p.vertices.used() << "/" << p.vertices.capacity() << " vertices, "
+                << p.indices.used() << "/" << p.indices.capacity() << " indices" << std::endl;
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<GeometryPool> > pools;
+
+    GeometryArena()
+    {
+    }
+
+    GeometryArena(const GeometryArena &) = delete;
+    GeometryArena &operator=(const GeometryArena &) = delete;
+
+    GeometryPool &pool(const VertexFormat &format)
+    {
+        for(unsigned int i = 0; i < pools.size(); i++)
+        {
+            if(pools[i]->format.attributes == format.attributes)
+                return *pools[i];
+        }
+
+        std::unique_ptr<GeometryPool> created(new GeometryPool());
+        created->format = format;
+        created->VAO = created->VBO = created->EBO = 0;
+        created->instanceBuffer = 0;
+        glGenVertexArrays(1, &created->VAO);
+        growBuffer(created->VBO, created->vertices, INITIAL_VERTICES, format.stride);
+        growBuffer(created->EBO, created->indices, INITIAL_INDICES, sizeof(unsigned int));
+        bindVertexArray(*created);
+
+        pools.push_back(std::move(created));
+        return *pools.back();
+    }
+
+    // replaces 'buffer' by one with room for at least 'needed' more units, copying the old contents over
+    static void growBuffer(unsigned int &buffer, RangeAllocator &allocator, size_t needed, unsigned int unitSize)
+    {
+        size_t capacity = std::max(allocator.capacity() * 2, allocator.capacity() + needed);
+
+        unsigned int grown;
+        glGenBuffers(1, &grown);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity * unitSize, NULL, GL_STATIC_DRAW);
+        if(buffer != 0)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, allocator.capacity() * unitSize);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glDeleteBuffers(1, &buffer);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        buffer = grown;
+        allocator.grow(capacity);
+    }
+
+    // (re)connects a pool's VAO to its current buffers
+    static void bindVertexArray(GeometryPool &target)
+    {
+        glBindVertexArray(target.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, target.VBO);
+        target.format.setAttributePointers();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, target.EBO);
+        glBindVertexArray(0);
+    }
+};
+#endif
@@ -0,0 +1,94 @@
+#ifndef GPU_QUERY_H
+#define GPU_QUERY_H
+
+#include <glad/glad.h>
+
+// Sums the results of a GL query (GL_TIME_ELAPSED, GL_SAMPLES_PASSED, ...) over many frames. Results are
+// read LATENCY queries late, by which time the GPU has normally finished them, so measuring doesn't stall
+// the pipeline.
+class GpuQuery
+{
+public:
+    static const int LATENCY = 4;
+
+    GLenum target;
+    // sum and number of the results read so far
+    GLuint64 total;
+    unsigned int count;
+
+    GpuQuery(GLenum target) : target(target), total(0), count(0), next(0)
+    {
+        for(int i = 0; i < LATENCY; i++)
+        {
+            queries[i] = 0;
+            pending[i] = false;
+        }
+    }
+
+    void setup()
+    {
+        glGenQueries(LATENCY, queries);
+    }
+
+    void begin()
+    {
+        if(pending[next])
+            read(next);
+        glBeginQuery(target, queries[next]);
+    }
+
+    void end()
+    {
+        glEndQuery(target);
+        pending[next] = true;
+        next = (next + 1) % LATENCY;
+    }
+
+    // waits for the queries still in flight
+    void finish()
+    {
+        for(int i = 0; i < LATENCY; i++)
+        {
+            if(pending[i])
+                read(i);
+        }
+    }
+
+    void reset()
+    {
+        finish();
+        total = 0;
+        count = 0;
+    }
+
+    double average() const
+    {
+        return count > 0 ? (double)total / count : 0.0;
+    }
+
+    // average of GL_TIME_ELAPSED results in milliseconds
+    double averageMs() const
+    {
+        return average() / 1.0e6;
+    }
+
+    void destroy()
+    {
+        glDeleteQueries(LATENCY, queries);
+    }
+
+private:
+    unsigned int queries[LATENCY];
+    bool pending[LATENCY];
+    int next;
+
+    void read(int i)
+    {
+        GLuint64 result = 0;
+        glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &result);
+        total += result;
+        count++;
+        pending[i] = false;
+    }
+};
+#endif
@@ -0,0 +1,149 @@
+#ifndef HIZ_PYRAMID_H
+#define HIZ_PYRAMID_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader_c.h>
+
+#include <iostream>
+
+// Hierarchical depth of the last frame (GL 4.3). build() copies the depth of the default framebuffer and
+// reduces it with a compute shader (5.4.hiz.cs) into a mip chain whose every texel holds the farthest depth
+// of the pixels under it, level 0 at half the framebuffer's size. A box whose nearest depth lies behind the
+// farthest depth of the at most 2x2 texels covering it was hidden in that frame (see 5.4.cull.cs).
+class HiZPyramid
+{
+public:
+    // false until build() has run, and again after invalidate() or a resize
+    bool valid;
+
+    HiZPyramid() : valid(false), width(0), height(0), levels(0), depthFBO(0), depth(0), pyramid(0)
+    {
+    }
+
+    void setup()
+    {
+        glGenFramebuffers(1, &depthFBO);
+    }
+
+    // builds the pyramid from the current depth of the default framebuffer, a 'w' x 'h' frame drawn with
+    // 'viewProjection', and leaves the default framebuffer bound
+    void build(const ComputeShader &reduceShader, const glm::mat4 &viewProjection, int w, int h)
+    {
+        resize(w, h);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFBO);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        reduceShader.use();
+        reduceShader.setInt("source", 0);
+        glActiveTexture(GL_TEXTURE0);
+        for(int level = 0; level < levels; level++)
+        {
+            // level 0 reads the depth copy, every other level the one above it
+            glBindTexture(GL_TEXTURE_2D, level == 0 ? depth : pyramid);
+            reduceShader.setInt("sourceLevel", level == 0 ? 0 : level - 1);
+            glBindImageTexture(0, pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            glm::ivec2 size = levelSize(level);
+            glDispatchCompute((size.x + 7) / 8, (size.y + 7) / 8, 1);
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        builtViewProjection = viewProjection;
+        valid = true;
+    }
+
+    void invalidate()
+    {
+        valid = false;
+    }
+
+    // the pyramid on unit 'unit' and the Hi-Z uniforms of 'shader'; 'useHiZ' is off while it isn't valid
+    void bind(const ComputeShader &shader, int unit = 0) const
+    {
+        shader.setBool("useHiZ", valid);
+        if(!valid)
+            return;
+
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, pyramid);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("hiZ", unit);
+        shader.setInt("hiZLevels", levels);
+        shader.setVec2("hiZScreenSize", glm::vec2((float)width, (float)height));
+        shader.setMat4("hiZViewProjection", builtViewProjection);
+    }
+
+    void destroy()
+    {
+        glDeleteFramebuffers(1, &depthFBO);
+        glDeleteTextures(1, &depth);
+        glDeleteTextures(1, &pyramid);
+        depthFBO = depth = pyramid = 0;
+        width = height = levels = 0;
+        valid = false;
+    }
+
+private:
+    int width, height;
+    int levels;
+    unsigned int depthFBO;
+    // copy of the default framebuffer's depth, and the pyramid over it
+    unsigned int depth;
+    unsigned int pyramid;
+    glm::mat4 builtViewProjection;
+
+    glm::ivec2 levelSize(int level) const
+    {
+        return glm::ivec2(glm::max(1, width >> (level + 1)), glm::max(1, height >> (level + 1)));
+    }
+
+    // reallocates the depth copy and the pyramid for a new framebuffer size
+    void resize(int w, int h)
+    {
+        if(w == width && h == height)
+            return;
+        width = w;
+        height = h;
+        valid = false;
+
+        glDeleteTextures(1, &depth);
+        glDeleteTextures(1, &pyramid);
+
+        // matches the default framebuffer, so its depth can be blitted over
+        glGenTextures(1, &depth);
+        glBindTexture(GL_TEXTURE_2D, depth);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        // halved until the larger side is 1 texel; the reduction folds odd rows and columns into the last texel
+        levels = 1;
+        glm::ivec2 top = levelSize(0);
+        while(top.x > 1 || top.y > 1)
+        {
+            levels++;
+            top = levelSize(levels - 1);
+        }
+        glGenTextures(1, &pyramid);
+        glBindTexture(GL_TEXTURE_2D, pyramid);
+        glTexStorage2D(GL_TEXTURE_2D, levels, GL_R32F, levelSize(0).x, levelSize(0).y);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "HIZ_PYRAMID::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+};
+#endif
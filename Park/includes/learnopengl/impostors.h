@@ -0,0 +1,216 @@
+#ifndef IMPOSTORS_H
+#define IMPOSTORS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/shader_m.h>
+#include <learnopengl/spatial_index.h>
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+// Billboard stand-ins for many copies of one upright prefab. At startup the prefab is captured from VIEWS
+// directions around the vertical into an atlas of G-buffer style tiles (albedo with coverage in alpha,
+// specular, packed normal). Each frame the copies beyond 'startDistance' draw as camera facing quads in one
+// instanced draw, each quad showing the tile captured nearest to its view direction. Over the next
+// 'fadeBand' the prefab dissolves into its impostor: the prefab drops the pixels of a dither pattern below
+// fade() (the 'dissolve' uniform of the box shaders) and the impostor keeps exactly those.
+class Impostors
+{
+public:
+    static const int VIEWS = 8;
+
+    // where the copies stand, as passed to the prefab's draw function
+    std::vector<glm::vec3> positions;
+    float startDistance;
+    float fadeBand;
+    int tileWidth;
+    int tileHeight;
+
+    Impostors(float start, float band, int width, int height)
+        : startDistance(start), fadeBand(band), tileWidth(width), tileHeight(height), atlasFBO(0), albedo(0),
+          specular(0), normal(0), depth(0), VAO(0), quadVBO(0), instanceVBO(0), count(0)
+    {
+    }
+
+    // 'prefabBounds' are those of the prefab drawn at the origin
+    void setup(const AABB &prefabBounds)
+    {
+        glm::vec3 size = prefabBounds.max - prefabBounds.min;
+        centre = (prefabBounds.min + prefabBounds.max) * 0.5f;
+        // wide enough for the prefab seen from any side, with a little margin so no tile touches the next
+        halfSize = glm::vec2(0.5f * glm::length(glm::vec2(size.x, size.z)), 0.5f * size.y) * 1.05f;
+
+        glGenFramebuffers(1, &atlasFBO);
+        // only the albedo, whose alpha cuts out the outline, gets mipmaps; specular and normals are read where
+        // the albedo is opaque and don't need them
+        albedo = createTiles(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, true);
+        specular = createTiles(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, false);
+        normal = createTiles(GL_RG16, GL_RG, GL_UNSIGNED_SHORT, false);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, VIEWS * tileWidth, tileHeight);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        // same attachments as the G-buffer, so its shaders capture the prefab unchanged
+        glBindFramebuffer(GL_FRAMEBUFFER, atlasFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedo, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, specular, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, normal, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+        unsigned int attachments[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+        glDrawBuffers(3, attachments);
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "IMPOSTORS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // a quad with corners in [-1, 1]^2, and per copy its position and fade
+        float corners[] = {-1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &quadVBO);
+        glGenBuffers(1, &instanceVBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribDivisor(1, 1);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // renders drawPrefab(captureShader) into every tile of the atlas, then goes back to the default framebuffer
+    // with a 'width' x 'height' viewport. 'captureShader' writes albedo, specular and the packed normal like
+    // 5.4.gbuffer.fs, and must be in use with its material uniforms set.
+    template<typename DrawPrefab>
+    void capture(Shader &captureShader, int width, int height, DrawPrefab drawPrefab)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, atlasFBO);
+        glViewport(0, 0, VIEWS * tileWidth, tileHeight);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        float radius = glm::max(halfSize.x, 0.01f);
+        captureShader.setMat4("projection", glm::ortho(-halfSize.x, halfSize.x, -halfSize.y, halfSize.y, 0.0f, 4.0f * radius));
+        for(int i = 0; i < VIEWS; i++)
+        {
+            // seen from the direction at the angle 'i' / VIEWS of a turn from +z towards +x, as the vertex shader
+            // picks the tiles
+            float angle = glm::radians(360.0f) * i / VIEWS;
+            glm::vec3 towardsViewer(std::sin(angle), 0.0f, std::cos(angle));
+            captureShader.setMat4("view", glm::lookAt(centre + towardsViewer * (2.0f * radius), centre, glm::vec3(0.0f, 1.0f, 0.0f)));
+            glViewport(i * tileWidth, 0, tileWidth, tileHeight);
+            drawPrefab(captureShader);
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, width, height);
+
+        // mipmaps for the distant copies; the tiles' empty margins keep the smaller levels from mixing views
+        glBindTexture(GL_TEXTURE_2D, albedo);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // fades of every copy seen from 'viewPos', and the instances of those that draw as impostors
+    void update(const glm::vec3 &viewPos)
+    {
+        fades.resize(positions.size());
+        std::vector<glm::vec4> instances;
+        for(unsigned int i = 0; i < positions.size(); i++)
+        {
+            glm::vec2 offset(positions[i].x + centre.x - viewPos.x, positions[i].z + centre.z - viewPos.z);
+            fades[i] = glm::clamp((glm::length(offset) - startDistance) / fadeBand, 0.0f, 1.0f);
+            if(fades[i] > 0.0f)
+                instances.push_back(glm::vec4(positions[i], fades[i]));
+        }
+        count = (unsigned int)instances.size();
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(glm::vec4), instances.empty() ? NULL : &instances[0], GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // 0: the copy draws in full, 1: only its impostor draws, in between: both, dithered
+    float fade(unsigned int i) const
+    {
+        return i < fades.size() ? fades[i] : 0.0f;
+    }
+
+    unsigned int impostorCount() const
+    {
+        return count;
+    }
+
+    // draws the impostors with 'shader' (5.4.impostor.vs), the atlas on units 'firstUnit' onwards
+    void draw(const Shader &shader, int firstUnit = 7) const
+    {
+        if(count == 0)
+            return;
+
+        const unsigned int textures[] = {albedo, specular, normal};
+        const char *samplers[] = {"impostorAlbedo", "impostorSpecular", "impostorNormals"};
+        for(int i = 0; i < 3; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            shader.setInt(samplers[i], firstUnit + i);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        shader.setVec3("impostorCentre", centre);
+        shader.setVec2("impostorHalfSize", halfSize);
+        shader.setInt("impostorViews", VIEWS);
+
+        glBindVertexArray(VAO);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+        glBindVertexArray(0);
+    }
+
+    void destroy()
+    {
+        glDeleteFramebuffers(1, &atlasFBO);
+        unsigned int textures[] = {albedo, specular, normal};
+        glDeleteTextures(3, textures);
+        glDeleteRenderbuffers(1, &depth);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &quadVBO);
+        glDeleteBuffers(1, &instanceVBO);
+        atlasFBO = albedo = specular = normal = depth = VAO = quadVBO = instanceVBO = 0;
+        count = 0;
+    }
+
+private:
+    // of the quads, relative to the copies' positions
+    glm::vec3 centre;
+    glm::vec2 halfSize;
+    std::vector<float> fades;
+    unsigned int atlasFBO;
+    unsigned int albedo, specular, normal, depth;
+    unsigned int VAO, quadVBO, instanceVBO;
+    unsigned int count;
+
+    unsigned int createTiles(GLint internalFormat, GLenum format, GLenum type, bool mipmapped)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, VIEWS * tileWidth, tileHeight, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+};
+#endif
@@ -0,0 +1,172 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file. The file is memory mapped where the platform supports it so the
+// contents are paged in on demand without being copied; otherwise it is read with a single fread.
+class MappedFile
+{
+public:
+    MappedFile() : bytes(NULL), length(0), mapped(false)
+    {
+#if defined(_WIN32)
+        file = INVALID_HANDLE_VALUE;
+        mapping = NULL;
+#endif
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    bool open(const std::string &path)
+    {
+        close();
+#if defined(_WIN32)
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if(file != INVALID_HANDLE_VALUE)
+        {
+            LARGE_INTEGER fileSize;
+            if(GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+            {
+                mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+                if(mapping != NULL)
+                {
+                    bytes = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                    length = (size_t)fileSize.QuadPart;
+                    mapped = bytes != NULL;
+                }
+            }
+            else if(GetFileSizeEx(file, &fileSize))
+            {
+                // empty files can't be mapped but are still valid
+                return true;
+            }
+        }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd >= 0)
+        {
+            struct stat info;
+            if(fstat(fd, &info) == 0)
+            {
+                length = (size_t)info.st_size;
+                if(length == 0)
+                {
+                    ::close(fd);
+                    return true;
+                }
+
+                void *view = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(view != MAP_FAILED)
+                {
+                    bytes = (const unsigned char*)view;
+                    mapped = true;
+                }
+            }
+            // the mapping stays valid after the descriptor is closed
+            ::close(fd);
+        }
+#endif
+        if(mapped)
+            return true;
+
+        // fall back to reading the whole file in one go
+        close();
+        FILE *stream = fopen(path.c_str(), "rb");
+        if(!stream)
+            return false;
+
+        fseek(stream, 0, SEEK_END);
+        long fileSize = ftell(stream);
+        fseek(stream, 0, SEEK_SET);
+        if(fileSize < 0)
+        {
+            fclose(stream);
+            return false;
+        }
+
+        buffer.resize((size_t)fileSize);
+        size_t read = fileSize > 0 ? fread(&buffer[0], 1, buffer.size(), stream) : 0;
+        fclose(stream);
+        if(read != buffer.size())
+        {
+            buffer.clear();
+            return false;
+        }
+
+        bytes = buffer.empty() ? NULL : &buffer[0];
+        length = buffer.size();
+        return true;
+    }
+
+    void close()
+    {
+        if(mapped)
+        {
+#if defined(_WIN32)
+            UnmapViewOfFile(bytes);
+#else
+            munmap((void*)bytes, length);
+#endif
+        }
+#if defined(_WIN32)
+        if(mapping != NULL)
+            CloseHandle(mapping);
+        if(file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#endif
+        std::vector<unsigned char>().swap(buffer);
+        bytes = NULL;
+        length = 0;
+        mapped = false;
+    }
+
+    const unsigned char *data() const
+    {
+        return bytes;
+    }
+
+    size_t size() const
+    {
+        return length;
+    }
+
+    bool isMapped() const
+    {
+        return mapped;
+    }
+
+private:
+    const unsigned char *bytes;
+    size_t length;
+    bool mapped;
+    std::vector<unsigned char> buffer;
+#if defined(_WIN32)
+    HANDLE file;
+    HANDLE mapping;
+#endif
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+};
+#endif
@@ -0,0 +1,329 @@
+#ifndef MAPPED_IO_H
+#define MAPPED_IO_H
+
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+
+#include <learnopengl/mapped_file.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// '\' to '/' and '.', '..' and empty segments resolved, so the same file always has the same name
+inline std::string normalizeAssetPath(const std::string &path)
+{
+    std::string unified(path);
+    for(size_t i = 0; i < unified.size(); i++)
+    {
+        if(unified[i] == '\\')
+            unified[i] = '/';
+    }
+
+    std::vector<std::string> segments;
+    size_t start = 0;
+    while(start <= unified.size())
+    {
+        size_t end = unified.find('/', start);
+        if(end == std::string::npos)
+            end = unified.size();
+        std::string segment = unified.substr(start, end - start);
+        if(segment == ".." && !segments.empty() && segments.back() != "..")
+            segments.pop_back();
+        else if(!segment.empty() && segment != ".")
+            segments.push_back(segment);
+        start = end + 1;
+    }
+
+    std::string normalized = !unified.empty() && unified[0] == '/' ? "/" : "";
+    for(size_t i = 0; i < segments.size(); i++)
+        normalized += (i > 0 ? "/" : "") + segments[i];
+    return normalized;
+}
+
+// A read-only archive of asset files stored back to back in one mapped file, so a whole model with its
+// material files is served from a single mapping.
+//
+// Layout (little endian):
+//   char magic[8] "LOGLPACK", uint32 version, uint32 entryCount
+//   per entry: uint32 nameLength, name, uint64 offset, uint64 size
+//   file contents, each starting on a 16 byte boundary
+class AssetPack
+{
+public:
+    static const uint32_t VERSION = 1;
+
+    bool open(const std::string &path)
+    {
+        entries.clear();
+        if(!file.open(path) || file.size() < 16 || memcmp(file.data(), "LOGLPACK", 8) != 0)
+            return false;
+
+        uint32_t header[2];
+        memcpy(header, file.data() + 8, sizeof(header));
+        if(header[0] != VERSION)
+            return false;
+
+        size_t cursor = 16;
+        for(uint32_t i = 0; i < header[1]; i++)
+        {
+            uint32_t nameLength;
+            if(file.size() - cursor < sizeof(nameLength))
+                return false;
+            memcpy(&nameLength, file.data() + cursor, sizeof(nameLength));
+            cursor += sizeof(nameLength);
+            if(file.size() - cursor < nameLength + 2 * sizeof(uint64_t))
+                return false;
+
+            std::string name((const char*)file.data() + cursor, nameLength);
+            cursor += nameLength;
+            uint64_t range[2];
+            memcpy(range, file.data() + cursor, sizeof(range));
+            cursor += sizeof(range);
+            if(range[0] > file.size() || range[1] > file.size() - range[0])
+                return false;
+
+            entries[name] = std::make_pair((size_t)range[0], (size_t)range[1]);
+        }
+        return true;
+    }
+
+    // contents of an entry, NULL if the pack doesn't hold it
+    const unsigned char *find(const std::string &name, size_t &size) const
+    {
+        std::unordered_map<std::string, std::pair<size_t, size_t> >::const_iterator found = entries.find(normalizeAssetPath(name));
+        if(found == entries.end())
+            return NULL;
+        size = found->second.second;
+        return file.data() + found->second.first;
+    }
+
+    unsigned int size() const
+    {
+        return (unsigned int)entries.size();
+    }
+
+    // packs 'files' (paths relative to 'root') into a new archive at 'path'
+    static bool write(const std::string &path, const std::string &root, const std::vector<std::string> &files)
+    {
+        std::vector<std::string> names;
+        for(unsigned int i = 0; i < files.size(); i++)
+            names.push_back(normalizeAssetPath(files[i]));
+
+        // the table comes first, so its size decides where the contents start
+        uint64_t offset = 16;
+        for(unsigned int i = 0; i < names.size(); i++)
+            offset += sizeof(uint32_t) + names[i].size() + 2 * sizeof(uint64_t);
+
+        std::vector<MappedFile> sources(files.size());
+        std::vector<uint64_t> offsets(files.size());
+        for(unsigned int i = 0; i < files.size(); i++)
+        {
+            if(!sources[i].open(root + "/" + files[i]))
+                return false;
+            offset = (offset + 15) & ~(uint64_t)15;
+            offsets[i] = offset;
+            offset += sources[i].size();
+        }
+
+        FILE *out = fopen(path.c_str(), "wb");
+        if(!out)
+            return false;
+
+        uint32_t header[2] = {VERSION, (uint32_t)files.size()};
+        fwrite("LOGLPACK", 1, 8, out);
+        fwrite(header, sizeof(header), 1, out);
+        for(unsigned int i = 0; i < names.size(); i++)
+        {
+            uint32_t nameLength = (uint32_t)names[i].size();
+            uint64_t range[2] = {offsets[i], (uint64_t)sources[i].size()};
+            fwrite(&nameLength, sizeof(nameLength), 1, out);
+            fwrite(names[i].data(), 1, nameLength, out);
+            fwrite(range, sizeof(range), 1, out);
+        }
+        for(unsigned int i = 0; i < files.size(); i++)
+        {
+            static const char padding[16] = {0};
+            fwrite(padding, 1, (size_t)(offsets[i] - ftell(out)), out);
+            if(sources[i].size() > 0)
+                fwrite(sources[i].data(), 1, sources[i].size(), out);
+        }
+
+        bool success = ferror(out) == 0;
+        return fclose(out) == 0 && success;
+    }
+
+private:
+    MappedFile file;
+    // name -> (offset, size)
+    std::unordered_map<std::string, std::pair<size_t, size_t> > entries;
+};
+
+// Serves reads straight out of a mapped file or pack entry: Read() is a memcpy, with no stdio buffer in
+// between and no syscall per call.
+class MappedIOStream : public Assimp::IOStream
+{
+public:
+    // 'owner' keeps the mapping (a MappedFile or AssetPack) alive for as long as the stream exists
+    MappedIOStream(const unsigned char *data, size_t size, const std::shared_ptr<void> &owner)
+        : bytes(data), length(size), cursor(0), owner(owner)
+    {
+    }
+
+    size_t Read(void *pvBuffer, size_t pSize, size_t pCount)
+    {
+        if(pSize == 0)
+            return 0;
+        size_t count = std::min(pCount, (length - cursor) / pSize);
+        if(count > 0)
+            memcpy(pvBuffer, bytes + cursor, count * pSize);
+        cursor += count * pSize;
+        return count;
+    }
+
+    size_t Write(const void *, size_t, size_t)
+    {
+        return 0;
+    }
+
+    aiReturn Seek(size_t pOffset, aiOrigin pOrigin)
+    {
+        // like fseek, offsets relative to the cursor or the end may be negative; they wrap around here
+        size_t position;
+        if(pOrigin == aiOrigin_SET)
+            position = pOffset;
+        else if(pOrigin == aiOrigin_CUR)
+            position = cursor + pOffset;
+        else
+            position = length + pOffset;
+
+        if(position > length)
+            return AI_FAILURE;
+        cursor = position;
+        return AI_SUCCESS;
+    }
+
+    size_t Tell() const
+    {
+        return cursor;
+    }
+
+    size_t FileSize() const
+    {
+        return length;
+    }
+
+    void Flush()
+    {
+    }
+
+private:
+    const unsigned char *bytes;
+    size_t length;
+    size_t cursor;
+    std::shared_ptr<void> owner;
+};
+
+// Assimp file system that memory maps every file it opens and looks in mounted asset packs first. Only
+// supports reading, which is all an import needs. Hand a new instance to Assimp::Importer::SetIOHandler(),
+// which takes ownership of it.
+class MappedIOSystem : public Assimp::IOSystem
+{
+public:
+    // makes the entries of 'pack' visible under 'mountPoint', e.g. a pack of "tree/tree.obj" mounted at
+    // "resources/objects" serves "resources/objects/tree/tree.obj". Mount packs before starting any import.
+    static void mount(const std::string &mountPoint, const std::shared_ptr<AssetPack> &pack)
+    {
+        mounts().push_back(std::make_pair(normalizeAssetPath(mountPoint), pack));
+    }
+
+    static void unmountAll()
+    {
+        mounts().clear();
+    }
+
+    bool Exists(const char *pFile) const
+    {
+        size_t size;
+        if(findInPacks(pFile, size) != NULL)
+            return true;
+        FILE *file = fopen(pFile, "rb");
+        if(file)
+            fclose(file);
+        return file != NULL;
+    }
+
+    char getOsSeparator() const
+    {
+        return '/';
+    }
+
+    Assimp::IOStream *Open(const char *pFile, const char *pMode = "rb")
+    {
+        if(pMode == NULL || pMode[0] != 'r')
+            return NULL;
+
+        std::shared_ptr<AssetPack> pack;
+        size_t size;
+        const unsigned char *data = findInPacks(pFile, size, &pack);
+        if(data != NULL)
+            return new MappedIOStream(data, size, pack);
+
+        std::shared_ptr<MappedFile> file(new MappedFile());
+        if(!file->open(pFile))
+            return NULL;
+        return new MappedIOStream(file->data(), file->size(), file);
+    }
+
+    void Close(Assimp::IOStream *pFile)
+    {
+        delete pFile;
+    }
+
+    bool ComparePaths(const char *one, const char *second) const
+    {
+        return normalizeAssetPath(one) == normalizeAssetPath(second);
+    }
+
+private:
+    typedef std::vector<std::pair<std::string, std::shared_ptr<AssetPack> > > MountList;
+
+    static MountList &mounts()
+    {
+        static MountList list;
+        return list;
+    }
+
+    static const unsigned char *findInPacks(const char *path, size_t &size, std::shared_ptr<AssetPack> *owner = NULL)
+    {
+        std::string normalized = normalizeAssetPath(path);
+        const MountList &list = mounts();
+        for(unsigned int i = 0; i < list.size(); i++)
+        {
+            const std::string &mountPoint = list[i].first;
+            std::string name;
+            if(mountPoint.empty())
+                name = normalized;
+            else if(normalized.size() > mountPoint.size() && normalized.compare(0, mountPoint.size(), mountPoint) == 0 && normalized[mountPoint.size()] == '/')
+                name = normalized.substr(mountPoint.size() + 1);
+            else
+                continue;
+
+            const unsigned char *data = list[i].second->find(name, size);
+            if(data != NULL)
+            {
+                if(owner)
+                    *owner = list[i].second;
+                return data;
+            }
+        }
+        return NULL;
+    }
+};
+#endif
@@ -7,7 +7,11 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <learnopengl/vertex_format.h>
+#include <learnopengl/geometry_arena.h>
+#include <learnopengl/mesh_simplify.h>
 
+#include <cstddef>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -34,106 +38,331 @@ struct Texture {
     string path;
 };
 
+// Per instance data of an instanced mesh draw, read by 5.4.model_loading.vs from attributes 5 to 9
+struct MeshInstance {
+    glm::mat4 Transform;
+    // multiplies the diffuse colour
+    glm::vec4 Tint;
+};
+
+// Viewer parameters for picking a level of detail by its projected error in pixels
+struct LodSelection {
+    glm::vec3 viewPos;
+    // pixels covered by one unit at a distance of one unit: screen height / (2 * tan(fovy / 2))
+    float pixelsPerUnit;
+    // coarsest level whose error stays below this many pixels is used
+    float maxPixelError;
+    // a coarser level is only switched to once its error is this fraction below maxPixelError, so meshes
+    // near a threshold don't pop back and forth
+    float hysteresis;
+
+    LodSelection(const glm::vec3 &viewPos, float screenHeight, float fovy, float maxPixelError = 1.0f, float hysteresis = 0.25f)
+        : viewPos(viewPos), pixelsPerUnit(screenHeight / (2.0f * tan(fovy * 0.5f))), maxPixelError(maxPixelError), hysteresis(hysteresis)
+    {
+    }
+};
+
 class Mesh {
 public:
     /*  Mesh Data  */
+    // CPU copies of the geometry; emptied once it is on the GPU unless 'retainData' is set
     vector<Vertex> vertices;
     vector<unsigned int> indices;
     vector<Texture> textures;
+    bool retainData;
+    // the VAO of the GeometryArena pool holding the mesh, shared with every mesh of the same vertex format
     unsigned int VAO;
+    GeometryAllocation geometry;
+    // compact layout of the vertices on the GPU; positions are stored relative to these bounds
+    VertexFormat format;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsExtent;
+    // levels of detail as ranges of 'indices', from full detail to coarsest
+    vector<MeshLod> lods;
+    unsigned int currentLod;
 
     /*  Functions  */
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor; without levels of detail all indices form a single level. With 'upload' false no GL calls
+    // are made until upload(), so a loader can spread the buffer creation of many meshes over several frames.
+    // 'retainData' keeps 'vertices' and 'indices' after the upload.
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, vector<MeshLod> lods = vector<MeshLod>(),
+         bool upload = true, bool retainData = false)
+        : retainData(retainData), VAO(0), currentLod(0), instanceVBO(0)
+    {
+        this->vertices.swap(vertices);
+        this->indices.swap(indices);
+        this->textures.swap(textures);
+        this->lods.swap(lods);
+        if(this->lods.empty())
+        {
+            MeshLod full = {0, (unsigned int)this->indices.size(), 0.0f};
+            this->lods.push_back(full);
+        }
+
+        if(upload)
+            this->upload();
+    }
+
+    // copies the mesh into the GeometryArena
+    void upload()
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        if(isUploaded())
+            return;
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
+        updateBindings();
     }
 
-    // render the mesh
-    void Draw(Shader shader) 
+    bool isUploaded() const
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
+        return VAO != 0;
+    }
+
+    // gives the mesh's space in the GeometryArena back; it can't be drawn afterwards. Copies of a Mesh
+    // share its allocation, so release only one of them.
+    void release()
+    {
+        GeometryArena::instance().free(geometry);
+        VAO = 0;
+    }
+
+    // render the mesh. Every sampler slot has a fixed texture unit (see textureUnit()), so drawing is only
+    // texture binds, the uniforms describing the vertex format and one draw call; the shader's sampler
+    // uniforms are assigned once per program.
+    void Draw(const Shader &shader)
+    {
+        unsigned int boundVAO = 0;
+        Draw(shader, boundVAO);
+        glBindVertexArray(0);
+
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // for drawing many meshes in a row: only binds the mesh's VAO if it isn't 'boundVAO' already and leaves
+    // it bound, so meshes sharing a pool are drawn without switching VAOs
+    void Draw(const Shader &shader, unsigned int &boundVAO)
+    {
+        prepareDraw(shader, false, boundVAO);
+
+        // draw mesh
+        const MeshLod &lod = lods[currentLod];
+        glDrawElementsBaseVertex(GL_TRIANGLES, lod.indexCount, GL_UNSIGNED_INT, indexPointer(lod), geometry.vertexOffset);
+    }
+
+    // renders 'count' instances of the mesh with one draw call, taking their transformations and tints from
+    // the buffer attached with setInstanceBuffer(). All instances use the current level of detail.
+    void DrawInstanced(const Shader &shader, unsigned int count)
+    {
+        unsigned int boundVAO = 0;
+        DrawInstanced(shader, count, boundVAO);
+        glBindVertexArray(0);
+
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void DrawInstanced(const Shader &shader, unsigned int count, unsigned int &boundVAO)
+    {
+        if(instanceVBO == 0 || count == 0 || !isUploaded())
+            return;
+
+        // the VAO is shared, so the per instance attributes (locations 5 to 9, see MeshInstance) are pointed
+        // at this mesh's buffer whenever another mesh last drew from a different one
+        GeometryPool &pool = *geometry.pool;
+        if(pool.instanceBuffer != instanceVBO)
+        {
+            glBindVertexArray(VAO);
+            boundVAO = VAO;
+            pool.instanceBuffer = instanceVBO;
+
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            // transformation: a mat4 occupies four consecutive vec4 attribute slots
+            for(unsigned int i = 0; i < 4; i++)
+            {
+                glEnableVertexAttribArray(5 + i);
+                glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, sizeof(MeshInstance), (void*)(offsetof(MeshInstance, Transform) + i * sizeof(glm::vec4)));
+                glVertexAttribDivisor(5 + i, 1);
+            }
+            glEnableVertexAttribArray(9);
+            glVertexAttribPointer(9, 4, GL_FLOAT, GL_FALSE, sizeof(MeshInstance), (void*)offsetof(MeshInstance, Tint));
+            glVertexAttribDivisor(9, 1);
+        }
+
+        prepareDraw(shader, true, boundVAO);
+
+        const MeshLod &lod = lods[currentLod];
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lod.indexCount, GL_UNSIGNED_INT, indexPointer(lod), count, geometry.vertexOffset);
+    }
+
+    // sources the per instance attributes (locations 5 to 9, see MeshInstance) from 'buffer'
+    void setInstanceBuffer(unsigned int buffer)
+    {
+        instanceVBO = buffer;
+    }
+
+    // picks the level drawn by the next Draw() from the error it would show on screen with this model matrix
+    void selectLod(const glm::mat4 &model, const LodSelection &selection)
+    {
+        // the bounding sphere decides the distance, so the whole mesh is treated as being at its nearest point
+        float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        glm::vec3 center = glm::vec3(model * glm::vec4(boundsMin + boundsExtent * 0.5f, 1.0f));
+        float radius = glm::length(boundsExtent) * 0.5f * scale;
+        float distance = std::max(glm::length(center - selection.viewPos) - radius, 1e-4f);
+        float pixelsPerError = scale * selection.pixelsPerUnit / distance;
+
+        // refine right away, coarsen only with some margin
+        unsigned int lod = std::min(currentLod, (unsigned int)lods.size() - 1);
+        while(lod > 0 && lods[lod].error * pixelsPerError > selection.maxPixelError)
+            lod--;
+        while(lod + 1 < lods.size() && lods[lod + 1].error * pixelsPerError <= selection.maxPixelError * (1.0f - selection.hysteresis))
+            lod++;
+        currentLod = lod;
+    }
+
+    // recomputes the texture bindings; call after changing 'textures'
+    void updateBindings()
+    {
+        bindings.clear();
+        unsigned int counts[SAMPLER_TYPE_COUNT] = {0};
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-				number = std::to_string(diffuseNr++);
-			else if(name == "texture_specular")
-				number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-				number = std::to_string(normalNr++); // transfer unsigned int to stream
-             else if(name == "texture_height")
-			    number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-													 // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            int type = samplerType(textures[i].type);
+            if(type < 0 || counts[type] == SAMPLERS_PER_TYPE)
+                continue;
+
+            TextureBinding binding;
+            binding.unit = GL_TEXTURE0 + textureUnit(type, counts[type]++);
+            binding.id = textures[i].id;
+            bindings.push_back(binding);
         }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // the sampler types a model shader can declare, as texture_<type>1 .. texture_<type>4
+    static const unsigned int SAMPLER_TYPE_COUNT = 4;
+    static const unsigned int SAMPLERS_PER_TYPE = 4;
+
+    static const char *samplerTypeName(unsigned int type)
+    {
+        static const char *names[SAMPLER_TYPE_COUNT] = {"texture_diffuse", "texture_specular", "texture_normal", "texture_height"};
+        return names[type];
+    }
+
+    static int samplerType(const string &name)
+    {
+        for(unsigned int type = 0; type < SAMPLER_TYPE_COUNT; type++)
+        {
+            if(name == samplerTypeName(type))
+                return type;
+        }
+        return -1;
+    }
+
+    // texture_diffuseN uses unit N - 1, texture_specularN 4 + N - 1 and so on, 16 units in total
+    // (the minimum every GL 3.3 implementation provides to the fragment shader)
+    static unsigned int textureUnit(unsigned int type, unsigned int index)
+    {
+        return type * SAMPLERS_PER_TYPE + index;
+    }
+
+    // uniform locations of a program that draws meshes
+    struct ProgramState {
+        unsigned int program;
+        GLint boundsMin;
+        GLint boundsExtent;
+        GLint attributes;
+        GLint instanced;
+    };
+
+    // looks up the mesh uniforms of a program and points every sampler at its fixed unit. Only done the
+    // first time a program is seen; the shader must be in use.
+    static const ProgramState &programState(const Shader &shader)
+    {
+        static vector<ProgramState> programs;
+        for(unsigned int i = 0; i < programs.size(); i++)
+        {
+            if(programs[i].program == shader.ID)
+                return programs[i];
+        }
+
+        ProgramState state;
+        state.program = shader.ID;
+        state.boundsMin = glGetUniformLocation(shader.ID, "meshBoundsMin");
+        state.boundsExtent = glGetUniformLocation(shader.ID, "meshBoundsExtent");
+        state.attributes = glGetUniformLocation(shader.ID, "meshAttributes");
+        state.instanced = glGetUniformLocation(shader.ID, "instanced");
+        programs.push_back(state);
+
+        for(unsigned int type = 0; type < SAMPLER_TYPE_COUNT; type++)
+        {
+            for(unsigned int index = 0; index < SAMPLERS_PER_TYPE; index++)
+            {
+                string name = samplerTypeName(type) + std::to_string(index + 1);
+                GLint location = glGetUniformLocation(shader.ID, name.c_str());
+                if(location != -1)
+                    glUniform1i(location, textureUnit(type, index));
+            }
+        }
+        return programs.back();
     }
 
 private:
+    struct TextureBinding {
+        GLenum unit;
+        unsigned int id;
+    };
+
     /*  Render data  */
-    unsigned int VBO, EBO;
+    unsigned int instanceVBO;
+    vector<TextureBinding> bindings;
+
+    // sets the uniforms and textures of the mesh and binds its VAO unless it is 'boundVAO' already
+    void prepareDraw(const Shader &shader, bool instanced, unsigned int &boundVAO)
+    {
+        const ProgramState &program = programState(shader);
+        glUniform3fv(program.boundsMin, 1, &boundsMin[0]);
+        glUniform3fv(program.boundsExtent, 1, &boundsExtent[0]);
+        glUniform1i(program.attributes, format.attributes);
+        glUniform1i(program.instanced, instanced);
+
+        // bind appropriate textures
+        for(unsigned int i = 0; i < bindings.size(); i++)
+        {
+            glActiveTexture(bindings[i].unit);
+            glBindTexture(GL_TEXTURE_2D, bindings[i].id);
+        }
+        if(boundVAO != VAO)
+        {
+            glBindVertexArray(VAO);
+            boundVAO = VAO;
+        }
+    }
+
+    // byte offset of a level's indices in the pool's index buffer
+    const void *indexPointer(const MeshLod &lod) const
+    {
+        return (const void*)((size_t)(geometry.indexOffset + lod.indexOffset) * sizeof(unsigned int));
+    }
 
     /*  Functions    */
-    // initializes all the buffer objects/arrays
+    // quantizes the vertices and copies them and the indices into the GeometryArena
     void setupMesh()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);	
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);	
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);	
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        // pick the smallest layout holding everything the mesh uses and quantize the vertices into it
+        format = VertexFormat(chooseVertexAttributes(vertices, textures));
+        vector<unsigned char> encoded;
+        encodeVertices(vertices, format, encoded, boundsMin, boundsExtent);
 
-        glBindVertexArray(0);
+        geometry = GeometryArena::instance().allocate(format, encoded.empty() ? NULL : &encoded[0], (unsigned int)vertices.size(),
+                                                      indices.empty() ? NULL : &indices[0], (unsigned int)indices.size());
+        VAO = geometry.pool->VAO;
+
+        if(!retainData)
+        {
+            vector<Vertex>().swap(vertices);
+            vector<unsigned int>().swap(indices);
+        }
     }
 };
 #endif
@@ -0,0 +1,245 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/mapped_file.h>
+
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Binary cache of the meshes Model extracts from an assimp scene. The blob is stored next to the source
+// asset as <asset>.meshcache and is only used while the hash of the source file, the import flags, the
+// cache version and the Vertex layout all still match, so editing the asset transparently re-imports it.
+//
+// Layout (little endian, no padding):
+//   MeshCacheHeader
+//   per mesh: uint32 vertexCount, uint32 indexCount, uint32 textureCount, uint32 lodCount,
+//             per texture: uint32 typeLength, type, uint32 pathLength, path
+//             Vertex[vertexCount], uint32[indexCount], MeshLod[lodCount]
+
+// bump whenever the layout or the way meshes are processed changes
+const uint32_t MESH_CACHE_VERSION = 3;
+
+struct MeshCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t vertexSize;
+    uint32_t importFlags;
+    uint32_t meshCount;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+};
+
+// CPU side copy of one cached mesh; texture ids are left at 0 for the caller to resolve by path
+struct CachedMesh {
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<Texture> textures;
+    vector<MeshLod> lods;
+};
+
+// 64-bit FNV-1a
+inline uint64_t hashBytes(const unsigned char *data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+    for(size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline string meshCachePath(const string &sourcePath)
+{
+    return sourcePath + ".meshcache";
+}
+
+// bounds checked reader over the mapped cache blob
+class MeshCacheReader
+{
+public:
+    MeshCacheReader(const unsigned char *data, size_t size) : cursor(data), end(data + size)
+    {
+    }
+
+    bool read(void *destination, size_t size)
+    {
+        if((size_t)(end - cursor) < size)
+            return false;
+        if(size > 0)
+            memcpy(destination, cursor, size);
+        cursor += size;
+        return true;
+    }
+
+    bool readString(string &value)
+    {
+        uint32_t length;
+        if(!read(&length, sizeof(length)) || (size_t)(end - cursor) < length)
+            return false;
+        value.assign((const char*)cursor, length);
+        cursor += length;
+        return true;
+    }
+
+    bool atEnd() const
+    {
+        return cursor == end;
+    }
+
+    size_t remaining() const
+    {
+        return (size_t)(end - cursor);
+    }
+
+private:
+    const unsigned char *cursor;
+    const unsigned char *end;
+};
+
+inline void fillMeshCacheHeader(MeshCacheHeader &header, const MappedFile &source, unsigned int importFlags, uint32_t meshCount)
+{
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "LOGLMESH", 8);
+    header.version = MESH_CACHE_VERSION;
+    header.vertexSize = sizeof(Vertex);
+    header.importFlags = importFlags;
+    header.meshCount = meshCount;
+    header.sourceHash = hashBytes(source.data(), source.size());
+    header.sourceSize = source.size();
+}
+
+// loads the cached meshes of a source asset; returns false if there is no cache or it is stale
+inline bool readMeshCache(const string &sourcePath, unsigned int importFlags, vector<CachedMesh> &meshes)
+{
+    MappedFile cache;
+    if(!cache.open(meshCachePath(sourcePath)) || cache.size() < sizeof(MeshCacheHeader))
+        return false;
+
+    MeshCacheReader reader(cache.data(), cache.size());
+    MeshCacheHeader header;
+    reader.read(&header, sizeof(header));
+    if(memcmp(header.magic, "LOGLMESH", 8) != 0 || header.version != MESH_CACHE_VERSION ||
+       header.vertexSize != sizeof(Vertex) || header.importFlags != importFlags)
+        return false;
+
+    // the source has to be unchanged
+    MappedFile source;
+    if(!source.open(sourcePath) || source.size() != header.sourceSize || hashBytes(source.data(), source.size()) != header.sourceHash)
+        return false;
+
+    // every count is checked against the bytes left before anything is allocated for it, so a truncated or
+    // corrupt cache is rebuilt instead of asking for a huge allocation
+    if((uint64_t)header.meshCount * 4 * sizeof(uint32_t) > reader.remaining())
+        return false;
+    vector<CachedMesh> loaded(header.meshCount);
+    for(uint32_t i = 0; i < header.meshCount; i++)
+    {
+        uint32_t counts[4];
+        if(!reader.read(counts, sizeof(counts)))
+            return false;
+
+        // each texture is at least the lengths of its type and path
+        if((uint64_t)counts[2] * 2 * sizeof(uint32_t) > reader.remaining())
+            return false;
+        CachedMesh &mesh = loaded[i];
+        mesh.textures.resize(counts[2]);
+        for(uint32_t j = 0; j < counts[2]; j++)
+        {
+            mesh.textures[j].id = 0;
+            if(!reader.readString(mesh.textures[j].type) || !reader.readString(mesh.textures[j].path))
+                return false;
+        }
+
+        if((uint64_t)counts[0] * sizeof(Vertex) + (uint64_t)counts[1] * sizeof(unsigned int) + (uint64_t)counts[3] * sizeof(MeshLod) > reader.remaining())
+            return false;
+        mesh.vertices.resize(counts[0]);
+        mesh.indices.resize(counts[1]);
+        mesh.lods.resize(counts[3]);
+        if(!reader.read(mesh.vertices.empty() ? NULL : &mesh.vertices[0], counts[0] * sizeof(Vertex)) ||
+           !reader.read(mesh.indices.empty() ? NULL : &mesh.indices[0], counts[1] * sizeof(unsigned int)) ||
+           !reader.read(mesh.lods.empty() ? NULL : &mesh.lods[0], counts[3] * sizeof(MeshLod)))
+            return false;
+
+        // every index and LOD range must stay inside the mesh, or drawing it reads past its buffers
+        for(uint32_t j = 0; j < counts[1]; j++)
+        {
+            if(mesh.indices[j] >= counts[0])
+                return false;
+        }
+        for(uint32_t j = 0; j < counts[3]; j++)
+        {
+            if((uint64_t)mesh.lods[j].indexOffset + mesh.lods[j].indexCount > counts[1])
+                return false;
+        }
+    }
+
+    if(!reader.atEnd())
+        return false;
+
+    meshes.swap(loaded);
+    return true;
+}
+
+inline void writeMeshCacheString(FILE *file, const string &value)
+{
+    uint32_t length = (uint32_t)value.size();
+    fwrite(&length, sizeof(length), 1, file);
+    fwrite(value.data(), 1, length, file);
+}
+
+// stores the processed meshes (Mesh or CachedMesh) of a source asset; written to a temporary file first so
+// a crash never leaves a truncated cache behind
+template <typename MeshType>
+bool writeMeshCache(const string &sourcePath, unsigned int importFlags, const vector<MeshType> &meshes)
+{
+    MappedFile source;
+    if(!source.open(sourcePath))
+        return false;
+
+    string path = meshCachePath(sourcePath);
+    string temporaryPath = path + ".tmp";
+    FILE *file = fopen(temporaryPath.c_str(), "wb");
+    if(!file)
+        return false;
+
+    MeshCacheHeader header;
+    fillMeshCacheHeader(header, source, importFlags, (uint32_t)meshes.size());
+    fwrite(&header, sizeof(header), 1, file);
+
+    for(unsigned int i = 0; i < meshes.size(); i++)
+    {
+        const MeshType &mesh = meshes[i];
+        uint32_t counts[4] = {(uint32_t)mesh.vertices.size(), (uint32_t)mesh.indices.size(), (uint32_t)mesh.textures.size(), (uint32_t)mesh.lods.size()};
+        fwrite(counts, sizeof(counts), 1, file);
+
+        for(unsigned int j = 0; j < mesh.textures.size(); j++)
+        {
+            writeMeshCacheString(file, mesh.textures[j].type);
+            writeMeshCacheString(file, mesh.textures[j].path);
+        }
+
+        if(!mesh.vertices.empty())
+            fwrite(&mesh.vertices[0], sizeof(Vertex), mesh.vertices.size(), file);
+        if(!mesh.indices.empty())
+            fwrite(&mesh.indices[0], sizeof(unsigned int), mesh.indices.size(), file);
+        if(!mesh.lods.empty())
+            fwrite(&mesh.lods[0], sizeof(MeshLod), mesh.lods.size(), file);
+    }
+
+    bool success = ferror(file) == 0;
+    success = fclose(file) == 0 && success;
+
+    // rename() doesn't replace an existing file on every platform
+    remove(path.c_str());
+    if(!success || rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+#endif
@@ -0,0 +1,407 @@
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh_simplify.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+
+// Index and vertex order optimization, run once when a mesh is imported (the result is what the mesh cache
+// stores). In pipeline order:
+//   weldVertices         merges bitwise identical vertices, so triangles actually share them
+//   optimizeVertexCache  orders triangles for the post-transform vertex cache (Forsyth)
+//   optimizeOverdraw     reorders clusters of those triangles so outward facing ones are drawn first
+//                        (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw")
+//   optimizeVertexFetch  renumbers vertices in the order they are first used, so fetches walk the VBO linearly
+
+// Post-transform cache efficiency of a triangle list, simulated with a FIFO cache
+struct VertexCacheStats {
+    // vertex shader invocations per triangle: 3 is the worst, about 0.5 the best for a large regular grid
+    float acmr;
+    // vertex shader invocations per referenced vertex: 1 is ideal
+    float atvr;
+};
+
+// size of the simulated FIFO; current GPUs behave like a cache of roughly this many vertices
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+inline VertexCacheStats analyzeVertexCache(const unsigned int *indices, unsigned int indexCount, unsigned int vertexCount,
+                                           unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+    VertexCacheStats stats = {0.0f, 0.0f};
+    if(indexCount < 3)
+        return stats;
+
+    // a vertex is in the FIFO if it missed less than 'cacheSize' misses ago
+    std::vector<unsigned int> insertedAt(vertexCount, 0);
+    unsigned int misses = 0;
+    unsigned int referenced = 0;
+    for(unsigned int i = 0; i < indexCount; i++)
+    {
+        unsigned int v = indices[i];
+        if(insertedAt[v] == 0)
+            referenced++;
+        else if(insertedAt[v] + cacheSize > misses)
+            continue;
+        insertedAt[v] = ++misses;
+    }
+
+    stats.acmr = (float)misses / (indexCount / 3);
+    stats.atvr = (float)misses / referenced;
+    return stats;
+}
+
+// Merges vertices whose every byte is equal and rewrites 'indices' to match. Importers tend to emit one
+// vertex per triangle corner, which leaves nothing for the vertex cache to reuse.
+template <typename VertexType>
+void weldVertices(std::vector<VertexType> &vertices, std::vector<unsigned int> &indices)
+{
+    // open addressing table of vertex indices with linear probing, at most half full
+    const unsigned int EMPTY = ~0u;
+    size_t tableSize = 1;
+    while(tableSize < vertices.size() * 2)
+        tableSize *= 2;
+    std::vector<unsigned int> table(tableSize, EMPTY);
+
+    std::vector<unsigned int> remap(vertices.size());
+    unsigned int kept = 0;
+    for(unsigned int i = 0; i < vertices.size(); i++)
+    {
+        // 64-bit FNV-1a of the vertex's bytes
+        const unsigned char *bytes = (const unsigned char*)&vertices[i];
+        uint64_t hash = 14695981039346656037ULL;
+        for(size_t b = 0; b < sizeof(VertexType); b++)
+            hash = (hash ^ bytes[b]) * 1099511628211ULL;
+
+        size_t slot = (size_t)(hash ^ (hash >> 32)) & (tableSize - 1);
+        while(table[slot] != EMPTY && memcmp(&vertices[table[slot]], &vertices[i], sizeof(VertexType)) != 0)
+            slot = (slot + 1) & (tableSize - 1);
+
+        if(table[slot] == EMPTY)
+        {
+            // unique vertices are compacted in place; slot 'kept' has already been looked at, so the table can
+            // point at the moved copy
+            vertices[kept] = vertices[i];
+            table[slot] = kept;
+            remap[i] = kept++;
+        }
+        else
+            remap[i] = table[slot];
+    }
+    vertices.resize(kept);
+
+    for(unsigned int i = 0; i < indices.size(); i++)
+        indices[i] = remap[indices[i]];
+}
+
+// Reorders the triangles of 'indices' (a triangle list of 'indexCount' indices into 'vertexCount' vertices)
+// in place for the post-transform cache, using Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": the
+// next triangle is always the best scoring one among those using a cached vertex, where vertices score
+// higher the more recently they were used and the fewer triangles they have left.
+inline void optimizeVertexCache(unsigned int *indices, unsigned int indexCount, unsigned int vertexCount)
+{
+    const int CACHE_SIZE = 32;
+    const float CACHE_DECAY_POWER = 1.5f;
+    const float LAST_TRIANGLE_SCORE = 0.75f;
+    const float VALENCE_BOOST_SCALE = 2.0f;
+    const float VALENCE_BOOST_POWER = 0.5f;
+
+    unsigned int triangleCount = indexCount / 3;
+    if(triangleCount < 2)
+        return;
+
+    // triangles around each vertex; the first 'remaining[v]' entries are the ones not emitted yet
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for(unsigned int i = 0; i < triangleCount * 3; i++)
+        offsets[indices[i] + 1]++;
+    for(unsigned int v = 0; v < vertexCount; v++)
+        offsets[v + 1] += offsets[v];
+    std::vector<unsigned int> adjacent(triangleCount * 3);
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for(unsigned int i = 0; i < triangleCount * 3; i++)
+    {
+        unsigned int v = indices[i];
+        adjacent[offsets[v] + remaining[v]++] = i / 3;
+    }
+
+    float cacheScores[CACHE_SIZE];
+    for(int i = 0; i < CACHE_SIZE; i++)
+    {
+        // the three vertices of the last triangle get a fixed score, so it isn't simply repeated
+        if(i < 3)
+            cacheScores[i] = LAST_TRIANGLE_SCORE;
+        else
+            cacheScores[i] = std::pow(1.0f - (float)(i - 3) / (CACHE_SIZE - 3), CACHE_DECAY_POWER);
+    }
+    const unsigned int VALENCE_TABLE_SIZE = 64;
+    float valenceScores[VALENCE_TABLE_SIZE];
+    for(unsigned int i = 0; i < VALENCE_TABLE_SIZE; i++)
+        valenceScores[i] = i == 0 ? 0.0f : VALENCE_BOOST_SCALE * std::pow((float)i, -VALENCE_BOOST_POWER);
+
+    // a vertex without triangles left is never looked at again
+    auto scoreVertex = [&](int position, unsigned int valence) -> float
+    {
+        if(valence == 0)
+            return -1.0f;
+        float score = position >= 0 ? cacheScores[position] : 0.0f;
+        return score + (valence < VALENCE_TABLE_SIZE ? valenceScores[valence] : VALENCE_BOOST_SCALE * std::pow((float)valence, -VALENCE_BOOST_POWER));
+    };
+    std::vector<float> vertexScore(vertexCount);
+    for(unsigned int v = 0; v < vertexCount; v++)
+        vertexScore[v] = scoreVertex(-1, remaining[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<char> emitted(triangleCount, 0);
+    unsigned int best = 0;
+    for(unsigned int t = 0; t < triangleCount; t++)
+    {
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+        if(triangleScore[t] > triangleScore[best])
+            best = t;
+    }
+
+    std::vector<unsigned int> ordered;
+    ordered.reserve(triangleCount * 3);
+    std::vector<unsigned int> cache, nextCache;
+    cache.reserve(CACHE_SIZE + 3);
+    nextCache.reserve(CACHE_SIZE + 3);
+    unsigned int scanCursor = 0;
+
+    for(unsigned int step = 0; step < triangleCount; step++)
+    {
+        emitted[best] = 1;
+        const unsigned int *triangle = &indices[best * 3];
+        ordered.insert(ordered.end(), triangle, triangle + 3);
+
+        // move the triangle's vertices to the front of the cache and drop it from their adjacency
+        nextCache.assign(triangle, triangle + 3);
+        for(unsigned int i = 0; i < cache.size(); i++)
+        {
+            if(cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2])
+                nextCache.push_back(cache[i]);
+        }
+        for(unsigned int e = 0; e < 3; e++)
+        {
+            unsigned int v = triangle[e];
+            unsigned int *list = &adjacent[offsets[v]];
+            // degenerate triangles list a vertex more than once
+            for(unsigned int i = 0; i < remaining[v]; )
+            {
+                if(list[i] == best)
+                    std::swap(list[i], list[--remaining[v]]);
+                else
+                    i++;
+            }
+        }
+
+        // rescore everything that moved in or out of the cache and the triangles around it
+        for(unsigned int i = 0; i < nextCache.size(); i++)
+        {
+            unsigned int v = nextCache[i];
+            float score = scoreVertex(i < (unsigned int)CACHE_SIZE ? (int)i : -1, remaining[v]);
+            float delta = score - vertexScore[v];
+            vertexScore[v] = score;
+            const unsigned int *list = &adjacent[offsets[v]];
+            for(unsigned int j = 0; j < remaining[v]; j++)
+                triangleScore[list[j]] += delta;
+        }
+        if(nextCache.size() > (unsigned int)CACHE_SIZE)
+            nextCache.resize(CACHE_SIZE);
+        cache.swap(nextCache);
+
+        // the next triangle is the best one touching the cache...
+        bool found = false;
+        float bestScore = -1.0f;
+        for(unsigned int i = 0; i < cache.size(); i++)
+        {
+            unsigned int v = cache[i];
+            const unsigned int *list = &adjacent[offsets[v]];
+            for(unsigned int j = 0; j < remaining[v]; j++)
+            {
+                if(triangleScore[list[j]] > bestScore)
+                {
+                    bestScore = triangleScore[list[j]];
+                    best = list[j];
+                    found = true;
+                }
+            }
+        }
+        // ...or, once that part of the mesh is done, the next one in input order
+        if(!found)
+        {
+            while(scanCursor < triangleCount && emitted[scanCursor])
+                scanCursor++;
+            best = scanCursor;
+        }
+    }
+
+    std::copy(ordered.begin(), ordered.end(), indices);
+}
+
+// Splits cache optimized triangles into clusters and sorts those so the ones facing away from the mesh
+// centre, which are likely to occlude the others, come first. Clusters start wherever the cache is cold
+// anyway and, inside those, wherever the ACMR so far is within 'threshold' of the whole run, so the
+// reordering costs at most that much vertex cache efficiency.
+template <typename VertexType>
+void optimizeOverdraw(unsigned int *indices, unsigned int indexCount, const std::vector<VertexType> &vertices, float threshold = 1.05f)
+{
+    unsigned int triangleCount = indexCount / 3;
+    if(triangleCount < 2)
+        return;
+
+    // hard boundaries: triangles where all three vertices miss
+    std::vector<unsigned int> hard;
+    {
+        std::vector<unsigned int> insertedAt(vertices.size(), 0);
+        unsigned int misses = 0;
+        for(unsigned int t = 0; t < triangleCount; t++)
+        {
+            unsigned int missed = 0;
+            for(unsigned int e = 0; e < 3; e++)
+            {
+                unsigned int v = indices[t * 3 + e];
+                if(insertedAt[v] != 0 && insertedAt[v] + VERTEX_CACHE_SIZE > misses)
+                    continue;
+                insertedAt[v] = ++misses;
+                missed++;
+            }
+            if(missed == 3 || t == 0)
+                hard.push_back(t);
+        }
+        hard.push_back(triangleCount);
+    }
+
+    // soft boundaries inside each hard cluster, simulating a cold cache from each one
+    std::vector<unsigned int> clusters;
+    std::vector<unsigned int> insertedAt(vertices.size(), 0);
+    unsigned int misses = 0;
+    for(unsigned int h = 0; h + 1 < hard.size(); h++)
+    {
+        unsigned int start = hard[h], end = hard[h + 1];
+        // ACMR of the whole hard cluster from a cold cache
+        misses += VERTEX_CACHE_SIZE;
+        unsigned int hardStart = misses;
+        for(unsigned int i = start * 3; i < end * 3; i++)
+        {
+            unsigned int v = indices[i];
+            if(insertedAt[v] == 0 || insertedAt[v] + VERTEX_CACHE_SIZE <= misses)
+                insertedAt[v] = ++misses;
+        }
+        float target = (float)(misses - hardStart) / (end - start) * threshold;
+
+        clusters.push_back(start);
+        unsigned int clusterStart = start;
+        unsigned int clusterMisses = 0;
+        misses += VERTEX_CACHE_SIZE;
+        for(unsigned int t = start; t < end; t++)
+        {
+            for(unsigned int e = 0; e < 3; e++)
+            {
+                unsigned int v = indices[t * 3 + e];
+                if(insertedAt[v] != 0 && insertedAt[v] + VERTEX_CACHE_SIZE > misses)
+                    continue;
+                insertedAt[v] = ++misses;
+                clusterMisses++;
+            }
+            if(t + 1 < end && (float)clusterMisses / (t + 1 - clusterStart) <= target)
+            {
+                clusters.push_back(t + 1);
+                clusterStart = t + 1;
+                clusterMisses = 0;
+                // the next cluster may be drawn anywhere, so it starts with a cold cache
+                misses += VERTEX_CACHE_SIZE;
+            }
+        }
+    }
+    clusters.push_back(triangleCount);
+
+    // area weighted centroid of the whole mesh and of each cluster, and each cluster's average normal
+    unsigned int clusterCount = (unsigned int)clusters.size() - 1;
+    std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for(unsigned int c = 0; c < clusterCount; c++)
+    {
+        float area = 0.0f;
+        for(unsigned int t = clusters[c]; t < clusters[c + 1]; t++)
+        {
+            const glm::vec3 &a = vertices[indices[t * 3]].Position;
+            const glm::vec3 &b = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3 &p = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 normal = glm::cross(b - a, p - a);
+            float weight = glm::length(normal);
+            centroids[c] += (a + b + p) * (weight / 3.0f);
+            normals[c] += normal;
+            area += weight;
+        }
+        meshCentroid += centroids[c];
+        meshArea += area;
+        if(area > 0.0f)
+            centroids[c] /= area;
+    }
+    if(meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    std::vector<std::pair<float, unsigned int> > order(clusterCount);
+    for(unsigned int c = 0; c < clusterCount; c++)
+    {
+        float length = glm::length(normals[c]);
+        float key = length > 0.0f ? glm::dot(centroids[c] - meshCentroid, normals[c] / length) : 0.0f;
+        // sorted ascending, so negate to draw the most outward facing clusters first
+        order[c] = std::make_pair(-key, c);
+    }
+    std::stable_sort(order.begin(), order.end());
+
+    std::vector<unsigned int> sorted;
+    sorted.reserve(triangleCount * 3);
+    for(unsigned int i = 0; i < clusterCount; i++)
+    {
+        unsigned int c = order[i].second;
+        sorted.insert(sorted.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+    }
+    std::copy(sorted.begin(), sorted.end(), indices);
+}
+
+// Renumbers vertices in the order 'indices' first uses them and drops unused ones
+template <typename VertexType>
+void optimizeVertexFetch(std::vector<VertexType> &vertices, std::vector<unsigned int> &indices)
+{
+    const unsigned int UNUSED = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), UNUSED);
+    std::vector<VertexType> ordered;
+    ordered.reserve(vertices.size());
+    for(unsigned int i = 0; i < indices.size(); i++)
+    {
+        unsigned int &target = remap[indices[i]];
+        if(target == UNUSED)
+        {
+            target = (unsigned int)ordered.size();
+            ordered.push_back(vertices[indices[i]]);
+        }
+        indices[i] = target;
+    }
+    vertices.swap(ordered);
+}
+
+// Cache and overdraw optimizes every level of detail of a welded mesh, then lays out its vertices for the
+// full detail level (coarser levels only use a subset of them). The level ranges stay valid.
+template <typename VertexType>
+void optimizeMesh(std::vector<VertexType> &vertices, std::vector<unsigned int> &indices, const std::vector<MeshLod> &lods)
+{
+    for(unsigned int i = 0; i < lods.size(); i++)
+    {
+        if(lods[i].indexCount == 0)
+            continue;
+        unsigned int *range = &indices[lods[i].indexOffset];
+        optimizeVertexCache(range, lods[i].indexCount, (unsigned int)vertices.size());
+        optimizeOverdraw(range, lods[i].indexCount, vertices);
+    }
+    optimizeVertexFetch(vertices, indices);
+}
+#endif
@@ -0,0 +1,463 @@
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <vector>
+
+// One level of detail of a mesh: a range of its index buffer. Every level indexes the same vertices, so
+// all levels share one VBO and differ only in the range that is drawn.
+struct MeshLod {
+    unsigned int indexOffset;
+    unsigned int indexCount;
+    // largest distance (in object space) the level deviates from the full detail surface, estimated from
+    // the quadric error of the collapses that produced it
+    float error;
+};
+
+// Quadric error metric simplification (Garland & Heckbert) with half edge collapses. Collapsing a vertex
+// onto one of its neighbours never creates new vertices, which is what lets the levels share a VBO.
+//
+// Vertices at the same position are simplified as one, so UV and normal seams stay closed: when a seam
+// vertex collapses, each of its copies moves onto the copy of the target that shares a triangle with it.
+// Edges that only belong to one triangle (mesh borders and attribute seams) get an extra quadric that
+// keeps them in place.
+class MeshSimplifier
+{
+public:
+    // builds the positions of the simplification; 'indices' is a triangle list
+    MeshSimplifier(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices)
+        : positions(positions), triangles(indices), collapsedError(0.0f)
+    {
+        weldPositions();
+        liveTriangles = (unsigned int)triangles.size() / 3;
+        alive.assign(liveTriangles, true);
+
+        buildAdjacency();
+        computeQuadrics();
+
+        // queue every edge once
+        std::vector<unsigned long long> edges;
+        edges.reserve(triangles.size());
+        for(unsigned int t = 0; t < alive.size(); t++)
+        {
+            for(unsigned int e = 0; alive[t] && e < 3; e++)
+            {
+                unsigned long long a = group[triangles[t * 3 + e]], b = group[triangles[t * 3 + (e + 1) % 3]];
+                edges.push_back(std::min(a, b) << 32 | std::max(a, b));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+        std::vector<Collapse> initial(edges.size());
+        for(unsigned int i = 0; i < edges.size(); i++)
+            initial[i] = evaluateEdge((unsigned int)(edges[i] >> 32), (unsigned int)(edges[i] & 0xFFFFFFFFULL));
+        std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse> > heap(std::greater<Collapse>(), std::move(initial));
+        candidates.swap(heap);
+    }
+
+    unsigned int triangleCount() const
+    {
+        return liveTriangles;
+    }
+
+    // largest error of any collapse so far
+    float error() const
+    {
+        return collapsedError;
+    }
+
+    // collapses edges in order of increasing error until at most 'targetTriangles' are left or no valid
+    // collapse remains; returns false in the latter case
+    bool simplify(unsigned int targetTriangles)
+    {
+        while(liveTriangles > targetTriangles)
+        {
+            if(candidates.empty())
+                return false;
+
+            Collapse collapse = candidates.top();
+            candidates.pop();
+            if(version[collapse.from] != collapse.fromVersion || version[collapse.to] != collapse.toVersion)
+                continue;
+            if(!canCollapse(collapse.from, collapse.to))
+                continue;
+
+            applyCollapse(collapse.from, collapse.to);
+            collapsedError = std::max(collapsedError, (float)std::sqrt(std::max(collapse.cost, 0.0)));
+        }
+        return true;
+    }
+
+    // appends the remaining triangles to 'indices'
+    void appendTriangles(std::vector<unsigned int> &indices) const
+    {
+        for(unsigned int t = 0; t < alive.size(); t++)
+        {
+            if(alive[t])
+                indices.insert(indices.end(), &triangles[t * 3], &triangles[t * 3] + 3);
+        }
+    }
+
+private:
+    struct Quadric {
+        // symmetric 4x4 matrix: a2 ab ac ad b2 bc bd c2 cd d2
+        double m[10];
+
+        Quadric()
+        {
+            memset(m, 0, sizeof(m));
+        }
+
+        // squared distance to the plane ax + by + cz + d = 0 (with a unit normal), scaled by weight
+        static Quadric plane(const glm::dvec3 &n, double d, double weight)
+        {
+            Quadric q;
+            q.m[0] = n.x * n.x * weight; q.m[1] = n.x * n.y * weight; q.m[2] = n.x * n.z * weight; q.m[3] = n.x * d * weight;
+            q.m[4] = n.y * n.y * weight; q.m[5] = n.y * n.z * weight; q.m[6] = n.y * d * weight;
+            q.m[7] = n.z * n.z * weight; q.m[8] = n.z * d * weight;
+            q.m[9] = d * d * weight;
+            return q;
+        }
+
+        void add(const Quadric &other)
+        {
+            for(int i = 0; i < 10; i++)
+                m[i] += other.m[i];
+        }
+
+        double evaluate(const glm::dvec3 &p) const
+        {
+            return m[0] * p.x * p.x + 2.0 * m[1] * p.x * p.y + 2.0 * m[2] * p.x * p.z + 2.0 * m[3] * p.x
+                 + m[4] * p.y * p.y + 2.0 * m[5] * p.y * p.z + 2.0 * m[6] * p.y
+                 + m[7] * p.z * p.z + 2.0 * m[8] * p.z
+                 + m[9];
+        }
+    };
+
+    struct Collapse {
+        double cost;
+        unsigned int from, to;
+        unsigned int fromVersion, toVersion;
+
+        bool operator>(const Collapse &other) const
+        {
+            return cost > other.cost;
+        }
+    };
+
+    // border and seam edges are this many times more expensive to move than interior surface
+    static constexpr double BORDER_WEIGHT = 10.0;
+    // collapses may not turn a triangle by more than ~78 degrees
+    static constexpr double MIN_NORMAL_DOT = 0.2;
+
+    const std::vector<glm::vec3> &positions;
+    std::vector<unsigned int> triangles;
+    std::vector<char> alive;
+    unsigned int liveTriangles;
+    float collapsedError;
+
+    // vertices at the same position form a group; groups are what gets collapsed
+    std::vector<unsigned int> group;
+    std::vector<std::vector<unsigned int> > members;
+    std::vector<std::vector<unsigned int> > groupTriangles;
+    std::vector<Quadric> quadrics;
+    std::vector<unsigned int> version;
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse> > candidates;
+    std::vector<unsigned int> scratch;
+    std::vector<std::pair<unsigned int, unsigned int> > moveScratch;
+
+    void weldPositions()
+    {
+        std::vector<unsigned int> order(positions.size());
+        for(unsigned int i = 0; i < order.size(); i++)
+            order[i] = i;
+
+        const std::vector<glm::vec3> &p = positions;
+        std::sort(order.begin(), order.end(), [&p](unsigned int a, unsigned int b)
+        {
+            if(p[a].x != p[b].x) return p[a].x < p[b].x;
+            if(p[a].y != p[b].y) return p[a].y < p[b].y;
+            return p[a].z < p[b].z;
+        });
+
+        group.assign(positions.size(), 0);
+        for(unsigned int i = 0; i < order.size(); i++)
+        {
+            if(i == 0 || p[order[i]] != p[order[i - 1]])
+                members.push_back(std::vector<unsigned int>());
+            group[order[i]] = (unsigned int)members.size() - 1;
+            members.back().push_back(order[i]);
+        }
+        version.assign(members.size(), 0);
+    }
+
+    void buildAdjacency()
+    {
+        groupTriangles.assign(members.size(), std::vector<unsigned int>());
+        for(unsigned int t = 0; t < alive.size(); t++)
+        {
+            unsigned int a = group[triangles[t * 3]], b = group[triangles[t * 3 + 1]], c = group[triangles[t * 3 + 2]];
+            if(a == b || b == c || a == c)
+            {
+                // already degenerate
+                alive[t] = false;
+                liveTriangles--;
+                continue;
+            }
+            groupTriangles[a].push_back(t);
+            groupTriangles[b].push_back(t);
+            groupTriangles[c].push_back(t);
+        }
+    }
+
+    glm::dvec3 groupPosition(unsigned int g) const
+    {
+        return glm::dvec3(positions[members[g][0]]);
+    }
+
+    void computeQuadrics()
+    {
+        quadrics.assign(members.size(), Quadric());
+
+        // count how many triangles use every (vertex, vertex) edge: edges used once are borders or seams
+        std::vector<std::pair<unsigned long long, unsigned int> > edges;
+        for(unsigned int t = 0; t < alive.size(); t++)
+        {
+            if(!alive[t])
+                continue;
+
+            glm::dvec3 p0 = groupPosition(group[triangles[t * 3]]);
+            glm::dvec3 p1 = groupPosition(group[triangles[t * 3 + 1]]);
+            glm::dvec3 p2 = groupPosition(group[triangles[t * 3 + 2]]);
+            glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+            double length = glm::length(normal);
+            if(length > 0.0)
+            {
+                normal /= length;
+                Quadric q = Quadric::plane(normal, -glm::dot(normal, p0), 1.0);
+                for(unsigned int e = 0; e < 3; e++)
+                    quadrics[group[triangles[t * 3 + e]]].add(q);
+            }
+
+            for(unsigned int e = 0; e < 3; e++)
+            {
+                unsigned long long a = triangles[t * 3 + e], b = triangles[t * 3 + (e + 1) % 3];
+                edges.push_back(std::make_pair(std::min(a, b) << 32 | std::max(a, b), t));
+            }
+        }
+
+        std::sort(edges.begin(), edges.end());
+        for(unsigned int i = 0; i < edges.size(); i++)
+        {
+            bool shared = (i > 0 && edges[i - 1].first == edges[i].first) || (i + 1 < edges.size() && edges[i + 1].first == edges[i].first);
+            if(shared)
+                continue;
+
+            // plane through the edge, perpendicular to its triangle
+            unsigned int t = edges[i].second;
+            unsigned int a = group[(unsigned int)(edges[i].first >> 32)], b = group[(unsigned int)(edges[i].first & 0xFFFFFFFFULL)];
+            glm::dvec3 p0 = groupPosition(group[triangles[t * 3]]);
+            glm::dvec3 normal = glm::cross(groupPosition(group[triangles[t * 3 + 1]]) - p0, groupPosition(group[triangles[t * 3 + 2]]) - p0);
+            glm::dvec3 edge = groupPosition(b) - groupPosition(a);
+            glm::dvec3 border = glm::cross(edge, normal);
+            double length = glm::length(border);
+            if(length <= 0.0)
+                continue;
+
+            border /= length;
+            Quadric q = Quadric::plane(border, -glm::dot(border, groupPosition(a)), BORDER_WEIGHT);
+            quadrics[a].add(q);
+            quadrics[b].add(q);
+        }
+    }
+
+    // queues the cheaper direction of the edge between two groups
+    void pushEdge(unsigned int a, unsigned int b)
+    {
+        if(a != b)
+            candidates.push(evaluateEdge(a, b));
+    }
+
+    Collapse evaluateEdge(unsigned int a, unsigned int b) const
+    {
+        Quadric q = quadrics[a];
+        q.add(quadrics[b]);
+        double toB = q.evaluate(groupPosition(b));
+        double toA = q.evaluate(groupPosition(a));
+
+        Collapse collapse;
+        collapse.cost = std::min(toA, toB);
+        collapse.from = toB <= toA ? a : b;
+        collapse.to = toB <= toA ? b : a;
+        collapse.fromVersion = version[collapse.from];
+        collapse.toVersion = version[collapse.to];
+        return collapse;
+    }
+
+    bool containsGroup(unsigned int t, unsigned int g) const
+    {
+        return group[triangles[t * 3]] == g || group[triangles[t * 3 + 1]] == g || group[triangles[t * 3 + 2]] == g;
+    }
+
+    // rejects collapses that would flip or squash any of the triangles that survive them
+    bool canCollapse(unsigned int from, unsigned int to) const
+    {
+        glm::dvec3 target = groupPosition(to);
+        const std::vector<unsigned int> &adjacent = groupTriangles[from];
+        for(unsigned int i = 0; i < adjacent.size(); i++)
+        {
+            unsigned int t = adjacent[i];
+            if(!alive[t] || containsGroup(t, to))
+                continue;
+
+            glm::dvec3 p[3], moved[3];
+            for(unsigned int e = 0; e < 3; e++)
+            {
+                unsigned int g = group[triangles[t * 3 + e]];
+                p[e] = groupPosition(g);
+                moved[e] = g == from ? target : p[e];
+            }
+            glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::dvec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+            double lengths = glm::length(before) * glm::length(after);
+            if(lengths <= 0.0 || glm::dot(before, after) < MIN_NORMAL_DOT * lengths)
+                return false;
+        }
+        return true;
+    }
+
+    void applyCollapse(unsigned int from, unsigned int to)
+    {
+        std::vector<unsigned int> &adjacent = groupTriangles[from];
+
+        // each copy of 'from' moves onto the copy of 'to' it shares a triangle with, if any
+        std::vector<std::pair<unsigned int, unsigned int> > &moves = moveScratch;
+        moves.clear();
+        for(unsigned int i = 0; i < adjacent.size(); i++)
+        {
+            unsigned int t = adjacent[i];
+            if(!alive[t] || !containsGroup(t, to))
+                continue;
+
+            unsigned int copy = 0, other = 0;
+            for(unsigned int e = 0; e < 3; e++)
+            {
+                unsigned int v = triangles[t * 3 + e];
+                if(group[v] == from)
+                    copy = v;
+                else if(group[v] == to)
+                    other = v;
+            }
+            moves.push_back(std::make_pair(copy, other));
+        }
+        std::sort(moves.begin(), moves.end());
+
+        for(unsigned int i = 0; i < adjacent.size(); i++)
+        {
+            unsigned int t = adjacent[i];
+            if(!alive[t])
+                continue;
+
+            if(containsGroup(t, to))
+            {
+                alive[t] = false;
+                liveTriangles--;
+                continue;
+            }
+
+            for(unsigned int e = 0; e < 3; e++)
+            {
+                unsigned int &v = triangles[t * 3 + e];
+                if(group[v] != from)
+                    continue;
+
+                std::vector<std::pair<unsigned int, unsigned int> >::const_iterator move =
+                    std::lower_bound(moves.begin(), moves.end(), std::make_pair(v, 0u));
+                v = move != moves.end() && move->first == v ? move->second : members[to][0];
+            }
+            groupTriangles[to].push_back(t);
+        }
+
+        std::vector<unsigned int> &copies = members[from];
+        for(unsigned int c = 0; c < copies.size(); c++)
+            group[copies[c]] = to;
+        copies.clear();
+        std::vector<unsigned int>().swap(adjacent);
+
+        quadrics[to].add(quadrics[from]);
+        version[from]++;
+        version[to]++;
+
+        // drop dead triangles and requeue the edges around the merged group
+        std::vector<unsigned int> &merged = groupTriangles[to];
+        unsigned int kept = 0;
+        for(unsigned int i = 0; i < merged.size(); i++)
+        {
+            if(alive[merged[i]])
+                merged[kept++] = merged[i];
+        }
+        merged.resize(kept);
+
+        std::vector<unsigned int> &neighbours = scratch;
+        neighbours.clear();
+        for(unsigned int i = 0; i < merged.size(); i++)
+        {
+            for(unsigned int e = 0; e < 3; e++)
+                neighbours.push_back(group[triangles[merged[i] * 3 + e]]);
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+        for(unsigned int i = 0; i < neighbours.size(); i++)
+            pushEdge(to, neighbours[i]);
+    }
+};
+
+// Appends up to 'levelCount' - 1 simplified versions of a triangle list to 'indices', each with about
+// 'ratio' times the triangles of the previous one, and describes every level (including the original
+// indices as level 0) in 'lods'. Stops early once a mesh can't be reduced any further.
+template <typename VertexType>
+void generateLods(const std::vector<VertexType> &vertices, std::vector<unsigned int> &indices, std::vector<MeshLod> &lods,
+                  unsigned int levelCount = 4, float ratio = 0.5f, unsigned int minTriangles = 32)
+{
+    lods.clear();
+    MeshLod full = {0, (unsigned int)indices.size(), 0.0f};
+    lods.push_back(full);
+
+    unsigned int triangleCount = (unsigned int)indices.size() / 3;
+    if(levelCount < 2 || triangleCount < minTriangles * 2)
+        return;
+
+    std::vector<glm::vec3> positions(vertices.size());
+    for(unsigned int i = 0; i < vertices.size(); i++)
+        positions[i] = vertices[i].Position;
+
+    MeshSimplifier simplifier(positions, indices);
+    unsigned int previous = simplifier.triangleCount();
+    for(unsigned int level = 1; level < levelCount; level++)
+    {
+        unsigned int target = std::max(minTriangles, (unsigned int)(previous * ratio));
+        simplifier.simplify(target);
+
+        // not worth a level of its own
+        if(simplifier.triangleCount() > previous * 0.9f)
+            break;
+
+        MeshLod lod;
+        lod.indexOffset = (unsigned int)indices.size();
+        simplifier.appendTriangles(indices);
+        lod.indexCount = (unsigned int)indices.size() - lod.indexOffset;
+        lod.error = simplifier.error();
+        lods.push_back(lod);
+
+        previous = simplifier.triangleCount();
+        if(previous <= minTriangles)
+            break;
+    }
+}
+#endif
@@ -11,64 +11,273 @@
 #include <assimp/postprocess.h>
 
 #include <learnopengl/mesh.h>
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/mesh_optimize.h>
+#include <learnopengl/mapped_io.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/texture_registry.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <atomic>
 #include <map>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
+// post processing applied to every imported model; part of the mesh cache key
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+// levels of detail generated per mesh (including full detail), each with about half the triangles of the last
+const unsigned int MODEL_LOD_LEVELS = 4;
+
 class Model 
 {
 public:
     /*  Model Data */
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<Texture> textures_loaded;	// the unique textures used by this model; the GL textures themselves are shared through the TextureRegistry
     vector<Mesh> meshes;
     string directory;
     bool gammaCorrection;
+    // false until the meshes are on the GPU; a model that is still loading draws nothing
+    bool loaded;
+    // keep the meshes' vertices and indices in memory after they are uploaded (see Mesh::retainData)
+    bool retainMeshData;
 
     /*  Functions   */
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const &path, bool gamma = false, bool retainMeshData = false)
+        : gammaCorrection(gamma), loaded(false), retainMeshData(retainMeshData), instanceVBO(0), instanceCapacity(0)
     {
         loadModel(path);
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader shader)
+    // empty model, filled in later (see ModelLoader)
+    Model() : gammaCorrection(false), loaded(false), retainMeshData(false), instanceVBO(0), instanceCapacity(0)
     {
-        for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
     }
-    
-private:
-    /*  Functions   */
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const &path)
+
+    static string directoryOf(string const &path)
+    {
+        return path.substr(0, path.find_last_of('/'));
+    }
+
+    // The CPU half of loading a model: reads the mesh cache, or imports the file and processes its node tree
+    // on up to 'threadCount' threads (and then writes the cache). Makes no GL calls, so it can run on any
+    // thread; textures are only referenced by type and path relative to the model's directory.
+    static bool importMeshes(string const &path, vector<CachedMesh> &meshes, unsigned int threadCount = 1)
     {
-        // read file via ASSIMP
+        // a valid mesh cache skips the importer entirely
+        if(readMeshCache(path, MODEL_IMPORT_FLAGS, meshes))
+            return true;
+
+        // read file via ASSIMP; files are memory mapped (or served from a mounted asset pack) instead of read through stdio
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        importer.SetIOHandler(new MappedIOSystem());
+        const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+            return false;
+        }
+
+        processNodes(scene, meshes, threadCount);
+
+        if(!writeMeshCache(path, MODEL_IMPORT_FLAGS, meshes))
+            cout << "WARNING::MODEL:: could not write mesh cache for " << path << endl;
+        return true;
+    }
+
+    // every texture file the meshes reference, once each
+    static vector<string> texturePaths(string const &directory, const vector<CachedMesh> &meshes)
+    {
+        vector<string> paths;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            for(unsigned int j = 0; j < meshes[i].textures.size(); j++)
+                paths.push_back(directory + '/' + meshes[i].textures[j].path);
+        }
+        sort(paths.begin(), paths.end());
+        paths.erase(unique(paths.begin(), paths.end()), paths.end());
+        return paths;
+    }
+
+    // the GL half: creates a mesh from its CPU data once its textures are in the TextureRegistry. With
+    // 'upload' false the GL buffers are left for Mesh::upload().
+    Mesh createMesh(CachedMesh &cached, bool upload = true)
+    {
+        vector<Texture> &textures = cached.textures;
+        for(unsigned int j = 0; j < textures.size(); j++)
+            textures[j] = loadTexture(textures[j].path, textures[j].type);
+
+        return Mesh(std::move(cached.vertices), std::move(cached.indices), std::move(textures), std::move(cached.lods), upload, retainMeshData);
+    }
+
+    // draws the model, and thus all its meshes; meshes with the same vertex format share a VAO, which is
+    // only bound once
+    void Draw(const Shader &shader)
+    {
+        unsigned int boundVAO = 0;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].Draw(shader, boundVAO);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // draws 'count' copies of the model, one instanced draw call per mesh. 'tints' is optional and multiplies
+    // the diffuse colour of each copy.
+    void DrawInstanced(const Shader &shader, const glm::mat4 *transforms, unsigned int count, const glm::vec4 *tints = NULL)
+    {
+        if(count == 0)
             return;
+
+        instanceData.resize(count);
+        for(unsigned int i = 0; i < count; i++)
+        {
+            instanceData[i].Transform = transforms[i];
+            instanceData[i].Tint = tints ? tints[i] : glm::vec4(1.0f);
         }
+        DrawInstanced(shader, &instanceData[0], count);
+    }
+
+    void DrawInstanced(const Shader &shader, const MeshInstance *instances, unsigned int count)
+    {
+        if(count == 0)
+            return;
+
+        if(instanceVBO == 0)
+            glGenBuffers(1, &instanceVBO);
+
+        // grow the buffer geometrically, otherwise only overwrite its contents
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        if(count > instanceCapacity)
+        {
+            instanceCapacity = std::max(count, instanceCapacity * 2);
+            glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(MeshInstance), NULL, GL_STREAM_DRAW);
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(MeshInstance), instances);
+
+        unsigned int boundVAO = 0;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            meshes[i].setInstanceBuffer(instanceVBO);
+            meshes[i].DrawInstanced(shader, count, boundVAO);
+        }
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // returns the model's geometry to the GeometryArena; the model draws nothing afterwards
+    void release()
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].release();
+        meshes.clear();
+        loaded = false;
+    }
+
+    // picks the level of detail of every mesh for the next Draw() of the model at this transformation
+    void selectLod(const glm::mat4 &model, const LodSelection &selection)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].selectLod(model, selection);
+    }
+    
+private:
+    // per instance data streamed to every mesh by DrawInstanced()
+    unsigned int instanceVBO;
+    unsigned int instanceCapacity;
+    vector<MeshInstance> instanceData;
+
+    /*  Functions   */
+    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    void loadModel(string const &path)
+    {
         // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
+        directory = directoryOf(path);
+
+        vector<CachedMesh> cached;
+        if(!importMeshes(path, cached, std::max(1u, std::thread::hardware_concurrency())))
+            return;
+
+        // decode every texture in parallel before the meshes ask for them
+        TextureRegistry::instance().preload(texturePaths(directory, cached));
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        meshes.reserve(cached.size());
+        for(unsigned int i = 0; i < cached.size(); i++)
+            meshes.push_back(createMesh(cached[i]));
+        loaded = true;
+    }
+
+    // A part of the node tree: either only the meshes of one node, or a node with all its descendants
+    struct NodeTask {
+        aiNode *node;
+        bool subtree;
+    };
+
+    // Processes the node tree into 'meshes' in the same order as a depth first walk. The tree is split into
+    // tasks, a subtree at a time, until there is enough work for every thread; splitting a subtree into its
+    // node's own meshes followed by its children keeps the order intact.
+    static void processNodes(const aiScene *scene, vector<CachedMesh> &meshes, unsigned int threadCount)
+    {
+        vector<NodeTask> tasks(1);
+        tasks[0].node = scene->mRootNode;
+        tasks[0].subtree = true;
+
+        bool split = true;
+        while(split && threadCount > 1 && tasks.size() < threadCount * 4)
+        {
+            split = false;
+            vector<NodeTask> expanded;
+            for(unsigned int i = 0; i < tasks.size(); i++)
+            {
+                if(!tasks[i].subtree || tasks[i].node->mNumChildren == 0)
+                {
+                    expanded.push_back(tasks[i]);
+                    continue;
+                }
+
+                NodeTask own = {tasks[i].node, false};
+                expanded.push_back(own);
+                for(unsigned int c = 0; c < tasks[i].node->mNumChildren; c++)
+                {
+                    NodeTask child = {tasks[i].node->mChildren[c], true};
+                    expanded.push_back(child);
+                }
+                split = true;
+            }
+            tasks.swap(expanded);
+        }
+
+        vector<vector<CachedMesh> > results(tasks.size());
+        std::atomic<unsigned int> next(0);
+        auto work = [&]()
+        {
+            for(unsigned int i = next++; i < tasks.size(); i = next++)
+                processNode(tasks[i].node, scene, results[i], tasks[i].subtree);
+        };
+
+        vector<std::thread> workers;
+        for(unsigned int i = 1; i < std::min<unsigned int>(threadCount, (unsigned int)tasks.size()); i++)
+            workers.push_back(std::thread(work));
+        work();
+        for(unsigned int i = 0; i < workers.size(); i++)
+            workers[i].join();
+
+        for(unsigned int i = 0; i < results.size(); i++)
+        {
+            for(unsigned int j = 0; j < results[i].size(); j++)
+                meshes.push_back(std::move(results[i][j]));
+        }
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    static void processNode(aiNode *node, const aiScene *scene, vector<CachedMesh> &meshes, bool recursive = true)
     {
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -76,23 +285,23 @@ private:
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            meshes.push_back(CachedMesh());
+            processMesh(mesh, scene, meshes.back());
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
-        for(unsigned int i = 0; i < node->mNumChildren; i++)
+        for(unsigned int i = 0; recursive && i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, meshes);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    static void processMesh(aiMesh *mesh, const aiScene *scene, CachedMesh &result)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
-
+        vector<Vertex> &vertices = result.vertices;
+        vector<unsigned int> &indices = result.indices;
+        vector<Texture> &textures = result.textures;
         // Walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
@@ -162,42 +371,55 @@ private:
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
         
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // shared vertices first, so the simplifier and the cache optimization have something to work with
+        VertexCacheStats before = analyzeVertexCache(indices.data(), (unsigned int)indices.size(), (unsigned int)vertices.size());
+        unsigned int importedVertices = (unsigned int)vertices.size();
+        weldVertices(vertices, indices);
+        // simplified versions of the mesh are appended to its indices
+        generateLods(vertices, indices, result.lods, MODEL_LOD_LEVELS);
+        // triangle and vertex order of every level
+        optimizeMesh(vertices, indices, result.lods);
+
+        VertexCacheStats after = analyzeVertexCache(indices.data(), result.lods[0].indexCount, (unsigned int)vertices.size());
+        ostringstream report;
+        report << "MESH::OPTIMIZE:: " << mesh->mName.C_Str() << ": " << importedVertices << " -> " << vertices.size() << " vertices, ACMR "
+               << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << endl;
+        cout << report.str();
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
+    // checks all material textures of a given type; the textures themselves are loaded by createMesh().
     // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    static vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
     {
         vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            Texture texture;
+            texture.id = 0;
+            texture.type = typeName;
+            texture.path = str.C_Str();
+            textures.push_back(texture);
         }
         return textures;
     }
+
+    // returns the texture of a path relative to the model's directory; the registry makes sure every file is only loaded once
+    Texture loadTexture(const string &path, const string &typeName)
+    {
+        Texture texture;
+        texture.id = TextureFromFile(path.c_str(), this->directory);
+        texture.type = typeName;
+        texture.path = path;
+
+        if(textureIndex.insert(make_pair(path, (unsigned int)textures_loaded.size())).second)
+            textures_loaded.push_back(texture);
+        return texture;
+    }
+
+    // position of each path in textures_loaded
+    unordered_map<string, unsigned int> textureIndex;
 };
 
 
@@ -206,38 +428,6 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureRegistry::instance().load(filename);
 }
 #endif
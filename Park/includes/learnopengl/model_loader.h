@@ -0,0 +1,211 @@
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
+#include <learnopengl/model.h>
+#include <learnopengl/texture_registry.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Loads models without stalling the render loop. Worker threads import the file (or read its mesh cache),
+// convert and simplify the meshes with the node tree split across threads and decode the textures.
+// Everything that needs the GL context is then done by pump() on the render thread, a few textures and
+// meshes at a time within a per frame budget. A model only becomes drawable, with 'loaded' set, once all of
+// its meshes are on the GPU.
+//
+//     ModelLoader loader;
+//     std::shared_ptr<Model> tree = loader.load(FileSystem::getPath("resources/objects/tree/tree.obj"));
+//     // every frame:
+//     loader.pump(2.0);
+//     tree->Draw(shader); // draws nothing until the tree is loaded
+class ModelLoader
+{
+public:
+    // 'workerCount' 0 uses one thread less than the hardware has, leaving one for rendering
+    explicit ModelLoader(unsigned int workerCount = 0) : stopping(false), pendingCount(0), importing(0)
+    {
+        hardwareThreads = std::max(2u, std::thread::hardware_concurrency());
+        if(workerCount == 0)
+            workerCount = hardwareThreads - 1;
+
+        for(unsigned int i = 0; i < workerCount; i++)
+            workers.push_back(std::thread(&ModelLoader::workerLoop, this));
+    }
+
+    ~ModelLoader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(unsigned int i = 0; i < workers.size(); i++)
+            workers[i].join();
+
+        // free the pixels of anything that never got uploaded
+        for(unsigned int i = 0; i < finished.size(); i++)
+            finished[i]->releaseImages();
+        if(current)
+            current->releaseImages();
+    }
+
+    // queues a model for loading. Must be called on the render thread; the returned model stays empty until
+    // pump() has uploaded it.
+    std::shared_ptr<Model> load(const string &path)
+    {
+        std::shared_ptr<Job> job(new Job());
+        job->path = path;
+        job->model = std::make_shared<Model>();
+        job->model->directory = Model::directoryOf(path);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queued.push_back(job);
+            pendingCount++;
+        }
+        wake.notify_one();
+        return job->model;
+    }
+
+    // Does GL work for finished imports until 'budgetMs' milliseconds are spent, one texture or mesh at a
+    // time; at least one step is always taken so loading can't stall. Call once per frame on the render thread.
+    void pump(double budgetMs)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool first = true;
+        while(first || std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() < budgetMs)
+        {
+            first = false;
+            if(!current)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(finished.empty())
+                    return;
+                current = finished.front();
+                finished.pop_front();
+            }
+
+            if(step(*current))
+            {
+                current.reset();
+                pendingCount--;
+            }
+        }
+    }
+
+    // models that are queued, importing or waiting for upload
+    unsigned int pending() const
+    {
+        return pendingCount;
+    }
+
+private:
+    struct Job {
+        string path;
+        std::shared_ptr<Model> model;
+        bool imported;
+        vector<CachedMesh> meshes;
+        vector<DecodedImage> images;
+        // upload progress
+        unsigned int nextImage;
+        unsigned int nextMesh;
+        vector<Mesh> staged;
+
+        Job() : imported(false), nextImage(0), nextMesh(0)
+        {
+        }
+
+        void releaseImages()
+        {
+            for(unsigned int i = 0; i < images.size(); i++)
+            {
+                stbi_image_free(images[i].pixels);
+                images[i].pixels = NULL;
+            }
+        }
+    };
+
+    vector<std::thread> workers;
+    unsigned int hardwareThreads;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+    std::deque<std::shared_ptr<Job> > queued;
+    std::deque<std::shared_ptr<Job> > finished;
+    std::atomic<unsigned int> pendingCount;
+    // jobs in importMeshes() right now
+    std::atomic<unsigned int> importing;
+
+    // only touched by the render thread
+    std::shared_ptr<Job> current;
+
+    void workerLoop()
+    {
+        for(;;)
+        {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !queued.empty(); });
+                if(stopping)
+                    return;
+                job = queued.front();
+                queued.pop_front();
+            }
+
+            // CPU work: import, conversion, LOD generation and texture decoding
+            // the node tree is split across the hardware's threads, shared with the imports running alongside,
+            // so a model loaded on its own gets all of them
+            unsigned int threads = std::max(1u, hardwareThreads / ++importing);
+            job->imported = Model::importMeshes(job->path, job->meshes, threads);
+            importing--;
+            if(job->imported)
+            {
+                vector<string> paths = Model::texturePaths(Model::directoryOf(job->path), job->meshes);
+                job->images.resize(paths.size());
+                for(unsigned int i = 0; i < paths.size(); i++)
+                    job->images[i].path = paths[i];
+                TextureRegistry::decodeAll(job->images, false);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.push_back(job);
+        }
+    }
+
+    // one unit of GL work for a job; returns true once the job is complete
+    bool step(Job &job)
+    {
+        if(!job.imported)
+            return true;
+
+        if(job.nextImage < job.images.size())
+        {
+            TextureRegistry::instance().adopt(job.images[job.nextImage++]);
+            return false;
+        }
+
+        if(job.nextMesh < job.meshes.size())
+        {
+            job.staged.push_back(job.model->createMesh(job.meshes[job.nextMesh++], false));
+            job.staged.back().upload();
+            return false;
+        }
+
+        // everything is on the GPU: hand the meshes over in one go
+        job.model->meshes.swap(job.staged);
+        job.model->loaded = true;
+        vector<CachedMesh>().swap(job.meshes);
+        return true;
+    }
+};
+#endif
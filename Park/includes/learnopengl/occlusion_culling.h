@@ -0,0 +1,349 @@
+#ifndef OCCLUSION_CULLING_H
+#define OCCLUSION_CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/spatial_index.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_SSE2 1
+#endif
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+// Software occlusion culling. A few large occluder boxes are rasterized on the CPU into a small depth buffer
+// every frame, and the bounds of everything else are tested against it before submission: a box that lies
+// behind the occluders at every pixel it could cover is skipped. Needs no GL context.
+//
+// Depths are window depths in [0, 1] like the GPU's. The culling is conservative: an occluder face only
+// covers the pixels that lie entirely inside it, with the farthest depth its plane reaches inside the pixel,
+// and a box is visible if its nearest depth is not behind the buffer somewhere in any pixel its screen
+// rectangle touches. Rows are split between threads, and each thread runs four pixels at a time through SSE2
+// where the compiler targets it.
+class OcclusionRasterizer
+{
+public:
+    static const int MIN_ROWS_PER_THREAD = 16;
+    static const unsigned int MIN_FACES_PER_THREAD = 128;
+
+    // width is rounded up to a multiple of 4
+    int width;
+    int height;
+    // 0: one thread per hardware thread
+    unsigned int threadCount;
+    // row by row from the bottom of the screen, 1 where no occluder is
+    std::vector<float> depth;
+    // boxes tested and found hidden since begin()
+    unsigned int tested;
+    unsigned int culled;
+
+    OcclusionRasterizer(int w = 256, int h = 128) : width((w + 3) & ~3), height(h), threadCount(0), tested(0), culled(0)
+    {
+        depth.assign(width * height, 1.0f);
+    }
+
+    // starts a frame seen through 'viewProjection', without occluders
+    void begin(const glm::mat4 &viewProjection)
+    {
+        this->viewProjection = viewProjection;
+        faces.clear();
+        tested = culled = 0;
+    }
+
+    // the unit box transformed by 'obj' (as drawn by applyTexture()) becomes an occluder
+    void addOccluder(const glm::mat4 &obj)
+    {
+        glm::vec4 corners[8];
+        for(int i = 0; i < 8; i++)
+        {
+            glm::vec4 local((i & 1) ? 0.5f : -0.5f, (i & 2) ? 0.5f : -0.5f, (i & 4) ? 0.5f : -0.5f, 1.0f);
+            corners[i] = viewProjection * (obj * local);
+        }
+
+        // both sides of every face; occluders are few, and the nearer side always wins the depth test. Whole
+        // faces rather than triangles, so no pixel along a face's diagonal is left half covered by each half.
+        static const int faces[6][4] = {{0, 2, 6, 4}, {1, 5, 7, 3}, {0, 4, 5, 1}, {2, 3, 7, 6}, {0, 1, 3, 2}, {4, 6, 7, 5}};
+        for(int f = 0; f < 6; f++)
+        {
+            glm::vec4 face[4] = {corners[faces[f][0]], corners[faces[f][1]], corners[faces[f][2]], corners[faces[f][3]]};
+            addFace(face);
+        }
+    }
+
+    // fills the depth buffer with the occluders added since begin()
+    void rasterize()
+    {
+        std::fill(depth.begin(), depth.end(), 1.0f);
+
+        unsigned int threads = threadCount > 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+        threads = std::min(threads, std::max(1u, (unsigned int)(height / MIN_ROWS_PER_THREAD)));
+        threads = std::min(threads, std::max(1u, (unsigned int)faces.size() / MIN_FACES_PER_THREAD));
+
+        // each thread owns a band of rows, so no two threads write the same pixel
+        if(threads == 1)
+        {
+            rasterizeRows(0, height);
+        }
+        else
+        {
+            std::vector<std::thread> workers;
+            for(unsigned int t = 0; t < threads; t++)
+            {
+                workers.push_back(std::thread(&OcclusionRasterizer::rasterizeRows, this, height * t / threads,
+                                              height * (t + 1) / threads));
+            }
+            for(unsigned int t = 0; t < workers.size(); t++)
+                workers[t].join();
+        }
+    }
+
+    // false if 'box' is certainly hidden behind the occluders
+    bool visible(const AABB &box)
+    {
+        tested++;
+        if(box.empty())
+            return true;
+
+        // the corners in clip space: the min corner plus the box's extent along the matrix columns
+        glm::vec3 extent = box.extent();
+        glm::vec4 origin = viewProjection * glm::vec4(box.min, 1.0f);
+        glm::vec4 edges[3] = {viewProjection[0] * extent.x, viewProjection[1] * extent.y, viewProjection[2] * extent.z};
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+        for(int i = 0; i < 8; i++)
+        {
+            glm::vec4 clip = origin;
+            if(i & 1)
+                clip += edges[0];
+            if(i & 2)
+                clip += edges[1];
+            if(i & 4)
+                clip += edges[2];
+            // reaching in front of the near plane: no screen rectangle to test
+            if(clip.z < -clip.w || clip.w <= 0.0f)
+                return true;
+
+            glm::vec3 window = toWindow(clip);
+            minX = std::min(minX, window.x);
+            maxX = std::max(maxX, window.x);
+            minY = std::min(minY, window.y);
+            maxY = std::max(maxY, window.y);
+            nearest = std::min(nearest, window.z);
+        }
+
+        // every pixel the rectangle touches; off the screen is left to frustum culling
+        int x0 = pixelIndex(std::floor(minX), width);
+        int x1 = pixelIndex(std::floor(maxX), width);
+        int y0 = pixelIndex(std::floor(minY), height);
+        int y1 = pixelIndex(std::floor(maxY), height);
+        if(maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height)
+            return true;
+
+        for(int y = y0; y <= y1; y++)
+        {
+            const float *row = &depth[y * width];
+#ifdef OCCLUSION_SSE2
+            __m128 near4 = _mm_set1_ps(nearest);
+            for(int x = x0 & ~3; x <= x1; x += 4)
+            {
+                // lanes outside [x0, x1] don't count
+                int lanes = 0xF;
+                if(x < x0)
+                    lanes &= 0xF << (x0 - x);
+                if(x + 3 > x1)
+                    lanes &= 0xF >> (x + 3 - x1);
+                if(_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), near4)) & lanes)
+                    return true;
+            }
+#else
+            for(int x = x0; x <= x1; x++)
+            {
+                if(row[x] >= nearest)
+                    return true;
+            }
+#endif
+        }
+
+        culled++;
+        return false;
+    }
+
+    float culledPercent() const
+    {
+        return tested > 0 ? 100.0f * culled / tested : 0.0f;
+    }
+
+    unsigned int faceCount() const
+    {
+        return (unsigned int)faces.size();
+    }
+
+private:
+    // a face clipped by the near plane has at most one corner more
+    static const int MAX_EDGES = 5;
+
+    // a face, or what the near plane leaves of it, set up for rasterizing as a convex polygon: a pixel lies
+    // entirely inside where a * x + b * y + c >= 0 for every edge at its centre (the edges are moved in by half a
+    // pixel); depth z0 + dzdx * x + dzdy * y, at most zMax
+    struct Face {
+        int edges;
+        float a[MAX_EDGES], b[MAX_EDGES], c[MAX_EDGES];
+        float z0, dzdx, dzdy, zMax;
+        int minX, maxX, minY, maxY;
+    };
+
+    glm::mat4 viewProjection;
+    std::vector<Face> faces;
+
+    // 'coordinate' clamped to [0, size - 1] before it becomes an int, however far off the screen it is
+    static int pixelIndex(float coordinate, int size)
+    {
+        return (int)std::min(std::max(coordinate, 0.0f), (float)(size - 1));
+    }
+
+    glm::vec3 toWindow(const glm::vec4 &clip) const
+    {
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        return glm::vec3((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f);
+    }
+
+    // clips a clip space quad against the near plane (z >= -w) and sets up what is left
+    void addFace(const glm::vec4 clip[4])
+    {
+        glm::vec4 polygon[MAX_EDGES];
+        int count = 0;
+        for(int i = 0; i < 4; i++)
+        {
+            const glm::vec4 &from = clip[i];
+            const glm::vec4 &to = clip[(i + 1) % 4];
+            float dFrom = from.z + from.w;
+            float dTo = to.z + to.w;
+            if(dFrom >= 0.0f)
+                polygon[count++] = from;
+            if((dFrom >= 0.0f) != (dTo >= 0.0f))
+                polygon[count++] = from + (to - from) * (dFrom / (dFrom - dTo));
+        }
+
+        if(count < 3)
+            return;
+        glm::vec3 window[MAX_EDGES];
+        for(int i = 0; i < count; i++)
+            window[i] = toWindow(polygon[i]);
+        setupFace(window, count);
+    }
+
+    // 'v' are the corners of a convex polygon in window coordinates, in either winding
+    void setupFace(glm::vec3 v[], int count)
+    {
+        // twice the signed area; the projection of a planar face in front of the camera stays convex
+        float area = 0.0f;
+        for(int i = 0; i < count; i++)
+            area += v[i].x * v[(i + 1) % count].y - v[(i + 1) % count].x * v[i].y;
+        if(std::fabs(area) < 1.0e-6f)
+            return;
+        if(area < 0.0f)
+            std::reverse(v, v + count);
+
+        Face face;
+        // the pixels whose centres the bounding rectangle covers, a superset of those entirely inside
+        glm::vec3 low = v[0], high = v[0];
+        for(int i = 1; i < count; i++)
+        {
+            low = glm::min(low, v[i]);
+            high = glm::max(high, v[i]);
+        }
+        if(high.x < 0.5f || high.y < 0.5f || low.x > width - 0.5f || low.y > height - 0.5f)
+            return;
+        face.minX = pixelIndex(std::ceil(low.x - 0.5f), width);
+        face.maxX = pixelIndex(std::floor(high.x - 0.5f), width);
+        face.minY = pixelIndex(std::ceil(low.y - 0.5f), height);
+        face.maxY = pixelIndex(std::floor(high.y - 0.5f), height);
+        if(face.minX > face.maxX || face.minY > face.maxY)
+            return;
+
+        face.edges = count;
+        for(int i = 0; i < count; i++)
+        {
+            const glm::vec3 &from = v[i];
+            const glm::vec3 &to = v[(i + 1) % count];
+            face.a[i] = from.y - to.y;
+            face.b[i] = to.x - from.x;
+            // over a pixel the edge function drops at most this far below its value at the centre
+            face.c[i] = -(face.a[i] * from.x + face.b[i] * from.y) - 0.5f * (std::fabs(face.a[i]) + std::fabs(face.b[i]));
+        }
+
+        // the depth plane through the corners spanning the largest triangle, pushed back to the farthest depth
+        // it reaches inside a pixel
+        int apex = 1;
+        float apexArea = 0.0f;
+        for(int i = 1; i + 1 < count; i++)
+        {
+            float triangleArea = (v[i].x - v[0].x) * (v[i + 1].y - v[0].y) - (v[i + 1].x - v[0].x) * (v[i].y - v[0].y);
+            if(triangleArea > apexArea)
+            {
+                apex = i;
+                apexArea = triangleArea;
+            }
+        }
+        const glm::vec3 &v0 = v[0], &v1 = v[apex], &v2 = v[apex + 1];
+        face.dzdx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / apexArea;
+        face.dzdy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / apexArea;
+        face.z0 = v0.z - face.dzdx * v0.x - face.dzdy * v0.y + 0.5f * (std::fabs(face.dzdx) + std::fabs(face.dzdy));
+        face.zMax = high.z;
+        faces.push_back(face);
+    }
+
+    void rasterizeRows(int firstRow, int endRow)
+    {
+        for(unsigned int i = 0; i < faces.size(); i++)
+        {
+            const Face &t = faces[i];
+            int y0 = std::max(t.minY, firstRow);
+            int y1 = std::min(t.maxY, endRow - 1);
+            for(int y = y0; y <= y1; y++)
+            {
+                float py = y + 0.5f;
+                float rowEdge[MAX_EDGES];
+                for(int e = 0; e < t.edges; e++)
+                    rowEdge[e] = t.b[e] * py + t.c[e];
+                float rowDepth = t.z0 + t.dzdy * py;
+                float *row = &depth[y * width];
+#ifdef OCCLUSION_SSE2
+                const __m128 zero = _mm_setzero_ps();
+                const __m128 lane = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+                const __m128 zMax = _mm_set1_ps(t.zMax);
+                for(int x = t.minX & ~3; x <= t.maxX; x += 4)
+                {
+                    __m128 px = _mm_add_ps(_mm_set1_ps((float)x), lane);
+                    __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.a[0]), px), _mm_set1_ps(rowEdge[0])), zero);
+                    for(int e = 1; e < t.edges; e++)
+                        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.a[e]), px), _mm_set1_ps(rowEdge[e])), zero));
+                    if(_mm_movemask_ps(inside) == 0)
+                        continue;
+
+                    __m128 z = _mm_min_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.dzdx), px), _mm_set1_ps(rowDepth)), zMax);
+                    __m128 current = _mm_loadu_ps(row + x);
+                    __m128 nearer = _mm_min_ps(current, z);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+                }
+#else
+                for(int x = t.minX; x <= t.maxX; x++)
+                {
+                    float px = x + 0.5f;
+                    bool inside = true;
+                    for(int e = 0; e < t.edges && inside; e++)
+                        inside = t.a[e] * px + rowEdge[e] >= 0.0f;
+                    if(!inside)
+                        continue;
+                    row[x] = std::min(row[x], std::min(t.dzdx * px + rowDepth, t.zMax));
+                }
+#endif
+            }
+        }
+    }
+};
+#endif
@@ -0,0 +1,138 @@
+#ifndef OCCLUSION_QUERIES_H
+#define OCCLUSION_QUERIES_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/shader_m.h>
+#include <learnopengl/spatial_index.h>
+
+#include <vector>
+
+// GPU occlusion culling of whole props. After the scene is drawn, the bounding box of every prop is tested
+// against the depth buffer with an occlusion query; the next frame draws the prop inside a conditional render
+// on that query, which the GPU skips if none of the box was visible. GL_QUERY_NO_WAIT draws the prop anyway
+// while the result isn't ready, so the CPU never waits for a query.
+class OcclusionQueries
+{
+public:
+    // how far the query boxes stand out of the props, so the props' own faces don't hide them
+    static constexpr float MARGIN = 0.05f;
+
+    // one per prop
+    std::vector<AABB> bounds;
+    // props found hidden by the latest results read
+    unsigned int hidden;
+
+    OcclusionQueries() : hidden(0)
+    {
+    }
+
+    void setup(const std::vector<AABB> &propBounds)
+    {
+        bounds = propBounds;
+        queries.resize(bounds.size());
+        glGenQueries((GLsizei)queries.size(), &queries[0]);
+        issued.assign(bounds.size(), false);
+        wasHidden.assign(bounds.size(), false);
+    }
+
+    // draws prop 'i' with draw(); skipped by the GPU if the prop's box was hidden when last queried
+    template<typename Draw>
+    void drawConditional(unsigned int i, Draw draw)
+    {
+        if(!issued[i])
+        {
+            draw();
+            return;
+        }
+
+        glBeginConditionalRender(queries[i], GL_QUERY_NO_WAIT);
+        draw();
+        glEndConditionalRender();
+    }
+
+    // queries every prop's box against the current depth buffer, drawn with 'shader' (whose view and projection
+    // must be set) as the unit box in the first 36 vertices of the bound VAO. No prop is queried while the
+    // camera at 'viewPos' is inside its box, which would clip the box's front faces away.
+    void issue(const Shader &shader, const glm::vec3 &viewPos)
+    {
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_LEQUAL);
+
+        for(unsigned int i = 0; i < bounds.size(); i++)
+        {
+            readAvailable(i);
+
+            AABB box = bounds[i].inflated(MARGIN);
+            if(box.inflated(0.2f).contains(viewPos))
+            {
+                issued[i] = false;
+                setHidden(i, false);
+                continue;
+            }
+
+            glm::mat4 model = glm::translate(glm::mat4(), box.center());
+            shader.setMat4("model", glm::scale(model, box.extent()));
+            glBeginQuery(GL_ANY_SAMPLES_PASSED, queries[i]);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            glEndQuery(GL_ANY_SAMPLES_PASSED);
+            issued[i] = true;
+        }
+
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    }
+
+    // forgets the queries, so every prop is drawn until issue() runs again
+    void reset()
+    {
+        issued.assign(bounds.size(), false);
+        wasHidden.assign(bounds.size(), false);
+        hidden = 0;
+    }
+
+    void destroy()
+    {
+        if(!queries.empty())
+            glDeleteQueries((GLsizei)queries.size(), &queries[0]);
+        queries.clear();
+    }
+
+private:
+    std::vector<unsigned int> queries;
+    std::vector<bool> issued;
+    std::vector<bool> wasHidden;
+
+    // updates 'hidden' from query 'i' if its result has arrived; never waits for it
+    void readAvailable(unsigned int i)
+    {
+        if(!issued[i])
+            return;
+
+        GLuint available = 0;
+        glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available)
+            return;
+
+        GLuint anySamples = 0;
+        glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT, &anySamples);
+        setHidden(i, anySamples == 0);
+    }
+
+    void setHidden(unsigned int i, bool isHidden)
+    {
+        if(wasHidden[i] == isHidden)
+            return;
+        wasHidden[i] = isHidden;
+        if(isHidden)
+            hidden++;
+        else
+            hidden--;
+    }
+};
+#endif
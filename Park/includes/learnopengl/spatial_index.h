@@ -0,0 +1,845 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+// Axis aligned bounding box
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+
+    // an empty box that any call to expand() will replace
+    AABB() : min(FLT_MAX), max(-FLT_MAX)
+    {
+    }
+
+    AABB(const glm::vec3 &minimum, const glm::vec3 &maximum) : min(minimum), max(maximum)
+    {
+    }
+
+    bool empty() const
+    {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    void expand(const glm::vec3 &point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void expand(const AABB &other)
+    {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    glm::vec3 center() const
+    {
+        return (min + max) * 0.5f;
+    }
+
+    glm::vec3 extent() const
+    {
+        return max - min;
+    }
+
+    float surfaceArea() const
+    {
+        glm::vec3 e = max - min;
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    bool contains(const glm::vec3 &point) const
+    {
+        return point.x >= min.x && point.x <= max.x &&
+               point.y >= min.y && point.y <= max.y &&
+               point.z >= min.z && point.z <= max.z;
+    }
+
+    bool overlaps(const AABB &other) const
+    {
+        return min.x <= other.max.x && max.x >= other.min.x &&
+               min.y <= other.max.y && max.y >= other.min.y &&
+               min.z <= other.max.z && max.z >= other.min.z;
+    }
+
+    AABB inflated(float amount) const
+    {
+        return AABB(min - glm::vec3(amount), max + glm::vec3(amount));
+    }
+
+    // world bounds of a box with the given local bounds (the unit box by default) after a transformation
+    static AABB transformed(const glm::mat4 &obj, const glm::vec3 &localMin = glm::vec3(-0.5f), const glm::vec3 &localMax = glm::vec3(0.5f))
+    {
+        // Arvo's method: accumulate each matrix column's contribution to the min/max of every axis
+        glm::vec3 translation(obj[3]);
+        AABB result(translation, translation);
+
+        for(int column = 0; column < 3; column++)
+        {
+            for(int row = 0; row < 3; row++)
+            {
+                float a = obj[column][row] * localMin[column];
+                float b = obj[column][row] * localMax[column];
+                result.min[row] += std::min(a, b);
+                result.max[row] += std::max(a, b);
+            }
+        }
+        return result;
+    }
+};
+
+struct Ray {
+    glm::vec3 origin;
+    // the direction doesn't have to be normalized; hit distances are measured in multiples of it
+    glm::vec3 direction;
+    glm::vec3 invDirection;
+
+    Ray(const glm::vec3 &o, const glm::vec3 &d) : origin(o), direction(d), invDirection(1.0f / d.x, 1.0f / d.y, 1.0f / d.z)
+    {
+    }
+
+    // slab test; on a hit tNear holds the entry distance (0 if the origin is inside the box)
+    bool intersects(const AABB &box, float maxT, float &tNear) const
+    {
+        float tEnter = 0.0f;
+        float tExit = maxT;
+        tNear = tEnter;
+        for(int axis = 0; axis < 3; axis++)
+        {
+            // parallel to the slab: 1 / 0 is infinite, and on a face plane 0 * infinity would be NaN. The ray
+            // misses if it starts outside the slab, and isn't limited by it otherwise.
+            if(direction[axis] == 0.0f)
+            {
+                if(origin[axis] < box.min[axis] || origin[axis] > box.max[axis])
+                    return false;
+                continue;
+            }
+
+            float t0 = (box.min[axis] - origin[axis]) * invDirection[axis];
+            float t1 = (box.max[axis] - origin[axis]) * invDirection[axis];
+            tEnter = std::max(tEnter, std::min(t0, t1));
+            tExit = std::min(tExit, std::max(t0, t1));
+        }
+
+        tNear = tEnter;
+        return tEnter <= tExit;
+    }
+};
+
+// View frustum as six inward facing planes (xyz: normal, w: distance)
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // Gribb/Hartmann plane extraction from a projection * view matrix
+    static Frustum fromMatrix(const glm::mat4 &viewProjection)
+    {
+        glm::vec4 rows[4];
+        for(int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+        Frustum frustum;
+        frustum.planes[0] = rows[3] + rows[0]; // left
+        frustum.planes[1] = rows[3] - rows[0]; // right
+        frustum.planes[2] = rows[3] + rows[1]; // bottom
+        frustum.planes[3] = rows[3] - rows[1]; // top
+        frustum.planes[4] = rows[3] + rows[2]; // near
+        frustum.planes[5] = rows[3] - rows[2]; // far
+
+        for(int i = 0; i < 6; i++)
+            frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+
+        return frustum;
+    }
+
+    // 0: outside, 1: intersecting, 2: fully inside
+    int classify(const AABB &box) const
+    {
+        int result = 2;
+        for(int i = 0; i < 6; i++)
+        {
+            const glm::vec4 &p = planes[i];
+            glm::vec3 positive(p.x > 0.0f ? box.max.x : box.min.x, p.y > 0.0f ? box.max.y : box.min.y, p.z > 0.0f ? box.max.z : box.min.z);
+            if(glm::dot(glm::vec3(p), positive) + p.w < 0.0f)
+                return 0;
+
+            glm::vec3 negative(p.x > 0.0f ? box.min.x : box.max.x, p.y > 0.0f ? box.min.y : box.max.y, p.z > 0.0f ? box.min.z : box.max.z);
+            if(glm::dot(glm::vec3(p), negative) + p.w < 0.0f)
+                result = 1;
+        }
+        return result;
+    }
+
+    bool intersects(const AABB &box) const
+    {
+        return classify(box) != 0;
+    }
+};
+
+struct SpatialHit {
+    int id;
+    // distance along the query ray/sweep (in multiples of its direction)
+    float t;
+    // true if the hit object lives in the dynamic (actor) structure
+    bool dynamic;
+
+    SpatialHit() : id(-1), t(FLT_MAX), dynamic(false)
+    {
+    }
+};
+
+// The sphere sweep treats each box as its Minkowski sum with the sphere approximated by a box inflated
+// by the radius. This is conservative around edges and corners, which is what camera collision wants.
+// Boxes that already contain the start of the sweep are ignored so a camera can always move out of them.
+inline bool sweepSphereAgainst(const AABB &box, const Ray &ray, float radius, float &t)
+{
+    AABB inflated = box.inflated(radius);
+    if(inflated.contains(ray.origin))
+        return false;
+    return ray.intersects(inflated, 1.0f, t);
+}
+
+// Bounding volume hierarchy for scenery that never moves. Built once with binned SAH; object ids are
+// the indices into the bounds array handed to build().
+class StaticBVH
+{
+public:
+    StaticBVH() : leafSize(4)
+    {
+    }
+
+    void build(const std::vector<AABB> &bounds)
+    {
+        objectBounds = bounds;
+        nodes.clear();
+        objectIndices.resize(bounds.size());
+        centroids.resize(bounds.size());
+        for(unsigned int i = 0; i < bounds.size(); i++)
+        {
+            objectIndices[i] = i;
+            centroids[i] = bounds[i].center();
+        }
+
+        if(bounds.empty())
+            return;
+
+        nodes.reserve(bounds.size() * 2 / leafSize + 1);
+        nodes.push_back(Node());
+        buildNode(0, 0, (int)bounds.size(), 0);
+
+        // centroids are only needed while building
+        std::vector<glm::vec3>().swap(centroids);
+    }
+
+    unsigned int size() const
+    {
+        return (unsigned int)objectBounds.size();
+    }
+
+    const AABB &bounds(int id) const
+    {
+        return objectBounds[id];
+    }
+
+    // closest object hit by the ray within maxT
+    bool raycast(const Ray &ray, float maxT, SpatialHit &hit) const
+    {
+        return traverseRay(ray, maxT, 0.0f, hit);
+    }
+
+    // first object touched by a sphere moving from 'from' to 'to'; hit.t is the fraction of the move
+    bool sphereSweep(const glm::vec3 &from, const glm::vec3 &to, float radius, SpatialHit &hit) const
+    {
+        Ray ray(from, to - from);
+        return traverseRay(ray, 1.0f, radius, hit);
+    }
+
+    void queryFrustum(const Frustum &frustum, std::vector<int> &results) const
+    {
+        if(nodes.empty())
+            return;
+
+        int stack[MAX_DEPTH + 2];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+
+        while(stackSize > 0)
+        {
+            const Node &node = nodes[stack[--stackSize]];
+            int visibility = frustum.classify(node.bounds);
+            if(visibility == 0)
+                continue;
+
+            if(visibility == 2)
+            {
+                // everything below a fully visible node is visible; no further plane tests needed
+                collect(node, results);
+            }
+            else if(node.count > 0)
+            {
+                for(int i = node.first; i < node.first + node.count; i++)
+                {
+                    if(frustum.intersects(objectBounds[objectIndices[i]]))
+                        results.push_back(objectIndices[i]);
+                }
+            }
+            else
+            {
+                stack[stackSize++] = node.first;
+                stack[stackSize++] = node.first + 1;
+            }
+        }
+    }
+
+    void querySphere(const glm::vec3 &center, float radius, std::vector<int> &results) const
+    {
+        if(nodes.empty())
+            return;
+
+        int stack[MAX_DEPTH + 2];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+
+        while(stackSize > 0)
+        {
+            const Node &node = nodes[stack[--stackSize]];
+            if(!sphereOverlaps(node.bounds, center, radius))
+                continue;
+
+            if(node.count > 0)
+            {
+                for(int i = node.first; i < node.first + node.count; i++)
+                {
+                    if(sphereOverlaps(objectBounds[objectIndices[i]], center, radius))
+                        results.push_back(objectIndices[i]);
+                }
+            }
+            else
+            {
+                stack[stackSize++] = node.first;
+                stack[stackSize++] = node.first + 1;
+            }
+        }
+    }
+
+    static bool sphereOverlaps(const AABB &box, const glm::vec3 &center, float radius)
+    {
+        glm::vec3 closest = glm::clamp(center, box.min, box.max);
+        glm::vec3 d = center - closest;
+        return glm::dot(d, d) <= radius * radius;
+    }
+
+private:
+    // inner nodes: children live at first and first + 1; leaves: count > 0 objects starting at first
+    struct Node {
+        AABB bounds;
+        int first;
+        int count;
+
+        Node() : first(0), count(0)
+        {
+        }
+    };
+
+    static const int BIN_COUNT = 16;
+    // bounds the traversal stacks below
+    static const int MAX_DEPTH = 60;
+
+    std::vector<Node> nodes;
+    std::vector<int> objectIndices;
+    std::vector<AABB> objectBounds;
+    std::vector<glm::vec3> centroids;
+    int leafSize;
+
+    void buildNode(int nodeIndex, int first, int count, int depth)
+    {
+        AABB bounds, centroidBounds;
+        for(int i = first; i < first + count; i++)
+        {
+            bounds.expand(objectBounds[objectIndices[i]]);
+            centroidBounds.expand(centroids[objectIndices[i]]);
+        }
+        nodes[nodeIndex].bounds = bounds;
+
+        if(count <= leafSize)
+        {
+            makeLeaf(nodeIndex, first, count);
+            return;
+        }
+
+        // binned surface area heuristic along the largest centroid axis
+        glm::vec3 centroidExtent = centroidBounds.extent();
+        int axis = 0;
+        if(centroidExtent.y > centroidExtent[axis]) axis = 1;
+        if(centroidExtent.z > centroidExtent[axis]) axis = 2;
+
+        int mid = first + count / 2;
+        bool partitioned = false;
+        if(centroidExtent[axis] > 0.0f && depth < MAX_DEPTH)
+        {
+            AABB binBounds[BIN_COUNT];
+            int binCounts[BIN_COUNT] = {0};
+            float scale = BIN_COUNT / centroidExtent[axis] * 0.9999f;
+
+            for(int i = first; i < first + count; i++)
+            {
+                int bin = (int)((centroids[objectIndices[i]][axis] - centroidBounds.min[axis]) * scale);
+                binCounts[bin]++;
+                binBounds[bin].expand(objectBounds[objectIndices[i]]);
+            }
+
+            // sweep from the right to get the cost of every right-hand side
+            float rightArea[BIN_COUNT];
+            int rightCount[BIN_COUNT];
+            AABB accumulated;
+            int accumulatedCount = 0;
+            for(int i = BIN_COUNT - 1; i > 0; i--)
+            {
+                accumulated.expand(binBounds[i]);
+                accumulatedCount += binCounts[i];
+                rightArea[i] = accumulated.empty() ? 0.0f : accumulated.surfaceArea();
+                rightCount[i] = accumulatedCount;
+            }
+
+            float bestCost = FLT_MAX;
+            int bestSplit = -1;
+            AABB left;
+            int leftCount = 0;
+            for(int i = 0; i < BIN_COUNT - 1; i++)
+            {
+                left.expand(binBounds[i]);
+                leftCount += binCounts[i];
+                if(leftCount == 0 || rightCount[i + 1] == 0)
+                    continue;
+
+                float cost = leftCount * left.surfaceArea() + rightCount[i + 1] * rightArea[i + 1];
+                if(cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestSplit = i;
+                }
+            }
+
+            // small nodes become leaves when no split is cheaper than intersecting everything
+            float leafCost = count * bounds.surfaceArea();
+            if(bestSplit >= 0 && (bestCost < leafCost || count > leafSize * 4))
+            {
+                float splitPosition = centroidBounds.min[axis] + (bestSplit + 1) / scale;
+                int *middle = std::partition(&objectIndices[first], &objectIndices[first] + count, CentroidBelow(centroids, axis, splitPosition));
+                mid = (int)(middle - &objectIndices[0]);
+                partitioned = mid > first && mid < first + count;
+            }
+            else if(count <= leafSize * 4)
+            {
+                makeLeaf(nodeIndex, first, count);
+                return;
+            }
+        }
+
+        if(depth >= MAX_DEPTH)
+        {
+            makeLeaf(nodeIndex, first, count);
+            return;
+        }
+
+        // all centroids coincide (or the binned split degenerated): a median split keeps the tree balanced
+        if(!partitioned)
+        {
+            mid = first + count / 2;
+            std::nth_element(&objectIndices[first], &objectIndices[mid], &objectIndices[first] + count, CentroidLess(centroids, axis));
+        }
+
+        int leftChild = (int)nodes.size();
+        nodes.push_back(Node());
+        nodes.push_back(Node());
+        nodes[nodeIndex].first = leftChild;
+        nodes[nodeIndex].count = 0;
+
+        buildNode(leftChild, first, mid - first, depth + 1);
+        buildNode(leftChild + 1, mid, first + count - mid, depth + 1);
+    }
+
+    void makeLeaf(int nodeIndex, int first, int count)
+    {
+        nodes[nodeIndex].first = first;
+        nodes[nodeIndex].count = count;
+    }
+
+    void collect(const Node &node, std::vector<int> &results) const
+    {
+        if(node.count > 0)
+        {
+            for(int i = node.first; i < node.first + node.count; i++)
+                results.push_back(objectIndices[i]);
+            return;
+        }
+        collect(nodes[node.first], results);
+        collect(nodes[node.first + 1], results);
+    }
+
+    // shared by raycast (radius 0) and sphere sweeps
+    bool traverseRay(const Ray &ray, float maxT, float radius, SpatialHit &hit) const
+    {
+        if(nodes.empty())
+            return false;
+
+        bool found = false;
+        float best = maxT;
+        int stack[MAX_DEPTH + 2];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+
+        while(stackSize > 0)
+        {
+            const Node &node = nodes[stack[--stackSize]];
+            float tNode;
+            if(!ray.intersects(node.bounds.inflated(radius), best, tNode))
+                continue;
+
+            if(node.count > 0)
+            {
+                for(int i = node.first; i < node.first + node.count; i++)
+                {
+                    int id = objectIndices[i];
+                    float t;
+                    bool hitObject = radius > 0.0f ? sweepSphereAgainst(objectBounds[id], ray, radius, t) : ray.intersects(objectBounds[id], best, t);
+                    if(hitObject && t <= best)
+                    {
+                        best = t;
+                        hit.id = id;
+                        hit.t = t;
+                        hit.dynamic = false;
+                        found = true;
+                    }
+                }
+                continue;
+            }
+
+            // visit the nearer child first so the far one is usually culled by 'best'
+            const Node &left = nodes[node.first];
+            const Node &right = nodes[node.first + 1];
+            float tLeft, tRight;
+            bool hitLeft = ray.intersects(left.bounds.inflated(radius), best, tLeft);
+            bool hitRight = ray.intersects(right.bounds.inflated(radius), best, tRight);
+
+            if(hitLeft && hitRight)
+            {
+                if(tLeft < tRight)
+                {
+                    stack[stackSize++] = node.first + 1;
+                    stack[stackSize++] = node.first;
+                }
+                else
+                {
+                    stack[stackSize++] = node.first;
+                    stack[stackSize++] = node.first + 1;
+                }
+            }
+            else if(hitLeft)
+            {
+                stack[stackSize++] = node.first;
+            }
+            else if(hitRight)
+            {
+                stack[stackSize++] = node.first + 1;
+            }
+        }
+        return found;
+    }
+
+    struct CentroidBelow {
+        const std::vector<glm::vec3> &centroids;
+        int axis;
+        float split;
+        CentroidBelow(const std::vector<glm::vec3> &c, int a, float s) : centroids(c), axis(a), split(s) {}
+        bool operator()(int id) const { return centroids[id][axis] < split; }
+    };
+
+    struct CentroidLess {
+        const std::vector<glm::vec3> &centroids;
+        int axis;
+        CentroidLess(const std::vector<glm::vec3> &c, int a) : centroids(c), axis(a) {}
+        bool operator()(int a, int b) const { return centroids[a][axis] < centroids[b][axis]; }
+    };
+};
+
+// Loose octree for objects that move. Cells are twice the size of their tight octant so an object only
+// has to be re-linked when its center leaves the octant, and most per-frame updates are a bounds copy.
+class LooseOctree
+{
+public:
+    LooseOctree(const AABB &world = AABB(glm::vec3(-64.0f), glm::vec3(64.0f)), int depth = 8) : maxDepth(depth)
+    {
+        Node root;
+        root.center = world.center();
+        glm::vec3 extent = world.extent();
+        root.halfSize = std::max(std::max(extent.x, extent.y), extent.z) * 0.5f;
+        root.depth = 0;
+        nodes.push_back(root);
+    }
+
+    void insert(int id, const AABB &bounds)
+    {
+        if(id >= (int)objectNode.size())
+        {
+            objectNode.resize(id + 1, -1);
+            objectBounds.resize(id + 1);
+        }
+        if(objectNode[id] >= 0)
+            unlink(id);
+
+        int node = findNode(bounds);
+        objectBounds[id] = bounds;
+        objectNode[id] = node;
+        nodes[node].objects.push_back(id);
+    }
+
+    // moves an object; it is only re-linked when it no longer belongs to the same cell
+    void update(int id, const AABB &bounds)
+    {
+        if(id >= (int)objectNode.size() || objectNode[id] < 0)
+        {
+            insert(id, bounds);
+            return;
+        }
+
+        int node = findNode(bounds);
+        objectBounds[id] = bounds;
+        if(node != objectNode[id])
+        {
+            unlink(id);
+            objectNode[id] = node;
+            nodes[node].objects.push_back(id);
+        }
+    }
+
+    void remove(int id)
+    {
+        if(id < (int)objectNode.size() && objectNode[id] >= 0)
+        {
+            unlink(id);
+            objectNode[id] = -1;
+        }
+    }
+
+    bool contains(int id) const
+    {
+        return id < (int)objectNode.size() && objectNode[id] >= 0;
+    }
+
+    const AABB &bounds(int id) const
+    {
+        return objectBounds[id];
+    }
+
+    bool raycast(const Ray &ray, float maxT, SpatialHit &hit) const
+    {
+        float best = maxT;
+        return traverseRay(0, ray, 0.0f, best, hit);
+    }
+
+    bool sphereSweep(const glm::vec3 &from, const glm::vec3 &to, float radius, SpatialHit &hit) const
+    {
+        Ray ray(from, to - from);
+        float best = 1.0f;
+        return traverseRay(0, ray, radius, best, hit);
+    }
+
+    void queryFrustum(const Frustum &frustum, std::vector<int> &results) const
+    {
+        queryFrustum(0, frustum, results);
+    }
+
+    void querySphere(const glm::vec3 &center, float radius, std::vector<int> &results) const
+    {
+        querySphere(0, center, radius, results);
+    }
+
+private:
+    struct Node {
+        glm::vec3 center;
+        float halfSize;
+        int depth;
+        int children[8];
+        std::vector<int> objects;
+
+        Node() : halfSize(0.0f), depth(0)
+        {
+            for(int i = 0; i < 8; i++)
+                children[i] = -1;
+        }
+
+        // loose bounds are twice the tight octant
+        AABB looseBounds() const
+        {
+            return AABB(center - glm::vec3(halfSize * 2.0f), center + glm::vec3(halfSize * 2.0f));
+        }
+    };
+
+    std::vector<Node> nodes;
+    std::vector<AABB> objectBounds;
+    std::vector<int> objectNode;
+    int maxDepth;
+
+    // deepest cell whose loose bounds are guaranteed to contain the object
+    int findNode(const AABB &bounds)
+    {
+        glm::vec3 center = bounds.center();
+        glm::vec3 half = bounds.extent() * 0.5f;
+        float radius = std::max(std::max(half.x, half.y), half.z);
+
+        int node = 0;
+        while(nodes[node].depth < maxDepth)
+        {
+            float childHalf = nodes[node].halfSize * 0.5f;
+            if(radius > childHalf)
+                break;
+
+            glm::vec3 nodeCenter = nodes[node].center;
+            int octant = (center.x >= nodeCenter.x ? 1 : 0) | (center.y >= nodeCenter.y ? 2 : 0) | (center.z >= nodeCenter.z ? 4 : 0);
+
+            // objects outside the root's tight bounds stay at the lowest level that still contains them
+            glm::vec3 childCenter = nodeCenter + glm::vec3(octant & 1 ? childHalf : -childHalf, octant & 2 ? childHalf : -childHalf, octant & 4 ? childHalf : -childHalf);
+            if(glm::any(glm::greaterThan(glm::abs(center - childCenter), glm::vec3(childHalf))))
+                break;
+
+            if(nodes[node].children[octant] < 0)
+            {
+                Node child;
+                child.center = childCenter;
+                child.halfSize = childHalf;
+                child.depth = nodes[node].depth + 1;
+                nodes[node].children[octant] = (int)nodes.size();
+                nodes.push_back(child);
+            }
+            node = nodes[node].children[octant];
+        }
+        return node;
+    }
+
+    void unlink(int id)
+    {
+        std::vector<int> &objects = nodes[objectNode[id]].objects;
+        for(unsigned int i = 0; i < objects.size(); i++)
+        {
+            if(objects[i] == id)
+            {
+                objects[i] = objects.back();
+                objects.pop_back();
+                break;
+            }
+        }
+    }
+
+    bool traverseRay(int nodeIndex, const Ray &ray, float radius, float &best, SpatialHit &hit) const
+    {
+        const Node &node = nodes[nodeIndex];
+        float tNode;
+        // the root also holds objects that stick out of the world bounds, so it is always visited
+        if(nodeIndex != 0 && !ray.intersects(node.looseBounds().inflated(radius), best, tNode))
+            return false;
+
+        bool found = false;
+        for(unsigned int i = 0; i < node.objects.size(); i++)
+        {
+            int id = node.objects[i];
+            float t;
+            bool hitObject = radius > 0.0f ? sweepSphereAgainst(objectBounds[id], ray, radius, t) : ray.intersects(objectBounds[id], best, t);
+            if(hitObject && t <= best)
+            {
+                best = t;
+                hit.id = id;
+                hit.t = t;
+                hit.dynamic = true;
+                found = true;
+            }
+        }
+        for(int i = 0; i < 8; i++)
+        {
+            if(node.children[i] >= 0 && traverseRay(node.children[i], ray, radius, best, hit))
+                found = true;
+        }
+        return found;
+    }
+
+    void queryFrustum(int nodeIndex, const Frustum &frustum, std::vector<int> &results) const
+    {
+        const Node &node = nodes[nodeIndex];
+        if(nodeIndex != 0 && !frustum.intersects(node.looseBounds()))
+            return;
+
+        for(unsigned int i = 0; i < node.objects.size(); i++)
+        {
+            if(frustum.intersects(objectBounds[node.objects[i]]))
+                results.push_back(node.objects[i]);
+        }
+        for(int i = 0; i < 8; i++)
+        {
+            if(node.children[i] >= 0)
+                queryFrustum(node.children[i], frustum, results);
+        }
+    }
+
+    void querySphere(int nodeIndex, const glm::vec3 &center, float radius, std::vector<int> &results) const
+    {
+        const Node &node = nodes[nodeIndex];
+        if(nodeIndex != 0 && !StaticBVH::sphereOverlaps(node.looseBounds(), center, radius))
+            return;
+
+        for(unsigned int i = 0; i < node.objects.size(); i++)
+        {
+            if(StaticBVH::sphereOverlaps(objectBounds[node.objects[i]], center, radius))
+                results.push_back(node.objects[i]);
+        }
+        for(int i = 0; i < 8; i++)
+        {
+            if(node.children[i] >= 0)
+                querySphere(node.children[i], center, radius, results);
+        }
+    }
+};
+
+// Static scenery in a BVH plus moving actors in a loose octree, queried together
+class SpatialIndex
+{
+public:
+    StaticBVH scenery;
+    LooseOctree actors;
+
+    SpatialIndex(const AABB &world = AABB(glm::vec3(-64.0f), glm::vec3(64.0f))) : actors(world)
+    {
+    }
+
+    bool raycast(const Ray &ray, float maxT, SpatialHit &hit) const
+    {
+        SpatialHit staticHit, dynamicHit;
+        bool hitStatic = scenery.raycast(ray, maxT, staticHit);
+        bool hitDynamic = actors.raycast(ray, hitStatic ? staticHit.t : maxT, dynamicHit);
+        hit = hitDynamic ? dynamicHit : staticHit;
+        return hitStatic || hitDynamic;
+    }
+
+    bool sphereSweep(const glm::vec3 &from, const glm::vec3 &to, float radius, SpatialHit &hit) const
+    {
+        SpatialHit staticHit, dynamicHit;
+        bool hitStatic = scenery.sphereSweep(from, to, radius, staticHit);
+        bool hitDynamic = actors.sphereSweep(from, to, radius, dynamicHit);
+        if(hitStatic && hitDynamic)
+            hit = staticHit.t <= dynamicHit.t ? staticHit : dynamicHit;
+        else
+            hit = hitDynamic ? dynamicHit : staticHit;
+        return hitStatic || hitDynamic;
+    }
+
+    void queryFrustum(const Frustum &frustum, std::vector<int> &sceneryIds, std::vector<int> &actorIds) const
+    {
+        scenery.queryFrustum(frustum, sceneryIds);
+        actors.queryFrustum(frustum, actorIds);
+    }
+};
+#endif
@@ -0,0 +1,180 @@
+#ifndef SUN_SHADOWS_H
+#define SUN_SHADOWS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/shader_m.h>
+#include <learnopengl/spatial_index.h>
+
+#include <cmath>
+#include <iostream>
+
+// Shadows of a directional sun in two maps. The static map holds the scenery that never moves and is only
+// rendered again when the sun changes direction; the small dynamic map is fitted around the moving actors
+// and rendered every frame. The shader takes the darker of the two lookups (see sunLight() in
+// 5.4.light_casters.fs), so in a steady state only a handful of actor boxes go through a shadow pass.
+//
+// Usage per frame: setDirection(), then if staticDirty() render the static casters between beginStatic() and
+// end(); render the actors between beginDynamic() and end(); bind() every shader that receives shadows.
+class SunShadows
+{
+public:
+    static const int STATIC_SIZE = 2048;
+    static const int DYNAMIC_SIZE = 512;
+
+    // unit vector towards the sun
+    glm::vec3 direction;
+    // sphere around everything that casts or receives shadows
+    glm::vec3 sceneCentre;
+    float sceneRadius;
+    // how often the static map has been rendered
+    unsigned int staticRenders;
+
+    SunShadows(const glm::vec3 &centre, float radius)
+        : direction(0.0f, 1.0f, 0.0f), sceneCentre(centre), sceneRadius(radius), staticRenders(0), staticValid(false),
+          renderingStatic(false), staticFBO(0), dynamicFBO(0), staticMap(0), dynamicMap(0)
+    {
+    }
+
+    void setup()
+    {
+        createMap(staticFBO, staticMap, STATIC_SIZE);
+        createMap(dynamicFBO, dynamicMap, DYNAMIC_SIZE);
+    }
+
+    void setDirection(const glm::vec3 &towardsSun)
+    {
+        glm::vec3 normalized = glm::normalize(towardsSun);
+        if(glm::dot(normalized, direction) < 0.999999f)
+        {
+            direction = normalized;
+            staticValid = false;
+        }
+    }
+
+    bool staticDirty() const
+    {
+        return !staticValid;
+    }
+
+    // binds the static map; render the static casters with the returned matrices
+    void beginStatic(glm::mat4 &view, glm::mat4 &projection)
+    {
+        view = sunView();
+        projection = glm::ortho(-sceneRadius, sceneRadius, -sceneRadius, sceneRadius, 0.0f, 2.0f * sceneRadius);
+        staticMatrix = projection * view;
+        renderingStatic = true;
+        begin(staticFBO, STATIC_SIZE);
+    }
+
+    // binds the dynamic map, fitted around 'casters'; render the moving casters with the returned matrices
+    void beginDynamic(const AABB &casters, glm::mat4 &view, glm::mat4 &projection)
+    {
+        view = sunView();
+        // the shadow of a caster lies behind it along the sun direction, i.e. within the caster's own
+        // rectangle in sun space; the depth range stays that of the whole scene so every receiver is covered
+        AABB inSunSpace = casters.empty() ? AABB(glm::vec3(0.0f), glm::vec3(0.0f)) : AABB::transformed(view, casters.min, casters.max);
+        inSunSpace = inSunSpace.inflated(0.1f);
+        projection = glm::ortho(inSunSpace.min.x, inSunSpace.max.x, inSunSpace.min.y, inSunSpace.max.y, 0.0f, 2.0f * sceneRadius);
+        dynamicMatrix = projection * view;
+        renderingStatic = false;
+        begin(dynamicFBO, DYNAMIC_SIZE);
+    }
+
+    // back to the default framebuffer with a 'width' x 'height' viewport
+    void end(int width, int height)
+    {
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, width, height);
+        if(renderingStatic)
+        {
+            staticValid = true;
+            staticRenders++;
+        }
+    }
+
+    // the two maps on units 'firstUnit' and 'firstUnit' + 1 and the sun uniforms of 'shader'
+    void bind(const Shader &shader, int firstUnit = 5) const
+    {
+        glActiveTexture(GL_TEXTURE0 + firstUnit);
+        glBindTexture(GL_TEXTURE_2D, staticMap);
+        glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+        glBindTexture(GL_TEXTURE_2D, dynamicMap);
+        glActiveTexture(GL_TEXTURE0);
+
+        shader.setInt("staticShadowMap", firstUnit);
+        shader.setInt("dynamicShadowMap", firstUnit + 1);
+        shader.setMat4("staticShadowMatrix", toTextureSpace() * staticMatrix);
+        shader.setMat4("dynamicShadowMatrix", toTextureSpace() * dynamicMatrix);
+        shader.setVec3("sunDirection", direction);
+    }
+
+    void destroy()
+    {
+        glDeleteFramebuffers(1, &staticFBO);
+        glDeleteFramebuffers(1, &dynamicFBO);
+        glDeleteTextures(1, &staticMap);
+        glDeleteTextures(1, &dynamicMap);
+        staticFBO = dynamicFBO = staticMap = dynamicMap = 0;
+        staticValid = false;
+    }
+
+private:
+    bool staticValid;
+    bool renderingStatic;
+    unsigned int staticFBO, dynamicFBO;
+    unsigned int staticMap, dynamicMap;
+    glm::mat4 staticMatrix, dynamicMatrix;
+
+    glm::mat4 sunView() const
+    {
+        glm::vec3 up = std::fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        return glm::lookAt(sceneCentre + direction * sceneRadius, sceneCentre, up);
+    }
+
+    // clip space [-1, 1] to shadow map coordinates and depth in [0, 1]
+    static glm::mat4 toTextureSpace()
+    {
+        glm::mat4 bias = glm::translate(glm::mat4(), glm::vec3(0.5f));
+        return glm::scale(bias, glm::vec3(0.5f));
+    }
+
+    static void begin(unsigned int FBO, int size)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, size, size);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        // pushes the casters' depth back a little so lit surfaces don't shadow themselves
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+    }
+
+    static void createMap(unsigned int &FBO, unsigned int &map, int size)
+    {
+        glGenTextures(1, &map);
+        glBindTexture(GL_TEXTURE_2D, map);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        // hardware depth comparison with bilinear filtering of the results (2x2 PCF)
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, map, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "SUN_SHADOWS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+};
+#endif
@@ -0,0 +1,607 @@
+#ifndef TEXTURE_ARRAYS_H
+#define TEXTURE_ARRAYS_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+#include <image_helper.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/hiz_pyramid.h>
+#include <learnopengl/shader_c.h>
+#include <learnopengl/shader_m.h>
+#include <learnopengl/spatial_index.h>
+#include <learnopengl/texture_registry.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Where a texture went in TextureArrays: the array, and the layer within it. 'array' is -1 for a texture that
+// has no layer.
+struct ArrayLayer {
+    int array;
+    int layer;
+
+    ArrayLayer() : array(-1), layer(0)
+    {
+    }
+};
+
+// Textures regrouped into GL_TEXTURE_2D_ARRAYs, so boxes of different materials can be drawn with the same
+// textures bound. Every texture becomes one square layer with about as many texels as its file (a box face
+// maps the whole texture whatever its aspect), resampled with image_helper; textures that end up the same
+// size and format share an array. Grey images keep one channel as in the TextureRegistry, colour images
+// drop their alpha, which no box shader reads. There are never more than MAX_ARRAYS arrays, so a shader can
+// have all of them bound at once.
+class TextureArrays
+{
+public:
+    static const int MAX_LAYER_SIZE = 1024;
+    // as many as the materialArrays samplers of the box shaders
+    static const int MAX_ARRAYS = 8;
+
+    // GL names of the arrays, and the width and height of their layers
+    std::vector<unsigned int> arrays;
+    std::vector<int> layerSizes;
+    size_t uploadedBytes;
+
+    TextureArrays() : uploadedBytes(0)
+    {
+    }
+
+    // gives 'texture', loaded from the file at 'path', a layer when build() runs
+    void add(unsigned int texture, const std::string &path)
+    {
+        if(layers.count(texture))
+            return;
+        layers[texture] = ArrayLayer();
+        textures.push_back(texture);
+        paths.push_back(path);
+    }
+
+    // decodes the files added across all hardware threads, resamples them into their layers and uploads the
+    // arrays, with mipmaps
+    void build()
+    {
+        std::vector<DecodedImage> images(paths.size());
+        for(unsigned int i = 0; i < paths.size(); i++)
+            images[i].path = paths[i];
+        TextureRegistry::decodeAll(images, false);
+
+        // layer size and channel count of every image; files that failed to load become black, as the empty
+        // textures the registry made of them read
+        std::vector<std::pair<int, int> > formats(images.size());
+        for(unsigned int i = 0; i < images.size(); i++)
+        {
+            if(images[i].pixels)
+                formats[i] = std::make_pair(layerSize(images[i].width, images[i].height), images[i].grayscale ? 1 : 3);
+            else
+                formats[i] = std::make_pair(1, 3);
+        }
+
+        // while that makes too many arrays, the smallest layers move up to the next size, or from grey to
+        // colour once they are as large as layers get
+        for(;;)
+        {
+            std::map<std::pair<int, int>, unsigned int> counts;
+            for(unsigned int i = 0; i < formats.size(); i++)
+                counts[formats[i]]++;
+            if(counts.size() <= (size_t)MAX_ARRAYS)
+                break;
+
+            std::pair<int, int> smallest = counts.begin()->first;
+            std::pair<int, int> promoted = smallest.first < MAX_LAYER_SIZE ? std::make_pair(2 * smallest.first, smallest.second) : std::make_pair(smallest.first, 3);
+            for(unsigned int i = 0; i < formats.size(); i++)
+            {
+                if(formats[i] == smallest)
+                    formats[i] = promoted;
+            }
+        }
+
+        // resampled layers by layer size and channel count
+        std::vector<std::vector<unsigned char> > resampled(images.size());
+        std::map<std::pair<int, int>, std::vector<unsigned int> > groups;
+        for(unsigned int i = 0; i < images.size(); i++)
+        {
+            DecodedImage &image = images[i];
+            int size = formats[i].first;
+            int channels = formats[i].second;
+            if(image.pixels)
+            {
+                resample(image, channels, size, resampled[i]);
+                stbi_image_free(image.pixels);
+                image.pixels = NULL;
+            }
+            else
+            {
+                std::cout << "Texture failed to load at path: " << image.path << std::endl;
+                resampled[i].assign((size_t)size * size * channels, 0);
+            }
+            groups[formats[i]].push_back(i);
+        }
+
+        for(std::map<std::pair<int, int>, std::vector<unsigned int> >::const_iterator group = groups.begin(); group != groups.end(); ++group)
+        {
+            int size = group->first.first;
+            int channels = group->first.second;
+            const std::vector<unsigned int> &members = group->second;
+            GLenum format = channels == 1 ? GL_RED : GL_RGB;
+
+            unsigned int array;
+            glGenTextures(1, &array);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, channels == 1 ? GL_R8 : GL_RGB8, size, size, (GLsizei)members.size(), 0, format, GL_UNSIGNED_BYTE, NULL);
+            // rows of one and three channel layers needn't be 4 byte aligned
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            for(unsigned int layer = 0; layer < members.size(); layer++)
+            {
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, size, size, 1, format, GL_UNSIGNED_BYTE, &resampled[members[layer]][0]);
+                layers[textures[members[layer]]].array = (int)arrays.size();
+                layers[textures[members[layer]]].layer = (int)layer;
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+            if(channels == 1)
+            {
+                // read back as grey, like the registry's one channel textures
+                GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+                glTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+            }
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+            arrays.push_back(array);
+            layerSizes.push_back(size);
+            uploadedBytes += TextureRegistry::mipChainBytes(size, size, channels) * members.size();
+        }
+    }
+
+    // the layer of a texture added before build()
+    ArrayLayer find(unsigned int texture) const
+    {
+        std::unordered_map<unsigned int, ArrayLayer>::const_iterator found = layers.find(texture);
+        return found != layers.end() ? found->second : ArrayLayer();
+    }
+
+    // every array, the first on unit 'firstUnit'
+    void bind(int firstUnit) const
+    {
+        for(unsigned int i = 0; i < arrays.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    unsigned int layerCount() const
+    {
+        return (unsigned int)textures.size();
+    }
+
+    void report(std::ostream &out) const
+    {
+        out << "TEXTURE ARRAYS:: " << layerCount() << " textures in " << arrays.size() << " arrays (";
+        for(unsigned int i = 0; i < layerSizes.size(); i++)
+            out << (i > 0 ? ", " : "") << layerSizes[i] << "x" << layerSizes[i];
+        out << "): " << uploadedBytes / 1024 << " KB" << std::endl;
+    }
+
+    void destroy()
+    {
+        if(!arrays.empty())
+            glDeleteTextures((GLsizei)arrays.size(), &arrays[0]);
+        arrays.clear();
+        layerSizes.clear();
+        uploadedBytes = 0;
+    }
+
+private:
+    std::vector<unsigned int> textures;
+    std::vector<std::string> paths;
+    std::unordered_map<unsigned int, ArrayLayer> layers;
+
+    // the power of two nearest to the geometric mean of the sides, so the layer keeps the file's texel count
+    static int layerSize(int width, int height)
+    {
+        if(width * height <= 1)
+            return 1;
+        int exponent = (int)std::floor(0.5 * std::log2((double)width * height) + 0.5);
+        int size = std::max(1 << std::max(exponent, 0), 2);
+        return size < MAX_LAYER_SIZE ? size : MAX_LAYER_SIZE;
+    }
+
+    static int nextPowerOfTwo(int value)
+    {
+        int power = 1;
+        while(power < value)
+            power *= 2;
+        return power;
+    }
+
+    // 'image' as a 'size' x 'size' layer of 'channels' channels: grey images keep their first channel or repeat
+    // it, colour ones their RGB (one and two channel files read like their GL_RED and GL_RG textures). As SOIL
+    // does, the image is first scaled up to a power of two at least the layer's size, which then divides it
+    // into the whole blocks mipmap_image() averages.
+    static void resample(const DecodedImage &image, int channels, int size, std::vector<unsigned char> &layer)
+    {
+        const int width = image.width;
+        const int height = image.height;
+        std::vector<unsigned char> pixels((size_t)width * height * channels, 0);
+        for(size_t i = 0; i < (size_t)width * height; i++)
+        {
+            for(int c = 0; c < channels && (image.grayscale || c < image.components); c++)
+                pixels[i * channels + c] = image.pixels[i * image.components + (image.grayscale ? 0 : c)];
+        }
+
+        layer.resize((size_t)size * size * channels);
+        if(width == size && height == size)
+        {
+            layer.swap(pixels);
+            return;
+        }
+        if(width < 2 || height < 2)
+        {
+            // too thin to filter: nearest neighbour
+            for(int y = 0; y < size; y++)
+            {
+                for(int x = 0; x < size; x++)
+                {
+                    const unsigned char *source = &pixels[((size_t)(y * height / size) * width + x * width / size) * channels];
+                    memcpy(&layer[((size_t)y * size + x) * channels], source, channels);
+                }
+            }
+            return;
+        }
+
+        int upWidth = std::max(size, nextPowerOfTwo(width));
+        int upHeight = std::max(size, nextPowerOfTwo(height));
+        std::vector<unsigned char> upscaled;
+        const unsigned char *source = &pixels[0];
+        if(upWidth != width || upHeight != height)
+        {
+            upscaled.resize((size_t)upWidth * upHeight * channels);
+            up_scale_image(&pixels[0], width, height, channels, &upscaled[0], upWidth, upHeight);
+            source = &upscaled[0];
+        }
+
+        if(upWidth == size && upHeight == size)
+            memcpy(&layer[0], source, layer.size());
+        else
+            mipmap_image(source, upWidth, upHeight, channels, &layer[0], upWidth / size, upHeight / size);
+    }
+};
+
+// Per-instance data of MaterialBatches, matching the instance attributes of 5.4.batched.vs
+struct BatchInstance {
+    glm::mat4 Model;
+    // x: diffuse array, y: its layer, z: specular array, w: its layer
+    glm::vec4 Material;
+
+    BatchInstance(const glm::mat4 &model, const ArrayLayer &diffuse, const ArrayLayer &specular)
+        : Model(model), Material((float)diffuse.array, (float)diffuse.layer, (float)specular.array, (float)specular.layer)
+    {
+    }
+};
+
+// One command of glMultiDrawArraysIndirect()
+struct DrawArraysIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint baseInstance;
+};
+
+// Static boxes of any material drawn instanced. Each material is a (diffuse, specular) pair of TextureArrays
+// layers passed per instance, and every array is bound at once, so the textures are bound once per pass.
+// The instances lie in one buffer, sorted into a batch per pair of arrays.
+//
+// With a GL 4.3 context every batch is one command of a buffer built at load time, and a pass submits all of
+// them with a single glMultiDrawArraysIndirect(); the commands' base instances start each batch at its first
+// instance. Without it each batch is an instanced draw call of its own, with a VAO that starts at its first
+// instance (GL 3.3 has no base instance).
+//
+// On GL 4.3 the instances can also be culled on the GPU: cull() runs 5.4.cull.cs over all of them, which
+// copies those in the view frustum and not hidden in last frame's Hi-Z pyramid into a second instance buffer,
+// each batch keeping its range, and counts them into a second command buffer. The CPU's share is the same
+// few calls however many instances there are; the multi-draw call then reads the counts from that buffer.
+class MaterialBatches
+{
+public:
+    // recorded boxes and their textures, until build()
+    struct Box {
+        glm::mat4 model;
+        unsigned int diffuse;
+        unsigned int specular;
+    };
+    std::vector<Box> boxes;
+    // submits with glMultiDrawArraysIndirect() where the context has it
+    bool multiDraw;
+    // with multiDraw, draws what the last cull() found visible instead of every instance
+    bool gpuCulling;
+
+    MaterialBatches()
+        : multiDraw(true), gpuCulling(false), instanceVBO(0), commandBuffer(0), indirectVAO(0), visibleVBO(0),
+          visibleCommands(0), clearedCommands(0), culledVAO(0), instanceCount(0)
+    {
+    }
+
+    void add(const glm::mat4 &obj, unsigned int diffuse, unsigned int specular)
+    {
+        Box box;
+        box.model = obj;
+        box.diffuse = diffuse;
+        box.specular = specular;
+        boxes.push_back(box);
+    }
+
+    // true if a recorded box uses 'texture'
+    bool uses(unsigned int texture) const
+    {
+        for(unsigned int i = 0; i < boxes.size(); i++)
+        {
+            if(boxes[i].diffuse == texture || boxes[i].specular == texture)
+                return true;
+        }
+        return false;
+    }
+
+    // groups the recorded boxes by the arrays of their textures, and uploads them on top of an existing box VBO
+    // (position, normal, texture coords; 8 floats per vertex)
+    void build(const TextureArrays &textureArrays, unsigned int boxVBO)
+    {
+        // instances by (diffuse array, specular array)
+        std::map<std::pair<int, int>, std::vector<BatchInstance> > groups;
+        unsigned int dropped = 0;
+        for(unsigned int i = 0; i < boxes.size(); i++)
+        {
+            ArrayLayer diffuse = textureArrays.find(boxes[i].diffuse);
+            ArrayLayer specular = textureArrays.find(boxes[i].specular);
+            if(diffuse.array < 0 || specular.array < 0)
+            {
+                dropped++;
+                continue;
+            }
+            groups[std::make_pair(diffuse.array, specular.array)].push_back(BatchInstance(boxes[i].model, diffuse, specular));
+        }
+        if(dropped > 0)
+            std::cout << "MATERIAL_BATCHES::" << dropped << " boxes without texture layers dropped" << std::endl;
+
+        std::vector<BatchInstance> instances;
+        std::vector<DrawArraysIndirectCommand> commands;
+        for(std::map<std::pair<int, int>, std::vector<BatchInstance> >::const_iterator group = groups.begin(); group != groups.end(); ++group)
+        {
+            DrawArraysIndirectCommand command;
+            command.count = 36;
+            command.instanceCount = (GLuint)group->second.size();
+            command.first = 0;
+            command.baseInstance = (GLuint)instances.size();
+            commands.push_back(command);
+            instances.insert(instances.end(), group->second.begin(), group->second.end());
+        }
+        instanceCount = (unsigned int)instances.size();
+        boxes.clear();
+
+        glGenBuffers(1, &instanceVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(BatchInstance), instances.empty() ? NULL : &instances[0], GL_STATIC_DRAW);
+
+        for(unsigned int i = 0; i < commands.size(); i++)
+        {
+            Batch batch;
+            batch.count = (GLsizei)commands[i].instanceCount;
+            batch.VAO = createVAO(boxVBO, instanceVBO, commands[i].baseInstance * sizeof(BatchInstance));
+            batches.push_back(batch);
+        }
+
+        if(GLAD_GL_VERSION_4_3)
+        {
+            glGenBuffers(1, &commandBuffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawArraysIndirectCommand), commands.empty() ? NULL : &commands[0], GL_STATIC_DRAW);
+            indirectVAO = createVAO(boxVBO, instanceVBO, 0);
+
+            // what cull() writes: the visible instances, and the commands with their counts, reset from a copy
+            // of the commands whose counts are 0
+            glGenBuffers(1, &visibleVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, visibleVBO);
+            glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(BatchInstance), NULL, GL_DYNAMIC_COPY);
+            glGenBuffers(1, &visibleCommands);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, visibleCommands);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawArraysIndirectCommand), NULL, GL_DYNAMIC_COPY);
+            for(unsigned int i = 0; i < commands.size(); i++)
+                commands[i].instanceCount = 0;
+            glGenBuffers(1, &clearedCommands);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, clearedCommands);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawArraysIndirectCommand), commands.empty() ? NULL : &commands[0], GL_STATIC_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            culledVAO = createVAO(boxVBO, visibleVBO, 0);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // points the materialArrays samplers of 'shader' at units 'firstUnit' onwards. Every program whose
+    // fragment shader declares them needs this before drawing anything, as sampler2DArray and sampler2D
+    // uniforms must not share a unit.
+    static void setSamplers(const Shader &shader, int firstUnit = 7)
+    {
+        for(int i = 0; i < TextureArrays::MAX_ARRAYS; i++)
+            shader.setInt("materialArrays[" + std::to_string(i) + "]", firstUnit + i);
+    }
+
+    // draws every batch with 'shader' (5.4.batched.vs), which must be in use with its other uniforms set. The
+    // arrays are bound to units 'firstUnit' onwards unless 'bindTextures' is off.
+    void draw(const Shader &shader, const TextureArrays &textureArrays, bool bindTextures, int firstUnit = 7) const
+    {
+        setSamplers(shader, firstUnit);
+        if(bindTextures)
+            textureArrays.bind(firstUnit);
+
+        if(multiDraw && indirectVAO != 0)
+        {
+            bool culled = gpuCulling && culledVAO != 0;
+            glBindVertexArray(culled ? culledVAO : indirectVAO);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culled ? visibleCommands : commandBuffer);
+            glMultiDrawArraysIndirect(GL_TRIANGLES, (void*)0, (GLsizei)batches.size(), 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+        else
+        {
+            for(unsigned int i = 0; i < batches.size(); i++)
+            {
+                glBindVertexArray(batches[i].VAO);
+                glDrawArraysInstanced(GL_TRIANGLES, 0, 36, batches[i].count);
+            }
+        }
+        glBindVertexArray(0);
+    }
+
+    // finds the instances visible in 'frustum' and, where 'hiZ' is valid, not hidden in last frame's depth,
+    // with 'cullShader' (5.4.cull.cs), for the draws of this frame while 'gpuCulling' is on
+    void cull(const ComputeShader &cullShader, const Frustum &frustum, const HiZPyramid &hiZ)
+    {
+        if(culledVAO == 0)
+            return;
+
+        glBindBuffer(GL_COPY_READ_BUFFER, clearedCommands);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, visibleCommands);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, batches.size() * sizeof(DrawArraysIndirectCommand));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        cullShader.use();
+        cullShader.setInt("instanceCount", (int)instanceCount);
+        cullShader.setInt("batchCount", (int)batches.size());
+        for(int i = 0; i < 6; i++)
+            cullShader.setVec4("frustum[" + std::to_string(i) + "]", frustum.planes[i]);
+        hiZ.bind(cullShader);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceVBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, visibleVBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commandBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, visibleCommands);
+        glDispatchCompute((instanceCount + 63) / 64, 1, 1);
+        // the draws read what the shader wrote as instance attributes and indirect commands
+        glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+        for(unsigned int i = 0; i < 4; i++)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0);
+    }
+
+    // false if the context has no glMultiDrawArraysIndirect()
+    bool multiDrawAvailable() const
+    {
+        return indirectVAO != 0;
+    }
+
+    // false if the context has no compute shaders
+    bool cullAvailable() const
+    {
+        return culledVAO != 0;
+    }
+
+    // boxes the last cull() found visible. Waits for the GPU to finish it, so only for statistics.
+    unsigned int visibleCount() const
+    {
+        if(culledVAO == 0 || batches.empty())
+            return instanceCount;
+
+        std::vector<DrawArraysIndirectCommand> commands(batches.size());
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, visibleCommands);
+        glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawArraysIndirectCommand), &commands[0]);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        unsigned int visible = 0;
+        for(unsigned int i = 0; i < commands.size(); i++)
+            visible += commands[i].instanceCount;
+        return visible;
+    }
+
+    // CPU issued draw calls per pass
+    unsigned int drawCount() const
+    {
+        return multiDraw && indirectVAO != 0 ? 1 : (unsigned int)batches.size();
+    }
+
+    unsigned int batchCount() const
+    {
+        return (unsigned int)batches.size();
+    }
+
+    unsigned int boxCount() const
+    {
+        return instanceCount;
+    }
+
+    void destroy()
+    {
+        for(unsigned int i = 0; i < batches.size(); i++)
+            glDeleteVertexArrays(1, &batches[i].VAO);
+        batches.clear();
+        glDeleteVertexArrays(1, &indirectVAO);
+        glDeleteVertexArrays(1, &culledVAO);
+        glDeleteBuffers(1, &instanceVBO);
+        glDeleteBuffers(1, &commandBuffer);
+        glDeleteBuffers(1, &visibleVBO);
+        glDeleteBuffers(1, &visibleCommands);
+        glDeleteBuffers(1, &clearedCommands);
+        indirectVAO = culledVAO = instanceVBO = commandBuffer = visibleVBO = visibleCommands = clearedCommands = 0;
+        instanceCount = 0;
+    }
+
+private:
+    struct Batch {
+        GLsizei count;
+        unsigned int VAO;
+    };
+    std::vector<Batch> batches;
+    unsigned int instanceVBO;
+    unsigned int commandBuffer;
+    unsigned int indirectVAO;
+    // written by cull()
+    unsigned int visibleVBO;
+    unsigned int visibleCommands;
+    unsigned int clearedCommands;
+    unsigned int culledVAO;
+    unsigned int instanceCount;
+
+    // a VAO over the box and the instances in 'instances' from byte 'offset' on
+    unsigned int createVAO(unsigned int boxVBO, unsigned int instances, size_t offset)
+    {
+        unsigned int VAO;
+        glGenVertexArrays(1, &VAO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+
+        glBindBuffer(GL_ARRAY_BUFFER, instances);
+        // model transformation: a mat4 occupies four consecutive vec4 attribute slots
+        for(unsigned int i = 0; i < 4; i++)
+        {
+            glEnableVertexAttribArray(3 + i);
+            glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(BatchInstance), (void*)(offset + offsetof(BatchInstance, Model) + i * sizeof(glm::vec4)));
+            glVertexAttribDivisor(3 + i, 1);
+        }
+        // diffuse array + layer, specular array + layer
+        glEnableVertexAttribArray(7);
+        glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(BatchInstance), (void*)(offset + offsetof(BatchInstance, Material)));
+        glVertexAttribDivisor(7, 1);
+        return VAO;
+    }
+};
+#endif
@@ -0,0 +1,398 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// An image decoded on a worker thread, waiting to be uploaded on the GL thread. decode() also shrinks the
+// pixels to what their content needs (see TextureRegistry::reduce()), so width, height and components
+// describe the reduced image and the source* fields the file.
+struct DecodedImage {
+    std::string path;
+    int width;
+    int height;
+    int components;
+    unsigned char *pixels;
+    uint64_t contentHash;
+    int sourceWidth;
+    int sourceHeight;
+    int sourceComponents;
+    // an RGB(A) image with equal colour channels, stored as one channel (plus alpha) and swizzled back
+    bool grayscale;
+
+    DecodedImage() : width(0), height(0), components(0), pixels(NULL), contentHash(0),
+                     sourceWidth(0), sourceHeight(0), sourceComponents(0), grayscale(false)
+    {
+    }
+};
+
+// What content analysis did to the textures uploaded so far, and the GPU memory (mip chains included) it saved
+struct TextureMemory {
+    unsigned int textures;
+    unsigned int constant;
+    unsigned int grayscale;
+    unsigned int opaque;
+    unsigned int lowDetail;
+    size_t sourceBytes;
+    size_t uploadedBytes;
+
+    TextureMemory() : textures(0), constant(0), grayscale(0), opaque(0), lowDetail(0), sourceBytes(0), uploadedBytes(0)
+    {
+    }
+};
+
+// Process wide cache of GL textures keyed by canonical file path, shared by every Model and by the
+// textures the park loads directly. Lookups are O(1); preload() decodes many files in parallel before
+// uploading them one after another on the calling (GL) thread. Every texture is stored in the smallest
+// format that samples the same as its file: constant images become 1x1, grey images one channel and
+// opaque alpha channels are dropped.
+class TextureRegistry
+{
+public:
+    // also share one GL texture between files with identical pixels
+    bool dedupeByContent;
+    TextureMemory memory;
+
+    static TextureRegistry &instance()
+    {
+        static TextureRegistry registry;
+        return registry;
+    }
+
+    // absolute path with '.', '..' and duplicate separators resolved, so different spellings of the
+    // same file share a key
+    static std::string canonicalPath(const std::string &path)
+    {
+#if defined(_WIN32)
+        char resolved[_MAX_PATH];
+        if(_fullpath(resolved, path.c_str(), _MAX_PATH) != NULL)
+            return std::string(resolved);
+#else
+        char resolved[PATH_MAX];
+        if(realpath(path.c_str(), resolved) != NULL)
+            return std::string(resolved);
+#endif
+        return path;
+    }
+
+    // returns the texture of a file, loading it on first use
+    unsigned int load(const std::string &path)
+    {
+        std::string key = canonicalPath(path);
+        std::unordered_map<std::string, unsigned int>::const_iterator found = byPath.find(key);
+        if(found != byPath.end())
+            return found->second;
+
+        DecodedImage image;
+        image.path = path;
+        decode(image);
+        return add(key, image);
+    }
+
+    // decodes every file that isn't loaded yet across all hardware threads, then uploads them
+    void preload(const std::vector<std::string> &paths)
+    {
+        std::vector<std::string> keys;
+        std::vector<DecodedImage> images;
+        std::unordered_set<std::string> pending;
+        for(unsigned int i = 0; i < paths.size(); i++)
+        {
+            std::string key = canonicalPath(paths[i]);
+            if(byPath.count(key) || !pending.insert(key).second)
+                continue;
+
+            keys.push_back(key);
+            images.push_back(DecodedImage());
+            images.back().path = paths[i];
+        }
+
+        decodeAll(images, dedupeByContent);
+
+        for(unsigned int i = 0; i < images.size(); i++)
+            add(keys[i], images[i]);
+    }
+
+    // uploads an image decoded elsewhere, e.g. on a loader thread. If the file was loaded in the meantime the
+    // image is dropped and the existing texture returned.
+    unsigned int adopt(DecodedImage &image)
+    {
+        std::string key = canonicalPath(image.path);
+        std::unordered_map<std::string, unsigned int>::const_iterator found = byPath.find(key);
+        if(found != byPath.end())
+        {
+            stbi_image_free(image.pixels);
+            image.pixels = NULL;
+            return found->second;
+        }
+        return add(key, image);
+    }
+
+    // 0 if the file hasn't been loaded
+    unsigned int find(const std::string &path) const
+    {
+        std::unordered_map<std::string, unsigned int>::const_iterator found = byPath.find(canonicalPath(path));
+        return found != byPath.end() ? found->second : 0;
+    }
+
+    unsigned int size() const
+    {
+        return (unsigned int)byPath.size();
+    }
+
+    // stores a file that isn't loaded yet as 16 bit colour (RGB565, or RGBA4 with alpha). Meant for props
+    // whose textures have little detail, where the banding doesn't show.
+    void setLowDetail(const std::string &path)
+    {
+        lowDetailPaths.insert(canonicalPath(path));
+    }
+
+    void report(std::ostream &out) const
+    {
+        out << "TEXTURES:: " << memory.textures << " textures (" << memory.constant << " constant, "
+            << memory.grayscale << " grayscale, " << memory.opaque << " opaque alpha dropped, "
+            << memory.lowDetail << " low detail): " << memory.sourceBytes / 1024 << " KB -> "
+            << memory.uploadedBytes / 1024 << " KB, " << (memory.sourceBytes - memory.uploadedBytes) / 1024
+            << " KB saved" << std::endl;
+    }
+
+    // decodes images on as many threads as are useful; also hashes their pixels if requested
+    static void decodeAll(std::vector<DecodedImage> &images, bool hashContent)
+    {
+        unsigned int workerCount = std::min<unsigned int>(std::max(1u, std::thread::hardware_concurrency()), (unsigned int)images.size());
+        std::atomic<unsigned int> next(0);
+
+        std::vector<std::thread> workers;
+        for(unsigned int i = 0; i < workerCount; i++)
+        {
+            workers.push_back(std::thread([&images, &next, hashContent]()
+            {
+                for(unsigned int index = next++; index < images.size(); index = next++)
+                {
+                    decode(images[index]);
+                    if(hashContent)
+                        hashPixels(images[index]);
+                }
+            }));
+        }
+        for(unsigned int i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    static void decode(DecodedImage &image)
+    {
+        image.pixels = stbi_load(image.path.c_str(), &image.width, &image.height, &image.components, 0);
+        image.sourceWidth = image.width;
+        image.sourceHeight = image.height;
+        image.sourceComponents = image.components;
+        reduce(image);
+    }
+
+    // Drops what the content of an image doesn't need, in place: an RGB(A) image whose colour channels are
+    // all equal keeps one of them (sampled through a swizzle), an alpha channel that is 255 everywhere goes
+    // and an image of a single colour shrinks to one pixel. One and two channel files are left as they are
+    // (GL_RED and GL_RG textures don't read as grey).
+    static void reduce(DecodedImage &image)
+    {
+        if(!image.pixels || image.components < 3)
+            return;
+
+        const int components = image.components;
+        const size_t count = (size_t)image.width * image.height;
+        const unsigned char *first = image.pixels;
+        bool constant = true;
+        bool grayscale = true;
+        bool opaque = components == 4;
+        for(size_t i = 0; i < count && (constant || grayscale || opaque); i++)
+        {
+            const unsigned char *pixel = image.pixels + i * components;
+            constant = constant && memcmp(pixel, first, components) == 0;
+            grayscale = grayscale && pixel[1] == pixel[0] && pixel[2] == pixel[0];
+            opaque = opaque && pixel[3] == 255;
+        }
+
+        // which source channels are kept
+        int kept[4] = {0, 1, 2, 3};
+        int keptCount = components;
+        if(grayscale)
+        {
+            kept[1] = 3;
+            keptCount = opaque || components == 3 ? 1 : 2;
+        }
+        else if(opaque)
+        {
+            keptCount = 3;
+        }
+
+        // every output byte is at or before its source byte, so this can work in place
+        size_t keptPixels = constant ? 1 : count;
+        for(size_t i = 0; i < keptPixels; i++)
+        {
+            for(int c = 0; c < keptCount; c++)
+                image.pixels[i * keptCount + c] = image.pixels[i * components + kept[c]];
+        }
+
+        image.components = keptCount;
+        image.grayscale = grayscale;
+        if(constant)
+            image.width = image.height = 1;
+    }
+
+    // bytes of a texture and all its mip levels
+    static size_t mipChainBytes(int width, int height, int bytesPerPixel)
+    {
+        size_t bytes = 0;
+        for(;;)
+        {
+            bytes += (size_t)width * height * bytesPerPixel;
+            if(width == 1 && height == 1)
+                return bytes;
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+    }
+
+    // creates the GL texture of a decoded image and frees its pixels. Three and four channel images can
+    // be stored with 16 bits per pixel; returns the bytes the texture takes.
+    static unsigned int upload(DecodedImage &image, bool lowDetail = false, size_t *bytes = NULL)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+
+        if (image.pixels)
+        {
+            GLenum format = GL_RGBA;
+            GLenum internalFormat = lowDetail ? GL_RGBA4 : GL_RGBA8;
+            int bytesPerPixel = lowDetail ? 2 : 4;
+            if (image.components == 1)
+            {
+                format = GL_RED;
+                internalFormat = GL_R8;
+                bytesPerPixel = 1;
+            }
+            else if (image.components == 2)
+            {
+                format = GL_RG;
+                internalFormat = GL_RG8;
+                bytesPerPixel = 2;
+            }
+            else if (image.components == 3)
+            {
+                format = GL_RGB;
+                internalFormat = lowDetail ? GL_RGB565 : GL_RGB8;
+                bytesPerPixel = lowDetail ? 2 : 3;
+            }
+            if (bytes)
+                *bytes = mipChainBytes(image.width, image.height, bytesPerPixel);
+
+            glBindTexture(GL_TEXTURE_2D, textureID);
+            // rows of one and three channel images needn't be 4 byte aligned
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            glGenerateMipmap(GL_TEXTURE_2D);
+            if (image.grayscale)
+            {
+                // read back as the grey RGB(A) image it was
+                GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, image.components == 2 ? GL_GREEN : GL_ONE};
+                glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+            }
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+        else
+        {
+            std::cout << "Texture failed to load at path: " << image.path << std::endl;
+        }
+
+        stbi_image_free(image.pixels);
+        image.pixels = NULL;
+        return textureID;
+    }
+
+private:
+    std::unordered_map<std::string, unsigned int> byPath;
+    std::unordered_map<uint64_t, unsigned int> byContent;
+    std::unordered_set<std::string> lowDetailPaths;
+
+    TextureRegistry() : dedupeByContent(false)
+    {
+    }
+
+    TextureRegistry(const TextureRegistry &) = delete;
+    TextureRegistry &operator=(const TextureRegistry &) = delete;
+
+    unsigned int add(const std::string &key, DecodedImage &image)
+    {
+        // 16 bit textures only ever share with other 16 bit ones
+        bool lowDetail = image.components >= 3 && lowDetailPaths.count(key) > 0;
+        uint64_t contentKey = 0;
+        if(dedupeByContent && image.pixels)
+        {
+            if(image.contentHash == 0)
+                hashPixels(image);
+            contentKey = image.contentHash ^ (lowDetail ? 0x9E3779B97F4A7C15ULL : 0);
+
+            std::unordered_map<uint64_t, unsigned int>::const_iterator found = byContent.find(contentKey);
+            if(found != byContent.end())
+            {
+                stbi_image_free(image.pixels);
+                image.pixels = NULL;
+                byPath[key] = found->second;
+                return found->second;
+            }
+        }
+
+        bool decoded = image.pixels != NULL;
+        if(decoded)
+        {
+            memory.textures++;
+            memory.constant += image.width == 1 && image.height == 1 && image.sourceWidth * image.sourceHeight > 1;
+            memory.grayscale += image.grayscale;
+            memory.opaque += image.sourceComponents == 4 && (image.components == 3 || (image.grayscale && image.components == 1));
+            memory.lowDetail += lowDetail;
+            // what the file would take as an 8 bit texture of its own channel count
+            memory.sourceBytes += mipChainBytes(image.sourceWidth, image.sourceHeight, image.sourceComponents);
+        }
+
+        size_t bytes = 0;
+        unsigned int textureID = upload(image, lowDetail, &bytes);
+        memory.uploadedBytes += bytes;
+        byPath[key] = textureID;
+        if(dedupeByContent && decoded)
+            byContent[contentKey] = textureID;
+        return textureID;
+    }
+
+    // 64-bit FNV-1a over the layout and pixels
+    static void hashPixels(DecodedImage &image)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        int header[4] = {image.width, image.height, image.components, image.grayscale};
+        const unsigned char *bytes = (const unsigned char*)header;
+        for(size_t i = 0; i < sizeof(header); i++)
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+
+        size_t size = (size_t)image.width * image.height * image.components;
+        for(size_t i = 0; i < size; i++)
+            hash = (hash ^ image.pixels[i]) * 1099511628211ULL;
+
+        image.contentHash = hash;
+    }
+};
+#endif
@@ -0,0 +1,225 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+
+// Attributes a mesh can store on the GPU besides its position. Decoded by 5.4.model_loading.vs, which
+// receives the flags of the mesh being drawn in the 'meshAttributes' uniform.
+enum Vertex_Attribute {
+    VERTEX_NORMAL         = 1, // 10:10:10:2 signed normalized normal
+    VERTEX_TEXCOORDS      = 2, // two half floats
+    VERTEX_TANGENT_FRAME  = 4  // tangent, bitangent and normal as one 4x16-bit quaternion (replaces VERTEX_NORMAL)
+};
+
+// Compact GPU layout of a mesh's vertices. Positions are always stored as 16-bit unsigned normalized
+// offsets inside the mesh bounds, the other attributes follow in the order of Vertex_Attribute.
+struct VertexFormat {
+    unsigned int attributes;
+    unsigned int stride;
+    unsigned int normalOffset;
+    unsigned int texCoordsOffset;
+    unsigned int tangentFrameOffset;
+
+    // the position takes 8 bytes (three 16-bit components, padded to keep every attribute 4-byte aligned)
+    static const unsigned int POSITION_SIZE = 8;
+
+    explicit VertexFormat(unsigned int requested = VERTEX_NORMAL | VERTEX_TEXCOORDS) : attributes(requested)
+    {
+        // the quaternion already contains the normal
+        if(attributes & VERTEX_TANGENT_FRAME)
+            attributes &= ~VERTEX_NORMAL;
+
+        stride = POSITION_SIZE;
+        normalOffset = texCoordsOffset = tangentFrameOffset = 0;
+        if(attributes & VERTEX_NORMAL)
+        {
+            normalOffset = stride;
+            stride += 4;
+        }
+        if(attributes & VERTEX_TEXCOORDS)
+        {
+            texCoordsOffset = stride;
+            stride += 4;
+        }
+        if(attributes & VERTEX_TANGENT_FRAME)
+        {
+            tangentFrameOffset = stride;
+            stride += 8;
+        }
+    }
+
+    bool has(Vertex_Attribute attribute) const
+    {
+        return (attributes & attribute) != 0;
+    }
+
+    // configures attributes 0 (position), 1 (normal), 2 (texture coords) and 3 (tangent frame) of the
+    // bound VAO for the vertex buffer bound to GL_ARRAY_BUFFER
+    void setAttributePointers() const
+    {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)0);
+        if(has(VERTEX_NORMAL))
+        {
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)(size_t)normalOffset);
+        }
+        if(has(VERTEX_TEXCOORDS))
+        {
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)(size_t)texCoordsOffset);
+        }
+        if(has(VERTEX_TANGENT_FRAME))
+        {
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 4, GL_SHORT, GL_TRUE, stride, (void*)(size_t)tangentFrameOffset);
+        }
+    }
+};
+
+// --- encoders ---------------------------------------------------------------------------------------
+
+// position relative to the mesh bounds, 0..65535 per axis
+inline uint64_t encodePosition(const glm::vec3 &position, const glm::vec3 &boundsMin, const glm::vec3 &boundsExtent)
+{
+    glm::vec3 relative;
+    for(int i = 0; i < 3; i++)
+        relative[i] = boundsExtent[i] > 0.0f ? (position[i] - boundsMin[i]) / boundsExtent[i] : 0.0f;
+    return glm::packUnorm4x16(glm::vec4(relative, 0.0f));
+}
+
+inline uint32_t encodeNormal(const glm::vec3 &normal)
+{
+    float length = glm::length(normal);
+    return glm::packSnorm3x10_1x2(glm::vec4(length > 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f), 0.0f));
+}
+
+inline uint32_t encodeTexCoords(const glm::vec2 &texCoords)
+{
+    return glm::packHalf2x16(texCoords);
+}
+
+// Tangent frame as a unit quaternion rotating (1,0,0), (0,1,0), (0,0,1) onto the tangent, bitangent and
+// normal. The sign of w holds the handedness of the frame, so w is kept away from zero to survive quantization.
+inline uint64_t encodeTangentFrame(const glm::vec3 &normal, const glm::vec3 &tangent, const glm::vec3 &bitangent)
+{
+    float normalLength = glm::length(normal);
+    glm::vec3 n = normalLength > 0.0f ? normal / normalLength : glm::vec3(0.0f, 0.0f, 1.0f);
+
+    // Gram-Schmidt; meshes without texture coordinates have no tangents, so pick any perpendicular one
+    glm::vec3 t = tangent - n * glm::dot(n, tangent);
+    if(glm::length(t) < 1e-6f)
+        t = glm::cross(std::fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f), n);
+    t = glm::normalize(t);
+    glm::vec3 b = glm::cross(n, t);
+    bool reflected = glm::dot(b, bitangent) < 0.0f;
+
+    glm::quat q = glm::normalize(glm::quat_cast(glm::mat3(t, b, n)));
+    if(q.w < 0.0f)
+        q = -q;
+
+    const float bias = 1.0f / 32767.0f;
+    if(q.w < bias)
+    {
+        float scale = std::sqrt(1.0f - bias * bias);
+        q.x *= scale;
+        q.y *= scale;
+        q.z *= scale;
+        q.w = bias;
+    }
+    if(reflected)
+        q = -q;
+    return glm::packSnorm4x16(glm::vec4(q.x, q.y, q.z, q.w));
+}
+
+// --- decoders (the CPU mirror of 5.4.model_loading.vs) ------------------------------------------------
+
+inline glm::vec3 decodePosition(uint64_t packed, const glm::vec3 &boundsMin, const glm::vec3 &boundsExtent)
+{
+    return boundsMin + glm::vec3(glm::unpackUnorm4x16(packed)) * boundsExtent;
+}
+
+inline void decodeTangentFrame(uint64_t packed, glm::vec3 &normal, glm::vec3 &tangent, glm::vec3 &bitangent)
+{
+    glm::vec4 v = glm::unpackSnorm4x16(packed);
+    glm::quat q = glm::normalize(glm::quat(v.w, v.x, v.y, v.z));
+    tangent = q * glm::vec3(1.0f, 0.0f, 0.0f);
+    normal = q * glm::vec3(0.0f, 0.0f, 1.0f);
+    bitangent = glm::cross(normal, tangent) * (v.w < 0.0f ? -1.0f : 1.0f);
+}
+
+// --- mesh encoding ----------------------------------------------------------------------------------
+
+// Chooses the attributes a mesh actually needs: texture coordinates only if it has textures or non zero
+// coordinates, a tangent frame only if it has a normal map.
+template <typename VertexType, typename TextureType>
+unsigned int chooseVertexAttributes(const std::vector<VertexType> &vertices, const std::vector<TextureType> &textures)
+{
+    unsigned int attributes = VERTEX_NORMAL;
+
+    bool textured = !textures.empty();
+    for(unsigned int i = 0; !textured && i < vertices.size(); i++)
+        textured = vertices[i].TexCoords != glm::vec2(0.0f);
+    if(textured)
+        attributes |= VERTEX_TEXCOORDS;
+
+    for(unsigned int i = 0; i < textures.size(); i++)
+    {
+        if(textures[i].type == "texture_normal")
+            attributes |= VERTEX_TANGENT_FRAME;
+    }
+    return attributes;
+}
+
+// packs full precision vertices (anything with Position, Normal, TexCoords, Tangent and Bitangent members)
+// into 'format', returning the bounds the positions are relative to
+template <typename VertexType>
+void encodeVertices(const std::vector<VertexType> &vertices, const VertexFormat &format, std::vector<unsigned char> &encoded,
+                    glm::vec3 &boundsMin, glm::vec3 &boundsExtent)
+{
+    boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax(0.0f);
+    if(!vertices.empty())
+        boundsMin = boundsMax = vertices[0].Position;
+    for(unsigned int i = 1; i < vertices.size(); i++)
+    {
+        boundsMin = glm::min(boundsMin, vertices[i].Position);
+        boundsMax = glm::max(boundsMax, vertices[i].Position);
+    }
+    boundsExtent = boundsMax - boundsMin;
+
+    encoded.assign(vertices.size() * format.stride, 0);
+    for(unsigned int i = 0; i < vertices.size(); i++)
+    {
+        unsigned char *vertex = &encoded[i * format.stride];
+        const VertexType &source = vertices[i];
+
+        uint64_t position = encodePosition(source.Position, boundsMin, boundsExtent);
+        memcpy(vertex, &position, 6);
+        if(format.has(VERTEX_NORMAL))
+        {
+            uint32_t normal = encodeNormal(source.Normal);
+            memcpy(vertex + format.normalOffset, &normal, 4);
+        }
+        if(format.has(VERTEX_TEXCOORDS))
+        {
+            uint32_t texCoords = encodeTexCoords(source.TexCoords);
+            memcpy(vertex + format.texCoordsOffset, &texCoords, 4);
+        }
+        if(format.has(VERTEX_TANGENT_FRAME))
+        {
+            uint64_t frame = encodeTangentFrame(source.Normal, source.Tangent, source.Bitangent);
+            memcpy(vertex + format.tangentFrameOffset, &frame, 8);
+        }
+    }
+}
+#endif
@@ -0,0 +1,706 @@
+#include "bench.h"
+
+// Headless benchmarks for the CPU side systems of the park. Run without arguments for every benchmark,
+// or pass the name of one benchmark followed by its optional size, e.g. ./assignment__bench spatial 1000000
+// (the import benchmark also takes the path of a model instead of a size)
+
+int main(int argc, char *argv[])
+{
+    std::string which = argc > 1 ? argv[1] : "all";
+    long count = argc > 2 ? atol(argv[2]) : 0;
+
+    if(which == "all" || which == "spatial")
+    {
+        spatialBench(count > 0 ? count : 1000000);
+    }
+    if(which == "all" || which == "lod")
+    {
+        lodBench(count > 0 ? count : 500000);
+    }
+    if(which == "all" || which == "optimize")
+    {
+        optimizeBench(count > 0 ? count : 500000);
+    }
+    if(which == "all" || which == "import")
+    {
+        importBench(argc > 2 && count == 0 ? argv[2] : "", count > 0 ? count : 500000);
+    }
+    if(which == "all" || which == "dxt")
+    {
+        dxtBench(count > 0 ? count : 4 * 1024 * 1024);
+    }
+    if(which == "all" || which == "image")
+    {
+        imageBench(count > 0 ? count : 4096 * 4096);
+    }
+    if(which == "all" || which == "lights")
+    {
+        lightBench(count > 0 ? count : 256);
+    }
+    if(which == "all" || which == "occlusion")
+    {
+        occlusionBench(count > 0 ? count : 100000);
+    }
+
+    return 0;
+}
+
+// utility functions
+// -----------------
+double elapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+float randomFloat(float lower, float upper)
+{
+    return lower + (upper - lower) * (float)rand() / (float)RAND_MAX;
+}
+
+// SPATIAL INDEX ----------------------------------------------------------------
+// Builds a BVH and a loose octree over 'count' random boxes in a 1km cube, times ray, sphere sweep and
+// frustum queries and validates a sample of ray queries against a linear scan.
+void spatialBench(long count)
+{
+    std::cout << "== spatial index: " << count << " objects ==" << std::endl;
+
+    srand(1);
+    const float worldSize = 1000.0f;
+    std::vector<AABB> bounds(count);
+    for(long i = 0; i < count; i++)
+    {
+        glm::vec3 center(randomFloat(-worldSize, worldSize) * 0.5f, randomFloat(-worldSize, worldSize) * 0.5f, randomFloat(-worldSize, worldSize) * 0.5f);
+        glm::vec3 half(randomFloat(0.05f, 1.0f), randomFloat(0.05f, 1.0f), randomFloat(0.05f, 1.0f));
+        bounds[i] = AABB(center - half, center + half);
+    }
+
+    // static BVH
+    Clock::time_point start = Clock::now();
+    StaticBVH bvh;
+    bvh.build(bounds);
+    std::cout << "BVH build:             " << elapsedMs(start) << " ms" << std::endl;
+
+    const int rayCount = 100000;
+    std::vector<Ray> rays;
+    for(int i = 0; i < rayCount; i++)
+    {
+        glm::vec3 origin(randomFloat(-500.0f, 500.0f), randomFloat(-500.0f, 500.0f), randomFloat(-500.0f, 500.0f));
+        glm::vec3 direction = glm::normalize(glm::vec3(randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f)) + glm::vec3(0.0f, 0.0f, 0.001f));
+        rays.push_back(Ray(origin, direction));
+    }
+
+    int hits = 0;
+    start = Clock::now();
+    for(int i = 0; i < rayCount; i++)
+    {
+        SpatialHit hit;
+        if(bvh.raycast(rays[i], 100.0f, hit))
+            hits++;
+    }
+    double ms = elapsedMs(start);
+    std::cout << "BVH raycast:           " << ms * 1000.0 / rayCount << " us/ray (" << hits << " hits)" << std::endl;
+
+    start = Clock::now();
+    hits = 0;
+    for(int i = 0; i < rayCount; i++)
+    {
+        SpatialHit hit;
+        if(bvh.sphereSweep(rays[i].origin, rays[i].origin + rays[i].direction * 10.0f, 0.25f, hit))
+            hits++;
+    }
+    ms = elapsedMs(start);
+    std::cout << "BVH sphere sweep:      " << ms * 1000.0 / rayCount << " us/sweep (" << hits << " hits)" << std::endl;
+
+    // a camera looking down -z from every corner of the world
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.25f, 0.1f, 100.0f);
+    const int frustumCount = 100;
+    size_t visible = 0;
+    start = Clock::now();
+    for(int i = 0; i < frustumCount; i++)
+    {
+        glm::vec3 eye(randomFloat(-500.0f, 500.0f), randomFloat(-500.0f, 500.0f), randomFloat(-500.0f, 500.0f));
+        glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f), -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        std::vector<int> results;
+        bvh.queryFrustum(Frustum::fromMatrix(projection * view), results);
+        visible += results.size();
+    }
+    ms = elapsedMs(start);
+    std::cout << "BVH frustum query:     " << ms / frustumCount << " ms/query (" << visible / frustumCount << " visible)" << std::endl;
+
+    // validate against a linear scan
+    const int validateCount = std::min(200L, count > 0 ? 200L : 0L);
+    int mismatches = 0;
+    start = Clock::now();
+    for(int i = 0; i < validateCount; i++)
+    {
+        SpatialHit hit;
+        bool found = bvh.raycast(rays[i], 100.0f, hit);
+
+        float best = 100.0f;
+        int bestId = -1;
+        for(long j = 0; j < count; j++)
+        {
+            float t;
+            if(rays[i].intersects(bounds[j], best, t) && t <= best)
+            {
+                best = t;
+                bestId = (int)j;
+            }
+        }
+        if(found != (bestId >= 0) || (found && hit.t != best))
+            mismatches++;
+    }
+    ms = elapsedMs(start);
+    std::cout << "linear scan raycast:   " << ms * 1000.0 / std::max(validateCount, 1) << " us/ray (" << mismatches << " mismatches in " << validateCount << " rays)" << std::endl;
+
+    // loose octree for moving objects
+    LooseOctree octree(AABB(glm::vec3(-worldSize * 0.5f), glm::vec3(worldSize * 0.5f)), 10);
+    start = Clock::now();
+    for(long i = 0; i < count; i++)
+        octree.insert((int)i, bounds[i]);
+    std::cout << "octree insert:         " << elapsedMs(start) << " ms" << std::endl;
+
+    // move 10% of the objects by a small amount, as actors do every frame
+    long moving = count / 10;
+    start = Clock::now();
+    for(long i = 0; i < moving; i++)
+    {
+        glm::vec3 offset(randomFloat(-0.5f, 0.5f), 0.0f, randomFloat(-0.5f, 0.5f));
+        bounds[i] = AABB(bounds[i].min + offset, bounds[i].max + offset);
+        octree.update((int)i, bounds[i]);
+    }
+    ms = elapsedMs(start);
+    std::cout << "octree update:         " << ms << " ms for " << moving << " objects" << std::endl;
+
+    start = Clock::now();
+    hits = 0;
+    for(int i = 0; i < rayCount; i++)
+    {
+        SpatialHit hit;
+        if(octree.raycast(rays[i], 100.0f, hit))
+            hits++;
+    }
+    ms = elapsedMs(start);
+    std::cout << "octree raycast:        " << ms * 1000.0 / rayCount << " us/ray (" << hits << " hits)" << std::endl;
+}
+
+// LEVEL OF DETAIL --------------------------------------------------------------
+struct BenchVertex {
+    glm::vec3 Position;
+};
+
+// a rolling (size x size quads) heightfield, indexed row by row
+void buildHeightfield(int size, std::vector<BenchVertex> &vertices, std::vector<unsigned int> &indices)
+{
+    for(int z = 0; z <= size; z++)
+    {
+        for(int x = 0; x <= size; x++)
+        {
+            BenchVertex vertex;
+            float u = (float)x / size, v = (float)z / size;
+            vertex.Position = glm::vec3(u * 10.0f, 0.5f * sinf(u * 12.0f) * cosf(v * 9.0f) + 0.1f * sinf(u * 61.0f + v * 47.0f), v * 10.0f);
+            vertices.push_back(vertex);
+        }
+    }
+    for(int z = 0; z < size; z++)
+    {
+        for(int x = 0; x < size; x++)
+        {
+            unsigned int a = z * (size + 1) + x, b = a + 1, c = a + size + 1, d = c + 1;
+            unsigned int quad[6] = {a, c, b, b, c, d};
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+// Simplifies a rolling heightfield of about 'triangles' triangles into a full LOD chain and reports the
+// triangle count and error of every level.
+void lodBench(long triangles)
+{
+    int size = std::max(2, (int)std::sqrt(triangles / 2.0));
+    std::cout << "== mesh simplification: " << 2L * size * size << " triangles ==" << std::endl;
+
+    std::vector<BenchVertex> vertices;
+    std::vector<unsigned int> indices;
+    buildHeightfield(size, vertices, indices);
+
+    std::vector<MeshLod> lods;
+    Clock::time_point start = Clock::now();
+    generateLods(vertices, indices, lods);
+    std::cout << "LOD chain:             " << elapsedMs(start) << " ms" << std::endl;
+    for(unsigned int i = 0; i < lods.size(); i++)
+        std::cout << "  LOD " << i << ":               " << lods[i].indexCount / 3 << " triangles, error " << lods[i].error << std::endl;
+}
+
+// MESH OPTIMIZATION -----------------------------------------------------------
+// The heightfield as an importer without vertex joining would deliver it: triangles in random order and one
+// vertex per corner. Prints the simulated vertex cache efficiency after each stage of the pipeline.
+void printCacheStats(const char *stage, const std::vector<unsigned int> &indices, unsigned int vertexCount, double ms)
+{
+    VertexCacheStats stats = analyzeVertexCache(&indices[0], (unsigned int)indices.size(), vertexCount);
+    printf("%-22s ACMR %.3f  ATVR %.3f  %8.1f ms\n", stage, stats.acmr, stats.atvr, ms);
+}
+
+void optimizeBench(long triangles)
+{
+    int size = std::max(2, (int)std::sqrt(triangles / 2.0));
+    std::cout << "== mesh optimization: " << 2L * size * size << " triangles ==" << std::endl;
+
+    std::vector<BenchVertex> grid;
+    std::vector<unsigned int> gridIndices;
+    buildHeightfield(size, grid, gridIndices);
+
+    std::vector<unsigned int> order(gridIndices.size() / 3);
+    for(unsigned int i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::shuffle(order.begin(), order.end(), std::mt19937(7));
+    std::vector<BenchVertex> vertices;
+    std::vector<unsigned int> indices;
+    for(unsigned int i = 0; i < order.size(); i++)
+    {
+        for(unsigned int e = 0; e < 3; e++)
+        {
+            indices.push_back((unsigned int)vertices.size());
+            vertices.push_back(grid[gridIndices[order[i] * 3 + e]]);
+        }
+    }
+    printCacheStats("imported:", indices, (unsigned int)vertices.size(), 0.0);
+
+    Clock::time_point start = Clock::now();
+    weldVertices(vertices, indices);
+    printCacheStats("welded:", indices, (unsigned int)vertices.size(), elapsedMs(start));
+
+    start = Clock::now();
+    optimizeVertexCache(&indices[0], (unsigned int)indices.size(), (unsigned int)vertices.size());
+    printCacheStats("vertex cache:", indices, (unsigned int)vertices.size(), elapsedMs(start));
+
+    start = Clock::now();
+    optimizeOverdraw(&indices[0], (unsigned int)indices.size(), vertices);
+    printCacheStats("overdraw clusters:", indices, (unsigned int)vertices.size(), elapsedMs(start));
+
+    start = Clock::now();
+    optimizeVertexFetch(vertices, indices);
+    printCacheStats("vertex fetch:", indices, (unsigned int)vertices.size(), elapsedMs(start));
+}
+
+// MODEL IMPORT -----------------------------------------------------------------
+// Imports a model with assimp's default stdio file system, with MappedIOSystem reading the mapped file and
+// with MappedIOSystem serving it from an asset pack. Without a path a grid of about 'triangles' triangles
+// is written to an OBJ file first.
+double timeImport(const std::string &path, bool mapped, int runs)
+{
+    Clock::time_point start = Clock::now();
+    for(int i = 0; i < runs; i++)
+    {
+        Assimp::Importer importer;
+        if(mapped)
+            importer.SetIOHandler(new MappedIOSystem());
+        if(!importer.ReadFile(path, aiProcess_Triangulate))
+        {
+            std::cout << "import failed: " << importer.GetErrorString() << std::endl;
+            return 0.0;
+        }
+    }
+    return elapsedMs(start) / runs;
+}
+
+void importBench(std::string path, long triangles)
+{
+    bool generated = path.empty();
+    if(generated)
+    {
+        path = "bench_import.obj";
+        int size = std::max(2, (int)std::sqrt(triangles / 2.0));
+        FILE *file = fopen(path.c_str(), "w");
+        if(!file)
+            return;
+        for(int z = 0; z <= size; z++)
+        {
+            for(int x = 0; x <= size; x++)
+                fprintf(file, "v %f %f %f\nvt %f %f\n", (float)x, sinf(x * 0.1f) * cosf(z * 0.1f), (float)z, (float)x / size, (float)z / size);
+        }
+        for(int z = 0; z < size; z++)
+        {
+            for(int x = 0; x < size; x++)
+            {
+                int a = z * (size + 1) + x + 1, b = a + 1, c = a + size + 1, d = c + 1;
+                fprintf(file, "f %d/%d %d/%d %d/%d\nf %d/%d %d/%d %d/%d\n", a, a, c, c, b, b, b, b, c, c, d, d);
+            }
+        }
+        fclose(file);
+    }
+
+    size_t slash = path.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : path.substr(0, slash);
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    std::string packPath = "bench_import.pack";
+    if(!AssetPack::write(packPath, directory, std::vector<std::string>(1, name)))
+    {
+        std::cout << "could not pack " << path << std::endl;
+        return;
+    }
+
+    MappedFile source;
+    source.open(path);
+    std::cout << "== model import: " << path << " (" << source.size() / 1024 << " KiB) ==" << std::endl;
+    source.close();
+
+    const int runs = 5;
+    // the first import warms the page cache, so every variant reads from memory
+    timeImport(path, false, 1);
+    std::cout << "stdio IOSystem:        " << timeImport(path, false, runs) << " ms" << std::endl;
+    std::cout << "mapped IOSystem:       " << timeImport(path, true, runs) << " ms" << std::endl;
+
+    std::shared_ptr<AssetPack> pack(new AssetPack());
+    pack->open(packPath);
+    MappedIOSystem::mount(directory, pack);
+    std::cout << "asset pack:            " << timeImport(path, true, runs) << " ms" << std::endl;
+    MappedIOSystem::unmountAll();
+
+    remove(packPath.c_str());
+    if(generated)
+        remove(path.c_str());
+}
+
+// DXT COMPRESSION --------------------------------------------------------------
+// Compresses a noisy gradient image of about 'pixels' pixels to DXT1 (from RGB) and DXT5 (from RGBA) in
+// every encoder mode, checking each result against the reference encoder.
+void dxtBench(long pixels)
+{
+    int size = std::max(4, (int)std::sqrt((double)pixels));
+    double megapixels = (double)size * size / 1e6;
+    std::cout << "== DXT compression: " << size << "x" << size << " ==" << std::endl;
+
+    std::vector<unsigned char> rgba((size_t)size * size * 4), rgb((size_t)size * size * 3);
+    for(int y = 0; y < size; y++)
+    {
+        for(int x = 0; x < size; x++)
+        {
+            size_t pixel = (size_t)y * size + x;
+            for(int c = 0; c < 4; c++)
+            {
+                float wave = 0.5f + 0.5f * sinf(x * 0.02f * (c + 1)) * cosf(y * 0.015f + c);
+                rgba[pixel * 4 + c] = (unsigned char)std::min(255.0f, wave * 230.0f + randomFloat(0.0f, 25.0f));
+                if(c < 3)
+                    rgb[pixel * 3 + c] = rgba[pixel * 4 + c];
+            }
+        }
+    }
+
+    const int modes[] = {DXT_MODE_REFERENCE, DXT_MODE_SCALAR, DXT_MODE_SSE4, DXT_MODE_AVX2};
+    const char *names[] = {"reference", "scalar threads", "SSE4.1 threads", "AVX2 threads"};
+    std::vector<unsigned char> reference[2];
+    for(unsigned int m = 0; m < 4; m++)
+    {
+        if(DXT_set_mode(modes[m]) != modes[m])
+        {
+            std::cout << names[m] << ": not supported by this CPU" << std::endl;
+            continue;
+        }
+        for(int dxt5 = 0; dxt5 < 2; dxt5++)
+        {
+            const int runs = 3;
+            int size_out = 0;
+            unsigned char *compressed = NULL;
+            Clock::time_point start = Clock::now();
+            for(int i = 0; i < runs; i++)
+            {
+                free(compressed);
+                compressed = dxt5 ? convert_image_to_DXT5(&rgba[0], size, size, 4, &size_out)
+                                  : convert_image_to_DXT1(&rgb[0], size, size, 3, &size_out);
+            }
+            double ms = elapsedMs(start) / runs;
+
+            bool identical = true;
+            if(reference[dxt5].empty())
+                reference[dxt5].assign(compressed, compressed + size_out);
+            else
+                identical = std::equal(reference[dxt5].begin(), reference[dxt5].end(), compressed);
+            free(compressed);
+
+            printf("%-15s %s: %8.1f ms %8.1f MPixels/s%s\n", names[m], dxt5 ? "DXT5" : "DXT1", ms, megapixels / (ms / 1000.0),
+                   identical ? "" : "  MISMATCH");
+        }
+    }
+    DXT_set_mode(DXT_MODE_AUTO);
+}
+
+// IMAGE PROCESSING -------------------------------------------------------------
+// Times the image_helper kernels in every mode on a noisy RGBA image of about 'pixels' pixels: a full 2x2
+// mip chain, up scaling a 3/4 size copy back to full size, NTSC scaling and a YCoCg round trip of the
+// RGB and RGBA versions. Every mode's output is compared with the reference mode's.
+void imageBench(long pixels)
+{
+    int size = std::max(4, (int)std::sqrt((double)pixels));
+    int small = std::max(2, size * 3 / 4);
+    std::cout << "== image processing: " << size << "x" << size << " ==" << std::endl;
+
+    std::vector<unsigned char> source[2];
+    source[0].resize((size_t)size * size * 3);
+    source[1].resize((size_t)size * size * 4);
+    for(size_t i = 0; i < source[1].size(); i++)
+    {
+        size_t pixel = i / 4;
+        float wave = 0.5f + 0.5f * sinf((pixel % size) * 0.013f * (i % 4 + 1)) * cosf((pixel / size) * 0.011f);
+        source[1][i] = (unsigned char)std::min(255.0f, wave * 230.0f + randomFloat(0.0f, 25.0f));
+        if(i % 4 < 3)
+            source[0][pixel * 3 + i % 4] = source[1][i];
+    }
+
+    const int modes[] = {IMAGE_HELPER_MODE_REFERENCE, IMAGE_HELPER_MODE_SCALAR, IMAGE_HELPER_MODE_SSE2, IMAGE_HELPER_MODE_AVX2};
+    const char *names[] = {"reference", "scalar threads", "SSE2 threads", "AVX2 threads"};
+    const char *steps[] = {"mip chain", "up scale", "NTSC", "YCoCg"};
+    // per step and channel count: the reference output
+    std::vector<unsigned char> reference[4][2];
+    for(unsigned int m = 0; m < 4; m++)
+    {
+        if(image_helper_set_mode(modes[m]) != modes[m])
+        {
+            std::cout << names[m] << ": not supported by this CPU" << std::endl;
+            continue;
+        }
+        for(int step = 0; step < 4; step++)
+        {
+            double ms[2];
+            bool identical = true;
+            for(int rgba = 0; rgba < 2; rgba++)
+            {
+                int channels = rgba ? 4 : 3;
+                const std::vector<unsigned char> &image = source[rgba];
+                std::vector<unsigned char> output;
+                Clock::time_point start = Clock::now();
+                if(step == 0)
+                {
+                    // every level of the chain, one after another
+                    output.resize(image.size() / 2);
+                    const unsigned char *level = &image[0];
+                    unsigned char *mip = &output[0];
+                    for(int width = size, height = size; width > 1 || height > 1; width = std::max(1, width / 2), height = std::max(1, height / 2))
+                    {
+                        mipmap_image(level, width, height, channels, mip, 2, 2);
+                        level = mip;
+                        mip += std::max(1, width / 2) * std::max(1, height / 2) * channels;
+                    }
+                }
+                else if(step == 1)
+                {
+                    std::vector<unsigned char> shrunk((size_t)small * small * channels);
+                    for(int y = 0; y < small; y++)
+                        std::copy(&image[(size_t)y * size * channels], &image[(size_t)y * size * channels] + small * channels, &shrunk[(size_t)y * small * channels]);
+                    start = Clock::now();
+                    output.resize(image.size());
+                    up_scale_image(&shrunk[0], small, small, channels, &output[0], size, size);
+                }
+                else
+                {
+                    output = image;
+                    start = Clock::now();
+                    if(step == 2)
+                    {
+                        scale_image_RGB_to_NTSC_safe(&output[0], size, size, channels);
+                    }
+                    else
+                    {
+                        convert_RGB_to_YCoCg(&output[0], size, size, channels);
+                        convert_YCoCg_to_RGB(&output[0], size, size, channels);
+                    }
+                }
+                ms[rgba] = elapsedMs(start);
+
+                if(reference[step][rgba].empty())
+                    reference[step][rgba].swap(output);
+                else
+                    identical = identical && reference[step][rgba] == output;
+            }
+            printf("%-15s %-9s RGB: %7.1f ms  RGBA: %7.1f ms%s\n", names[m], steps[step], ms[0], ms[1],
+                   identical ? "" : "  MISMATCH");
+        }
+    }
+    image_helper_set_mode(IMAGE_HELPER_MODE_AUTO);
+}
+
+// CLUSTERED LIGHTS -------------------------------------------------------------
+// Bins 1 up to 'lights' random point lights scattered over the park into the clusters of a camera walking
+// through it, on one thread and on all of them, and checks that every sampled point a light reaches finds
+// that light in the list of the cluster the fragment shader would pick.
+void lightBench(long lights)
+{
+    std::cout << "== clustered lights: up to " << lights << " lights ==" << std::endl;
+
+    srand(1);
+    const int frames = 200;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1000.0f / 800.0f, 0.1f, 100.0f);
+
+    for(long count = 1; ; count = std::min(lights, count * 4))
+    {
+        ClusteredLights clusters;
+        for(long i = 0; i < count; i++)
+        {
+            glm::vec3 position(randomFloat(-14.0f, 14.0f), randomFloat(0.2f, 4.0f), randomFloat(-14.0f, 14.0f));
+            clusters.lights.push_back(PointLight(position, randomFloat(2.0f, 6.0f), glm::vec3(1.0f)));
+        }
+
+        double ms[2];
+        long listed = 0;
+        unsigned int busiest = 0;
+        long missing = 0;
+        for(int threaded = 0; threaded < 2; threaded++)
+        {
+            clusters.threadCount = threaded ? 0 : 1;
+            Clock::time_point start = Clock::now();
+            for(int frame = 0; frame < frames; frame++)
+            {
+                float angle = frame * 0.05f;
+                glm::vec3 eye(10.0f * sinf(angle), 1.0f, 10.0f * cosf(angle));
+                glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+                clusters.build(view, projection);
+
+                if(threaded || frame % 20 != 0)
+                    continue;
+
+                // the shader's cluster of random points inside random lights
+                listed += (long)clusters.lightIndices().size();
+                for(int z = 0; z < ClusteredLights::GRID_Z; z++)
+                    for(int y = 0; y < ClusteredLights::GRID_Y; y++)
+                        for(int x = 0; x < ClusteredLights::GRID_X; x++)
+                            busiest = std::max(busiest, clusters.clusterCount(x, y, z));
+                for(int sample = 0; sample < 2000; sample++)
+                {
+                    unsigned int light = rand() % count;
+                    const PointLight &source = clusters.lights[light];
+                    glm::vec3 offset(randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f));
+                    if(glm::length(offset) > 0.99f)
+                        continue;
+                    glm::vec4 point = view * glm::vec4(source.position + offset * source.radius, 1.0f);
+                    glm::vec4 clip = projection * point;
+                    if(clip.w <= 0.0f || std::fabs(clip.x) > clip.w || std::fabs(clip.y) > clip.w)
+                        continue;
+
+                    int x = std::min((int)((clip.x / clip.w * 0.5f + 0.5f) * ClusteredLights::GRID_X), ClusteredLights::GRID_X - 1);
+                    int y = std::min((int)((clip.y / clip.w * 0.5f + 0.5f) * ClusteredLights::GRID_Y), ClusteredLights::GRID_Y - 1);
+                    float depth = std::max(-point.z, clusters.zNear);
+                    int z = std::min((int)(std::log(depth / clusters.zNear) * ClusteredLights::GRID_Z / std::log(clusters.zFar / clusters.zNear)), ClusteredLights::GRID_Z - 1);
+                    const unsigned int *first = &clusters.lightIndices()[0] + clusters.clusterFirst(x, y, z);
+                    if(!std::binary_search(first, first + clusters.clusterCount(x, y, z), light))
+                        missing++;
+                }
+            }
+            ms[threaded] = elapsedMs(start) / frames;
+        }
+
+        printf("%4ld lights: %.3f ms/frame on 1 thread, %.3f ms/frame threaded, %ld list entries, at most %u lights per cluster%s\n",
+               count, ms[0], ms[1], listed / (frames / 20), busiest, missing ? " MISSING LIGHTS" : "");
+        if(missing)
+            std::cout << "   " << missing << " sampled points not covered by their cluster" << std::endl;
+
+        if(count >= lights)
+            break;
+    }
+}
+
+// OCCLUSION CULLING ------------------------------------------------------------
+// The park's tree line and a few prop sized blocks as occluders, 'objects' random boxes half inside the park
+// and half behind the trees, seen from cameras walking around the park. Times the occluder rasterization on one
+// thread and threaded, and the box tests, and checks that the threads fill the same depth buffer and that
+// no point of a culled box can be seen past the occluders.
+void occlusionBench(long objects)
+{
+    std::cout << "== occlusion culling: " << objects << " objects ==" << std::endl;
+
+    srand(1);
+    // as treeDraw() and the props of the park place their boxes
+    std::vector<glm::mat4> occluders;
+    for(int i = -14; i <= 14; i++)
+    {
+        glm::vec3 trees[4] = {glm::vec3(i, 2.5f, 14.5f), glm::vec3(-14.5f, 2.5f, i), glm::vec3(i, 2.5f, -14.5f), glm::vec3(14.5f, 2.5f, i)};
+        for(int t = 0; t < 4; t++)
+        {
+            occluders.push_back(glm::scale(glm::translate(glm::mat4(), trees[t]), glm::vec3(0.3f, 5.0f, 0.3f)));
+            occluders.push_back(glm::scale(glm::translate(glm::mat4(), trees[t] + glm::vec3(0.0f, 2.7f, 0.0f)), glm::vec3(1.0f, 0.4f, 1.0f)));
+            occluders.push_back(glm::scale(glm::translate(glm::mat4(), trees[t] + glm::vec3(0.0f, 3.0f, 0.0f)), glm::vec3(0.6f, 0.2f, 0.6f)));
+            occluders.push_back(glm::scale(glm::translate(glm::mat4(), trees[t] + glm::vec3(0.0f, 3.15f, 0.0f)), glm::vec3(0.3f, 0.1f, 0.3f)));
+        }
+    }
+    glm::vec3 blocks[4] = {glm::vec3(-7.0f, 1.5f, -7.0f), glm::vec3(7.0f, 1.0f, 7.0f), glm::vec3(-8.0f, 0.6f, 6.0f), glm::vec3(6.0f, 1.0f, -8.0f)};
+    for(int b = 0; b < 4; b++)
+        occluders.push_back(glm::scale(glm::translate(glm::mat4(), blocks[b]), glm::vec3(3.0f, 2.0f * blocks[b].y, 3.0f)));
+    std::vector<AABB> occluderBounds;
+    for(unsigned int i = 0; i < occluders.size(); i++)
+        occluderBounds.push_back(AABB::transformed(occluders[i]));
+
+    std::vector<AABB> boxes(objects);
+    for(long i = 0; i < objects; i++)
+    {
+        float angle = randomFloat(0.0f, 6.2831853f);
+        float distance = i % 2 == 0 ? randomFloat(0.0f, 13.0f) : randomFloat(16.0f, 40.0f);
+        glm::vec3 centre(distance * sinf(angle), randomFloat(0.2f, 2.0f), distance * cosf(angle));
+        glm::vec3 half(randomFloat(0.05f, 0.5f), randomFloat(0.05f, 0.5f), randomFloat(0.05f, 0.5f));
+        boxes[i] = AABB(centre - half, centre + half);
+    }
+
+    const int frames = 64;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1000.0f / 800.0f, 0.1f, 100.0f);
+    OcclusionRasterizer single, threaded;
+    single.threadCount = 1;
+    double rasterizeMs[2] = {0.0, 0.0};
+    double testMs = 0.0;
+    long culled = 0, tested = 0, mismatches = 0, samples = 0, seen = 0;
+    for(int frame = 0; frame < frames; frame++)
+    {
+        float angle = frame * 0.37f;
+        glm::vec3 eye(8.0f * sinf(angle), 1.7f, 8.0f * cosf(angle));
+        glm::vec3 target = eye + glm::vec3(sinf(angle * 3.0f + 1.0f), -0.1f, cosf(angle * 3.0f + 1.0f));
+        glm::mat4 viewProjection = projection * glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+
+        OcclusionRasterizer *rasterizers[2] = {&single, &threaded};
+        for(int r = 0; r < 2; r++)
+        {
+            Clock::time_point start = Clock::now();
+            rasterizers[r]->begin(viewProjection);
+            for(unsigned int i = 0; i < occluders.size(); i++)
+                rasterizers[r]->addOccluder(occluders[i]);
+            rasterizers[r]->rasterize();
+            rasterizeMs[r] += elapsedMs(start);
+        }
+        if(single.depth != threaded.depth)
+            mismatches++;
+
+        std::vector<char> visible(objects);
+        Clock::time_point start = Clock::now();
+        for(long i = 0; i < objects; i++)
+            visible[i] = threaded.visible(boxes[i]);
+        testMs += elapsedMs(start);
+        culled += threaded.culled;
+        tested += threaded.tested;
+
+        // points of culled boxes on the screen that a ray from the eye reaches without hitting an occluder
+        Frustum frustum = Frustum::fromMatrix(viewProjection);
+        for(long i = 0; i < objects && samples < (frame + 1) * 200L; i++)
+        {
+            if(visible[i] || !frustum.intersects(boxes[i]))
+                continue;
+            glm::vec3 point = boxes[i].min + boxes[i].extent() * glm::vec3(randomFloat(0.0f, 1.0f), randomFloat(0.0f, 1.0f), randomFloat(0.0f, 1.0f));
+            glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+            if(clip.w <= 0.0f || std::fabs(clip.x) > clip.w || std::fabs(clip.y) > clip.w)
+                continue;
+
+            samples++;
+            Ray ray(eye, point - eye);
+            bool blocked = false;
+            for(unsigned int o = 0; o < occluderBounds.size() && !blocked; o++)
+            {
+                float t;
+                blocked = ray.intersects(occluderBounds[o], 1.0f, t);
+            }
+            if(!blocked)
+                seen++;
+        }
+    }
+
+    printf("%u occluder faces at %dx%d: %.3f ms/frame on 1 thread, %.3f ms/frame threaded%s\n",
+           threaded.faceCount(), threaded.width, threaded.height, rasterizeMs[0] / frames, rasterizeMs[1] / frames,
+           mismatches ? " DEPTH BUFFERS DIFFER" : "");
+    printf("box tests: %.1f ns/box, %.1f%% of %ld boxes culled\n", testMs * 1.0e6 / tested, 100.0 * culled / tested, objects);
+    printf("points of culled boxes sampled on screen: %ld, %ld (%.2f%%) not behind an occluder\n",
+           samples, seen, samples > 0 ? 100.0 * seen / samples : 0.0);
+}
@@ -0,0 +1,48 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/spatial_index.h>
+#include <learnopengl/mesh_simplify.h>
+#include <learnopengl/mesh_optimize.h>
+#include <learnopengl/mapped_io.h>
+#include <learnopengl/clustered_lights.h>
+#include <learnopengl/occlusion_culling.h>
+
+#include <image_DXT.h>
+#include <image_helper.h>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// FUNCTION DECLARATIONS
+// Utility
+double elapsedMs(Clock::time_point start);
+float randomFloat(float lower, float upper);
+
+// Benchmarks
+void spatialBench(long count);
+void lodBench(long triangles);
+void optimizeBench(long triangles);
+void importBench(std::string path, long triangles);
+void dxtBench(long pixels);
+void imageBench(long pixels);
+void lightBench(long lights);
+void occlusionBench(long objects);
+
+#endif
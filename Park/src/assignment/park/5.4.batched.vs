@@ -0,0 +1,27 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in vec4 aMaterial; // diffuse array and layer, specular array and layer, see MaterialBatches
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+flat out vec4 ArrayLayers;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// the depth pre-pass runs this shader too; both passes must produce the same depths for their GL_EQUAL test
+invariant gl_Position;
+
+void main()
+{
+    FragPos = vec3(aModel * vec4(aPos, 1.0));
+    Normal = mat3(transpose(inverse(aModel))) * aNormal;
+    TexCoords = aTexCoords;
+    ArrayLayers = aMaterial;
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,118 @@
+#version 430 core
+layout (local_size_x = 64) in;
+
+// GPU culling of the batched scenery, see MaterialBatches::cull(). One invocation per instance tests the unit
+// box its model transforms against the view frustum and last frame's Hi-Z pyramid, and appends the instance
+// to its batch's range of the visible instances if it passes.
+
+struct Instance {
+    mat4 model;
+    vec4 material;
+};
+
+struct Command {
+    uint count;
+    uint instanceCount;
+    uint first;
+    uint baseInstance;
+};
+
+layout (std430, binding = 0) readonly buffer AllInstances { Instance allInstances[]; };
+layout (std430, binding = 1) writeonly buffer VisibleInstances { Instance visibleInstances[]; };
+// the commands of every instance, and those of the visible ones, whose instance counts start at 0
+layout (std430, binding = 2) readonly buffer AllCommands { Command allCommands[]; };
+layout (std430, binding = 3) buffer VisibleCommands { Command visibleCommands[]; };
+
+uniform int instanceCount;
+uniform int batchCount;
+// inward facing planes (xyz: normal, w: distance), see Frustum
+uniform vec4 frustum[6];
+
+// see HiZPyramid::bind()
+uniform bool useHiZ;
+uniform sampler2D hiZ;
+uniform int hiZLevels;
+uniform vec2 hiZScreenSize;
+uniform mat4 hiZViewProjection;
+
+bool outsideFrustum(vec3 centre, vec3 extent)
+{
+    for(int i = 0; i < 6; i++)
+    {
+        if(dot(frustum[i].xyz, centre) + frustum[i].w + dot(abs(frustum[i].xyz), extent) < 0.0)
+            return true;
+    }
+    return false;
+}
+
+// true if the box lay behind what was drawn last frame
+bool hiddenLastFrame(vec3 centre, vec3 extent)
+{
+    // its rectangle on last frame's screen and its nearest depth there
+    vec2 lower = vec2(1.0);
+    vec2 upper = vec2(0.0);
+    float nearest = 1.0;
+    for(int i = 0; i < 8; i++)
+    {
+        vec3 corner = centre + extent * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = hiZViewProjection * vec4(corner, 1.0);
+        // reaching behind the camera: nothing to compare with
+        if(clip.w <= 0.0)
+            return false;
+        vec3 ndc = clip.xyz / clip.w;
+        lower = min(lower, ndc.xy * 0.5 + 0.5);
+        upper = max(upper, ndc.xy * 0.5 + 0.5);
+        nearest = min(nearest, ndc.z * 0.5 + 0.5);
+    }
+    if(any(greaterThan(lower, vec2(1.0))) || any(lessThan(upper, vec2(0.0))))
+        return false;
+
+    ivec2 lastPixel = ivec2(hiZScreenSize) - 1;
+    ivec2 lowerPixel = min(ivec2(clamp(lower, 0.0, 1.0) * hiZScreenSize), lastPixel);
+    ivec2 upperPixel = min(ivec2(clamp(upper, 0.0, 1.0) * hiZScreenSize), lastPixel);
+
+    // the first level where the rectangle lies within 2x2 texels; texel t of level l covers the pixels
+    // t * 2^(l + 1) onwards, the last texels also the leftover pixels
+    vec2 pixels = vec2(upperPixel - lowerPixel + 1);
+    int level = clamp(int(ceil(log2(max(pixels.x, pixels.y)))) - 1, 0, hiZLevels - 1);
+    ivec2 first, last;
+    for(;;)
+    {
+        ivec2 levelEnd = textureSize(hiZ, level) - 1;
+        first = min(lowerPixel >> (level + 1), levelEnd);
+        last = min(upperPixel >> (level + 1), levelEnd);
+        if(all(lessThanEqual(last - first, ivec2(1))) || level == hiZLevels - 1)
+            break;
+        level++;
+    }
+
+    float farthest = 0.0;
+    for(int y = first.y; y <= last.y; y++)
+    {
+        for(int x = first.x; x <= last.x; x++)
+            farthest = max(farthest, texelFetch(hiZ, ivec2(x, y), level).r);
+    }
+    return nearest > farthest;
+}
+
+void main()
+{
+    int i = int(gl_GlobalInvocationID.x);
+    if(i >= instanceCount)
+        return;
+
+    // world bounds of the unit box
+    mat4 model = allInstances[i].model;
+    vec3 centre = model[3].xyz;
+    vec3 extent = 0.5 * (abs(model[0].xyz) + abs(model[1].xyz) + abs(model[2].xyz));
+    if(outsideFrustum(centre, extent) || (useHiZ && hiddenLastFrame(centre, extent)))
+        return;
+
+    // the batches' instances are consecutive, in the order of their commands
+    int batch = 0;
+    while(batch < batchCount - 1 && uint(i) >= allCommands[batch].baseInstance + allCommands[batch].instanceCount)
+        batch++;
+
+    uint slot = atomicAdd(visibleCommands[batch].instanceCount, 1u);
+    visibleInstances[allCommands[batch].baseInstance + slot] = allInstances[i];
+}
@@ -0,0 +1,122 @@
+#version 330 core
+out vec4 FragColor;
+
+struct Material {
+    float shininess;
+}; 
+
+struct Light {
+    vec3 position;  
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+  
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+	
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform vec2 screenSize;
+uniform mat4 inverseViewProjection;
+
+uniform vec3 viewPos;
+uniform Material material;
+uniform Light light;
+
+// sun (see SunShadows); sunColour is black at night
+uniform vec3 sunDirection;                    // towards the sun
+uniform vec3 sunColour;
+uniform sampler2DShadow staticShadowMap;
+uniform sampler2DShadow dynamicShadowMap;
+uniform mat4 staticShadowMatrix;              // world space to shadow map coordinates and depth
+uniform mat4 dynamicShadowMatrix;
+
+// fraction of four filtered taps around 'position' that see the sun; 1 outside the map
+float sunVisibility(sampler2DShadow map, mat4 shadowMatrix, vec3 position)
+{
+    vec3 coords = (shadowMatrix * vec4(position, 1.0)).xyz;
+    if(any(lessThan(coords, vec3(0.0))) || any(greaterThan(coords, vec3(1.0))))
+        return 1.0;
+
+    vec2 texel = 1.0 / vec2(textureSize(map, 0));
+    float visible = 0.0;
+    visible += textureLod(map, vec3(coords.xy + vec2(-0.5, -0.5) * texel, coords.z), 0.0);
+    visible += textureLod(map, vec3(coords.xy + vec2( 0.5, -0.5) * texel, coords.z), 0.0);
+    visible += textureLod(map, vec3(coords.xy + vec2(-0.5,  0.5) * texel, coords.z), 0.0);
+    visible += textureLod(map, vec3(coords.xy + vec2( 0.5,  0.5) * texel, coords.z), 0.0);
+    return visible * 0.25;
+}
+
+// diffuse sunlight, shadowed by the static scenery and by the actors
+vec3 sunLight(vec3 position, vec3 norm, vec3 diffuseColour)
+{
+    float diff = max(dot(norm, sunDirection), 0.0);
+    if(diff == 0.0 || sunColour == vec3(0.0))
+        return vec3(0.0);
+
+    float visible = min(sunVisibility(staticShadowMap, staticShadowMatrix, position),
+                        sunVisibility(dynamicShadowMap, dynamicShadowMatrix, position));
+    return sunColour * diff * visible * diffuseColour;
+}
+
+vec3 decodeNormal(vec2 encoded)
+{
+    encoded = encoded * 2.0 - 1.0;
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if(n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+// the flashlight, ambient and sun terms of 5.4.light_casters.fs, once per pixel from the G-buffer
+void main()
+{
+    vec2 uv = gl_FragCoord.xy / screenSize;
+    float depth = texture(gDepth, uv).r;
+    if(depth == 1.0)
+        discard;
+
+    vec4 world = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    vec3 FragPos = world.xyz / world.w;
+    vec4 albedoSun = texture(gAlbedo, uv);
+    vec3 albedo = albedoSun.rgb;
+
+    // ambient
+    vec3 ambient = light.ambient * albedo;
+    
+    // diffuse 
+    vec3 norm = decodeNormal(texture(gNormal, uv).xy);
+    vec3 lightDir = normalize(light.position - FragPos);
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 diffuse = light.diffuse * diff * albedo;  
+    
+    // specular
+    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 reflectDir = reflect(-lightDir, norm);  
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess); 
+    vec3 specular = light.specular * spec * texture(gSpecular, uv).rgb;  
+    
+    // spotlight (soft edges)
+    float theta = dot(lightDir, normalize(-light.direction)); 
+    float epsilon = (light.cutOff - light.outerCutOff);
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    diffuse  *= intensity;
+    specular *= intensity;
+    
+    // attenuation
+    float distance    = length(light.position - FragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+    ambient  *= attenuation; 
+    diffuse   *= attenuation;
+    specular *= attenuation;   
+        
+    FragColor = vec4(ambient + diffuse + specular + albedoSun.a * sunLight(FragPos, norm, albedo), 1.0);
+}
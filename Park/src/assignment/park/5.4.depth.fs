@@ -0,0 +1,18 @@
+#version 330 core
+
+uniform float dissolve; // fraction of the pixels dropped while fading into an impostor, as in the shading pass
+
+// 4x4 ordered dither threshold of this pixel, in (0, 1)
+float ditherThreshold()
+{
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+    return (bayer[pixel.x + 4 * pixel.y] + 0.5) / 16.0;
+}
+
+// depth pre-pass: colour writes are off, only the depth test runs
+void main()
+{
+    if(ditherThreshold() < dissolve)
+        discard;
+}
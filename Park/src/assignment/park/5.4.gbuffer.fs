@@ -0,0 +1,78 @@
+#version 330 core
+layout (location = 0) out vec4 gAlbedo;
+layout (location = 1) out vec4 gSpecular;
+layout (location = 2) out vec2 gNormal;
+
+struct Material {
+    sampler2D diffuse;
+    sampler2D specular;    
+    float shininess;
+}; 
+
+in vec3 FragPos;  
+in vec3 Normal;  
+in vec2 TexCoords;
+flat in vec4 ArrayLayers;  // texture arrays and layers of batched boxes, negative for other boxes
+
+uniform Material material;
+uniform sampler2DArray materialArrays[8]; // all the arrays of batched boxes (see TextureArrays::MAX_ARRAYS)
+uniform bool noSun;     // set while drawing the sky; kept in the albedo's alpha
+uniform float dissolve; // fraction of the pixels dropped while fading into an impostor
+
+// octahedron encoding of a unit vector into [0, 1]^2
+vec2 encodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 folded = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return folded * 0.5 + 0.5;
+}
+
+// layer 'layer' of the texture array 'array' at this fragment
+vec3 arrayTexture(float array, float layer)
+{
+    vec3 coords = vec3(TexCoords, layer);
+    switch(int(array))
+    {
+    case 0: return texture(materialArrays[0], coords).rgb;
+    case 1: return texture(materialArrays[1], coords).rgb;
+    case 2: return texture(materialArrays[2], coords).rgb;
+    case 3: return texture(materialArrays[3], coords).rgb;
+    case 4: return texture(materialArrays[4], coords).rgb;
+    case 5: return texture(materialArrays[5], coords).rgb;
+    case 6: return texture(materialArrays[6], coords).rgb;
+    default: return texture(materialArrays[7], coords).rgb;
+    }
+}
+
+// the material's colours at this fragment: from its textures, or from the texture array layers of a batched box
+vec3 materialDiffuse()
+{
+    if(ArrayLayers.x < 0.0)
+        return texture(material.diffuse, TexCoords).rgb;
+    return arrayTexture(ArrayLayers.x, ArrayLayers.y);
+}
+
+vec3 materialSpecular()
+{
+    if(ArrayLayers.x < 0.0)
+        return texture(material.specular, TexCoords).rgb;
+    return arrayTexture(ArrayLayers.z, ArrayLayers.w);
+}
+
+// 4x4 ordered dither threshold of this pixel, in (0, 1)
+float ditherThreshold()
+{
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+    return (bayer[pixel.x + 4 * pixel.y] + 0.5) / 16.0;
+}
+
+void main()
+{
+    if(ditherThreshold() < dissolve)
+        discard;
+
+    gAlbedo = vec4(materialDiffuse(), noSun ? 0.0 : 1.0);
+    gSpecular = vec4(materialSpecular(), 1.0);
+    gNormal = encodeNormal(normalize(Normal));
+}
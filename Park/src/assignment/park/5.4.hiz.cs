@@ -0,0 +1,31 @@
+#version 430 core
+layout (local_size_x = 8, local_size_y = 8) in;
+
+// one level of the Hi-Z pyramid, see HiZPyramid: the farthest depth of the 2x2 texels of the level above
+// under each texel
+uniform sampler2D source;
+uniform int sourceLevel;
+layout (r32f, binding = 0) uniform writeonly image2D destination;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(destination);
+    if(any(greaterThanEqual(texel, size)))
+        return;
+
+    // the last texel of a row or column also covers the texel left over where the level above is odd sized
+    ivec2 sourceSize = textureSize(source, sourceLevel);
+    ivec2 first = 2 * texel;
+    ivec2 last = ivec2(texel.x == size.x - 1 ? sourceSize.x - 1 : first.x + 1,
+                       texel.y == size.y - 1 ? sourceSize.y - 1 : first.y + 1);
+    last = min(last, sourceSize - 1);
+
+    float farthest = 0.0;
+    for(int y = first.y; y <= last.y; y++)
+    {
+        for(int x = first.x; x <= last.x; x++)
+            farthest = max(farthest, texelFetch(source, ivec2(x, y), sourceLevel).r);
+    }
+    imageStore(destination, texel, vec4(farthest));
+}
@@ -0,0 +1,163 @@
+#version 330 core
+out vec4 FragColor;
+
+struct Material {
+    float shininess;
+};
+
+struct Light {
+    vec3 position;  
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+  
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+	
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+in vec3 FragPos;
+in vec2 TexCoords;
+in float Fade;
+
+uniform vec3 viewPos;
+uniform Material material;
+uniform Light light;
+uniform mat4 view;
+
+// clustered point lights (see ClusteredLights)
+uniform samplerBuffer clusterLightData;       // two texels per light: position + radius, colour
+uniform usamplerBuffer clusterRanges;         // per cluster: first entry in clusterLightIndices, light count
+uniform usamplerBuffer clusterLightIndices;
+uniform ivec3 clusterGrid;
+uniform vec2 clusterTileSize;                 // in pixels
+uniform vec2 clusterDepth;                    // near depth, slices / log(far / near)
+
+// sun (see SunShadows); sunColour is black at night
+uniform vec3 sunDirection;                    // towards the sun
+uniform vec3 sunColour;
+uniform sampler2DShadow staticShadowMap;
+uniform sampler2DShadow dynamicShadowMap;
+uniform mat4 staticShadowMatrix;              // world space to shadow map coordinates and depth
+uniform mat4 dynamicShadowMatrix;
+
+// fraction of four filtered taps around 'position' that see the sun; 1 outside the map
+float sunVisibility(sampler2DShadow map, mat4 shadowMatrix, vec3 position)
+{
+    vec3 coords = (shadowMatrix * vec4(position, 1.0)).xyz;
+    if(any(lessThan(coords, vec3(0.0))) || any(greaterThan(coords, vec3(1.0))))
+        return 1.0;
+
+    vec2 texel = 1.0 / vec2(textureSize(map, 0));
+    float visible = 0.0;
+    visible += textureLod(map, vec3(coords.xy + vec2(-0.5, -0.5) * texel, coords.z), 0.0);
+    visible += textureLod(map, vec3(coords.xy + vec2( 0.5, -0.5) * texel, coords.z), 0.0);
+    visible += textureLod(map, vec3(coords.xy + vec2(-0.5,  0.5) * texel, coords.z), 0.0);
+    visible += textureLod(map, vec3(coords.xy + vec2( 0.5,  0.5) * texel, coords.z), 0.0);
+    return visible * 0.25;
+}
+
+// diffuse sunlight, shadowed by the static scenery and by the actors
+vec3 sunLight(vec3 position, vec3 norm, vec3 diffuseColour)
+{
+    float diff = max(dot(norm, sunDirection), 0.0);
+    if(diff == 0.0 || sunColour == vec3(0.0))
+        return vec3(0.0);
+
+    float visible = min(sunVisibility(staticShadowMap, staticShadowMatrix, position),
+                        sunVisibility(dynamicShadowMap, dynamicShadowMatrix, position));
+    return sunColour * diff * visible * diffuseColour;
+}
+
+// diffuse + specular of the point lights binned into this fragment's cluster
+vec3 clusteredLights(vec3 norm, vec3 viewDir, vec3 diffuseColour, vec3 specularColour)
+{
+    float depth = max(-(view * vec4(FragPos, 1.0)).z, clusterDepth.x);
+    int slice = min(int(log(depth / clusterDepth.x) * clusterDepth.y), clusterGrid.z - 1);
+    ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterTileSize), clusterGrid.xy - 1);
+    uvec2 range = texelFetch(clusterRanges, tile.x + clusterGrid.x * (tile.y + clusterGrid.y * slice)).xy;
+
+    vec3 result = vec3(0.0);
+    for(uint i = 0u; i < range.y; i++)
+    {
+        int index = int(texelFetch(clusterLightIndices, int(range.x + i)).r);
+        vec4 positionRadius = texelFetch(clusterLightData, 2 * index);
+        vec3 colour = texelFetch(clusterLightData, 2 * index + 1).rgb;
+
+        vec3 toLight = positionRadius.xyz - FragPos;
+        float distance = length(toLight);
+        // smooth falloff that reaches exactly zero at the light's radius
+        float falloff = clamp(1.0 - (distance * distance) / (positionRadius.w * positionRadius.w), 0.0, 1.0);
+        falloff *= falloff;
+
+        vec3 lightDir = toLight / max(distance, 0.0001);
+        float diff = max(dot(norm, lightDir), 0.0);
+        float spec = pow(max(dot(viewDir, reflect(-lightDir, norm)), 0.0), material.shininess);
+        result += colour * falloff * (diff * diffuseColour + spec * specularColour);
+    }
+    return result;
+}
+
+// the atlas of Impostors: albedo with coverage in alpha, specular, octahedron packed normal
+uniform sampler2D impostorAlbedo;
+uniform sampler2D impostorSpecular;
+uniform sampler2D impostorNormals;
+uniform vec2 impostorHalfSize;
+uniform bool overdraw;                        // counts the fragments like 5.4.overdraw.fs instead
+
+vec3 decodeNormal(vec2 encoded)
+{
+    encoded = encoded * 2.0 - 1.0;
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if(n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+// 4x4 ordered dither threshold of this pixel, in (0, 1)
+float ditherThreshold()
+{
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+    return (bayer[pixel.x + 4 * pixel.y] + 0.5) / 16.0;
+}
+
+void main()
+{
+    // the pixels the full prefab dropped with its dissolve (see 5.4.light_casters.fs), and the prefab's outline
+    vec4 albedo = texture(impostorAlbedo, TexCoords);
+    if(ditherThreshold() >= Fade || albedo.a < 0.5)
+        discard;
+
+    if(overdraw)
+    {
+        FragColor = vec4(0.125, 0.0625, 0.03125, 1.0);
+        return;
+    }
+
+    vec3 specularColour = texture(impostorSpecular, TexCoords).rgb;
+    vec3 norm = decodeNormal(texture(impostorNormals, TexCoords).rg);
+
+    // flashlight, as in 5.4.light_casters.fs
+    vec3 lightDir = normalize(light.position - FragPos);
+    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 ambient = light.ambient * albedo.rgb;
+    vec3 diffuse = light.diffuse * max(dot(norm, lightDir), 0.0) * albedo.rgb;
+    vec3 specular = light.specular * pow(max(dot(viewDir, reflect(-lightDir, norm)), 0.0), material.shininess) * specularColour;
+
+    float theta = dot(lightDir, normalize(-light.direction));
+    float intensity = clamp((theta - light.outerCutOff) / (light.cutOff - light.outerCutOff), 0.0, 1.0);
+    float distance = length(light.position - FragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+
+    vec3 result = (ambient + (diffuse + specular) * intensity) * attenuation;
+    result += clusteredLights(norm, viewDir, albedo.rgb, specularColour);
+    // the quad runs through the middle of the prefab, whose surfaces would shadow it: look the shadows up about
+    // where the surface seen in the tile is instead
+    result += sunLight(FragPos + norm * impostorHalfSize.x, norm, albedo.rgb);
+    FragColor = vec4(result, 1.0);
+}
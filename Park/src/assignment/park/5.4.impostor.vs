@@ -0,0 +1,35 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;          // of the quad, in [-1, 1]^2
+layout (location = 1) in vec4 aPositionFade;    // per impostor
+
+out vec3 FragPos;
+out vec2 TexCoords;
+out float Fade;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 viewPos;
+
+// see Impostors
+uniform vec3 impostorCentre;                    // of the quads, relative to the positions
+uniform vec2 impostorHalfSize;
+uniform int impostorViews;                      // tiles side by side in the atlas
+
+void main()
+{
+    vec3 centre = aPositionFade.xyz + impostorCentre;
+    vec2 toCamera = viewPos.xz - centre.xz;
+    vec2 facing = dot(toCamera, toCamera) > 1.0e-8 ? normalize(toCamera) : vec2(0.0, 1.0);
+
+    // the tile captured nearest to the direction of the camera, turning from +z towards +x
+    float views = float(impostorViews);
+    float tile = mod(floor(atan(facing.x, facing.y) * views / 6.28318531 + 0.5), views);
+
+    // upright quad turned towards the camera
+    vec3 right = vec3(facing.y, 0.0, -facing.x);
+    FragPos = centre + right * (aCorner.x * impostorHalfSize.x) + vec3(0.0, aCorner.y * impostorHalfSize.y, 0.0);
+    TexCoords = vec2((tile + aCorner.x * 0.5 + 0.5) / views, aCorner.y * 0.5 + 0.5);
+    Fade = aPositionFade.w;
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
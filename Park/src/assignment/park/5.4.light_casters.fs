@@ -25,27 +25,151 @@ struct Light {
 in vec3 FragPos;  
 in vec3 Normal;  
 in vec2 TexCoords;
+flat in vec4 ArrayLayers;                     // texture arrays and layers of batched boxes, negative for other boxes
   
 uniform vec3 viewPos;
 uniform Material material;
+uniform sampler2DArray materialArrays[8];     // all the arrays of batched boxes (see TextureArrays::MAX_ARRAYS)
 uniform Light light;
+uniform mat4 view;
+uniform float dissolve;                       // fraction of the pixels dropped while fading into an impostor
+
+// clustered point lights (see ClusteredLights)
+uniform samplerBuffer clusterLightData;       // two texels per light: position + radius, colour
+uniform usamplerBuffer clusterRanges;         // per cluster: first entry in clusterLightIndices, light count
+uniform usamplerBuffer clusterLightIndices;
+uniform ivec3 clusterGrid;
+uniform vec2 clusterTileSize;                 // in pixels
+uniform vec2 clusterDepth;                    // near depth, slices / log(far / near)
+
+// sun (see SunShadows); sunColour is black at night
+uniform vec3 sunDirection;                    // towards the sun
+uniform vec3 sunColour;
+uniform bool noSun;                           // set while drawing the sky
+uniform sampler2DShadow staticShadowMap;
+uniform sampler2DShadow dynamicShadowMap;
+uniform mat4 staticShadowMatrix;              // world space to shadow map coordinates and depth
+uniform mat4 dynamicShadowMatrix;
+
+// fraction of four filtered taps around 'position' that see the sun; 1 outside the map
+float sunVisibility(sampler2DShadow map, mat4 shadowMatrix, vec3 position)
+{
+    vec3 coords = (shadowMatrix * vec4(position, 1.0)).xyz;
+    if(any(lessThan(coords, vec3(0.0))) || any(greaterThan(coords, vec3(1.0))))
+        return 1.0;
+
+    vec2 texel = 1.0 / vec2(textureSize(map, 0));
+    float visible = 0.0;
+    visible += textureLod(map, vec3(coords.xy + vec2(-0.5, -0.5) * texel, coords.z), 0.0);
+    visible += textureLod(map, vec3(coords.xy + vec2( 0.5, -0.5) * texel, coords.z), 0.0);
+    visible += textureLod(map, vec3(coords.xy + vec2(-0.5,  0.5) * texel, coords.z), 0.0);
+    visible += textureLod(map, vec3(coords.xy + vec2( 0.5,  0.5) * texel, coords.z), 0.0);
+    return visible * 0.25;
+}
+
+// diffuse sunlight, shadowed by the static scenery and by the actors
+vec3 sunLight(vec3 position, vec3 norm, vec3 diffuseColour)
+{
+    float diff = max(dot(norm, sunDirection), 0.0);
+    if(diff == 0.0 || sunColour == vec3(0.0))
+        return vec3(0.0);
+
+    float visible = min(sunVisibility(staticShadowMap, staticShadowMatrix, position),
+                        sunVisibility(dynamicShadowMap, dynamicShadowMatrix, position));
+    return sunColour * diff * visible * diffuseColour;
+}
+
+// diffuse + specular of the point lights binned into this fragment's cluster
+vec3 clusteredLights(vec3 norm, vec3 viewDir, vec3 diffuseColour, vec3 specularColour)
+{
+    float depth = max(-(view * vec4(FragPos, 1.0)).z, clusterDepth.x);
+    int slice = min(int(log(depth / clusterDepth.x) * clusterDepth.y), clusterGrid.z - 1);
+    ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterTileSize), clusterGrid.xy - 1);
+    uvec2 range = texelFetch(clusterRanges, tile.x + clusterGrid.x * (tile.y + clusterGrid.y * slice)).xy;
+
+    vec3 result = vec3(0.0);
+    for(uint i = 0u; i < range.y; i++)
+    {
+        int index = int(texelFetch(clusterLightIndices, int(range.x + i)).r);
+        vec4 positionRadius = texelFetch(clusterLightData, 2 * index);
+        vec3 colour = texelFetch(clusterLightData, 2 * index + 1).rgb;
+
+        vec3 toLight = positionRadius.xyz - FragPos;
+        float distance = length(toLight);
+        // smooth falloff that reaches exactly zero at the light's radius
+        float falloff = clamp(1.0 - (distance * distance) / (positionRadius.w * positionRadius.w), 0.0, 1.0);
+        falloff *= falloff;
+
+        vec3 lightDir = toLight / max(distance, 0.0001);
+        float diff = max(dot(norm, lightDir), 0.0);
+        float spec = pow(max(dot(viewDir, reflect(-lightDir, norm)), 0.0), material.shininess);
+        result += colour * falloff * (diff * diffuseColour + spec * specularColour);
+    }
+    return result;
+}
+
+// layer 'layer' of the texture array 'array' at this fragment
+vec3 arrayTexture(float array, float layer)
+{
+    vec3 coords = vec3(TexCoords, layer);
+    switch(int(array))
+    {
+    case 0: return texture(materialArrays[0], coords).rgb;
+    case 1: return texture(materialArrays[1], coords).rgb;
+    case 2: return texture(materialArrays[2], coords).rgb;
+    case 3: return texture(materialArrays[3], coords).rgb;
+    case 4: return texture(materialArrays[4], coords).rgb;
+    case 5: return texture(materialArrays[5], coords).rgb;
+    case 6: return texture(materialArrays[6], coords).rgb;
+    default: return texture(materialArrays[7], coords).rgb;
+    }
+}
+
+// the material's colours at this fragment: from its textures, or from the texture array layers of a batched box
+vec3 materialDiffuse()
+{
+    if(ArrayLayers.x < 0.0)
+        return texture(material.diffuse, TexCoords).rgb;
+    return arrayTexture(ArrayLayers.x, ArrayLayers.y);
+}
+
+vec3 materialSpecular()
+{
+    if(ArrayLayers.x < 0.0)
+        return texture(material.specular, TexCoords).rgb;
+    return arrayTexture(ArrayLayers.z, ArrayLayers.w);
+}
+
+// 4x4 ordered dither threshold of this pixel, in (0, 1)
+float ditherThreshold()
+{
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+    return (bayer[pixel.x + 4 * pixel.y] + 0.5) / 16.0;
+}
 
 void main()
 {
+    if(ditherThreshold() < dissolve)
+        discard;
+
+    vec3 diffuseColour = materialDiffuse();
+    vec3 specularColour = materialSpecular();
+
     // ambient
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
+    vec3 ambient = light.ambient * diffuseColour;
     
     // diffuse 
     vec3 norm = normalize(Normal);
     vec3 lightDir = normalize(light.position - FragPos);
     float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = light.diffuse * diff * texture(material.diffuse, TexCoords).rgb;  
+    vec3 diffuse = light.diffuse * diff * diffuseColour;  
     
     // specular
     vec3 viewDir = normalize(viewPos - FragPos);
     vec3 reflectDir = reflect(-lightDir, norm);  
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess); 
-    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;  
+    vec3 specular = light.specular * spec * specularColour;  
     
     // spotlight (soft edges)
     float theta = dot(lightDir, normalize(-light.direction)); 
@@ -62,5 +186,8 @@ void main()
     specular *= attenuation;   
         
     vec3 result = ambient + diffuse + specular;
+    result += clusteredLights(norm, viewDir, diffuseColour, specularColour);
+    if(!noSun)
+        result += sunLight(FragPos, norm, diffuseColour);
     FragColor = vec4(result, 1.0);
 } 
\ No newline at end of file
@@ -6,16 +6,21 @@ layout (location = 2) in vec2 aTexCoords;
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+flat out vec4 ArrayLayers; // texture array layers of batched boxes (see 5.4.batched.vs), none here
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// must match 5.4.depth.vs bit for bit for the GL_EQUAL test after the depth pre-pass
+invariant gl_Position;
+
 void main()
 {
     FragPos = vec3(model * vec4(aPos, 1.0));
     Normal = mat3(transpose(inverse(model))) * aNormal;  
     TexCoords = aTexCoords;
+    ArrayLayers = vec4(-1.0);
     
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
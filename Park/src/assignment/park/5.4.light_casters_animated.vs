@@ -0,0 +1,66 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in mat4 aBase;
+layout (location = 7) in vec4 aMotion; // xyz: amplitude, w: frequency
+layout (location = 8) in vec2 aParams; // x: phase, y: path
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+flat out vec4 ArrayLayers; // texture array layers of batched boxes (see 5.4.batched.vs), none here
+
+uniform float time;
+uniform mat4 view;
+uniform mat4 projection;
+
+// the depth pre-pass runs this shader too; both passes must produce the same depths for their GL_EQUAL test
+invariant gl_Position;
+
+mat4 translation(vec3 offset)
+{
+    mat4 m = mat4(1.0);
+    m[3] = vec4(offset, 1.0);
+    return m;
+}
+
+mat4 rotation(vec3 axis, float angle)
+{
+    float c = cos(angle);
+    float s = sin(angle);
+    vec3 a = normalize(axis);
+    vec3 t = (1.0 - c) * a;
+
+    return mat4(
+        vec4(c + t.x * a.x,       t.x * a.y + s * a.z, t.x * a.z - s * a.y, 0.0),
+        vec4(t.y * a.x - s * a.z, c + t.y * a.y,       t.y * a.z + s * a.x, 0.0),
+        vec4(t.z * a.x + s * a.y, t.z * a.y - s * a.x, c + t.z * a.z,       0.0),
+        vec4(0.0, 0.0, 0.0, 1.0));
+}
+
+// evaluates the instance's periodic motion, see Animation_Path in animated_batch.h
+mat4 motion()
+{
+    float angle = time * aMotion.w + aParams.x;
+    int path = int(aParams.y + 0.5);
+
+    if(path == 1) // orbit
+        return translation(vec3(-aMotion.x * sin(angle), 0.0, aMotion.z * cos(angle)));
+    if(path == 2) // sway
+        return rotation(aMotion.xyz, radians(length(aMotion.xyz) * sin(angle)));
+
+    return translation(aMotion.xyz * sin(angle)); // bob
+}
+
+void main()
+{
+    mat4 model = motion() * aBase;
+
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    Normal = mat3(transpose(inverse(model))) * aNormal;
+    TexCoords = aTexCoords;
+    ArrayLayers = vec4(-1.0);
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
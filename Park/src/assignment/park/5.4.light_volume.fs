@@ -0,0 +1,51 @@
+#version 330 core
+out vec4 FragColor;
+
+struct Material {
+    float shininess;
+}; 
+
+flat in vec4 LightSphere;
+flat in vec3 LightColour;
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform vec2 screenSize;
+uniform mat4 inverseViewProjection;
+
+uniform vec3 viewPos;
+uniform Material material;
+
+vec3 decodeNormal(vec2 encoded)
+{
+    encoded = encoded * 2.0 - 1.0;
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if(n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+// one point light on the pixel under its volume, as clusteredLights() in 5.4.light_casters.fs
+void main()
+{
+    vec2 uv = gl_FragCoord.xy / screenSize;
+    vec4 world = inverseViewProjection * vec4(vec3(uv, texture(gDepth, uv).r) * 2.0 - 1.0, 1.0);
+    vec3 FragPos = world.xyz / world.w;
+
+    vec3 toLight = LightSphere.xyz - FragPos;
+    float distance = length(toLight);
+    float falloff = clamp(1.0 - (distance * distance) / (LightSphere.w * LightSphere.w), 0.0, 1.0);
+    falloff *= falloff;
+    if(falloff == 0.0)
+        discard;
+
+    vec3 norm = decodeNormal(texture(gNormal, uv).xy);
+    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 lightDir = toLight / max(distance, 0.0001);
+    float diff = max(dot(norm, lightDir), 0.0);
+    float spec = pow(max(dot(viewDir, reflect(-lightDir, norm)), 0.0), material.shininess);
+    vec3 result = LightColour * falloff * (diff * texture(gAlbedo, uv).rgb + spec * texture(gSpecular, uv).rgb);
+    FragColor = vec4(result, 1.0);
+}
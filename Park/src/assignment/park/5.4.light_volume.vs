@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec4 aLight;  // xyz: position, w: radius
+layout (location = 2) in vec4 aColour;
+
+flat out vec4 LightSphere;
+flat out vec3 LightColour;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    LightSphere = aLight;
+    LightColour = aColour.rgb;
+    gl_Position = projection * view * vec4(aLight.xyz + aPos * aLight.w, 1.0);
+}
@@ -0,0 +1,77 @@
+#version 330 core
+out vec4 FragColor;
+
+struct Material {
+    float shininess;
+};
+
+struct Light {
+    vec3 position;  
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+  
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+	
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+in vec3 FragPos;  
+in vec3 Normal;  
+in vec2 TexCoords;
+in mat3 TBN;
+in vec4 Tint;
+  
+uniform vec3 viewPos;
+uniform Material material;
+uniform Light light;
+
+// bound by Mesh::Draw to fixed texture units
+uniform sampler2D texture_diffuse1;
+uniform sampler2D texture_specular1;
+uniform sampler2D texture_normal1;
+
+// meshes with a normal map are the ones that store a tangent frame
+uniform int meshAttributes;
+const int VERTEX_TANGENT_FRAME = 4;
+
+void main()
+{
+    // ambient
+    vec3 ambient = light.ambient * (texture(texture_diffuse1, TexCoords).rgb * Tint.rgb);
+    
+    // diffuse 
+    vec3 norm = normalize(Normal);
+    if((meshAttributes & VERTEX_TANGENT_FRAME) != 0)
+        norm = normalize(TBN * (texture(texture_normal1, TexCoords).rgb * 2.0 - 1.0));
+    vec3 lightDir = normalize(light.position - FragPos);
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 diffuse = light.diffuse * diff * (texture(texture_diffuse1, TexCoords).rgb * Tint.rgb);  
+    
+    // specular
+    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 reflectDir = reflect(-lightDir, norm);  
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess); 
+    vec3 specular = light.specular * spec * texture(texture_specular1, TexCoords).rgb;  
+    
+    // spotlight (soft edges)
+    float theta = dot(lightDir, normalize(-light.direction)); 
+    float epsilon = (light.cutOff - light.outerCutOff);
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    diffuse  *= intensity;
+    specular *= intensity;
+    
+    // attenuation
+    float distance    = length(light.position - FragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+    ambient  *= attenuation; 
+    diffuse   *= attenuation;
+    specular *= attenuation;   
+        
+    vec3 result = ambient + diffuse + specular;
+    FragColor = vec4(result, 1.0);
+} 
\ No newline at end of file
@@ -0,0 +1,63 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;          // unsigned normalized offset inside the mesh bounds
+layout (location = 1) in vec4 aNormal;       // 10:10:10:2 signed normalized
+layout (location = 2) in vec2 aTexCoords;    // half floats
+layout (location = 3) in vec4 aTangentFrame; // quaternion, sign of w = handedness
+layout (location = 5) in mat4 aInstanceModel;  // per instance, see MeshInstance
+layout (location = 9) in vec4 aInstanceTint;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+out mat3 TBN;
+out vec4 Tint;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// set by Mesh::Draw, see vertex_format.h
+uniform vec3 meshBoundsMin;
+uniform vec3 meshBoundsExtent;
+uniform int meshAttributes;
+// Mesh::DrawInstanced takes the model matrix and tint from the instance attributes
+uniform bool instanced;
+
+const int VERTEX_NORMAL = 1;
+const int VERTEX_TEXCOORDS = 2;
+const int VERTEX_TANGENT_FRAME = 4;
+
+vec3 rotate(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main()
+{
+    vec3 position = meshBoundsMin + aPos * meshBoundsExtent;
+    mat4 world = instanced ? aInstanceModel : model;
+    mat3 normalMatrix = mat3(transpose(inverse(world)));
+
+    vec3 normal = vec3(0.0, 0.0, 1.0);
+    vec3 tangent = vec3(1.0, 0.0, 0.0);
+    vec3 bitangent = vec3(0.0, 1.0, 0.0);
+    if((meshAttributes & VERTEX_TANGENT_FRAME) != 0)
+    {
+        vec4 q = normalize(aTangentFrame);
+        normal = rotate(q, vec3(0.0, 0.0, 1.0));
+        tangent = rotate(q, vec3(1.0, 0.0, 0.0));
+        bitangent = cross(normal, tangent) * (aTangentFrame.w < 0.0 ? -1.0 : 1.0);
+    }
+    else if((meshAttributes & VERTEX_NORMAL) != 0)
+    {
+        normal = aNormal.xyz;
+    }
+
+    FragPos = vec3(world * vec4(position, 1.0));
+    Normal = normalMatrix * normal;
+    TBN = mat3(normalize(normalMatrix * tangent), normalize(normalMatrix * bitangent), normalize(Normal));
+    Tint = instanced ? aInstanceTint : vec4(1.0);
+    TexCoords = (meshAttributes & VERTEX_TEXCOORDS) != 0 ? aTexCoords : vec2(0.0);
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
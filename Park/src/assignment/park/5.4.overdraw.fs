@@ -0,0 +1,20 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform float dissolve; // fraction of the pixels dropped while fading into an impostor, as in the shading pass
+
+// 4x4 ordered dither threshold of this pixel, in (0, 1)
+float ditherThreshold()
+{
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+    return (bayer[pixel.x + 4 * pixel.y] + 0.5) / 16.0;
+}
+
+// added up with GL_ONE, GL_ONE blending: one layer is dark red, about 8 turn red, 16 orange and 32 white
+void main()
+{
+    if(ditherThreshold() < dissolve)
+        discard;
+    FragColor = vec4(0.125, 0.0625, 0.03125, 1.0);
+}
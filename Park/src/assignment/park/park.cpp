@@ -10,6 +10,12 @@ const float Y_UPPER_BOUNDS = 15.0f;
 const float Z_LOWER_BOUNDS = -14.0f;
 const float Z_UPPER_BOUNDS = 14.0f;
 
+// ACTORS
+const glm::vec3 MAN_POSITION(-0.12f, 0.0f, -1.5f);
+const glm::vec3 BBALL_POSITION(0.0f, 0.3f, -1.5f);
+const glm::vec3 DOG_POSITION(3.0f, 0.2f, -3.0f);
+const glm::vec3 BIRD_POSITION(2.9f, 1.0f, -3.0f);
+
 // CAMERA
 Camera camera(glm::vec3(0.0f, 1.0f, 3.0f));
 glm::mat4 projection;
@@ -17,6 +23,22 @@ glm::vec3 lastPosition;
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
+const float CAMERA_RADIUS = 0.1f;
+
+// SCENE QUERIES
+SpatialIndex spatialIndex(AABB(glm::vec3(-32.0f), glm::vec3(32.0f)));
+std::vector<AABB> *boundsRecorder = NULL; // when set, applyTexture() records box bounds instead of drawing
+AABB *actorBounds = NULL; // when set, applyTexture() also grows these bounds
+bool depthOnlyPass = false; // when set, applyTexture() doesn't bind any textures
+std::vector<glm::mat4> *occluderRecorder = NULL; // when set, applyTexture() records box transforms instead of drawing
+bool occlusionTesting = false; // when set, applyTexture() skips the boxes 'occlusion' finds hidden
+MaterialBatches *batchRecorder = NULL; // when set, applyTexture() records boxes for instanced batches instead of drawing
+enum Actor_Id {
+    ACTOR_MAN,
+    ACTOR_BBALL,
+    ACTOR_DOG,
+    ACTOR_BIRD
+};
 
 // TIMING
 float deltaTime = 0.0f;
@@ -27,30 +49,77 @@ int dayNightTimer = 0;
 int followStayTimer = 0;
 int projectionTimer = 0;
 int animationTimer = 0;
+int shadingTimer = 0;
+int prepassTimer = 0;
+int overdrawTimer = 0;
+int impostorTimer = 0;
+int occlusionTimer = 0;
+int queryTimer = 0;
+int batchTimer = 0;
+int multiDrawTimer = 0;
+int cullTimer = 0;
 
 // LIGHT
 float amb = 1.0f;
 float linearAtten[2] = {0.0014f, 0.045f};
 float quadAtten[2] = {0.000007f, 0.0075f};
 int attenIndex = 1;
+ClusteredLights parkLights; // lamps, BBQ and gazebo lights, on at night (attenIndex 1)
+std::vector<PointLight> nightLights;
+SunShadows sunShadows(glm::vec3(0.0f, 2.0f, 0.0f), 22.0f); // sun shadows of the day (attenIndex 0)
+const glm::vec3 SUN_COLOUR(0.5f, 0.47f, 0.4f);
+float sunAngle = 30.0f;
+OcclusionRasterizer occlusion; // software occlusion culling of the boxes, toggled with C
+OcclusionQueries propQueries; // GPU occlusion queries of the props, toggled with Q
+MaterialBatches staticBatches; // the static scenery drawn instanced, toggled with B
+HiZPyramid depthPyramid; // last frame's depth for culling the batched scenery on the GPU, toggled with H
+int framebufferWidth = SCR_WIDTH;
+int framebufferHeight = SCR_HEIGHT;
 
 // TOGGLES
 bool brightToggle = false;
 bool lightStay = false;
 bool orthographic = false;
+bool deferredShading = false;
+bool depthPrepass = false;
+bool overdrawView = false;
+bool impostorTrees = true;
+bool occlusionCulling = false;
+bool gpuOcclusion = false;
+bool batchedScenery = true;
+bool multiDraw = true;
+bool gpuCulling = false;
+
+// BENCHMARK (--bench): the same frames rendered by every shading path, with and without the depth
+// pre-pass, timed on the GPU
+bool benchMode = false;
+int benchFrame = 0;
+const int BENCH_FRAMES = 300;
 
 // ANIMATION TRIGGER
 bool playAnimation = true;
 float ballDistance;
 float dogBodyDistance; 
 float birdDistance; 
+bool dogResting = false;
+bool birdResting = false;
 
-int main()
+int main(int argc, char *argv[])
 {
+    for(int i = 1; i < argc; i++)
+    {
+        if(std::string(argv[i]) == "--bench")
+        {
+            benchMode = true;
+        }
+    }
+
     // glfw: initialize and configure
     // ------------------------------
+    // 4.3 where the driver has it, for the multi-draw-indirect submission and GPU culling of the batched
+    // scenery; everything else only needs 3.3
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
@@ -62,13 +131,25 @@ int main()
     // --------------------
     GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Neighborhood Park", NULL, NULL);
     if (window == NULL)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Neighborhood Park", NULL, NULL);
+    }
+    if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
         return -1;
     }
     glfwMakeContextCurrent(window);
+    if(benchMode)
+    {
+        // don't let vsync hide the difference between the paths
+        glfwSwapInterval(0);
+    }
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
 
@@ -91,8 +172,74 @@ int main()
     // ------------------------------------
     Shader shader("5.4.light_casters.vs", "5.4.light_casters.fs");
     Shader skyShader("5.4.lamp.vs", "5.4.lamp.fs");
+    Shader animShader("5.4.light_casters_animated.vs", "5.4.light_casters.fs");
+    Shader gBufferShader("5.4.light_casters.vs", "5.4.gbuffer.fs");
+    Shader gBufferAnimShader("5.4.light_casters_animated.vs", "5.4.gbuffer.fs");
+    Shader deferredLightShader("5.4.deferred_light.vs", "5.4.deferred_light.fs");
+    Shader lightVolumeShader("5.4.light_volume.vs", "5.4.light_volume.fs");
+    Shader depthShader("5.4.depth.vs", "5.4.depth.fs");
+    Shader depthAnimShader("5.4.light_casters_animated.vs", "5.4.depth.fs");
+    Shader overdrawShader("5.4.light_casters.vs", "5.4.overdraw.fs");
+    Shader overdrawAnimShader("5.4.light_casters_animated.vs", "5.4.overdraw.fs");
+    Shader impostorShader("5.4.impostor.vs", "5.4.impostor.fs");
+    Shader batchedShader("5.4.batched.vs", "5.4.light_casters.fs");
+    Shader batchedGBufferShader("5.4.batched.vs", "5.4.gbuffer.fs");
+    Shader batchedDepthShader("5.4.batched.vs", "5.4.depth.fs");
+    Shader batchedOverdrawShader("5.4.batched.vs", "5.4.overdraw.fs");
+
+    // the material textures on units 0 and 1 as applyTexture() binds them, the texture arrays of the batched
+    // boxes after the clusters' and shadows' units
+    Shader *materialShaders[] = {&shader, &animShader, &gBufferShader, &gBufferAnimShader, &batchedShader, &batchedGBufferShader};
+    for(Shader *materialShader : materialShaders)
+    {
+        materialShader->use();
+        materialShader->setInt("material.diffuse", 0);
+        materialShader->setInt("material.specular", 1);
+        MaterialBatches::setSamplers(*materialShader);
+    }
+
+    // compute shaders of the GPU culling, which needs GL 4.3
+    ComputeShader cullShader;
+    ComputeShader hiZShader;
+    if(GLAD_GL_VERSION_4_3)
+    {
+        cullShader = ComputeShader("5.4.cull.cs");
+        hiZShader = ComputeShader("5.4.hiz.cs");
+        depthPyramid.setup();
+    }
+
+    // SETUP DEFERRED SHADING
+    GBuffer gBuffer;
+    gBuffer.setup(framebufferWidth, framebufferHeight);
+    LightVolumes lightVolumes;
+    lightVolumes.setup();
+    unsigned int fullscreenVAO;
+    glGenVertexArrays(1, &fullscreenVAO);
+    GpuQuery frameTimer(GL_TIME_ELAPSED);
+    frameTimer.setup();
+    GpuQuery samplesShaded(GL_SAMPLES_PASSED);
+    samplesShaded.setup();
+    float lastStatsTime = 0.0f;
+    AABB actorCasterBounds; // where the actors were drawn last frame
+
+    // SETUP NIGHT LIGHTS
+    parkLights.setup();
+    nightLightsSetup(nightLights);
+
+    // SETUP SUN SHADOWS
+    sunShadows.setup();
 
     // SETUP TEXTURES -----------------------------------------------------------
+    // decode every texture in parallel up front; the loadTexture() calls below are then only lookups.
+    // Several textures are plain colours shared between props, so identical images also share a texture.
+    TextureRegistry::instance().dedupeByContent = true;
+    for(unsigned int i = 0; i < sizeof(lowDetailTextureFiles) / sizeof(lowDetailTextureFiles[0]); i++)
+        TextureRegistry::instance().setLowDetail(FileSystem::getPath(std::string("resources/textures/") + lowDetailTextureFiles[i]));
+    std::vector<std::string> texturePaths;
+    for(unsigned int i = 0; i < sizeof(textureFiles) / sizeof(textureFiles[0]); i++)
+        texturePaths.push_back(FileSystem::getPath(std::string("resources/textures/") + textureFiles[i]));
+    TextureRegistry::instance().preload(texturePaths);
+
     unsigned int noSpec = loadTexture(FileSystem::getPath("resources/textures/no_spec.png").c_str());
     unsigned int mildSpec = loadTexture(FileSystem::getPath("resources/textures/mild_spec.png").c_str());
     unsigned int highSpec = loadTexture(FileSystem::getPath("resources/textures/high_spec.png").c_str());
@@ -141,6 +288,7 @@ int main()
     unsigned int binRecSignDiff = loadTexture(FileSystem::getPath("resources/textures/bin_sign2.png").c_str());
     unsigned int fountainBaseDiff = loadTexture(FileSystem::getPath("resources/textures/fountain_base.png").c_str());
     unsigned int fountainTapDiff = loadTexture(FileSystem::getPath("resources/textures/fountain_tap.png").c_str());
+    TextureRegistry::instance().report(std::cout);
     
 
     // first, configure the cube's VAO (and VBO)
@@ -178,7 +326,209 @@ int main()
 	//texture coordinates
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
 	glEnableVertexAttribArray(2);
-    
+
+    // third, a positions only VAO over the same VBO for the depth pre-pass
+    unsigned int positionVAO;
+    glGenVertexArrays(1, &positionVAO);
+    glBindVertexArray(positionVAO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    // animated actors: periodic motion is evaluated in the vertex shader, so these are only built once
+    AnimatedBatch bballBatch(bballDiff, mildSpec);
+    AnimatedBatch birdBatch(birdDiff, noSpec);
+    AnimatedBatch manHandBatch(manNeckDiff, noSpec);
+    AnimatedBatch dogHeadBatch(dogHeadDiff, noSpec);
+    AnimatedBatch dogBodyBatch(dogBodyDiff, noSpec);
+    AnimatedBatch birdRestBatch(birdDiff, noSpec);
+    AnimatedBatch *animatedBatches[] = {&bballBatch, &birdBatch, &manHandBatch, &dogHeadBatch, &dogBodyBatch, &birdRestBatch};
+
+    for(AnimatedBatch *batch : animatedBatches)
+    {
+        batch->setup(VBO);
+    }
+
+    manAnimate(MAN_POSITION.x, MAN_POSITION.y, MAN_POSITION.z, manHandBatch);
+    bballAnimate(BBALL_POSITION.x, BBALL_POSITION.y, BBALL_POSITION.z, bballBatch);
+    dogAnimate(DOG_POSITION.x, DOG_POSITION.y, DOG_POSITION.z, dogHeadBatch, dogBodyBatch);
+    birdAnimate(BIRD_POSITION.x, BIRD_POSITION.y, BIRD_POSITION.z, birdBatch, birdRestBatch);
+
+    // the perimeter tree line; far trees draw as billboards, captured from the tree drawn at the origin
+    Impostors treeImpostors(16.0f, 3.0f, 128, 512);
+    for(int i = -14; i <= 14; i++)
+    {
+        treeImpostors.positions.push_back(glm::vec3(i, 2.5f, 14.5f));
+        treeImpostors.positions.push_back(glm::vec3(-14.5f, 2.5f, i));
+        treeImpostors.positions.push_back(glm::vec3(i, 2.5f, -14.5f));
+        treeImpostors.positions.push_back(glm::vec3(14.5f, 2.5f, i));
+    }
+
+    std::vector<AABB> treeBoxes;
+    boundsRecorder = &treeBoxes;
+    treeDraw(0.0f, 0.0f, 0.0f, shader, treeTopDiff, mildSpec, treeTrunkDiff, noSpec);
+    boundsRecorder = NULL;
+    AABB treeBounds;
+    for(const AABB &box : treeBoxes)
+    {
+        treeBounds.expand(box);
+    }
+    treeImpostors.setup(treeBounds);
+
+    gBufferShader.use();
+    gBufferShader.setBool("noSun", false);
+    glBindVertexArray(VAO);
+    treeImpostors.capture(gBufferShader, framebufferWidth, framebufferHeight, [&](Shader &captureShader)
+    {
+        treeDraw(0.0f, 0.0f, 0.0f, captureShader, treeTopDiff, mildSpec, treeTrunkDiff, noSpec);
+    });
+
+    // the composite props, each tested as a whole by a GPU occlusion query
+    const int PROP_COUNT = 8;
+    auto propDraw = [&](int prop, Shader &shader)
+    {
+        switch(prop)
+        {
+        case 0: bballRingDraw(false, 0.0f, 1.0f, -5.5f, shader, bballPoleDiff, bballBoardFrontDiff, bballBoardBackDiff, bballBoardEdgeDiff, bballRingDiff, highSpec, mildSpec); break;
+        case 1: bballRingDraw(true, 0.0f, 1.0f, 5.5f,  shader, bballPoleDiff, bballBoardFrontDiff, bballBoardBackDiff, bballBoardEdgeDiff, bballRingDiff, highSpec, mildSpec); break;
+        case 2: swingDraw(shader, swingFrameDiff, swingRopeDiff, swingSeatDiff, noSpec, mildSpec); break;
+        case 3: gazeboDraw(shader, metalFrameDiff, gazeboRoofDiff, pavingDiff, highSpec, mildSpec, noSpec); break;
+        case 4: tableBenchDraw(shader, woodSlatsDiff, paintedMetalDiff, noSpec, mildSpec); break;
+        case 5: bbqDraw(shader, bbqBaseDiff, bbqPanelDiff, metalFrameDiff, bbqTopDiff, bbqGrillDiff, bbqPanDiff, pavingDiff, noSpec, mildSpec, highSpec); break;
+        case 6: fountainDraw(-3.0f, 0.36f, -10.5f, shader, fountainBaseDiff, fountainTapDiff, noSpec, highSpec); break;
+        case 7: fountainDraw(10.5f, 0.36f, 10.5f, shader, fountainBaseDiff, fountainTapDiff, noSpec, highSpec); break;
+        }
+    };
+
+    std::vector<AABB> propBounds;
+    for(int prop = 0; prop < PROP_COUNT; prop++)
+    {
+        std::vector<AABB> propBoxes;
+        boundsRecorder = &propBoxes;
+        propDraw(prop, shader);
+        boundsRecorder = NULL;
+        AABB bounds;
+        for(const AABB &box : propBoxes)
+        {
+            bounds.expand(box);
+        }
+        propBounds.push_back(bounds);
+    }
+    propQueries.setup(propBounds);
+
+    // the bins and street lamps
+    auto fixturesDraw = [&](Shader &shader)
+    {
+        binDraw(-12.0f, 0.0f, 0.5f, shader, binMetalDiff, binPanelDiff, binGenSignDiff, mildSpec, noSpec);
+        binDraw(-12.0f, 0.0f, -0.5f, shader, binMetalDiff, binPanelDiff, binRecSignDiff, mildSpec, noSpec);
+        for(const glm::vec3 &lamp : streetLampPositions)
+        {
+            streetLampDraw(lamp.x, lamp.y, lamp.z, shader, paintedMetalDiff, highSpec, noSpec);
+        }
+    };
+
+    // the grass, court, play floor and paths under everything else
+    auto groundDraw = [&](Shader &shader)
+    {
+        grassDraw(shader, grassDiff, mildSpec);
+        bballCourtDraw(shader, bballCourtDiff, noSpec);
+        playFloorDraw(shader, playFloorDiff, noSpec);
+        pavingDraw(-9.0f, 0.0f, 3.0f, 2, 12, shader, pavingDiff, noSpec);
+        pavingDraw(-7.0f, 0.0f, 12.0f, 21, 2, shader, pavingDiff, noSpec);
+        pavingDraw(12.0f, 0.0f, -13.0f, 2, 25, shader, pavingDiff, noSpec);
+        pavingDraw(-9.0f, 0.0f, -13.0f, 21, 2, shader, pavingDiff, noSpec);
+    };
+
+    // static props the camera collides with. In the camera passes the trees past the impostors' distance are
+    // left to them, the trees fading into them drop part of their pixels, and with the GPU occlusion queries
+    // each prop is drawn on the condition that its box was visible last frame. With the batched scenery the
+    // camera passes only draw the trees here.
+    auto sceneryDraw = [&](Shader &shader, bool cameraPass)
+    {
+        bool treeLod = cameraPass && impostorTrees;
+        if(!(cameraPass && batchedScenery))
+        {
+            for(int prop = 0; prop < PROP_COUNT; prop++)
+            {
+                if(cameraPass && gpuOcclusion)
+                {
+                    propQueries.drawConditional(prop, [&]() { propDraw(prop, shader); });
+                }
+                else
+                {
+                    propDraw(prop, shader);
+                }
+            }
+            fixturesDraw(shader);
+        }
+
+        // DRAW TREE BARRIERS
+        for(unsigned int i = 0; i < treeImpostors.positions.size(); i++)
+        {
+            const glm::vec3 &tree = treeImpostors.positions[i];
+            if(treeLod)
+            {
+                float fade = treeImpostors.fade(i);
+                if(fade >= 1.0f)
+                {
+                    continue;
+                }
+                shader.setFloat("dissolve", fade);
+            }
+            treeDraw(tree.x, tree.y, tree.z, shader, treeTopDiff, mildSpec, treeTrunkDiff, noSpec);
+        }
+        if(treeLod)
+        {
+            shader.setFloat("dissolve", 0.0f);
+        }
+    };
+
+    // build the spatial index over every scenery box once
+    std::vector<AABB> sceneryBounds;
+    boundsRecorder = &sceneryBounds;
+    sceneryDraw(shader, false);
+    boundsRecorder = NULL;
+    spatialIndex.scenery.build(sceneryBounds);
+
+    // BATCHED SCENERY: the ground, props, bins and lamps never move or fade, so they are drawn from instance
+    // buffers grouped by texture arrays instead of box by box. The trees stay out as they fade into their
+    // impostors one by one.
+    batchRecorder = &staticBatches;
+    groundDraw(shader);
+    for(int prop = 0; prop < PROP_COUNT; prop++)
+    {
+        propDraw(prop, shader);
+    }
+    fixturesDraw(shader);
+    batchRecorder = NULL;
+
+    TextureArrays materialArrays;
+    for(const std::string &path : texturePaths)
+    {
+        unsigned int texture = TextureRegistry::instance().find(path);
+        if(staticBatches.uses(texture))
+        {
+            materialArrays.add(texture, path);
+        }
+    }
+    materialArrays.build();
+    materialArrays.report(std::cout);
+    staticBatches.build(materialArrays, VBO);
+    std::cout << "BATCHES:: " << staticBatches.boxCount() << " static boxes in " << staticBatches.batchCount() << " batches, "
+              << staticBatches.drawCount() << " draw call(s) per pass "
+              << (staticBatches.multiDrawAvailable() ? "(multi-draw-indirect, culled on the GPU with H)" : "(no GL 4.3)") << std::endl;
+
+    // occluders of the software occlusion culling: the large props and the tree line
+    std::vector<glm::mat4> occluders;
+    occluderRecorder = &occluders;
+    bballRingDraw(false, 0.0f, 1.0f, -5.5f, shader, bballPoleDiff, bballBoardFrontDiff, bballBoardBackDiff, bballBoardEdgeDiff, bballRingDiff, highSpec, mildSpec);
+    bballRingDraw(true, 0.0f, 1.0f, 5.5f,  shader, bballPoleDiff, bballBoardFrontDiff, bballBoardBackDiff, bballBoardEdgeDiff, bballRingDiff, highSpec, mildSpec);
+    gazeboDraw(shader, metalFrameDiff, gazeboRoofDiff, pavingDiff, highSpec, mildSpec, noSpec);
+    bbqDraw(shader, bbqBaseDiff, bbqPanelDiff, metalFrameDiff, bbqTopDiff, bbqGrillDiff, bbqPanDiff, pavingDiff, noSpec, mildSpec, highSpec);
+    for(const glm::vec3 &tree : treeImpostors.positions)
+    {
+        treeDraw(tree.x, tree.y, tree.z, shader, treeTopDiff, mildSpec, treeTrunkDiff, noSpec);
+    }
+    occluderRecorder = NULL;
 
     // shader configuration
     // --------------------
@@ -205,44 +555,22 @@ int main()
 
         // input
         // -----
-        processInput(window);        
+        if(!benchMode)
+        {
+            processInput(window);
+        }
 
         // render
         // ------
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // be sure to activate shader when setting uniforms/drawing objects
-        shader.use();
-
-        if(lightStay)
+        if(overdrawView)
         {
-            shader.setVec3("light.position", lastPosition);
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         }
         else
         {
-            shader.setVec3("light.position", camera.Position);
+            glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         }
-
-        // shader.setVec3("light.direction", camera.Position);
-        shader.setFloat("light.cutOff", glm::cos(glm::radians(12.5f)));
-        shader.setFloat("light.outerCutOff", glm::cos(glm::radians(17.5f)));
-
-        // light properties
-        // we configure the diffuse intensity slightly higher; the right lighting conditions differ with each lighting method and environment.
-        // each environment and lighting type requires some tweaking to get the best out of your environment.
-        shader.setVec3("light.ambient", amb, amb, amb);
-        shader.setVec3("light.diffuse", 0.5f, 0.5f, 0.5f);
-        shader.setVec3("light.specular", 1.0f, 1.0f, 1.0f);
-        shader.setFloat("light.constant", 1.0f);
-        shader.setFloat("light.linear", linearAtten[attenIndex]);
-        shader.setFloat("light.quadratic", quadAtten[attenIndex]);
-
-        // material properties
-        shader.setVec3("material.ambient", 1.0f, 0.5f, 0.31f);
-        shader.setVec3("material.diffuse", 1.0f, 0.5f, 0.31f);
-        shader.setVec3("material.specular", 0.5f, 0.5f, 0.5f);
-        shader.setFloat("material.shininess", 32.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // view/projection transformations
         if(orthographic)
@@ -255,47 +583,300 @@ int main()
         }
 
         glm::mat4 view = camera.GetViewMatrix();
-        shader.setMat4("projection", projection);
-        // shader.setVec3("view", camera.Position);
-        shader.setMat4("view", view);
 
-        // world transformation
-        glm::mat4 model;
-        shader.setMat4("model", model);
+        // bin the lights that are on into the clusters of this frame's view; setLighting() binds them.
+        // The deferred path draws them as light volumes instead, but the tree impostors drawn after it still
+        // read the clusters.
+        parkLights.lights = attenIndex == 1 ? nightLights : std::vector<PointLight>();
+        if(!deferredShading || impostorTrees)
+        {
+            parkLights.build(view, projection);
+            parkLights.upload();
+        }
 
-        // DRAW SKY BOX
-        skyDraw(shader, skyDiff, noSpec);
+        // which trees draw in full, as impostors, or both while fading
+        if(impostorTrees)
+        {
+            treeImpostors.update(camera.Position);
+        }
 
-        // DRAW OBJECTS ---------------------------------------------------------
-        grassDraw(shader, grassDiff, mildSpec);
-        bballCourtDraw(shader, bballCourtDiff, noSpec);
-        bballRingDraw(false, 0.0f, 1.0f, -5.5f, shader, bballPoleDiff, bballBoardFrontDiff, bballBoardBackDiff, bballBoardEdgeDiff, bballRingDiff, highSpec, mildSpec);
-        bballRingDraw(true, 0.0f, 1.0f, 5.5f,  shader, bballPoleDiff, bballBoardFrontDiff, bballBoardBackDiff, bballBoardEdgeDiff, bballRingDiff, highSpec, mildSpec);
-        manDraw(-0.12f, 0.0f, -1.5f, shader, manShoeDiff, manLegsDiff, manTopBackDiff, manTopDiff, manNeckDiff, manFaceDiff, manFace2Diff, manHeadTopDiff, manHeadBackDiff, manHeadLeftDiff, manHeadRightDiff, noSpec);
-        bballDraw(0.0f, 0.3f, -1.5f, shader, bballDiff, mildSpec);
-        dogDraw(3.0f, 0.2f, -3.0f, shader, dogHeadDiff, dogBodyDiff, noSpec);
-        birdDraw(2.9f, 1.0f, -3.0f, shader, birdDiff, noSpec);
-        playFloorDraw(shader, playFloorDiff, noSpec);
-        swingDraw(shader, swingFrameDiff, swingRopeDiff, swingSeatDiff, noSpec, mildSpec);
-        gazeboDraw(shader, metalFrameDiff, gazeboRoofDiff, pavingDiff, highSpec, mildSpec, noSpec);
-        tableBenchDraw(shader, woodSlatsDiff, paintedMetalDiff, noSpec, mildSpec);
-        bbqDraw(shader, bbqBaseDiff, bbqPanelDiff, metalFrameDiff, bbqTopDiff, bbqGrillDiff, bbqPanDiff, pavingDiff, noSpec, mildSpec, highSpec);
-        binDraw(-12.0f, 0.0f, 0.5f, shader, binMetalDiff, binPanelDiff, binGenSignDiff, mildSpec, noSpec);
-        binDraw(-12.0f, 0.0f, -0.5f, shader, binMetalDiff, binPanelDiff, binRecSignDiff, mildSpec, noSpec);
-        fountainDraw(-3.0f, 0.36f, -10.5f, shader, fountainBaseDiff, fountainTapDiff, noSpec, highSpec);
-        fountainDraw(10.5f, 0.36f, 10.5f, shader, fountainBaseDiff, fountainTapDiff, noSpec, highSpec);
-        pavingDraw(-9.0f, 0.0f, 3.0f, 2, 12, shader, pavingDiff, noSpec);
-        pavingDraw(-7.0f, 0.0f, 12.0f, 21, 2, shader, pavingDiff, noSpec);
-        pavingDraw(12.0f, 0.0f, -13.0f, 2, 25, shader, pavingDiff, noSpec);
-        pavingDraw(-9.0f, 0.0f, -13.0f, 21, 2, shader, pavingDiff, noSpec);
+        // SOFTWARE OCCLUSION CULLING: the occluders rasterized on the CPU; the camera passes test every box
+        // against them before drawing it
+        if(occlusionCulling)
+        {
+            occlusion.begin(projection * view);
+            for(const glm::mat4 &obj : occluders)
+            {
+                occlusion.addOccluder(obj);
+            }
+            occlusion.rasterize();
+        }
 
-        // DRAW TREE BARRIERS
-        for(int i = -14; i <= 14; i++)
+        // the GPU time of the frame, from the culling dispatch to the Hi-Z build
+        frameTimer.begin();
+
+        // GPU CULLING: a compute shader tests every batched box against the view frustum and last frame's Hi-Z
+        // pyramid and writes the visible ones and their counts for the multi-draw call of the camera passes
+        bool gpuCullFrame = gpuCulling && batchedScenery && multiDraw && staticBatches.cullAvailable();
+        staticBatches.gpuCulling = gpuCullFrame;
+        if(gpuCullFrame)
+        {
+            staticBatches.cull(cullShader, Frustum::fromMatrix(projection * view), depthPyramid);
+        }
+
+        // forward: every fragment is lit as it is drawn. deferred: the boxes only fill the G-buffer and
+        // lighting is applied afterwards, once per visible pixel. The overdraw view counts the fragments
+        // of the shading pass straight on the screen instead of lighting them.
+        bool deferredFrame = deferredShading && !overdrawView;
+        Shader &boxShader = overdrawView ? overdrawShader : (deferredFrame ? gBufferShader : shader);
+        Shader &actorShader = overdrawView ? overdrawAnimShader : (deferredFrame ? gBufferAnimShader : animShader);
+        Shader &batchShader = overdrawView ? batchedOverdrawShader : (deferredFrame ? batchedGBufferShader : batchedShader);
+
+        // DRAW ACTORS: the moving boxes and animated batches, with shaders whose uniforms are already set
+        AABB manBounds, bballBounds, dogBounds, birdBounds;
+        auto actorsDraw = [&](Shader &passShader, Shader &passActorShader)
+        {
+            passShader.use();
+
+            // their bounds are refitted into the spatial index from the boxes drawn this frame
+            manBounds = bballBounds = dogBounds = birdBounds = AABB();
+            actorBounds = &manBounds;
+            manDraw(MAN_POSITION.x, MAN_POSITION.y, MAN_POSITION.z, passShader, manShoeDiff, manLegsDiff, manTopBackDiff, manTopDiff, manNeckDiff, manFaceDiff, manFace2Diff, manHeadTopDiff, manHeadBackDiff, manHeadLeftDiff, manHeadRightDiff, noSpec);
+            actorBounds = &bballBounds;
+            bballDraw(BBALL_POSITION.x, BBALL_POSITION.y, BBALL_POSITION.z, passShader, bballDiff, mildSpec);
+            actorBounds = &dogBounds;
+            dogDraw(DOG_POSITION.x, DOG_POSITION.y, DOG_POSITION.z, passShader, dogHeadDiff, dogBodyDiff, noSpec);
+            actorBounds = &birdBounds;
+            birdDraw(BIRD_POSITION.x, BIRD_POSITION.y, BIRD_POSITION.z, passShader, birdDiff, noSpec);
+            actorBounds = NULL;
+
+            // DRAW ANIMATED ACTORS
+            passActorShader.use();
+            passActorShader.setFloat("time", currentFrame);
+
+            if(playAnimation)
+            {
+                bballBatch.Draw();
+                birdBatch.Draw();
+                manHandBatch.Draw();
+
+                bballBounds.expand(animatedBounds(bballBatch));
+                birdBounds.expand(animatedBounds(birdBatch));
+                manBounds.expand(animatedBounds(manHandBatch));
+            }
+            else
+            {
+                if(dogResting)
+                {
+                    dogHeadBatch.Draw();
+                    dogBodyBatch.Draw();
+
+                    dogBounds.expand(animatedBounds(dogHeadBatch));
+                    dogBounds.expand(animatedBounds(dogBodyBatch));
+                }
+
+                if(birdResting)
+                {
+                    birdRestBatch.Draw();
+
+                    birdBounds.expand(animatedBounds(birdRestBatch));
+                }
+            }
+        };
+
+        // DRAW SCENE: every box and animated batch with the given shaders
+        auto sceneDraw = [&](Shader &passShader, Shader &passActorShader, Shader &passBatchShader, unsigned int boxVAO)
+        {
+            occlusionTesting = occlusionCulling;
+
+            // be sure to activate shader when setting uniforms/drawing objects
+            passShader.use();
+            setLighting(passShader, view);
+
+            // world transformation
+            glm::mat4 model;
+            passShader.setMat4("model", model);
+            // the animated batches and the lighting passes leave other VAOs bound
+            glBindVertexArray(boxVAO);
+
+            // DRAW SKY BOX: not lit by the sun
+            passShader.setBool("noSun", true);
+            skyDraw(passShader, skyDiff, noSpec);
+            passShader.setBool("noSun", false);
+
+            // DRAW OBJECTS ---------------------------------------------------------
+            if(batchedScenery)
+            {
+                passBatchShader.use();
+                setLighting(passBatchShader, view);
+                staticBatches.multiDraw = multiDraw;
+                staticBatches.draw(passBatchShader, materialArrays, !depthOnlyPass);
+                passShader.use();
+                glBindVertexArray(boxVAO);
+            }
+            else
+            {
+                groundDraw(passShader);
+            }
+            sceneryDraw(passShader, true);
+
+            passActorShader.use();
+            setLighting(passActorShader, view);
+            actorsDraw(passShader, passActorShader);
+            occlusionTesting = false;
+        };
+
+        // SUN SHADOWS: the static scenery is only rendered again when the sun has moved; the actors are
+        // rendered every frame into the small dynamic map fitted around where they were last frame
+        if(attenIndex == 0)
+        {
+            sunShadows.setDirection(sunDirection());
+            glm::mat4 sunView, sunProjection;
+            depthOnlyPass = true;
+            if(sunShadows.staticDirty())
+            {
+                sunShadows.beginStatic(sunView, sunProjection);
+                depthShader.use();
+                depthShader.setMat4("view", sunView);
+                depthShader.setMat4("projection", sunProjection);
+                glBindVertexArray(positionVAO);
+                sceneryDraw(depthShader, false);
+                sunShadows.end(framebufferWidth, framebufferHeight);
+            }
+
+            sunShadows.beginDynamic(actorCasterBounds.inflated(0.5f), sunView, sunProjection);
+            depthAnimShader.use();
+            depthAnimShader.setMat4("view", sunView);
+            depthAnimShader.setMat4("projection", sunProjection);
+            depthShader.use();
+            depthShader.setMat4("view", sunView);
+            depthShader.setMat4("projection", sunProjection);
+            glBindVertexArray(positionVAO);
+            actorsDraw(depthShader, depthAnimShader);
+            sunShadows.end(framebufferWidth, framebufferHeight);
+            depthOnlyPass = false;
+        }
+
+        if(deferredFrame)
+        {
+            gBuffer.resize(framebufferWidth, framebufferHeight);
+            gBuffer.begin();
+        }
+
+        // DEPTH PRE-PASS: positions only and no colour writes, so the shading pass after it only runs
+        // for the fragments that end up visible
+        if(depthPrepass)
+        {
+            depthOnlyPass = true;
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            sceneDraw(depthShader, depthAnimShader, batchedDepthShader, positionVAO);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            depthOnlyPass = false;
+
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+
+        if(overdrawView)
+        {
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+        }
+
+        samplesShaded.begin();
+        sceneDraw(boxShader, actorShader, batchShader, VAO);
+        samplesShaded.end();
+
+        glDisable(GL_BLEND);
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+
+        // GPU OCCLUSION QUERIES: the props' boxes against this frame's depth, for next frame's conditional
+        // rendering. The batched scenery draws the props without conditions, so nothing is queried while it is on.
+        if(gpuOcclusion && !batchedScenery)
+        {
+            depthShader.use();
+            depthShader.setMat4("view", view);
+            depthShader.setMat4("projection", projection);
+            glBindVertexArray(positionVAO);
+            propQueries.issue(depthShader, camera.Position);
+        }
+        else
+        {
+            propQueries.reset();
+        }
+
+        trackActor(ACTOR_MAN, manBounds);
+        trackActor(ACTOR_BBALL, bballBounds);
+        trackActor(ACTOR_DOG, dogBounds);
+        trackActor(ACTOR_BIRD, birdBounds);
+        actorCasterBounds = manBounds;
+        actorCasterBounds.expand(bballBounds);
+        actorCasterBounds.expand(dogBounds);
+        actorCasterBounds.expand(birdBounds);
+
+        // DEFERRED LIGHTING: flashlight and ambient over the whole screen, then the point lights inside
+        // their volumes
+        if(deferredFrame)
+        {
+            gBuffer.blitDepth();
+            glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+
+            glDisable(GL_DEPTH_TEST);
+            deferredLightShader.use();
+            setLighting(deferredLightShader, view);
+            deferredLightShader.setMat4("inverseViewProjection", inverseViewProjection);
+            gBuffer.bindTextures(deferredLightShader);
+            glBindVertexArray(fullscreenVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glEnable(GL_DEPTH_TEST);
+
+            lightVolumeShader.use();
+            setLighting(lightVolumeShader, view);
+            lightVolumeShader.setMat4("inverseViewProjection", inverseViewProjection);
+            gBuffer.bindTextures(lightVolumeShader);
+            lightVolumes.upload(parkLights.lights);
+            lightVolumes.draw();
+        }
+
+        // TREE IMPOSTORS: one instanced draw of the far trees, lit forward in every mode since the G-buffer
+        // has no way to cut out their outlines
+        if(impostorTrees)
+        {
+            if(overdrawView)
+            {
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_ONE, GL_ONE);
+            }
+            impostorShader.use();
+            setLighting(impostorShader, view);
+            impostorShader.setBool("overdraw", overdrawView);
+            treeImpostors.draw(impostorShader);
+            glDisable(GL_BLEND);
+        }
+
+        // this frame's finished depth reduced into the Hi-Z pyramid the next frame's GPU culling tests against
+        if(gpuCullFrame)
+        {
+            depthPyramid.build(hiZShader, projection * view, framebufferWidth, framebufferHeight);
+        }
+        else
+        {
+            depthPyramid.invalidate();
+        }
+        frameTimer.end();
+
+        if(benchMode)
+        {
+            benchStep(window, frameTimer, samplesShaded);
+        }
+        else if(currentFrame - lastStatsTime >= 1.0f)
         {
-            treeDraw(i, 2.5f, 14.5f, shader, treeTopDiff, mildSpec, treeTrunkDiff, noSpec);
-            treeDraw(-14.5f, 2.5f, i, shader, treeTopDiff, mildSpec, treeTrunkDiff, noSpec);
-            treeDraw(i, 2.5f, -14.5f, shader, treeTopDiff, mildSpec, treeTrunkDiff, noSpec);
-            treeDraw(14.5f, 2.5f, i, shader, treeTopDiff, mildSpec, treeTrunkDiff, noSpec);
+            // once a second: GPU time and samples shaded of the current mode in the title bar
+            lastStatsTime = currentFrame;
+            glfwSetWindowTitle(window, ("Neighborhood Park - " + frameStats(frameTimer, samplesShaded)).c_str());
+            frameTimer.reset();
+            samplesShaded.reset();
         }
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
@@ -309,6 +890,24 @@ int main()
     glDeleteVertexArrays(1, &VAO);
     glDeleteVertexArrays(1, &lightVAO);
     glDeleteBuffers(1, &VBO);
+    glDeleteVertexArrays(1, &fullscreenVAO);
+    parkLights.destroy();
+    gBuffer.destroy();
+    lightVolumes.destroy();
+    frameTimer.destroy();
+    sunShadows.destroy();
+    treeImpostors.destroy();
+    propQueries.destroy();
+    staticBatches.destroy();
+    materialArrays.destroy();
+    depthPyramid.destroy();
+    samplesShaded.destroy();
+    glDeleteVertexArrays(1, &positionVAO);
+
+    for(AnimatedBatch *batch : animatedBatches)
+    {
+        batch->destroy();
+    }
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -391,6 +990,8 @@ void processInput(GLFWwindow *window)
         }
     }
 
+    camera.Position = collideCamera(beforeMovement, camera.Position);
+
     if(!within_Boundaries())
     {
         camera.Position = beforeMovement;
@@ -464,6 +1065,80 @@ void processInput(GLFWwindow *window)
             playAnimation = true;
         }
     }
+
+    // [G] - Toggle between forward and deferred shading
+    if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS && shadingTimer == 0)
+    {
+        shadingTimer = 20;
+        deferredShading = !deferredShading;
+    }
+
+    // [I] - Toggle the tree impostors
+    if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS && impostorTimer == 0)
+    {
+        impostorTimer = 20;
+        impostorTrees = !impostorTrees;
+    }
+
+    // [C] - Toggle the software occlusion culling
+    if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS && occlusionTimer == 0)
+    {
+        occlusionTimer = 20;
+        occlusionCulling = !occlusionCulling;
+    }
+
+    // [Q] - Toggle the GPU occlusion queries of the props
+    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS && queryTimer == 0)
+    {
+        queryTimer = 20;
+        gpuOcclusion = !gpuOcclusion;
+    }
+
+    // [B] - Toggle the batched drawing of the static scenery
+    if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS && batchTimer == 0)
+    {
+        batchTimer = 20;
+        batchedScenery = !batchedScenery;
+    }
+
+    // [M] - Toggle between one multi-draw-indirect call and a draw call per batch for the batched scenery
+    if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS && multiDrawTimer == 0)
+    {
+        multiDrawTimer = 20;
+        multiDraw = !multiDraw;
+    }
+
+    // [H] - Toggle the GPU culling of the batched scenery against the view frustum and last frame's depth
+    if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS && cullTimer == 0)
+    {
+        cullTimer = 20;
+        gpuCulling = !gpuCulling;
+    }
+
+    // [[] and []] - Move the sun around the park
+    if (glfwGetKey(window, GLFW_KEY_LEFT_BRACKET) == GLFW_PRESS)
+    {
+        sunAngle -= 30.0f * deltaTime;
+    }
+
+    if (glfwGetKey(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS)
+    {
+        sunAngle += 30.0f * deltaTime;
+    }
+
+    // [Z] - Toggle the depth pre-pass
+    if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS && prepassTimer == 0)
+    {
+        prepassTimer = 20;
+        depthPrepass = !depthPrepass;
+    }
+
+    // [V] - Toggle the overdraw view
+    if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS && overdrawTimer == 0)
+    {
+        overdrawTimer = 20;
+        overdrawView = !overdrawView;
+    }
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -473,6 +1148,8 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     // make sure the viewport matches the new window dimensions; note that width and 
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
+    framebufferWidth = width;
+    framebufferHeight = height;
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -509,6 +1186,45 @@ bool within_Boundaries()
     return valid;
 }
 
+// sweeps the camera sphere through the spatial index one axis at a time, so the camera slides along
+// the scenery and actors instead of stopping dead
+glm::vec3 collideCamera(glm::vec3 from, glm::vec3 to)
+{
+    glm::vec3 position = from;
+
+    for(int axis = 0; axis < 3; axis++)
+    {
+        if(to[axis] == position[axis])
+        {
+            continue;
+        }
+
+        glm::vec3 target = position;
+        target[axis] = to[axis];
+
+        SpatialHit hit;
+        if(!spatialIndex.sphereSweep(position, target, CAMERA_RADIUS, hit))
+        {
+            position = target;
+        }
+    }
+
+    return position;
+}
+
+// moves an actor in the spatial index; actors that drew nothing this frame are removed
+void trackActor(int id, const AABB &bounds)
+{
+    if(bounds.empty())
+    {
+        spatialIndex.actors.remove(id);
+    }
+    else
+    {
+        spatialIndex.actors.update(id, bounds);
+    }
+}
+
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
 // ----------------------------------------------------------------------
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
@@ -520,50 +1236,166 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 // ---------------------------------------------------
 unsigned int loadTexture(char const * path)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
+    return TextureRegistry::instance().load(path);
+}
+
+void applyTexture(Shader shader, glm::mat4 obj, unsigned int diff, unsigned int spec)
+{
+    // recording pass: only collect the world bounds of the box
+    if(boundsRecorder != NULL)
+    {
+        boundsRecorder->push_back(AABB::transformed(obj));
+        return;
+    }
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
+    if(occluderRecorder != NULL)
     {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
+        occluderRecorder->push_back(obj);
+        return;
+    }
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    if(batchRecorder != NULL)
+    {
+        batchRecorder->add(obj, diff, spec);
+        return;
+    }
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if(actorBounds != NULL)
+    {
+        actorBounds->expand(AABB::transformed(obj));
+    }
 
-        stbi_image_free(data);
+    // camera passes with occlusion culling: boxes hidden behind this frame's occluders aren't drawn
+    if(occlusionTesting && !occlusion.visible(AABB::transformed(obj)))
+    {
+        return;
     }
-    else
+
+    if(!depthOnlyPass)
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, diff);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, spec);
     }
 
-    return textureID;
+    shader.setMat4("model", obj);
+    glDrawArrays(GL_TRIANGLES, 0 , 36);
 }
 
-void applyTexture(Shader shader, glm::mat4 obj, unsigned int diff, unsigned int spec)
+// --bench: renders BENCH_FRAMES frames forward, forward with the depth pre-pass, deferred and deferred with the
+// pre-pass, printing the statistics of each
+void benchStep(GLFWwindow *window, GpuQuery &frameTimer, GpuQuery &samplesShaded)
 {
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, diff);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, spec);
+    benchFrame++;
+    if(benchFrame % BENCH_FRAMES != 0)
+    {
+        return;
+    }
 
-    shader.setMat4("model", obj);
-    glDrawArrays(GL_TRIANGLES, 0 , 36);
+    std::cout << "BENCH:: " << frameStats(frameTimer, samplesShaded) << " (" << frameTimer.count << " frames)" << std::endl;
+    frameTimer.reset();
+    samplesShaded.reset();
+
+    int mode = benchFrame / BENCH_FRAMES;
+    if(mode == 4)
+    {
+        glfwSetWindowShouldClose(window, true);
+    }
+    depthPrepass = (mode & 1) != 0;
+    deferredShading = (mode & 2) != 0;
+}
+
+// average GPU time and samples shaded per frame since the queries were last reset. The samples are those of
+// the shading pass (the G-buffer pass when deferred), so more than one per pixel is overdraw the depth
+// pre-pass could save.
+std::string frameStats(GpuQuery &frameTimer, GpuQuery &samplesShaded)
+{
+    frameTimer.finish();
+    samplesShaded.finish();
+
+    std::ostringstream stats;
+    stats.setf(std::ios::fixed);
+    stats.precision(2);
+    stats << (deferredShading ? "deferred" : "forward") << (depthPrepass ? " + depth pre-pass" : "")
+          << (overdrawView ? " (overdraw view)" : "") << ": " << frameTimer.averageMs() << " ms GPU, "
+          << samplesShaded.average() / 1.0e6 << "M samples shaded, "
+          << samplesShaded.average() / std::max(1, framebufferWidth * framebufferHeight) << " per pixel";
+    if(occlusionCulling)
+    {
+        stats << ", " << occlusion.culledPercent() << "% of boxes occlusion culled";
+    }
+    if(gpuOcclusion && !batchedScenery)
+    {
+        stats << ", " << propQueries.hidden << " props hidden";
+    }
+    if(staticBatches.gpuCulling)
+    {
+        stats << ", " << staticBatches.visibleCount() << " of " << staticBatches.boxCount() << " batched boxes drawn";
+    }
+    if(impostorTrees)
+    {
+        stats << ", " << treeImpostors.impostorCount() << " tree impostors";
+    }
+    if(attenIndex == 0)
+    {
+        stats << ", static sun shadows rendered " << sunShadows.staticRenders << " times";
+    }
+    return stats.str();
+}
+
+// uploads the per-frame light, material and camera uniforms shared by all box shaders and by the deferred
+// lighting passes, so both modes shade from the same eye
+void setLighting(Shader shader, glm::mat4 view)
+{
+    if(lightStay)
+    {
+        shader.setVec3("light.position", lastPosition);
+    }
+    else
+    {
+        shader.setVec3("light.position", camera.Position);
+    }
+
+    // shader.setVec3("light.direction", camera.Position);
+    shader.setFloat("light.cutOff", glm::cos(glm::radians(12.5f)));
+    shader.setFloat("light.outerCutOff", glm::cos(glm::radians(17.5f)));
+
+    // light properties
+    // we configure the diffuse intensity slightly higher; the right lighting conditions differ with each lighting method and environment.
+    // each environment and lighting type requires some tweaking to get the best out of your environment.
+    shader.setVec3("light.ambient", amb, amb, amb);
+    shader.setVec3("light.diffuse", 0.5f, 0.5f, 0.5f);
+    shader.setVec3("light.specular", 1.0f, 1.0f, 1.0f);
+    shader.setFloat("light.constant", 1.0f);
+    shader.setFloat("light.linear", linearAtten[attenIndex]);
+    shader.setFloat("light.quadratic", quadAtten[attenIndex]);
+
+    // material properties
+    shader.setVec3("material.ambient", 1.0f, 0.5f, 0.31f);
+    shader.setVec3("material.diffuse", 1.0f, 0.5f, 0.31f);
+    shader.setVec3("material.specular", 0.5f, 0.5f, 0.5f);
+    shader.setFloat("material.shininess", 32.0f);
+
+    shader.setMat4("projection", projection);
+    // shader.setVec3("view", camera.Position);
+    shader.setMat4("view", view);
+    // the eye of the specular highlights
+    shader.setVec3("viewPos", camera.Position);
+
+    // point lights of the clusters built this frame
+    parkLights.bind(shader, framebufferWidth, framebufferHeight);
+
+    // the sun only shines by day
+    shader.setVec3("sunColour", attenIndex == 0 ? SUN_COLOUR : glm::vec3(0.0f));
+    sunShadows.bind(shader);
+}
+
+// unit vector towards the sun, which circles the park at about 50 degrees above the horizon
+glm::vec3 sunDirection()
+{
+    float angle = glm::radians(sunAngle);
+    return glm::normalize(glm::vec3(0.8f * cos(angle), 1.0f, 0.8f * sin(angle)));
 }
 
 void update_delay()
@@ -597,6 +1429,51 @@ void update_delay()
     {
          animationTimer -= 1;
     }
+
+    if(shadingTimer > 0)
+    {
+         shadingTimer -= 1;
+    }
+
+    if(prepassTimer > 0)
+    {
+         prepassTimer -= 1;
+    }
+
+    if(overdrawTimer > 0)
+    {
+         overdrawTimer -= 1;
+    }
+
+    if(impostorTimer > 0)
+    {
+         impostorTimer -= 1;
+    }
+
+    if(occlusionTimer > 0)
+    {
+         occlusionTimer -= 1;
+    }
+
+    if(queryTimer > 0)
+    {
+         queryTimer -= 1;
+    }
+
+    if(batchTimer > 0)
+    {
+         batchTimer -= 1;
+    }
+
+    if(multiDrawTimer > 0)
+    {
+         multiDrawTimer -= 1;
+    }
+
+    if(cullTimer > 0)
+    {
+         cullTimer -= 1;
+    }
 }
 
 void skyDraw(Shader shader, unsigned int skyDiff, unsigned int noSpec)
@@ -918,9 +1795,6 @@ void manDraw(float x, float y, float z, Shader shader, unsigned int manShoeDiff,
     backTorsoObj = glm::scale(backTorsoObj, glm::vec3(0.4f, 0.45f, 0.01f));
 
     // ANIMATED PARTS -----------------------------------------------------------
-    // For arm animations
-    float scaleAmount = sin(glfwGetTime() * 8.0f);
-
     if(playAnimation)
     {
         // Left arm
@@ -929,23 +1803,13 @@ void manDraw(float x, float y, float z, Shader shader, unsigned int manShoeDiff,
         leftArmObj = glm::rotate(leftArmObj, glm::radians(25.0f), glm::vec3(1.0, 0.0, 0.0));
         leftArmObj = glm::scale(leftArmObj, glm::vec3(0.1f, 0.15f, 0.1f));
 
-        // Left hand
-        leftHandObj = glm::rotate(leftHandObj, glm::radians(scaleAmount), glm::vec3(1.0, 0.0, 0.0));
-        leftHandObj = glm::translate(leftHandObj, glm::vec3(x - 0.07f, y + 0.70f, z - 0.09f));
-        leftHandObj = glm::rotate(leftHandObj, glm::radians(-30.0f), glm::vec3(0.0, 1.0, 0.0));
-        leftHandObj = glm::scale(leftHandObj, glm::vec3(0.1f, 0.1f, 0.35f));
-
         // Right arm
         rightArmObj = glm::translate(rightArmObj, glm::vec3(x + 0.38f, y + 0.8f, z + 0.05f));
         rightArmObj = glm::rotate(rightArmObj, glm::radians(10.0f), glm::vec3(0.0, 1.0, 0.0));
         rightArmObj = glm::rotate(rightArmObj, glm::radians(25.0f), glm::vec3(1.0, 0.0, 0.0));
         rightArmObj = glm::scale(rightArmObj, glm::vec3(0.1f, 0.15f, 0.1f));
 
-        // Right hand
-        rightHandObj = glm::rotate(rightHandObj, glm::radians(scaleAmount), glm::vec3(1.0, 0.0, 0.0));
-        rightHandObj = glm::translate(rightHandObj, glm::vec3(x + 0.32f, y + 0.70f, z - 0.09f));
-        rightHandObj = glm::rotate(rightHandObj, glm::radians(30.0f), glm::vec3(0.0, 1.0, 0.0));
-        rightHandObj = glm::scale(rightHandObj, glm::vec3(0.1f, 0.1f, 0.35f));
+        // Waving hands are drawn from the GPU animated batch, see manAnimate()
 
         // Head box
         headObj = glm::translate(headObj, glm::vec3(x + 0.125f, y + 1.07f, z + 0.05f));
@@ -1057,9 +1921,13 @@ void manDraw(float x, float y, float z, Shader shader, unsigned int manShoeDiff,
     applyTexture(shader, torsoObj, manTopDiff, noSpec);
     applyTexture(shader, backTorsoObj, manTopBackDiff, noSpec);
     applyTexture(shader, leftArmObj, manTopDiff, noSpec);
-    applyTexture(shader, leftHandObj, manNeckDiff, noSpec);
     applyTexture(shader, rightArmObj, manTopDiff, noSpec);
-    applyTexture(shader, rightHandObj, manNeckDiff, noSpec);
+
+    if(!playAnimation)
+    {
+        applyTexture(shader, leftHandObj, manNeckDiff, noSpec);
+        applyTexture(shader, rightHandObj, manNeckDiff, noSpec);
+    }
     applyTexture(shader, neckObj, manNeckDiff, noSpec);
     applyTexture(shader, chinObj, manNeckDiff, noSpec);
     applyTexture(shader, hairObj, manHeadTopDiff, noSpec);
@@ -1076,11 +1944,9 @@ void bballDraw(float x, float y, float z, Shader shader, unsigned int bballDiff,
 
     if(playAnimation)
     {
+        // Bouncing is evaluated in the vertex shader, see bballAnimate()
         ballDistance = 1.0;
-        scaleAmount = sin(glfwGetTime() * 8.0f);
-        bballObj = glm::translate(bballObj, glm::vec3(x, y, z));
-        bballObj = glm::scale(bballObj, glm::vec3(0.15f, 0.15f, 0.15f));
-        bballObj = glm::translate(bballObj, glm::vec3(x, scaleAmount * 1.7f, z));
+        return;
     }
     else
     {
@@ -1116,6 +1982,7 @@ void dogDraw(float x, float y, float z, Shader shader, unsigned int dogHeadDiff,
     if(playAnimation)
     {
         dogBodyDistance = 1.0;
+        dogResting = false;
 
         // Original position of the dog
         dogHeadObj = glm::translate(dogHeadObj, glm::vec3(x, y, z));
@@ -1130,15 +1997,12 @@ void dogDraw(float x, float y, float z, Shader shader, unsigned int dogHeadDiff,
         dogBodyDistance++;
 
         // End position animation of the dog jumping
+        // Bobbing is evaluated in the vertex shader, see dogAnimate()
         if(dogBodyDistance == 75.0)
         {
             dogBodyDistance--;
-
-            headScaleZ = sin(glfwGetTime() * 4.0f);
-            bodyScaleZ = sin(glfwGetTime() * 4.0f);
-
-            dogHeadObj = glm::translate(dogHeadObj, glm::vec3(x - 3.0f, headScaleZ * 0.1f, z + 3.5f));
-            dogBodyObj = glm::translate(dogBodyObj, glm::vec3(x - 3.0f, bodyScaleZ * 0.1f, z + 3.5f));
+            dogResting = true;
+            return;
         }
 
         headScaleZ = dogBodyDistance * 0.35f;
@@ -1162,33 +2026,27 @@ void dogDraw(float x, float y, float z, Shader shader, unsigned int dogHeadDiff,
 
 void birdDraw(float x, float y, float z, Shader shader, unsigned int birdDiff,unsigned int noSpec)
 {
-    float scaleX, scaleY, scaleZ;
+    float scaleZ;
 
     glm::mat4 birdObj = glm::mat4();
 
     if(playAnimation)
     {
+        // Flying up and down is evaluated in the vertex shader, see birdAnimate()
         birdDistance = 1.0;
-        scaleY = sin(glfwGetTime() * 4.0f);
-
-        // Original position of bird flying up and down 
-        birdObj = glm::translate(birdObj, glm::vec3(x, y, z));
-        birdObj = glm::scale(birdObj, glm::vec3(0.1f, 0.1f, 0.15f)); // Scaling
-        birdObj = glm::translate(birdObj, glm::vec3(1.0, scaleY, 1.0)); // Up and down animation        
+        birdResting = false;
+        return;
     }
     else
     {
         birdDistance++;
 
-        // End position of bird flying side to side
+        // End position of bird flying side to side, evaluated in the vertex shader
         if(birdDistance == 75.0)
         {
             birdDistance--;
-
-            scaleX = sin(glfwGetTime() * 1.5f);
-            scaleZ = cos(glfwGetTime() * 1.5f);
-
-            birdObj = glm::translate(birdObj, glm::vec3(-scaleX, y - 1.0f, scaleZ + 1.5f));
+            birdResting = true;
+            return;
         }
 
         scaleZ = birdDistance * 0.65f;
@@ -1202,6 +2060,117 @@ void birdDraw(float x, float y, float z, Shader shader, unsigned int birdDiff,un
     applyTexture(shader, birdObj, birdDiff, noSpec);
 }
 
+// The *Animate functions build the GPU animated instances of each actor. They mirror the periodic
+// states of the matching *Draw functions with the motion factored out into amplitude/frequency/path.
+void manAnimate(float x, float y, float z, AnimatedBatch &handBatch)
+{
+    glm::mat4 leftHandObj = glm::mat4();
+    glm::mat4 rightHandObj = glm::mat4();
+
+    // Left hand
+    leftHandObj = glm::translate(leftHandObj, glm::vec3(x - 0.07f, y + 0.70f, z - 0.09f));
+    leftHandObj = glm::rotate(leftHandObj, glm::radians(-30.0f), glm::vec3(0.0, 1.0, 0.0));
+    leftHandObj = glm::scale(leftHandObj, glm::vec3(0.1f, 0.1f, 0.35f));
+
+    // Right hand
+    rightHandObj = glm::translate(rightHandObj, glm::vec3(x + 0.32f, y + 0.70f, z - 0.09f));
+    rightHandObj = glm::rotate(rightHandObj, glm::radians(30.0f), glm::vec3(0.0, 1.0, 0.0));
+    rightHandObj = glm::scale(rightHandObj, glm::vec3(0.1f, 0.1f, 0.35f));
+
+    // Waving: one degree about the x axis
+    handBatch.add(AnimatedInstance(leftHandObj, ANIM_SWAY, glm::vec3(1.0f, 0.0f, 0.0f), 8.0f));
+    handBatch.add(AnimatedInstance(rightHandObj, ANIM_SWAY, glm::vec3(1.0f, 0.0f, 0.0f), 8.0f));
+}
+
+void bballAnimate(float x, float y, float z, AnimatedBatch &bballBatch)
+{
+    glm::mat4 bballObj = glm::mat4();
+
+    bballObj = glm::translate(bballObj, glm::vec3(x, y, z));
+    bballObj = glm::scale(bballObj, glm::vec3(0.15f, 0.15f, 0.15f));
+    bballObj = glm::translate(bballObj, glm::vec3(x, 0.0f, z));
+
+    // Bouncing: 1.7 units in the ball's scaled space
+    bballBatch.add(AnimatedInstance(bballObj, ANIM_BOB, glm::vec3(0.0f, 0.15f * 1.7f, 0.0f), 8.0f));
+}
+
+void dogAnimate(float x, float y, float z, AnimatedBatch &dogHeadBatch, AnimatedBatch &dogBodyBatch)
+{
+    // The dog rests at the end of its path
+    float restDistance = 74.0f;
+    float headScaleZ = restDistance * 0.35f;
+    float bodyScaleZ = restDistance * 0.25f;
+
+    glm::mat4 dogHeadObj = glm::mat4();
+    glm::mat4 dogBodyObj = glm::mat4();
+
+    dogHeadObj = glm::translate(dogHeadObj, glm::vec3(x - 3.0f, 0.0f, z + 3.5f));
+    dogHeadObj = glm::translate(dogHeadObj, glm::vec3(x - 0.45f, y + 0.05f, z));
+    dogHeadObj = glm::scale(dogHeadObj, glm::vec3(0.15f, 0.15f, 0.25f));
+    dogHeadObj = glm::translate(dogHeadObj, glm::vec3(x, y, -headScaleZ));
+    dogHeadObj = glm::rotate(dogHeadObj, glm::radians(25.0f), glm::vec3(1.0, 0.0, 0.0));
+
+    dogBodyObj = glm::translate(dogBodyObj, glm::vec3(x - 3.0f, 0.0f, z + 3.5f));
+    dogBodyObj = glm::translate(dogBodyObj, glm::vec3(x - 0.45f, y, z + 0.25f));
+    dogBodyObj = glm::scale(dogBodyObj, glm::vec3(0.25f, 0.20f, 0.35f));
+    dogBodyObj = glm::translate(dogBodyObj, glm::vec3(x - 1.2f, y, -bodyScaleZ));
+
+    // Jumping on the spot
+    dogHeadBatch.add(AnimatedInstance(dogHeadObj, ANIM_BOB, glm::vec3(0.0f, 0.1f, 0.0f), 4.0f));
+    dogBodyBatch.add(AnimatedInstance(dogBodyObj, ANIM_BOB, glm::vec3(0.0f, 0.1f, 0.0f), 4.0f));
+}
+
+void birdAnimate(float x, float y, float z, AnimatedBatch &birdBatch, AnimatedBatch &birdRestBatch)
+{
+    // Original position of bird flying up and down
+    glm::mat4 birdObj = glm::mat4();
+
+    birdObj = glm::translate(birdObj, glm::vec3(x, y, z));
+    birdObj = glm::scale(birdObj, glm::vec3(0.1f, 0.1f, 0.15f));
+    birdObj = glm::translate(birdObj, glm::vec3(1.0, 0.0, 1.0));
+
+    birdBatch.add(AnimatedInstance(birdObj, ANIM_BOB, glm::vec3(0.0f, 0.1f, 0.0f), 4.0f));
+
+    // End position of bird flying side to side
+    float scaleZ = 74.0f * 0.65f;
+    glm::mat4 birdRestObj = glm::mat4();
+
+    birdRestObj = glm::translate(birdRestObj, glm::vec3(0.0f, y - 1.0f, 1.5f));
+    birdRestObj = glm::translate(birdRestObj, glm::vec3(x - 0.18f, y, z));
+    birdRestObj = glm::scale(birdRestObj, glm::vec3(0.1f, 0.1f, 0.15f));
+    birdRestObj = glm::translate(birdRestObj, glm::vec3(x, y, -scaleZ));
+
+    birdRestBatch.add(AnimatedInstance(birdRestObj, ANIM_ORBIT, glm::vec3(1.0f, 0.0f, 1.0f), 1.5f));
+}
+
+// world bounds covering every position the batch's instances reach during their motion
+AABB animatedBounds(const AnimatedBatch &batch)
+{
+    AABB bounds;
+
+    for(unsigned int i = 0; i < batch.instances.size(); i++)
+    {
+        const AnimatedInstance &instance = batch.instances[i];
+        AABB box = AABB::transformed(instance.Base);
+        glm::vec3 amplitude = glm::abs(glm::vec3(instance.Motion));
+
+        if(instance.Params.y == ANIM_SWAY)
+        {
+            // a rotation of A degrees about the origin moves a point by at most |p| * A (in radians)
+            float reach = glm::length(glm::max(glm::abs(box.min), glm::abs(box.max)));
+            box = box.inflated(reach * glm::radians(glm::length(amplitude)));
+        }
+        else
+        {
+            box = AABB(box.min - amplitude, box.max + amplitude);
+        }
+
+        bounds.expand(box);
+    }
+
+    return bounds;
+}
+
 void playFloorDraw(Shader shader, unsigned int playFloorDiff, unsigned int noSpec)
 {
     float x = 7.0f;
@@ -1787,4 +2756,57 @@ void pavingDraw(float x, float y, float z, int iMax, int jMax, Shader shader, un
             applyTexture(shader, pavingObj, pavingDiff, noSpec);
         }
     }
-}
\ No newline at end of file
+}
+
+void streetLampDraw(float x, float y, float z, Shader shader, unsigned int paintedMetalDiff, unsigned int highSpec, unsigned int noSpec)
+{
+    // Post
+    glm::mat4 postObj = glm::mat4();
+
+    postObj = glm::translate(postObj, glm::vec3(x, y + 1.25f, z));
+    postObj = glm::scale(postObj, glm::vec3(0.08f, 2.5f, 0.08f));
+
+    applyTexture(shader, postObj, paintedMetalDiff, highSpec);
+
+    // Head
+    glm::mat4 headObj = glm::mat4();
+
+    headObj = glm::translate(headObj, glm::vec3(x, y + 2.55f, z));
+    headObj = glm::scale(headObj, glm::vec3(0.3f, 0.1f, 0.3f));
+
+    applyTexture(shader, headObj, paintedMetalDiff, noSpec);
+}
+
+// every light that comes on at night; each only reaches as far as its radius
+void nightLightsSetup(std::vector<PointLight> &lights)
+{
+    lights.clear();
+
+    // Street lamps, just under their heads
+    for(const glm::vec3 &lamp : streetLampPositions)
+    {
+        lights.push_back(PointLight(lamp + glm::vec3(0.0f, 2.4f, 0.0f), 6.0f, glm::vec3(1.0f, 0.85f, 0.6f)));
+    }
+
+    // Gazebo, one under each corner of the roof
+    float gazeboX = -9.0f;
+    float gazeboZ = -9.0f;
+    glm::vec3 gazebo_translations[] = {
+        glm::vec3(gazeboX - 1.5f, 2.6f, gazeboZ + 1.0f),
+        glm::vec3(gazeboX - 1.5f, 2.6f, gazeboZ + 4.0f),
+        glm::vec3(gazeboX + 1.5f, 2.6f, gazeboZ + 1.0f),
+        glm::vec3(gazeboX + 1.5f, 2.6f, gazeboZ + 4.0f),
+    };
+
+    for(int i = 0; i < 4; i++)
+    {
+        lights.push_back(PointLight(gazebo_translations[i], 4.0f, glm::vec3(0.9f, 0.9f, 0.7f)));
+    }
+
+    // BBQ glow above the grill
+    lights.push_back(PointLight(glm::vec3(-7.0f, 0.9f, 0.0f), 2.5f, glm::vec3(1.2f, 0.4f, 0.1f)));
+
+    // Fountains
+    lights.push_back(PointLight(glm::vec3(-3.0f, 1.2f, -10.5f), 2.0f, glm::vec3(0.3f, 0.5f, 1.0f)));
+    lights.push_back(PointLight(glm::vec3(10.5f, 1.2f, 10.5f), 2.0f, glm::vec3(0.3f, 0.5f, 1.0f)));
+}
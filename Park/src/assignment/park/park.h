@@ -12,6 +12,24 @@
 #include <learnopengl/filesystem.h>
 #include <learnopengl/shader_m.h>
 #include <learnopengl/camera.h>
+#include <learnopengl/animated_batch.h>
+#include <learnopengl/spatial_index.h>
+#include <learnopengl/texture_registry.h>
+#include <learnopengl/clustered_lights.h>
+#include <learnopengl/deferred_shading.h>
+#include <learnopengl/gpu_query.h>
+#include <learnopengl/sun_shadows.h>
+#include <learnopengl/impostors.h>
+#include <learnopengl/occlusion_culling.h>
+#include <learnopengl/occlusion_queries.h>
+#include <learnopengl/texture_arrays.h>
+#include <learnopengl/shader_c.h>
+#include <learnopengl/hiz_pyramid.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
 
 
 // FUNCTION DECLARATIONS
@@ -23,7 +41,13 @@ void processInput(GLFWwindow *window);
 unsigned int loadTexture(const char *path);
 void update_delay();
 void applyTexture(Shader shader, glm::mat4 obj, unsigned int diff, unsigned int spec);
+void setLighting(Shader shader, glm::mat4 view);
+glm::vec3 sunDirection();
 bool within_Boundaries();
+glm::vec3 collideCamera(glm::vec3 from, glm::vec3 to);
+void trackActor(int id, const AABB &bounds);
+void benchStep(GLFWwindow *window, GpuQuery &frameTimer, GpuQuery &samplesShaded);
+std::string frameStats(GpuQuery &frameTimer, GpuQuery &samplesShaded);
 
 // SKY BOX
 void skyDraw(Shader shader, unsigned int skyDiff, unsigned int noSpec);
@@ -45,9 +69,50 @@ void bbqDraw(Shader shader, unsigned int bbqBaseDiff, unsigned int bbqPanelDiff,
 void binDraw(float x, float y, float z, Shader shader, unsigned int binMetalDiff, unsigned int binPanelDiff, unsigned int binSignDiff, unsigned int mildSpec, unsigned int noSpec);
 void fountainDraw(float x, float y, float z, Shader shader, unsigned int fountainBaseDiff, unsigned int fountainTapDiff, unsigned int noSpec, unsigned int highSpec);
 void pavingDraw(float x, float y, float z, int iMax, int jMax, Shader shader, unsigned int pavingDiff, unsigned int noSpec);
+void streetLampDraw(float x, float y, float z, Shader shader, unsigned int paintedMetalDiff, unsigned int highSpec, unsigned int noSpec);
+
+// Night lights
+void nightLightsSetup(std::vector<PointLight> &lights);
+
+// GPU animations
+void manAnimate(float x, float y, float z, AnimatedBatch &handBatch);
+void bballAnimate(float x, float y, float z, AnimatedBatch &bballBatch);
+void dogAnimate(float x, float y, float z, AnimatedBatch &dogHeadBatch, AnimatedBatch &dogBodyBatch);
+void birdAnimate(float x, float y, float z, AnimatedBatch &birdBatch, AnimatedBatch &birdRestBatch);
+AABB animatedBounds(const AnimatedBatch &batch);
 
 // set up vertex data (and buffer(s)) and configure vertex attributes
 // ------------------------------------------------------------------
+// every texture under resources/textures the park uses
+const char *textureFiles[] = {
+    "no_spec.png", "mild_spec.png", "high_spec.png", "grass.png",
+    "bball_court.png", "tree_leaves.jpg", "tree_trunk.png", "bball_pole.png",
+    "bball_board_front.png", "bball_board_back.png", "bball_board_edge.png", "bball_ring.png",
+    "bball.png", "shoes.png", "pants.png", "man_top_back.png",
+    "man_top.png", "man_neck.png", "man_face.png", "man_face2.png",
+    "man_head_top.png", "man_head_back.png", "man_head_left.png", "man_head_right.png",
+    "dog_head.png", "dog_fur.png", "bird.png", "sky.jpg",
+    "play_floor.png", "log.png", "rope.png", "swing_seat.png",
+    "gazebo_frame.png", "gazebo_roof.png", "paving.png", "bench.png",
+    "painted_metal.png", "bbq_base.png", "bbq_grill.png", "bbq_pan.png",
+    "bbq_top.png", "bbq_panel.png", "bin_metal.png", "bin_panel.png",
+    "bin_sign1.png", "bin_sign2.png", "fountain_base.png", "fountain_tap.png"
+};
+
+// textures of small props, stored with 16 bits per pixel
+const char *lowDetailTextureFiles[] = {
+    "bball_pole.png", "bball_ring.png", "bbq_panel.png", "bin_metal.png",
+    "bin_panel.png", "fountain_tap.png"
+};
+
+// street lamps beside the paving paths
+const glm::vec3 streetLampPositions[] = {
+    glm::vec3(-10.2f, 0.0f, 4.0f), glm::vec3(-10.2f, 0.0f, 8.0f), glm::vec3(-10.2f, 0.0f, 12.0f),
+    glm::vec3(-5.0f, 0.0f, 11.0f), glm::vec3(-1.0f, 0.0f, 11.0f), glm::vec3(3.0f, 0.0f, 11.0f), glm::vec3(7.0f, 0.0f, 11.0f),
+    glm::vec3(11.0f, 0.0f, -9.0f), glm::vec3(11.0f, 0.0f, -5.0f), glm::vec3(11.0f, 0.0f, -1.0f), glm::vec3(11.0f, 0.0f, 3.0f), glm::vec3(11.0f, 0.0f, 7.0f),
+    glm::vec3(-7.0f, 0.0f, -11.0f), glm::vec3(1.0f, 0.0f, -11.0f), glm::vec3(5.0f, 0.0f, -11.0f), glm::vec3(9.0f, 0.0f, -11.0f)
+};
+
 float box[] = {
     // positions          // normals           // texture coords
     -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,